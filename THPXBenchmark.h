@@ -0,0 +1,674 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <algorithm>
+
+#include "THPXTypes.h"
+#include "THPXPixelFormat.h"
+#include "THPXFramebuffer.h"
+#include "THPXDepthBuffer.h"
+#include "THPXCommandList.h"
+#include "THPXTiledRasterizer.h"
+
+
+namespace THPX {
+
+	//===== BENCHMARK =====//
+
+	// Drawing workloads, each a fixed list of primitives generated from the seed
+	enum class Workload : uint8_t {
+		CLEAR,
+		RECTS,
+		BLENDED_RECTS,
+		LINES,
+		SMALL_TRIANGLES,
+		LARGE_TRIANGLES,
+		BLENDED_TRIANGLES,
+		DEFERRED_TRIANGLES,
+		TEXT,
+		CACHED_TEXT,
+		SPRITES,
+		SCALED_SPRITES,
+		GOURAUD_TRIANGLES,
+		AFFINE_TRIANGLES,
+		PERSPECTIVE_TRIANGLES,
+		DEPTH_TRIANGLES,
+		OCCLUDED_TRIANGLES,
+		COUNT
+	};
+
+	inline const char* WorkloadName(Workload workload) {
+		static const char* NAMES[] = {
+			"clear", "rects", "blended_rects", "lines", "small_triangles", "large_triangles",
+			"blended_triangles", "deferred_triangles", "text", "cached_text", "sprites", "scaled_sprites",
+			"gouraud_triangles", "affine_triangles", "perspective_triangles", "depth_triangles", "occluded_triangles"
+		};
+		return workload < Workload::COUNT ? NAMES[(size_t)workload] : "";
+	}
+
+
+
+	// xorshift64*, the same sequence on every platform and standard library
+	struct BenchmarkRandom {
+		uint64_t    nState;
+
+		explicit BenchmarkRandom(uint64_t nSeed) {
+			nState = nSeed * 0x9E3779B97F4A7C15ull + 1;
+		}
+
+		uint32_t Next() {
+			nState ^= nState >> 12;
+			nState ^= nState << 25;
+			nState ^= nState >> 27;
+			return (uint32_t)((nState * 0x2545F4914F6CDD1Dull) >> 32);
+		}
+
+		// Uniform in [nLow, nHigh]
+		int Range(int nLow, int nHigh) {
+			return nLow + (int)(Next() % (uint32_t)(nHigh - nLow + 1));
+		}
+
+		Pixel Color(uint8_t nAlpha = 255) {
+			uint32_t n = Next();
+			return Pixel((uint8_t)n, (uint8_t)(n >> 8), (uint8_t)(n >> 16), nAlpha);
+		}
+	};
+
+
+
+	struct BenchmarkConfig {
+		std::vector<Vec2D> sizes = { Vec2D(320, 240), Vec2D(1280, 720), Vec2D(1920, 1080) };
+		std::vector<PixelFormat> formats = { PixelFormat::RGBA8888, PixelFormat::RGB565, PixelFormat::RGBAF32 };
+
+		// Each workload repeats its primitive list until at least this much time has passed
+		double      fMinSeconds = 0.25;
+
+		uint64_t    nSeed = 1;
+
+		// Render threads of the deferred workloads, 0 uses all hardware threads
+		unsigned    nThreads = 0;
+
+		// Runs only workloads whose name contains this, empty runs all
+		std::string sFilter;
+	};
+
+
+
+	struct BenchmarkResult {
+		std::string sWorkload;
+		std::string sFormat;
+		int         nWidth = 0;
+		int         nHeight = 0;
+
+		// Times the primitive list was drawn, and what that added up to
+		uint64_t    nPasses = 0;
+		uint64_t    nPrimitives = 0;
+		uint64_t    nPixels = 0;
+		double      fSeconds = 0.0;
+
+		// FNV-1a of the frame after a single pass, equal between runs with
+		// the same seed unless the drawing output changed
+		uint64_t    nChecksum = 0;
+
+		double PixelsPerSecond() const {
+			return fSeconds > 0.0 ? (double)nPixels / fSeconds : 0.0;
+		}
+
+		double PrimitivesPerSecond() const {
+			return fSeconds > 0.0 ? (double)nPrimitives / fSeconds : 0.0;
+		}
+	};
+
+
+
+	// Runs the workloads of one pixel format
+	template<typename FORMAT>
+	class BasicBenchmarkRunner {
+
+	public:
+		using FramebufferType = BasicFramebuffer<FORMAT>;
+		using SpriteType = BasicSprite<FORMAT>;
+
+
+	private:
+		struct Primitive {
+			Vec2D       v[3];
+			Pixel       p;
+
+			// Corner colors of shaded triangles, view depths of perspective ones,
+			// z of depth tested ones
+			Pixel       c[3];
+			float       w[3];
+		};
+
+		const BenchmarkConfig& m_config;
+
+		FramebufferType m_fb;
+		TiledRasterizer m_rasterizer;
+		CommandList m_commands;
+
+		std::vector<Primitive> m_primitives;
+		std::vector<std::string> m_labels;
+
+		SpriteType  m_keyedSprite;
+		SpriteType  m_alphaSprite;
+		SpriteType  m_texture;
+
+		// Cleared before every pass of the depth tested workloads
+		DepthBuffer m_depth;
+
+
+	private:
+		void Generate(Workload workload, int nWidth, int nHeight) {
+			BenchmarkRandom rng(m_config.nSeed * 31 + (uint64_t)workload);
+			m_primitives.clear();
+			m_labels.clear();
+
+			auto add = [&](Vec2D a, Vec2D b, Vec2D c, Pixel p) {
+				Primitive prim;
+				prim.v[0] = a;
+				prim.v[1] = b;
+				prim.v[2] = c;
+				prim.p = p;
+				for (int k = 0; k < 3; k++) {
+					prim.c[k] = p;
+					prim.w[k] = 1.0f;
+				}
+				m_primitives.push_back(prim);
+			};
+
+			auto point = [&]() {
+				return Vec2D(rng.Range(0, nWidth - 1), rng.Range(0, nHeight - 1));
+			};
+
+			auto around = [&](Vec2D v, int nRadius) {
+				return Vec2D(v.x + rng.Range(-nRadius, nRadius), v.y + rng.Range(-nRadius, nRadius));
+			};
+
+			switch (workload) {
+			case Workload::CLEAR:
+				for (int i = 0; i < 8; i++)
+					add(Vec2D(0, 0), Vec2D(0, 0), Vec2D(0, 0), rng.Color());
+				break;
+
+			case Workload::RECTS:
+			case Workload::BLENDED_RECTS:
+				for (int i = 0; i < 2000; i++) {
+					Vec2D v = point();
+					add(v, Vec2D(rng.Range(1, 64), rng.Range(1, 64)), v, rng.Color(workload == Workload::RECTS ? 255 : 128));
+				}
+				break;
+
+			case Workload::LINES:
+				for (int i = 0; i < 5000; i++)
+					add(point(), point(), Vec2D(0, 0), rng.Color());
+				break;
+
+			case Workload::SMALL_TRIANGLES:
+			case Workload::DEFERRED_TRIANGLES:
+				for (int i = 0; i < 10000; i++) {
+					Vec2D v = point();
+					add(v, around(v, 8), around(v, 8), rng.Color());
+				}
+				break;
+
+			case Workload::LARGE_TRIANGLES:
+			case Workload::BLENDED_TRIANGLES:
+				for (int i = 0; i < 200; i++)
+					add(point(), point(), point(), rng.Color(workload == Workload::LARGE_TRIANGLES ? 255 : 128));
+				break;
+
+			case Workload::TEXT:
+			case Workload::CACHED_TEXT:
+				for (int i = 0; i < 1000; i++) {
+					char sLabel[32];
+					std::snprintf(sLabel, sizeof(sLabel), "Label %u: %u", rng.Next() % 1000, rng.Next() % 100000);
+					m_labels.push_back(sLabel);
+					add(point(), Vec2D(0, 0), Vec2D(0, 0), rng.Color());
+				}
+				break;
+
+			case Workload::SPRITES:
+				for (int i = 0; i < 2000; i++)
+					add(around(point(), 16), Vec2D(0, 0), Vec2D(0, 0), THPX::WHITE);
+				break;
+
+			case Workload::SCALED_SPRITES:
+				for (int i = 0; i < 500; i++)
+					add(around(point(), 32), Vec2D(rng.Range(16, 160), rng.Range(16, 160)), Vec2D(0, 0), THPX::WHITE);
+				break;
+
+			// Same sizes as LARGE_TRIANGLES, so the cost of shading shows against flat fills
+			case Workload::GOURAUD_TRIANGLES:
+			case Workload::AFFINE_TRIANGLES:
+			case Workload::PERSPECTIVE_TRIANGLES:
+				for (int i = 0; i < 200; i++) {
+					add(point(), point(), point(), THPX::WHITE);
+					for (int k = 0; k < 3; k++) {
+						m_primitives.back().c[k] = rng.Color();
+						if (workload == Workload::PERSPECTIVE_TRIANGLES)
+							m_primitives.back().w[k] = 1.0f + rng.Range(0, 300) * 0.01f;
+					}
+				}
+				break;
+
+			// Large triangles in no particular order, sloped through each other
+			case Workload::DEPTH_TRIANGLES:
+				for (int i = 0; i < 200; i++) {
+					add(point(), point(), point(), rng.Color());
+					for (int k = 0; k < 3; k++)
+						m_primitives.back().w[k] = rng.Range(0, 1000) * 0.001f;
+				}
+				break;
+
+			// A near occluder over the whole screen first, then large triangles
+			// behind it that the tile ranges reject without testing pixels
+			case Workload::OCCLUDED_TRIANGLES:
+				add(Vec2D(-1, -1), Vec2D(2 * nWidth, -1), Vec2D(-1, 2 * nHeight), rng.Color());
+				for (int k = 0; k < 3; k++)
+					m_primitives.back().w[k] = 0.1f;
+				for (int i = 0; i < 200; i++) {
+					add(point(), point(), point(), rng.Color());
+					for (int k = 0; k < 3; k++)
+						m_primitives.back().w[k] = 0.2f + rng.Range(0, 800) * 0.001f;
+				}
+				break;
+
+			default:
+				break;
+			}
+
+			if (workload == Workload::DEPTH_TRIANGLES || workload == Workload::OCCLUDED_TRIANGLES)
+				m_depth.Resize(nWidth, nHeight, DepthFormat::D32);
+		}
+
+
+
+		// Draws the primitive list once
+		void Pass(Workload workload) {
+			switch (workload) {
+			case Workload::CLEAR:
+				for (const Primitive& prim : m_primitives)
+					m_fb.Clear(prim.p);
+				break;
+
+			case Workload::RECTS:
+			case Workload::BLENDED_RECTS:
+				m_fb.SetBlendMode(workload == Workload::RECTS ? BlendMode::NONE : BlendMode::ALPHA);
+				for (const Primitive& prim : m_primitives)
+					m_fb.FillRectangle(prim.v[0], prim.v[1].x, prim.v[1].y, prim.p);
+				m_fb.SetBlendMode(BlendMode::NONE);
+				break;
+
+			case Workload::LINES:
+				for (const Primitive& prim : m_primitives)
+					m_fb.DrawLine(prim.v[0].x, prim.v[0].y, prim.v[1].x, prim.v[1].y, prim.p);
+				break;
+
+			case Workload::SMALL_TRIANGLES:
+			case Workload::LARGE_TRIANGLES:
+			case Workload::BLENDED_TRIANGLES:
+				m_fb.SetBlendMode(workload == Workload::BLENDED_TRIANGLES ? BlendMode::ALPHA : BlendMode::NONE);
+				for (const Primitive& prim : m_primitives)
+					m_fb.FillTriangle(prim.v[0], prim.v[1], prim.v[2], prim.p);
+				m_fb.SetBlendMode(BlendMode::NONE);
+				break;
+
+			case Workload::DEFERRED_TRIANGLES:
+				m_commands.Reset();
+				for (const Primitive& prim : m_primitives)
+					m_commands.FillTriangle(prim.v[0], prim.v[1], prim.v[2], prim.p);
+				m_rasterizer.Execute(m_commands, m_fb);
+				break;
+
+			case Workload::TEXT:
+				for (size_t i = 0; i < m_primitives.size(); i++)
+					m_fb.DrawString(m_primitives[i].v[0].x, m_primitives[i].v[0].y, m_labels[i], m_primitives[i].p);
+				break;
+
+			case Workload::CACHED_TEXT:
+				for (size_t i = 0; i < m_primitives.size(); i++)
+					m_fb.DrawText(m_primitives[i].v[0].x, m_primitives[i].v[0].y, m_labels[i], m_primitives[i].p);
+				break;
+
+			case Workload::SPRITES:
+				for (const Primitive& prim : m_primitives)
+					m_fb.DrawSprite(prim.v[0], m_keyedSprite);
+				break;
+
+			case Workload::SCALED_SPRITES:
+				for (const Primitive& prim : m_primitives)
+					m_fb.DrawScaledSprite(prim.v[0].x, prim.v[0].y, prim.v[1].x, prim.v[1].y, m_alphaSprite, SpriteFilter::BILINEAR);
+				break;
+
+			case Workload::GOURAUD_TRIANGLES:
+				for (const Primitive& prim : m_primitives)
+					m_fb.FillTriangle(prim.v[0], prim.c[0], prim.v[1], prim.c[1], prim.v[2], prim.c[2]);
+				break;
+
+			// Texture coordinates follow the screen, half a texel per pixel
+			case Workload::AFFINE_TRIANGLES:
+			case Workload::PERSPECTIVE_TRIANGLES:
+				for (const Primitive& prim : m_primitives) {
+					TexVertex t[3];
+					for (int k = 0; k < 3; k++)
+						t[k] = TexVertex(prim.v[k], prim.v[k].x * 0.5f, prim.v[k].y * 0.5f, prim.w[k]);
+					m_fb.DrawTexturedTriangle(t[0], t[1], t[2], m_texture);
+				}
+				break;
+
+			case Workload::DEPTH_TRIANGLES:
+			case Workload::OCCLUDED_TRIANGLES:
+				m_depth.Clear();
+				for (const Primitive& prim : m_primitives)
+					m_fb.FillTriangle(prim.v[0], prim.w[0], prim.v[1], prim.w[1], prim.v[2], prim.w[2], prim.p, m_depth);
+				break;
+
+			default:
+				break;
+			}
+		}
+
+
+
+		uint64_t Checksum() const {
+			uint64_t nHash = 14695981039346656037ull;
+			for (int y = 0; y < m_fb.ScreenHeight(); y++) {
+				const uint8_t* pRow = (const uint8_t*)m_fb.Row(y);
+				for (size_t i = 0; i < (size_t)m_fb.ScreenWidth() * sizeof(typename FORMAT::Texel); i++)
+					nHash = (nHash ^ pRow[i]) * 1099511628211ull;
+			}
+			return nHash;
+		}
+
+
+
+	public:
+		explicit BasicBenchmarkRunner(const BenchmarkConfig& config) : m_config(config), m_rasterizer(config.nThreads) {
+			// A keyed ring and a soft alpha disc, both procedural so no assets are needed
+			m_keyedSprite.Resize(32, 32, Pixel(255, 0, 255));
+			m_alphaSprite.Resize(64, 64, Pixel(0, 0, 0, 0));
+			for (int y = 0; y < 64; y++) {
+				for (int x = 0; x < 64; x++) {
+					int d2 = (x - 32) * (x - 32) + (y - 32) * (y - 32);
+					if (x < 32 && y < 32 && d2 > 100 && (x - 16) * (x - 16) + (y - 16) * (y - 16) < 225)
+						m_keyedSprite.SetPixel(x, y, Pixel((uint8_t)(x * 8), (uint8_t)(y * 8), 200));
+					if (d2 < 1024)
+						m_alphaSprite.SetPixel(x, y, Pixel(255, (uint8_t)(x * 4), (uint8_t)(y * 4), (uint8_t)(255 - d2 / 4)));
+				}
+			}
+			m_keyedSprite.SetColorKey(Pixel(255, 0, 255));
+			m_alphaSprite.SetAlphaMask();
+
+			// Opaque 64x64 checker of gradients for the textured triangles
+			m_texture.Resize(64, 64);
+			for (int y = 0; y < 64; y++) {
+				for (int x = 0; x < 64; x++)
+					m_texture.SetPixel(x, y, ((x / 8 + y / 8) % 2) ? Pixel((uint8_t)(x * 4), (uint8_t)(y * 4), 64) : Pixel(32, (uint8_t)(255 - y * 4), (uint8_t)(x * 4)));
+			}
+		}
+
+
+
+		BenchmarkResult Run(Workload workload, int nWidth, int nHeight) {
+			using Clock = std::chrono::steady_clock;
+
+			BenchmarkResult result;
+			result.sWorkload = WorkloadName(workload);
+			result.sFormat = PixelFormatName(FORMAT::ID);
+			result.nWidth = nWidth;
+			result.nHeight = nHeight;
+
+			m_fb.Resize(nWidth, nHeight, THPX::BLACK);
+			Generate(workload, nWidth, nHeight);
+
+			// First pass on a known frame gives the checksum and warms the caches
+			Pass(workload);
+			result.nChecksum = Checksum();
+
+			m_fb.ResetStats();
+			Clock::time_point start = Clock::now();
+			double fSeconds = 0.0;
+			do {
+				Pass(workload);
+				result.nPasses++;
+				fSeconds = std::chrono::duration<double>(Clock::now() - start).count();
+			} while (fSeconds < m_config.fMinSeconds);
+
+			result.fSeconds = fSeconds;
+			result.nPrimitives = m_fb.Stats().nPrimitives;
+			result.nPixels = m_fb.Stats().nPixels;
+			return result;
+		}
+	};
+
+
+
+	class Benchmark {
+
+	private:
+		template<typename FORMAT>
+		static void RunFormat(const BenchmarkConfig& config, std::vector<BenchmarkResult>& results) {
+			BasicBenchmarkRunner<FORMAT> runner(config);
+			for (const Vec2D& size : config.sizes) {
+				for (size_t i = 0; i < (size_t)Workload::COUNT; i++) {
+					if (!config.sFilter.empty() && std::strstr(WorkloadName((Workload)i), config.sFilter.c_str()) == nullptr)
+						continue;
+					results.push_back(runner.Run((Workload)i, size.x, size.y));
+				}
+			}
+		}
+
+
+
+	public:
+		static std::vector<BenchmarkResult> Run(const BenchmarkConfig& config) {
+			std::vector<BenchmarkResult> results;
+			for (PixelFormat format : config.formats) {
+				switch (format) {
+				case PixelFormat::RGBA8888: RunFormat<FormatRGBA8888>(config, results); break;
+				case PixelFormat::BGRA8888: RunFormat<FormatBGRA8888>(config, results); break;
+				case PixelFormat::RGB565:   RunFormat<FormatRGB565>(config, results); break;
+				case PixelFormat::RGBAF32:  RunFormat<FormatRGBAF32>(config, results); break;
+				}
+			}
+			return results;
+		}
+
+
+
+		// Human readable table
+		static void Print(const std::vector<BenchmarkResult>& results, FILE* pFile = stdout) {
+			std::fprintf(pFile, "%-22s %-9s %11s %12s %12s %18s\n", "workload", "format", "size", "Mpix/s", "Mprim/s", "checksum");
+			for (const BenchmarkResult& r : results) {
+				char sSize[24];
+				std::snprintf(sSize, sizeof(sSize), "%dx%d", r.nWidth, r.nHeight);
+				std::fprintf(pFile, "%-22s %-9s %11s %12.1f %12.3f %18llx\n", r.sWorkload.c_str(), r.sFormat.c_str(), sSize,
+					r.PixelsPerSecond() * 1e-6, r.PrimitivesPerSecond() * 1e-6, (unsigned long long)r.nChecksum);
+			}
+		}
+
+
+
+		static bool WriteJSON(const char* sPath, const std::vector<BenchmarkResult>& results) {
+			FILE* pFile = std::fopen(sPath, "wb");
+			if (!pFile)
+				return false;
+
+			std::fprintf(pFile, "{\"results\":[\n");
+			for (size_t i = 0; i < results.size(); i++) {
+				const BenchmarkResult& r = results[i];
+				std::fprintf(pFile, "{\"workload\":\"%s\",\"format\":\"%s\",\"width\":%d,\"height\":%d,\"passes\":%llu,\"primitives\":%llu,"
+					"\"pixels\":%llu,\"seconds\":%.6f,\"pixels_per_sec\":%.1f,\"primitives_per_sec\":%.1f,\"checksum\":\"%016llx\"}%s\n",
+					r.sWorkload.c_str(), r.sFormat.c_str(), r.nWidth, r.nHeight, (unsigned long long)r.nPasses,
+					(unsigned long long)r.nPrimitives, (unsigned long long)r.nPixels, r.fSeconds, r.PixelsPerSecond(),
+					r.PrimitivesPerSecond(), (unsigned long long)r.nChecksum, i + 1 < results.size() ? "," : "");
+			}
+			std::fprintf(pFile, "]}\n");
+			return std::fclose(pFile) == 0;
+		}
+
+
+
+		// One result per line, what ReadCSV reads back as a baseline
+		static bool WriteCSV(const char* sPath, const std::vector<BenchmarkResult>& results) {
+			FILE* pFile = std::fopen(sPath, "wb");
+			if (!pFile)
+				return false;
+
+			std::fprintf(pFile, "workload,format,width,height,passes,primitives,pixels,seconds,pixels_per_sec,primitives_per_sec,checksum\n");
+			for (const BenchmarkResult& r : results) {
+				std::fprintf(pFile, "%s,%s,%d,%d,%llu,%llu,%llu,%.6f,%.1f,%.1f,%016llx\n",
+					r.sWorkload.c_str(), r.sFormat.c_str(), r.nWidth, r.nHeight, (unsigned long long)r.nPasses,
+					(unsigned long long)r.nPrimitives, (unsigned long long)r.nPixels, r.fSeconds, r.PixelsPerSecond(),
+					r.PrimitivesPerSecond(), (unsigned long long)r.nChecksum);
+			}
+			return std::fclose(pFile) == 0;
+		}
+
+
+
+		static bool ReadCSV(const char* sPath, std::vector<BenchmarkResult>& results) {
+			FILE* pFile = std::fopen(sPath, "rb");
+			if (!pFile)
+				return false;
+
+			results.clear();
+			char sLine[512];
+			bool bHeader = true;
+			while (std::fgets(sLine, sizeof(sLine), pFile)) {
+				if (bHeader) {
+					bHeader = false;
+					continue;
+				}
+
+				BenchmarkResult r;
+				char sWorkload[64], sFormat[32];
+				unsigned long long nPasses, nPrimitives, nPixels, nChecksum;
+				double fPixelRate, fPrimitiveRate;
+				if (std::sscanf(sLine, "%63[^,],%31[^,],%d,%d,%llu,%llu,%llu,%lf,%lf,%lf,%llx", sWorkload, sFormat, &r.nWidth, &r.nHeight,
+					&nPasses, &nPrimitives, &nPixels, &r.fSeconds, &fPixelRate, &fPrimitiveRate, &nChecksum) != 11)
+					continue;
+
+				r.sWorkload = sWorkload;
+				r.sFormat = sFormat;
+				r.nPasses = nPasses;
+				r.nPrimitives = nPrimitives;
+				r.nPixels = nPixels;
+				r.nChecksum = nChecksum;
+				results.push_back(r);
+			}
+
+			std::fclose(pFile);
+			return true;
+		}
+
+
+
+		// False if any workload run in both lost more than fTolerance (0.1 is 10 %)
+		// of its pixel rate against the baseline. Checksum changes are reported,
+		// they mean the output changed, not that it got slower.
+		static bool Compare(const std::vector<BenchmarkResult>& baseline, const std::vector<BenchmarkResult>& results, double fTolerance, FILE* pReport = stdout) {
+			bool bPassed = true;
+			for (const BenchmarkResult& r : results) {
+				for (const BenchmarkResult& b : baseline) {
+					if (b.sWorkload != r.sWorkload || b.sFormat != r.sFormat || b.nWidth != r.nWidth || b.nHeight != r.nHeight)
+						continue;
+
+					double fRatio = b.PixelsPerSecond() > 0.0 ? r.PixelsPerSecond() / b.PixelsPerSecond() : 1.0;
+					bool bSlower = fRatio < 1.0 - fTolerance;
+					if (bSlower || b.nChecksum != r.nChecksum) {
+						std::fprintf(pReport, "%s %s %dx%d: %.1f%% of baseline%s%s\n", r.sWorkload.c_str(), r.sFormat.c_str(), r.nWidth, r.nHeight,
+							fRatio * 100.0, bSlower ? ", regressed" : "", b.nChecksum != r.nChecksum ? ", output changed" : "");
+					}
+					bPassed &= !bSlower;
+				}
+			}
+			return bPassed;
+		}
+	};
+
+
+
+	// Command line driver, so a benchmark executable is just
+	//     int main(int argc, char** argv) { return THPX::BenchmarkMain(argc, argv); }
+	// Options: --filter NAME, --seconds S, --seed N, --threads N, --size WxH (repeatable),
+	// --json PATH, --csv PATH, --baseline PATH with --tolerance F. Returns 1 on a regression.
+	inline int BenchmarkMain(int argc, char** argv) {
+		BenchmarkConfig config;
+		const char* sJSON = nullptr;
+		const char* sCSV = nullptr;
+		const char* sBaseline = nullptr;
+		double fTolerance = 0.1;
+		bool bSizes = false;
+
+		for (int i = 1; i < argc; i++) {
+			const char* sArg = argv[i];
+			const char* sValue = i + 1 < argc ? argv[i + 1] : nullptr;
+			if (!sValue) {
+				std::fprintf(stderr, "missing value for %s\n", sArg);
+				return 2;
+			}
+			i++;
+
+			if (std::strcmp(sArg, "--filter") == 0)
+				config.sFilter = sValue;
+			else if (std::strcmp(sArg, "--seconds") == 0)
+				config.fMinSeconds = std::atof(sValue);
+			else if (std::strcmp(sArg, "--seed") == 0)
+				config.nSeed = std::strtoull(sValue, nullptr, 10);
+			else if (std::strcmp(sArg, "--threads") == 0)
+				config.nThreads = (unsigned)std::atoi(sValue);
+			else if (std::strcmp(sArg, "--json") == 0)
+				sJSON = sValue;
+			else if (std::strcmp(sArg, "--csv") == 0)
+				sCSV = sValue;
+			else if (std::strcmp(sArg, "--baseline") == 0)
+				sBaseline = sValue;
+			else if (std::strcmp(sArg, "--tolerance") == 0)
+				fTolerance = std::atof(sValue);
+			else if (std::strcmp(sArg, "--size") == 0) {
+				int w = 0, h = 0;
+				if (std::sscanf(sValue, "%dx%d", &w, &h) != 2 || w <= 0 || h <= 0) {
+					std::fprintf(stderr, "bad size %s\n", sValue);
+					return 2;
+				}
+				if (!bSizes)
+					config.sizes.clear();
+				bSizes = true;
+				config.sizes.push_back(Vec2D(w, h));
+			}
+			else {
+				std::fprintf(stderr, "unknown option %s\n", sArg);
+				return 2;
+			}
+		}
+
+		std::vector<BenchmarkResult> results = Benchmark::Run(config);
+		Benchmark::Print(results);
+
+		if (sJSON && !Benchmark::WriteJSON(sJSON, results))
+			std::fprintf(stderr, "cannot write %s\n", sJSON);
+		if (sCSV && !Benchmark::WriteCSV(sCSV, results))
+			std::fprintf(stderr, "cannot write %s\n", sCSV);
+
+		if (sBaseline) {
+			std::vector<BenchmarkResult> baseline;
+			if (!Benchmark::ReadCSV(sBaseline, baseline)) {
+				std::fprintf(stderr, "cannot read %s\n", sBaseline);
+				return 2;
+			}
+			return Benchmark::Compare(baseline, results, fTolerance) ? 0 : 1;
+		}
+
+		return 0;
+	}
+
+}
@@ -0,0 +1,431 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <algorithm>
+#include <cstring>
+
+#include "THPXTypes.h"
+#include "THPXPixelFormat.h"
+#include "THPXSpanKernels.h"
+
+
+namespace THPX {
+
+	//===== BLEND MODES =====//
+
+	// How a primitive's color is combined with what is already in the framebuffer.
+	// Blending uses the color's alpha, NONE overwrites regardless of it.
+	enum class BlendMode : uint8_t {
+		NONE,           // dst = src
+		ALPHA,          // dst = src * a + dst * (1 - a)
+		ADDITIVE,       // dst = dst + src * a, saturated
+		MULTIPLY,       // dst = dst * lerp(1, src, a)
+		PREMULTIPLIED   // dst = src + dst * (1 - a), src already multiplied by a
+	};
+
+
+
+	// Blend constants of one primitive, worked out once from its color so the
+	// span loops only do dst = (s + dst * f) / 255 per channel (or dst + s for
+	// ADDITIVE). Channels are in Pixel order r, g, b, a.
+	struct BlendOp {
+		BlendMode   mode = BlendMode::NONE;
+		uint16_t    s[4] = { 0, 0, 0, 0 };
+		uint16_t    f[4] = { 0, 0, 0, 0 };
+
+
+		// Exact round(x / 255) for x <= 255 * 255
+		static uint32_t Div255(uint32_t x) {
+			x += 128;
+			return (x + (x >> 8)) >> 8;
+		}
+
+
+
+		BlendOp() {}
+
+		BlendOp(Pixel p, BlendMode blend) {
+			mode = blend;
+			const uint8_t c[3] = { p.r, p.g, p.b };
+
+			switch (blend) {
+			case BlendMode::NONE:
+				break;
+
+			case BlendMode::ALPHA:
+				for (int i = 0; i < 3; i++)
+					s[i] = (uint16_t)(c[i] * p.a);
+				s[3] = (uint16_t)(255 * p.a);
+				f[0] = f[1] = f[2] = f[3] = (uint16_t)(255 - p.a);
+				break;
+
+			case BlendMode::PREMULTIPLIED:
+				// Channels above alpha are not valid premultiplied colors and would overflow
+				for (int i = 0; i < 3; i++)
+					s[i] = (uint16_t)(std::min(c[i], p.a) * 255);
+				s[3] = (uint16_t)(255 * p.a);
+				f[0] = f[1] = f[2] = f[3] = (uint16_t)(255 - p.a);
+				break;
+
+			case BlendMode::ADDITIVE:
+				for (int i = 0; i < 3; i++)
+					s[i] = (uint16_t)Div255(c[i] * p.a);
+				break;
+
+			case BlendMode::MULTIPLY:
+				for (int i = 0; i < 3; i++)
+					f[i] = (uint16_t)(255 - Div255(p.a * (255 - c[i])));
+				f[3] = 255;
+				break;
+			}
+		}
+
+
+
+		// Result is just the source color, the plain fill path does the job
+		static bool IsOpaque(Pixel p, BlendMode blend) {
+			return blend == BlendMode::NONE || (p.a == 255 && (blend == BlendMode::ALPHA || blend == BlendMode::PREMULTIPLIED));
+		}
+
+
+
+		uint8_t Apply(uint8_t d, int nChannel) const {
+			if (mode == BlendMode::ADDITIVE)
+				return (uint8_t)std::min<uint32_t>(255, d + s[nChannel]);
+			return (uint8_t)Div255(s[nChannel] + d * f[nChannel]);
+		}
+
+
+
+		Pixel Apply(Pixel d) const {
+			return Pixel(Apply(d.r, 0), Apply(d.g, 1), Apply(d.b, 2), Apply(d.a, 3));
+		}
+	};
+
+
+
+	//===== BLEND KERNELS =====//
+
+	// Span blending per texel format. Formats with four byte channels blend
+	// 8 pixels per step with SSE2 and 16 with AVX2; float texels blend in
+	// float so HDR values survive; anything else decodes, blends and encodes.
+	class BlendKernels {
+
+	private:
+		// One pixel's worth of 16 bit constants in memory order, packed for broadcasting.
+		// Built in registers: a round trip through a small array stalls on store forwarding.
+		static uint64_t Pack(const uint16_t v[4], int nRed) {
+			return ((uint64_t)v[0] << (16 * nRed)) | ((uint64_t)v[1] << 16) | ((uint64_t)v[2] << (16 * (2 - nRed))) | ((uint64_t)v[3] << 48);
+		}
+
+
+
+		// Four byte channel texels, nRed is the byte offset of red (0 or 2)
+		static void ByteSpan(uint8_t* pDst, size_t nCount, const BlendOp& op, int nRed) {
+			size_t i = 0;
+
+#if defined(THPX_SPAN_SSE2)
+			if (op.mode == BlendMode::ADDITIVE) {
+				// Additive constants are below 256, so the 16 bit lanes narrow to bytes
+				uint64_t nPacked = Pack(op.s, nRed);
+				int32_t nAdd = (int32_t)((nPacked & 0xFF) | ((nPacked >> 8) & 0xFF00) | ((nPacked >> 16) & 0xFF0000) | ((nPacked >> 24) & 0xFF000000));
+#if defined(THPX_SPAN_AVX2)
+				__m256i add8 = _mm256_set1_epi32(nAdd);
+				for (; i + 8 <= nCount; i += 8) {
+					__m256i d = _mm256_loadu_si256((const __m256i*)(pDst + i * 4));
+					_mm256_storeu_si256((__m256i*)(pDst + i * 4), _mm256_adds_epu8(d, add8));
+				}
+#endif
+				__m128i add = _mm_set1_epi32(nAdd);
+				for (; i + 4 <= nCount; i += 4) {
+					__m128i d = _mm_loadu_si128((const __m128i*)(pDst + i * 4));
+					_mm_storeu_si128((__m128i*)(pDst + i * 4), _mm_adds_epu8(d, add));
+				}
+				for (; i < nCount; i++) {
+					int32_t d;
+					memcpy(&d, pDst + i * 4, 4);
+					d = _mm_cvtsi128_si32(_mm_adds_epu8(_mm_cvtsi32_si128(d), add));
+					memcpy(pDst + i * 4, &d, 4);
+				}
+				return;
+			}
+
+			int64_t nS = (int64_t)Pack(op.s, nRed);
+			int64_t nF = (int64_t)Pack(op.f, nRed);
+
+#if defined(THPX_SPAN_AVX2)
+			{
+				// s + 128 folded together, the rest of Div255 follows the multiply-add
+				__m256i vs = _mm256_add_epi16(_mm256_set1_epi64x(nS), _mm256_set1_epi16(128));
+				__m256i vf = _mm256_set1_epi64x(nF);
+				__m256i zero = _mm256_setzero_si256();
+
+				// Unpack and pack work within 128 bit lanes, so the round trip keeps pixel order
+				auto blend = [&](__m256i x) {
+					x = _mm256_add_epi16(_mm256_mullo_epi16(x, vf), vs);
+					return _mm256_srli_epi16(_mm256_add_epi16(x, _mm256_srli_epi16(x, 8)), 8);
+				};
+
+				for (; i + 16 <= nCount; i += 16) {
+					__m256i d0 = _mm256_loadu_si256((const __m256i*)(pDst + i * 4));
+					__m256i d1 = _mm256_loadu_si256((const __m256i*)(pDst + i * 4 + 32));
+					d0 = _mm256_packus_epi16(blend(_mm256_unpacklo_epi8(d0, zero)), blend(_mm256_unpackhi_epi8(d0, zero)));
+					d1 = _mm256_packus_epi16(blend(_mm256_unpacklo_epi8(d1, zero)), blend(_mm256_unpackhi_epi8(d1, zero)));
+					_mm256_storeu_si256((__m256i*)(pDst + i * 4), d0);
+					_mm256_storeu_si256((__m256i*)(pDst + i * 4 + 32), d1);
+				}
+				for (; i + 8 <= nCount; i += 8) {
+					__m256i d = _mm256_loadu_si256((const __m256i*)(pDst + i * 4));
+					d = _mm256_packus_epi16(blend(_mm256_unpacklo_epi8(d, zero)), blend(_mm256_unpackhi_epi8(d, zero)));
+					_mm256_storeu_si256((__m256i*)(pDst + i * 4), d);
+				}
+			}
+#endif
+			__m128i vs = _mm_add_epi16(_mm_set1_epi64x(nS), _mm_set1_epi16(128));
+			__m128i vf = _mm_set1_epi64x(nF);
+			__m128i zero = _mm_setzero_si128();
+
+			auto blend = [&](__m128i x) {
+				x = _mm_add_epi16(_mm_mullo_epi16(x, vf), vs);
+				return _mm_srli_epi16(_mm_add_epi16(x, _mm_srli_epi16(x, 8)), 8);
+			};
+
+			for (; i + 8 <= nCount; i += 8) {
+				__m128i d0 = _mm_loadu_si128((const __m128i*)(pDst + i * 4));
+				__m128i d1 = _mm_loadu_si128((const __m128i*)(pDst + i * 4 + 16));
+				d0 = _mm_packus_epi16(blend(_mm_unpacklo_epi8(d0, zero)), blend(_mm_unpackhi_epi8(d0, zero)));
+				d1 = _mm_packus_epi16(blend(_mm_unpacklo_epi8(d1, zero)), blend(_mm_unpackhi_epi8(d1, zero)));
+				_mm_storeu_si128((__m128i*)(pDst + i * 4), d0);
+				_mm_storeu_si128((__m128i*)(pDst + i * 4 + 16), d1);
+			}
+			for (; i + 4 <= nCount; i += 4) {
+				__m128i d = _mm_loadu_si128((const __m128i*)(pDst + i * 4));
+				d = _mm_packus_epi16(blend(_mm_unpacklo_epi8(d, zero)), blend(_mm_unpackhi_epi8(d, zero)));
+				_mm_storeu_si128((__m128i*)(pDst + i * 4), d);
+			}
+
+			// Leftover pixels one at a time in the low lanes, no scalar divides
+			for (; i < nCount; i++) {
+				int32_t d;
+				memcpy(&d, pDst + i * 4, 4);
+				__m128i x = blend(_mm_unpacklo_epi8(_mm_cvtsi32_si128(d), zero));
+				d = _mm_cvtsi128_si32(_mm_packus_epi16(x, x));
+				memcpy(pDst + i * 4, &d, 4);
+			}
+#else
+			const int order[4] = { nRed, 1, 2 - nRed, 3 };
+			for (; i < nCount; i++) {
+				uint8_t* p = pDst + i * 4;
+				for (int c = 0; c < 4; c++)
+					p[order[c]] = op.Apply(p[order[c]], c);
+			}
+#endif
+		}
+
+
+
+		// Source over for four byte channel texels with alpha in byte 3, per pixel
+		// alpha scaled by nOpacity / 255
+		static void ByteOver(uint8_t* pDst, const uint8_t* pSrc, size_t nCount, uint8_t nOpacity = 255) {
+			size_t i = 0;
+
+#if defined(THPX_SPAN_SSE2)
+			__m128i zero = _mm_setzero_si128();
+			__m128i round = _mm_set1_epi16(128);
+			__m128i c255 = _mm_set1_epi16(255);
+			__m128i opacity = _mm_set1_epi16(nOpacity);
+			__m128i alphaMask = _mm_set1_epi32((int32_t)0xFF000000);
+			__m128i alphaLanes = _mm_setr_epi16(0, 0, 0, 255, 0, 0, 0, 255);
+
+			auto div255 = [&](__m128i x) {
+				x = _mm_add_epi16(x, round);
+				return _mm_srli_epi16(_mm_add_epi16(x, _mm_srli_epi16(x, 8)), 8);
+			};
+
+			// Source alpha broadcast over its pixel's lanes, source alpha lane itself
+			// forced to 255 so the result alpha is a + dst_a * (1 - a)
+			auto over = [&](__m128i s, __m128i d) {
+				__m128i a = _mm_shufflehi_epi16(_mm_shufflelo_epi16(s, 0xFF), 0xFF);
+				if (nOpacity != 255)
+					a = div255(_mm_mullo_epi16(a, opacity));
+				s = _mm_or_si128(s, alphaLanes);
+				return div255(_mm_add_epi16(_mm_mullo_epi16(s, a), _mm_mullo_epi16(d, _mm_sub_epi16(c255, a))));
+			};
+
+			for (; i + 4 <= nCount; i += 4) {
+				__m128i s = _mm_loadu_si128((const __m128i*)(pSrc + i * 4));
+				int nOpaque = _mm_movemask_epi8(_mm_cmpeq_epi32(_mm_and_si128(s, alphaMask), alphaMask));
+
+				// Sprites are mostly fully opaque or fully clear, those skip the math
+				if (nOpaque == 0xFFFF && nOpacity == 255) {
+					_mm_storeu_si128((__m128i*)(pDst + i * 4), s);
+					continue;
+				}
+				if (_mm_movemask_epi8(_mm_cmpeq_epi32(_mm_and_si128(s, alphaMask), zero)) == 0xFFFF)
+					continue;
+
+				__m128i d = _mm_loadu_si128((const __m128i*)(pDst + i * 4));
+				__m128i lo = over(_mm_unpacklo_epi8(s, zero), _mm_unpacklo_epi8(d, zero));
+				__m128i hi = over(_mm_unpackhi_epi8(s, zero), _mm_unpackhi_epi8(d, zero));
+				_mm_storeu_si128((__m128i*)(pDst + i * 4), _mm_packus_epi16(lo, hi));
+			}
+
+			for (; i < nCount; i++) {
+				int32_t s, d;
+				memcpy(&s, pSrc + i * 4, 4);
+				memcpy(&d, pDst + i * 4, 4);
+				__m128i x = over(_mm_unpacklo_epi8(_mm_cvtsi32_si128(s), zero), _mm_unpacklo_epi8(_mm_cvtsi32_si128(d), zero));
+				d = _mm_cvtsi128_si32(_mm_packus_epi16(x, x));
+				memcpy(pDst + i * 4, &d, 4);
+			}
+#else
+			for (; i < nCount; i++) {
+				const uint8_t* s = pSrc + i * 4;
+				uint8_t* d = pDst + i * 4;
+				uint32_t a = BlendOp::Div255(s[3] * nOpacity);
+				for (int c = 0; c < 3; c++)
+					d[c] = (uint8_t)BlendOp::Div255(s[c] * a + d[c] * (255 - a));
+				d[3] = (uint8_t)BlendOp::Div255(255 * a + d[3] * (255 - a));
+			}
+#endif
+		}
+
+
+
+	public:
+		// Blends the primitive's color into nCount consecutive texels
+		template<typename FORMAT>
+		static void Span(typename FORMAT::Texel* pDst, size_t nCount, const BlendOp& op) {
+			for (size_t i = 0; i < nCount; i++)
+				pDst[i] = FORMAT::Encode(op.Apply(FORMAT::Decode(pDst[i])));
+		}
+
+
+
+		// Blends nCount source texels over the destination, each by its own alpha
+		template<typename FORMAT>
+		static void Over(typename FORMAT::Texel* pDst, const typename FORMAT::Texel* pSrc, size_t nCount) {
+			for (size_t i = 0; i < nCount; i++) {
+				Pixel s = FORMAT::Decode(pSrc[i]);
+				pDst[i] = FORMAT::Encode(BlendOp(s, BlendMode::ALPHA).Apply(FORMAT::Decode(pDst[i])));
+			}
+		}
+
+
+
+		// Over with every source alpha scaled by nOpacity / 255, for layers faded as a whole
+		template<typename FORMAT>
+		static void OverScaled(typename FORMAT::Texel* pDst, const typename FORMAT::Texel* pSrc, size_t nCount, uint8_t nOpacity) {
+			for (size_t i = 0; i < nCount; i++) {
+				Pixel s = FORMAT::Decode(pSrc[i]);
+				s.a = (uint8_t)BlendOp::Div255(s.a * nOpacity);
+				pDst[i] = FORMAT::Encode(BlendOp(s, BlendMode::ALPHA).Apply(FORMAT::Decode(pDst[i])));
+			}
+		}
+
+
+
+		// Same span of nRows rows, each nPitch texels apart
+		template<typename FORMAT>
+		static void Rows(typename FORMAT::Texel* pDst, size_t nCount, size_t nRows, size_t nPitch, const BlendOp& op) {
+			for (size_t row = 0; row < nRows; row++) {
+				Span<FORMAT>(pDst, nCount, op);
+				pDst += nPitch;
+			}
+		}
+	};
+
+
+
+	template<>
+	inline void BlendKernels::Span<FormatRGBA8888>(Pixel* pDst, size_t nCount, const BlendOp& op) {
+		ByteSpan((uint8_t*)pDst, nCount, op, 0);
+	}
+
+
+
+	template<>
+	inline void BlendKernels::Span<FormatBGRA8888>(PixelBGRA* pDst, size_t nCount, const BlendOp& op) {
+		ByteSpan((uint8_t*)pDst, nCount, op, 2);
+	}
+
+
+
+	// 1.0 is 255 in the byte constants, results are left unclamped
+	template<>
+	inline void BlendKernels::Span<FormatRGBAF32>(PixelF* pDst, size_t nCount, const BlendOp& op) {
+		const float k = 1.0f / (255.0f * 255.0f);
+		float s[4], f[4];
+		for (int i = 0; i < 4; i++) {
+			s[i] = op.mode == BlendMode::ADDITIVE ? op.s[i] * (1.0f / 255.0f) : op.s[i] * k;
+			f[i] = op.mode == BlendMode::ADDITIVE ? 1.0f : op.f[i] * (1.0f / 255.0f);
+		}
+
+		for (size_t i = 0; i < nCount; i++) {
+			pDst[i].r = s[0] + pDst[i].r * f[0];
+			pDst[i].g = s[1] + pDst[i].g * f[1];
+			pDst[i].b = s[2] + pDst[i].b * f[2];
+			pDst[i].a = s[3] + pDst[i].a * f[3];
+		}
+	}
+
+
+
+
+	template<>
+	inline void BlendKernels::Over<FormatRGBA8888>(Pixel* pDst, const Pixel* pSrc, size_t nCount) {
+		ByteOver((uint8_t*)pDst, (const uint8_t*)pSrc, nCount);
+	}
+
+
+
+	template<>
+	inline void BlendKernels::Over<FormatBGRA8888>(PixelBGRA* pDst, const PixelBGRA* pSrc, size_t nCount) {
+		ByteOver((uint8_t*)pDst, (const uint8_t*)pSrc, nCount);
+	}
+
+
+
+	template<>
+	inline void BlendKernels::Over<FormatRGBAF32>(PixelF* pDst, const PixelF* pSrc, size_t nCount) {
+		for (size_t i = 0; i < nCount; i++) {
+			float a = pSrc[i].a;
+			float ia = 1.0f - a;
+			pDst[i].r = pSrc[i].r * a + pDst[i].r * ia;
+			pDst[i].g = pSrc[i].g * a + pDst[i].g * ia;
+			pDst[i].b = pSrc[i].b * a + pDst[i].b * ia;
+			pDst[i].a = a + pDst[i].a * ia;
+		}
+	}
+
+
+
+	template<>
+	inline void BlendKernels::OverScaled<FormatRGBA8888>(Pixel* pDst, const Pixel* pSrc, size_t nCount, uint8_t nOpacity) {
+		ByteOver((uint8_t*)pDst, (const uint8_t*)pSrc, nCount, nOpacity);
+	}
+
+
+
+	template<>
+	inline void BlendKernels::OverScaled<FormatBGRA8888>(PixelBGRA* pDst, const PixelBGRA* pSrc, size_t nCount, uint8_t nOpacity) {
+		ByteOver((uint8_t*)pDst, (const uint8_t*)pSrc, nCount, nOpacity);
+	}
+
+
+
+	template<>
+	inline void BlendKernels::OverScaled<FormatRGBAF32>(PixelF* pDst, const PixelF* pSrc, size_t nCount, uint8_t nOpacity) {
+		const float k = nOpacity * (1.0f / 255.0f);
+		for (size_t i = 0; i < nCount; i++) {
+			float a = pSrc[i].a * k;
+			float ia = 1.0f - a;
+			pDst[i].r = pSrc[i].r * a + pDst[i].r * ia;
+			pDst[i].g = pSrc[i].g * a + pDst[i].g * ia;
+			pDst[i].b = pSrc[i].b * a + pDst[i].b * ia;
+			pDst[i].a = a + pDst[i].a * ia;
+		}
+	}
+
+}
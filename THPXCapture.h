@@ -0,0 +1,844 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <algorithm>
+
+#include "THPXTypes.h"
+#include "THPXPixelFormat.h"
+#include "THPXFramebuffer.h"
+#include "THPXThreadPool.h"
+#include "THPXImageFile.h"
+
+
+namespace THPX {
+
+	//===== CAPTURE FORMATS =====//
+
+	enum class CaptureFormat : uint8_t {
+		PPM,        // One binary PPM per frame, the %d in sPath becomes the frame number
+		Y4M,        // One YUV4MPEG2 stream, 4:4:4 full range BT.601
+		NATIVE      // TPXV stream of RLE compressed changed tiles, see below
+	};
+
+
+
+	// What Capture does when every queue slot is waiting to be encoded
+	enum class CapturePressure : uint8_t {
+		DROP,       // Skip the frame, its changes carry over to the next captured one
+		BLOCK,      // Wait for the encoder to free a slot
+		SPILL       // Append the raw frame to a temporary file the encoder reads back in order
+	};
+
+
+
+	// TPXV stream: this header, then per frame
+	//
+	//   uint32 frame       index of the frame since the capture started, gaps are dropped frames
+	//   uint32 tiles       number of tile records that follow
+	//   per tile:
+	//     uint32 index     ty * TilesX + tx of a CAPTURE_TILE_SIZE tile
+	//     uint32 bytes     size of the packets that follow
+	//     packets          RGBA8 pixels of the tile, rows clipped to the frame, as
+	//                      control byte c: c < 128 is c + 1 literal pixels,
+	//                      c >= 128 one pixel repeated c - 127 times
+	//
+	// Tiles not listed are unchanged from the previous frame, the first frame lists all of them.
+	struct CaptureFileHeader {
+		char        sMagic[4];      // "TPXV"
+		uint16_t    nVersion;
+		uint16_t    nTileSize;
+		uint32_t    nWidth;
+		uint32_t    nHeight;
+	};
+
+	static_assert(sizeof(CaptureFileHeader) == 16, "capture header is written as is");
+
+	constexpr uint16_t CAPTURE_VERSION = 1;
+	constexpr int CAPTURE_TILE_SIZE = FramebufferBase::DIRTY_TILE_SIZE;
+
+	// Largest frame side and tile side a capture may claim, CaptureReader refuses more
+	constexpr uint32_t CAPTURE_MAX_SIZE = 16384;
+	constexpr uint16_t CAPTURE_MAX_TILE_SIZE = 256;
+
+
+
+	struct CaptureConfig {
+		CaptureFormat format = CaptureFormat::NATIVE;
+		CapturePressure pressure = CapturePressure::DROP;
+
+		// Output file, or for PPM sequences a path whose first %d is replaced by
+		// the frame number (appended if there is none); nothing else is expanded
+		std::string sPath;
+
+		// Frames copied and waiting for the encoder before the pressure policy kicks in
+		unsigned    nQueueFrames = 3;
+
+		// Encoder threads including the encoder's own, 0 uses all hardware threads
+		unsigned    nThreads = 2;
+
+		// Frame rate written into the Y4M header
+		unsigned    nFrameRate = 60;
+
+		// NATIVE writes every tile each nKeyframeInterval frames, 0 only on the first
+		unsigned    nKeyframeInterval = 0;
+	};
+
+
+
+	//===== FRAME CAPTURE =====//
+
+	// Export stage fed with the final framebuffer once per frame. Capture only
+	// copies the frame into a free queue slot; colour conversion, compression
+	// and file writes happen on an encoder thread that splits each frame into
+	// row bands over its own thread pool. Frames are written in capture order.
+	class FrameCapture {
+
+	private:
+		struct Entry {
+			int         nSlot;          // -1 for a spilled frame
+			uint64_t    nSpillOffset;
+			uint32_t    nFrame;
+		};
+
+		// Encoder output of one band of rows
+		struct Band {
+			std::vector<uint8_t> out;
+			std::vector<Pixel> tile;
+			uint32_t    nTiles = 0;
+		};
+
+
+	private:
+		CaptureConfig m_config;
+		FILE*       m_pFile = nullptr;
+		bool        m_bOpen = false;
+
+		// Geometry of the first captured frame, later frames have to match
+		int         m_nWidth = 0;
+		int         m_nHeight = 0;
+		PixelFormat m_format = PixelFormat::RGBA8888;
+		size_t      m_nPitch = 0;
+		size_t      m_nFrameBytes = 0;
+		int         m_nTilesX = 0;
+		int         m_nTilesY = 0;
+
+		// Queue slots, each a raw copy of a frame and its changed tiles
+		std::vector<std::vector<uint8_t>> m_slots;
+		std::vector<std::vector<uint8_t>> m_slotTiles;
+		std::vector<int> m_freeSlots;
+		std::deque<Entry> m_queue;
+
+		// Tiles changed since the last queued frame, so dropped frames are not lost
+		std::vector<uint8_t> m_changedTiles;
+
+		// Spill file, guarded by m_spillMutex, written by Capture and read by the encoder
+		FILE*       m_pSpill = nullptr;
+		std::mutex  m_spillMutex;
+		uint64_t    m_nSpillEnd = 0;
+		unsigned    m_nSpilledQueued = 0;
+
+		std::thread m_encoder;
+		std::unique_ptr<ThreadPool> m_pPool;
+		std::mutex  m_mutex;
+		std::condition_variable m_cvQueued;
+		std::condition_variable m_cvFree;
+		bool        m_bQuit = false;
+		bool        m_bFailed = false;
+
+		// Encoder state: spill scratch, previous frame for NATIVE deltas, per band output
+		std::vector<uint8_t> m_spillFrame;
+		std::vector<uint8_t> m_spillTiles;
+		std::vector<Pixel> m_previous;
+		std::vector<Band> m_bands;
+		std::vector<uint8_t> m_rows;
+		uint64_t    m_nEncodedFrames = 0;
+
+		uint32_t    m_nFrame = 0;
+		std::atomic<uint64_t> m_nQueued;
+		std::atomic<uint64_t> m_nDropped;
+		std::atomic<uint64_t> m_nSpilled;
+		std::atomic<uint64_t> m_nEncoded;
+
+
+	private:
+		// Source row converted to RGBA8
+		static void DecodeRow(PixelFormat format, const uint8_t* pSrc, Pixel* pDst, int nCount) {
+			switch (format) {
+			case PixelFormat::RGBA8888:
+				std::memcpy(pDst, pSrc, (size_t)nCount * sizeof(Pixel));
+				break;
+			case PixelFormat::BGRA8888:
+				for (int i = 0; i < nCount; i++, pSrc += 4)
+					pDst[i] = Pixel(pSrc[2], pSrc[1], pSrc[0], pSrc[3]);
+				break;
+			default: {
+				size_t nTexel = TexelSize(format);
+				for (int i = 0; i < nCount; i++, pSrc += nTexel)
+					pDst[i] = DecodeTexel(format, pSrc);
+				break;
+			}
+			}
+		}
+
+
+
+		// 64 bit offsets, spill files pass 2 GB quickly at high resolutions
+		static bool Seek(FILE* pFile, uint64_t nOffset) {
+#ifdef _WIN32
+			return _fseeki64(pFile, (long long)nOffset, SEEK_SET) == 0;
+#else
+			return fseeko(pFile, (off_t)nOffset, SEEK_SET) == 0;
+#endif
+		}
+
+
+
+		static bool SamePixel(const Pixel& a, const Pixel& b) {
+			return a.r == b.r && a.g == b.g && a.b == b.b && a.a == b.a;
+		}
+
+
+
+		static void AppendU32(std::vector<uint8_t>& out, uint32_t n) {
+			const uint8_t* p = (const uint8_t*)&n;
+			out.insert(out.end(), p, p + 4);
+		}
+
+
+
+		// PackBits style runs of whole pixels
+		static void EncodeRLE(const Pixel* p, size_t nCount, std::vector<uint8_t>& out) {
+			size_t i = 0;
+			while (i < nCount) {
+				size_t nRun = 1;
+				while (i + nRun < nCount && nRun < 128 && SamePixel(p[i + nRun], p[i]))
+					nRun++;
+
+				if (nRun >= 2) {
+					out.push_back((uint8_t)(127 + nRun));
+					out.insert(out.end(), (const uint8_t*)&p[i], (const uint8_t*)&p[i] + 4);
+					i += nRun;
+					continue;
+				}
+
+				// Literal up to the next pair of equal pixels
+				size_t nLiteral = 1;
+				while (i + nLiteral < nCount && nLiteral < 128
+					&& !(i + nLiteral + 1 < nCount && SamePixel(p[i + nLiteral], p[i + nLiteral + 1])))
+					nLiteral++;
+
+				out.push_back((uint8_t)(nLiteral - 1));
+				out.insert(out.end(), (const uint8_t*)&p[i], (const uint8_t*)&p[i + nLiteral]);
+				i += nLiteral;
+			}
+		}
+
+
+
+		bool WriteHeader() {
+			if (m_config.format == CaptureFormat::Y4M) {
+				return std::fprintf(m_pFile, "YUV4MPEG2 W%d H%d F%u:1 Ip A1:1 C444 XCOLORRANGE=FULL\n",
+					m_nWidth, m_nHeight, std::max(1u, m_config.nFrameRate)) > 0;
+			}
+			if (m_config.format == CaptureFormat::NATIVE) {
+				CaptureFileHeader header = {};
+				std::memcpy(header.sMagic, "TPXV", 4);
+				header.nVersion = CAPTURE_VERSION;
+				header.nTileSize = (uint16_t)CAPTURE_TILE_SIZE;
+				header.nWidth = (uint32_t)m_nWidth;
+				header.nHeight = (uint32_t)m_nHeight;
+				return std::fwrite(&header, sizeof(header), 1, m_pFile) == 1;
+			}
+			return true;
+		}
+
+
+
+		bool EncodePPM(const uint8_t* pFrame, uint32_t nFrame) {
+			m_rows.resize((size_t)m_nWidth * m_nHeight * 3);
+
+			m_pPool->ParallelFor(m_bands.size(), [&](size_t nBand) {
+				Band& band = m_bands[nBand];
+				band.tile.resize(m_nWidth);
+				int y0 = (int)(m_nHeight * nBand / m_bands.size());
+				int y1 = (int)(m_nHeight * (nBand + 1) / m_bands.size());
+				for (int y = y0; y < y1; y++) {
+					DecodeRow(m_format, pFrame + y * m_nPitch, band.tile.data(), m_nWidth);
+					uint8_t* pDst = &m_rows[(size_t)y * m_nWidth * 3];
+					for (int x = 0; x < m_nWidth; x++) {
+						pDst[x * 3 + 0] = band.tile[x].r;
+						pDst[x * 3 + 1] = band.tile[x].g;
+						pDst[x * 3 + 2] = band.tile[x].b;
+					}
+				}
+			});
+
+			// The path is never used as a format, a stray % in it stays as it is
+			char sNumber[16];
+			std::snprintf(sNumber, sizeof(sNumber), "%u", nFrame);
+			std::string sPath = m_config.sPath;
+			size_t nAt = sPath.find("%d");
+			if (nAt != std::string::npos)
+				sPath.replace(nAt, 2, sNumber);
+			else
+				sPath += sNumber;
+
+			FILE* pFile = std::fopen(sPath.c_str(), "wb");
+			if (!pFile)
+				return false;
+			bool bOk = std::fprintf(pFile, "P6\n%d %d\n255\n", m_nWidth, m_nHeight) > 0
+				&& std::fwrite(m_rows.data(), 1, m_rows.size(), pFile) == m_rows.size();
+			return std::fclose(pFile) == 0 && bOk;
+		}
+
+
+
+		bool EncodeY4M(const uint8_t* pFrame) {
+			size_t nPlane = (size_t)m_nWidth * m_nHeight;
+			m_rows.resize(nPlane * 3);
+
+			m_pPool->ParallelFor(m_bands.size(), [&](size_t nBand) {
+				Band& band = m_bands[nBand];
+				band.tile.resize(m_nWidth);
+				int y0 = (int)(m_nHeight * nBand / m_bands.size());
+				int y1 = (int)(m_nHeight * (nBand + 1) / m_bands.size());
+				for (int y = y0; y < y1; y++) {
+					DecodeRow(m_format, pFrame + y * m_nPitch, band.tile.data(), m_nWidth);
+					uint8_t* pY = &m_rows[(size_t)y * m_nWidth];
+					uint8_t* pU = pY + nPlane;
+					uint8_t* pV = pU + nPlane;
+					for (int x = 0; x < m_nWidth; x++) {
+						int r = band.tile[x].r, g = band.tile[x].g, b = band.tile[x].b;
+						pY[x] = (uint8_t)((77 * r + 150 * g + 29 * b + 128) >> 8);
+						pU[x] = (uint8_t)std::min(255, std::max(0, ((-43 * r - 85 * g + 128 * b + 128) >> 8) + 128));
+						pV[x] = (uint8_t)std::min(255, std::max(0, ((128 * r - 107 * g - 21 * b + 128) >> 8) + 128));
+					}
+				}
+			});
+
+			return std::fwrite("FRAME\n", 1, 6, m_pFile) == 6
+				&& std::fwrite(m_rows.data(), 1, m_rows.size(), m_pFile) == m_rows.size();
+		}
+
+
+
+		// Tiles flagged as changed are compared against the previous frame and
+		// written only if they differ. Each band is one row of tiles.
+		bool EncodeNative(const uint8_t* pFrame, const uint8_t* pTiles, uint32_t nFrame) {
+			bool bKeyframe = m_nEncodedFrames == 0
+				|| (m_config.nKeyframeInterval && m_nEncodedFrames % m_config.nKeyframeInterval == 0);
+
+			m_pPool->ParallelFor((size_t)m_nTilesY, [&](size_t ty) {
+				Band& band = m_bands[ty];
+				band.out.clear();
+				band.nTiles = 0;
+				band.tile.resize((size_t)CAPTURE_TILE_SIZE * CAPTURE_TILE_SIZE);
+
+				int y0 = (int)ty * CAPTURE_TILE_SIZE;
+				int h = std::min(CAPTURE_TILE_SIZE, m_nHeight - y0);
+
+				for (int tx = 0; tx < m_nTilesX; tx++) {
+					size_t nTile = ty * m_nTilesX + tx;
+					if (!bKeyframe && !pTiles[nTile])
+						continue;
+
+					int x0 = tx * CAPTURE_TILE_SIZE;
+					int w = std::min(CAPTURE_TILE_SIZE, m_nWidth - x0);
+
+					bool bChanged = bKeyframe;
+					for (int y = 0; y < h; y++) {
+						Pixel* pRow = &band.tile[(size_t)y * w];
+						DecodeRow(m_format, pFrame + (y0 + y) * m_nPitch + x0 * TexelSize(m_format), pRow, w);
+						Pixel* pPrev = &m_previous[(size_t)(y0 + y) * m_nWidth + x0];
+						if (!bChanged && std::memcmp(pRow, pPrev, (size_t)w * sizeof(Pixel)) != 0)
+							bChanged = true;
+					}
+					if (!bChanged)
+						continue;
+
+					for (int y = 0; y < h; y++)
+						std::memcpy(&m_previous[(size_t)(y0 + y) * m_nWidth + x0], &band.tile[(size_t)y * w], (size_t)w * sizeof(Pixel));
+
+					AppendU32(band.out, (uint32_t)nTile);
+					size_t nSizeAt = band.out.size();
+					AppendU32(band.out, 0);
+					EncodeRLE(band.tile.data(), (size_t)w * h, band.out);
+
+					uint32_t nBytes = (uint32_t)(band.out.size() - nSizeAt - 4);
+					std::memcpy(&band.out[nSizeAt], &nBytes, 4);
+					band.nTiles++;
+				}
+			});
+
+			uint32_t nTiles = 0;
+			for (int ty = 0; ty < m_nTilesY; ty++)
+				nTiles += m_bands[ty].nTiles;
+
+			bool bOk = std::fwrite(&nFrame, 4, 1, m_pFile) == 1 && std::fwrite(&nTiles, 4, 1, m_pFile) == 1;
+			for (int ty = 0; ty < m_nTilesY && bOk; ty++) {
+				const std::vector<uint8_t>& out = m_bands[ty].out;
+				bOk = out.empty() || std::fwrite(out.data(), 1, out.size(), m_pFile) == out.size();
+			}
+			return bOk;
+		}
+
+
+
+		bool Encode(const uint8_t* pFrame, const uint8_t* pTiles, uint32_t nFrame) {
+			switch (m_config.format) {
+			case CaptureFormat::PPM:    return EncodePPM(pFrame, nFrame);
+			case CaptureFormat::Y4M:    return EncodeY4M(pFrame);
+			case CaptureFormat::NATIVE: return EncodeNative(pFrame, pTiles, nFrame);
+			}
+			return false;
+		}
+
+
+
+		void EncoderMain() {
+			for (;;) {
+				Entry entry;
+				{
+					std::unique_lock<std::mutex> lock(m_mutex);
+					m_cvQueued.wait(lock, [&] { return m_bQuit || !m_queue.empty(); });
+					if (m_queue.empty())
+						break;
+					entry = m_queue.front();
+				}
+
+				const uint8_t* pFrame;
+				const uint8_t* pTiles;
+				bool bOk = true;
+
+				if (entry.nSlot >= 0) {
+					pFrame = m_slots[entry.nSlot].data();
+					pTiles = m_slotTiles[entry.nSlot].data();
+				}
+				else {
+					std::lock_guard<std::mutex> lock(m_spillMutex);
+					bOk = Seek(m_pSpill, entry.nSpillOffset)
+						&& std::fread(m_spillFrame.data(), 1, m_spillFrame.size(), m_pSpill) == m_spillFrame.size()
+						&& std::fread(m_spillTiles.data(), 1, m_spillTiles.size(), m_pSpill) == m_spillTiles.size();
+					pFrame = m_spillFrame.data();
+					pTiles = m_spillTiles.data();
+				}
+
+				bOk = bOk && Encode(pFrame, pTiles, entry.nFrame);
+				m_nEncodedFrames++;
+
+				{
+					std::lock_guard<std::mutex> lock(m_mutex);
+					m_queue.pop_front();
+					if (entry.nSlot >= 0)
+						m_freeSlots.push_back(entry.nSlot);
+					else
+						m_nSpilledQueued--;
+					m_bFailed |= !bOk;
+				}
+				m_nEncoded.fetch_add(1, std::memory_order_relaxed);
+				m_cvFree.notify_all();
+			}
+		}
+
+
+
+		// Sizes the queue after the first frame and starts the encoder
+		bool Start(const FramebufferBase& frame) {
+			m_nWidth = frame.ScreenWidth();
+			m_nHeight = frame.ScreenHeight();
+			m_format = frame.Format();
+			m_nPitch = frame.PitchBytes();
+			m_nFrameBytes = frame.SizeBytes();
+			m_nTilesX = frame.DirtyTilesX();
+			m_nTilesY = frame.DirtyTilesY();
+			size_t nTiles = (size_t)m_nTilesX * m_nTilesY;
+
+			if (m_config.format != CaptureFormat::PPM) {
+				m_pFile = std::fopen(m_config.sPath.c_str(), "wb");
+				if (!m_pFile || !WriteHeader())
+					return false;
+			}
+
+			unsigned nSlots = std::max(1u, m_config.nQueueFrames);
+			m_slots.assign(nSlots, std::vector<uint8_t>(m_nFrameBytes));
+			m_slotTiles.assign(nSlots, std::vector<uint8_t>(nTiles));
+			m_freeSlots.clear();
+			for (unsigned i = nSlots; i-- > 0;)
+				m_freeSlots.push_back((int)i);
+
+			m_changedTiles.assign(nTiles, 1);
+			m_previous.assign((size_t)m_nWidth * m_nHeight, Pixel(0, 0, 0, 0));
+
+			m_pPool.reset(new ThreadPool(m_config.nThreads));
+			size_t nBands = m_config.format == CaptureFormat::NATIVE ? (size_t)m_nTilesY
+				: std::min((size_t)m_nHeight, (size_t)m_pPool->ThreadCount() * 4);
+			m_bands.resize(std::max((size_t)1, nBands));
+
+			m_encoder = std::thread(&FrameCapture::EncoderMain, this);
+			return true;
+		}
+
+
+
+		// Appends a frame to the spill file, false if the disk write fails
+		bool Spill(const FramebufferBase& frame, uint64_t& nOffset) {
+			std::lock_guard<std::mutex> lock(m_spillMutex);
+			if (!m_pSpill) {
+				m_pSpill = std::tmpfile();
+				if (!m_pSpill)
+					return false;
+				m_spillFrame.resize(m_nFrameBytes);
+				m_spillTiles.resize(m_changedTiles.size());
+			}
+
+			nOffset = m_nSpillEnd;
+			if (!Seek(m_pSpill, nOffset)
+				|| std::fwrite(frame.RawData(), 1, m_nFrameBytes, m_pSpill) != m_nFrameBytes
+				|| std::fwrite(m_changedTiles.data(), 1, m_changedTiles.size(), m_pSpill) != m_changedTiles.size())
+				return false;
+
+			m_nSpillEnd += m_nFrameBytes + m_changedTiles.size();
+			return true;
+		}
+
+
+
+	public:
+		FrameCapture() : m_nQueued(0), m_nDropped(0), m_nSpilled(0), m_nEncoded(0) {}
+
+		~FrameCapture() {
+			Close();
+		}
+
+		FrameCapture(const FrameCapture&) = delete;
+		FrameCapture& operator=(const FrameCapture&) = delete;
+
+
+
+		// Nothing is written before the first Capture, which fixes the size and format
+		bool Open(const CaptureConfig& config) {
+			Close();
+
+			if (config.sPath.empty())
+				return false;
+
+			m_config = config;
+			m_bOpen = true;
+			m_bQuit = false;
+			m_bFailed = false;
+			m_nWidth = 0;
+			m_nHeight = 0;
+			m_nFrame = 0;
+			m_nEncodedFrames = 0;
+			m_nSpillEnd = 0;
+			m_nSpilledQueued = 0;
+			m_nQueued = 0;
+			m_nDropped = 0;
+			m_nSpilled = 0;
+			m_nEncoded = 0;
+			return true;
+		}
+
+
+
+		// Encodes every queued frame and closes the output. False if any frame failed to write.
+		bool Close() {
+			if (!m_bOpen)
+				return !m_bFailed;
+
+			if (m_encoder.joinable()) {
+				{
+					std::lock_guard<std::mutex> lock(m_mutex);
+					m_bQuit = true;
+				}
+				m_cvQueued.notify_one();
+				m_encoder.join();
+			}
+			m_pPool.reset();
+
+			bool bOk = !m_bFailed;
+			if (m_pFile)
+				bOk &= std::fclose(m_pFile) == 0;
+			if (m_pSpill)
+				std::fclose(m_pSpill);
+			m_pFile = nullptr;
+			m_pSpill = nullptr;
+			m_bOpen = false;
+
+			m_slots.clear();
+			m_slotTiles.clear();
+			m_queue.clear();
+			return bOk;
+		}
+
+
+
+		bool IsOpen() const {
+			return m_bOpen;
+		}
+
+
+
+		// Queues a copy of the frame, call after the frame is finished and before
+		// its dirty tiles are cleared. Returns false if the frame was dropped.
+		// Frames with a different size or format than the first one are dropped.
+		bool Capture(const FramebufferBase& frame) {
+			if (!m_bOpen)
+				return false;
+
+			uint32_t nFrame = m_nFrame++;
+
+			if (m_nWidth == 0) {
+				if (!Start(frame)) {
+					m_bFailed = true;
+					Close();
+					return false;
+				}
+			}
+			else if (frame.ScreenWidth() != m_nWidth || frame.ScreenHeight() != m_nHeight || frame.Format() != m_format
+				|| frame.SizeBytes() != m_nFrameBytes) {
+				m_nDropped++;
+				return false;
+			}
+
+			const uint8_t* pDirty = frame.DirtyTiles();
+			for (size_t i = 0; i < m_changedTiles.size(); i++)
+				m_changedTiles[i] |= pDirty[i];
+
+			int nSlot = -1;
+			{
+				std::unique_lock<std::mutex> lock(m_mutex);
+				if (m_freeSlots.empty() && m_config.pressure == CapturePressure::BLOCK)
+					m_cvFree.wait(lock, [&] { return !m_freeSlots.empty(); });
+
+				// Once frames are spilled, later ones follow them through the file to stay in order
+				if (!m_freeSlots.empty() && m_nSpilledQueued == 0) {
+					nSlot = m_freeSlots.back();
+					m_freeSlots.pop_back();
+				}
+				else if (m_config.pressure != CapturePressure::SPILL) {
+					m_nDropped++;
+					return false;
+				}
+				else if (m_nSpilledQueued == 0) {
+					m_nSpillEnd = 0;
+				}
+			}
+
+			Entry entry = { nSlot, 0, nFrame };
+			if (nSlot >= 0) {
+				std::memcpy(m_slots[nSlot].data(), frame.RawData(), m_nFrameBytes);
+				std::memcpy(m_slotTiles[nSlot].data(), m_changedTiles.data(), m_changedTiles.size());
+			}
+			else if (!Spill(frame, entry.nSpillOffset)) {
+				m_nDropped++;
+				return false;
+			}
+			std::fill(m_changedTiles.begin(), m_changedTiles.end(), (uint8_t)0);
+
+			{
+				std::lock_guard<std::mutex> lock(m_mutex);
+				m_queue.push_back(entry);
+				if (nSlot < 0)
+					m_nSpilledQueued++;
+			}
+			m_cvQueued.notify_one();
+
+			m_nQueued++;
+			if (nSlot < 0)
+				m_nSpilled++;
+			return true;
+		}
+
+
+
+		// Blocks until every queued frame is written
+		void Flush() {
+			std::unique_lock<std::mutex> lock(m_mutex);
+			m_cvFree.wait(lock, [&] { return m_queue.empty(); });
+			if (m_pFile)
+				std::fflush(m_pFile);
+		}
+
+
+
+		// Frames accepted by Capture, including spilled ones
+		uint64_t Queued() const {
+			return m_nQueued.load(std::memory_order_relaxed);
+		}
+		uint64_t Dropped() const {
+			return m_nDropped.load(std::memory_order_relaxed);
+		}
+		uint64_t Spilled() const {
+			return m_nSpilled.load(std::memory_order_relaxed);
+		}
+		uint64_t Encoded() const {
+			return m_nEncoded.load(std::memory_order_relaxed);
+		}
+	};
+
+
+
+	//===== CAPTURE READER =====//
+
+	// Decodes a NATIVE capture frame by frame into an RGBA8 canvas
+	class CaptureReader {
+
+	private:
+		MappedFile  m_file;
+		CaptureFileHeader m_header = {};
+		size_t      m_nCursor = 0;
+		uint32_t    m_nFrame = 0;
+		std::vector<Pixel> m_canvas;
+		std::vector<Pixel> m_tile;
+
+
+	private:
+		static bool DecodeRLE(const uint8_t* p, size_t nBytes, Pixel* pDst, size_t nCount) {
+			size_t i = 0;
+			const uint8_t* pEnd = p + nBytes;
+			while (p < pEnd) {
+				uint8_t c = *p++;
+				if (c >= 128) {
+					size_t nRun = (size_t)c - 127;
+					if (pEnd - p < 4 || i + nRun > nCount)
+						return false;
+					Pixel px(p[0], p[1], p[2], p[3]);
+					p += 4;
+					for (size_t k = 0; k < nRun; k++)
+						pDst[i++] = px;
+				}
+				else {
+					size_t nLiteral = (size_t)c + 1;
+					if ((size_t)(pEnd - p) < nLiteral * 4 || i + nLiteral > nCount)
+						return false;
+					std::memcpy(&pDst[i], p, nLiteral * 4);
+					p += nLiteral * 4;
+					i += nLiteral;
+				}
+			}
+			return i == nCount;
+		}
+
+
+
+	public:
+		// False unless the header is sane and the file is large enough for the first
+		// frame, which lists every tile: a record per tile, and at least 5 bytes
+		// (one run) per 128 pixels. Nothing is allocated before that is checked.
+		bool Open(const char* sPath) {
+			if (!m_file.Open(sPath) || m_file.Size() < sizeof(CaptureFileHeader))
+				return false;
+
+			std::memcpy(&m_header, m_file.Data(), sizeof(m_header));
+			bool bValid = std::memcmp(m_header.sMagic, "TPXV", 4) == 0 && m_header.nVersion == CAPTURE_VERSION
+				&& m_header.nTileSize > 0 && m_header.nTileSize <= CAPTURE_MAX_TILE_SIZE
+				&& m_header.nWidth > 0 && m_header.nWidth <= CAPTURE_MAX_SIZE
+				&& m_header.nHeight > 0 && m_header.nHeight <= CAPTURE_MAX_SIZE;
+
+			if (bValid) {
+				uint64_t nPixels = (uint64_t)m_header.nWidth * m_header.nHeight;
+				uint64_t nTiles = (uint64_t)((m_header.nWidth + m_header.nTileSize - 1) / m_header.nTileSize)
+					* ((m_header.nHeight + m_header.nTileSize - 1) / m_header.nTileSize);
+				uint64_t nFirstFrame = 8 + nTiles * 8 + (nPixels + 127) / 128 * 5;
+				bValid = nFirstFrame <= m_file.Size() - sizeof(CaptureFileHeader);
+			}
+
+			if (!bValid) {
+				m_file.Close();
+				return false;
+			}
+
+			m_nCursor = sizeof(CaptureFileHeader);
+			m_canvas.assign((size_t)m_header.nWidth * m_header.nHeight, Pixel(0, 0, 0, 0));
+			m_tile.resize((size_t)m_header.nTileSize * m_header.nTileSize);
+			return true;
+		}
+
+
+
+		// Applies the next frame's tiles to the canvas, false at the end or on a damaged record
+		bool Next() {
+			const uint8_t* p = m_file.Data();
+			size_t nSize = m_file.Size();
+			size_t n = m_nCursor;
+			if (!p || n + 8 > nSize)
+				return false;
+
+			uint32_t nTiles;
+			std::memcpy(&m_nFrame, p + n, 4);
+			std::memcpy(&nTiles, p + n + 4, 4);
+			n += 8;
+
+			// Open bounded every size, the products are still taken in size_t
+			int nTile = (int)m_header.nTileSize;
+			int w = (int)m_header.nWidth;
+			int h = (int)m_header.nHeight;
+			size_t nTilesX = ((size_t)w + nTile - 1) / nTile;
+			size_t nTilesY = ((size_t)h + nTile - 1) / nTile;
+
+			for (uint32_t i = 0; i < nTiles; i++) {
+				if (n + 8 > nSize)
+					return false;
+				uint32_t nIndex, nBytes;
+				std::memcpy(&nIndex, p + n, 4);
+				std::memcpy(&nBytes, p + n + 4, 4);
+				n += 8;
+				if ((size_t)nIndex >= nTilesX * nTilesY || nBytes > nSize - n)
+					return false;
+
+				int x0 = (int)(nIndex % nTilesX) * nTile;
+				int y0 = (int)(nIndex / nTilesX) * nTile;
+				int tw = std::min(nTile, w - x0);
+				int th = std::min(nTile, h - y0);
+				if (!DecodeRLE(p + n, nBytes, m_tile.data(), (size_t)tw * th))
+					return false;
+				n += nBytes;
+
+				for (int y = 0; y < th; y++)
+					std::memcpy(&m_canvas[(size_t)(y0 + y) * w + x0], &m_tile[(size_t)y * tw], (size_t)tw * sizeof(Pixel));
+			}
+
+			m_nCursor = n;
+			return true;
+		}
+
+
+
+		// Capture index of the frame last read by Next
+		uint32_t FrameIndex() const {
+			return m_nFrame;
+		}
+
+
+
+		// Width() * Height() RGBA8 pixels of the current frame
+		const Pixel* Pixels() const {
+			return m_canvas.data();
+		}
+
+
+
+		int Width() const {
+			return (int)m_header.nWidth;
+		}
+
+
+
+		int Height() const {
+			return (int)m_header.nHeight;
+		}
+	};
+
+}
@@ -0,0 +1,268 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <vector>
+
+#include "THPXTypes.h"
+#include "THPXBlend.h"
+
+
+namespace THPX {
+
+	//===== COMMAND LIST =====//
+
+	// One recorded draw call. Fixed size, variable length vertex data
+	// (triangles, quads) lives in the command list's vertex array.
+	struct Command {
+		enum Type : uint8_t {
+			CLEAR, PIXEL, LINE, RECT, TRIANGLE, QUAD
+		};
+
+		uint8_t     nType;
+		BlendMode   blend;
+		Pixel       p;
+
+		// PIXEL: x, y. LINE: x0, y0, x1, y1. RECT: inclusive x0, y0, x1, y1.
+		// TRIANGLE, QUAD: index of the first vertex in a[0].
+		int32_t     a[4];
+	};
+
+
+
+	// Records draw calls with the same signatures as Framebuffer instead of
+	// running them, so they can be binned and rasterized later.
+	class CommandList {
+
+	private:
+		std::vector<Command> m_commands;
+		std::vector<Vec2D> m_vertices;
+
+		// Recorded into every command pushed from now on
+		BlendMode   m_blendMode = BlendMode::NONE;
+
+
+	private:
+		void Push(uint8_t nType, Pixel p, int32_t a0 = 0, int32_t a1 = 0, int32_t a2 = 0, int32_t a3 = 0) {
+			Command cmd;
+			cmd.nType = nType;
+			cmd.blend = m_blendMode;
+			cmd.p = p;
+			cmd.a[0] = a0;
+			cmd.a[1] = a1;
+			cmd.a[2] = a2;
+			cmd.a[3] = a3;
+			m_commands.push_back(cmd);
+		}
+
+
+
+	public:
+		// Drops all commands, keeps the memory for the next frame
+		void Reset() {
+			m_commands.clear();
+			m_vertices.clear();
+		}
+
+
+
+		// Blend mode of the following commands, the list's own state independent of the framebuffer's
+		void SetBlendMode(BlendMode blend) {
+			m_blendMode = blend;
+		}
+
+
+
+		BlendMode GetBlendMode() const {
+			return m_blendMode;
+		}
+
+
+
+		void Reserve(size_t nCommands, size_t nVertices = 0) {
+			m_commands.reserve(nCommands);
+			m_vertices.reserve(nVertices);
+		}
+
+
+
+		bool Empty() const {
+			return m_commands.empty();
+		}
+
+
+
+		size_t Size() const {
+			return m_commands.size();
+		}
+
+
+
+		const Command* Commands() const {
+			return m_commands.data();
+		}
+
+
+
+		const Vec2D* Vertices() const {
+			return m_vertices.data();
+		}
+
+
+
+		size_t VertexCount() const {
+			return m_vertices.size();
+		}
+
+
+
+		// False if a command has an unknown type or blend mode, or uses vertices
+		// past nVertices. Recorded commands are checked with it before they are run.
+		static bool Validate(const Command* pCommands, size_t nCommands, size_t nVertices) {
+			for (size_t i = 0; i < nCommands; i++) {
+				const Command& cmd = pCommands[i];
+				uint8_t nBlend;
+				std::memcpy(&nBlend, &cmd.blend, 1);
+				if (cmd.nType > Command::QUAD || nBlend > (uint8_t)BlendMode::PREMULTIPLIED)
+					return false;
+
+				if (cmd.nType == Command::TRIANGLE || cmd.nType == Command::QUAD) {
+					size_t nCorners = cmd.nType == Command::TRIANGLE ? 3 : 4;
+					if (cmd.a[0] < 0 || (size_t)cmd.a[0] > nVertices || nVertices - (size_t)cmd.a[0] < nCorners)
+						return false;
+				}
+			}
+			return true;
+		}
+
+
+
+		// Replaces the list with recorded commands, e.g. from a frame log
+		void Assign(const Command* pCommands, size_t nCommands, const Vec2D* pVertices, size_t nVertices) {
+			m_commands.assign(pCommands, pCommands + nCommands);
+			m_vertices.assign(pVertices, pVertices + nVertices);
+		}
+
+
+
+		// Same commands and vertices, compared field by field since Command has padding
+		bool Equals(const Command* pCommands, size_t nCommands, const Vec2D* pVertices, size_t nVertices) const {
+			if (nCommands != m_commands.size() || nVertices != m_vertices.size())
+				return false;
+
+			for (size_t i = 0; i < nCommands; i++) {
+				const Command& a = m_commands[i];
+				const Command& b = pCommands[i];
+				if (a.nType != b.nType || a.blend != b.blend || a.p.r != b.p.r || a.p.g != b.p.g || a.p.b != b.p.b || a.p.a != b.p.a
+					|| std::memcmp(a.a, b.a, sizeof(a.a)) != 0)
+					return false;
+			}
+			for (size_t i = 0; i < nVertices; i++) {
+				if (m_vertices[i].x != pVertices[i].x || m_vertices[i].y != pVertices[i].y)
+					return false;
+			}
+			return true;
+		}
+
+
+
+		void Clear(Pixel clearPixel) {
+			Push(Command::CLEAR, clearPixel);
+		}
+
+
+
+		void DrawPixel(int x, int y, uint8_t r, uint8_t g, uint8_t b) {
+			Push(Command::PIXEL, Pixel(r, g, b), x, y);
+		}
+		void DrawPixel(int x, int y, Pixel p) {
+			Push(Command::PIXEL, p, x, y);
+		}
+
+
+
+		void DrawLine(int x0, int y0, int x1, int y1, uint8_t r, uint8_t g, uint8_t b) {
+			Push(Command::LINE, Pixel(r, g, b), x0, y0, x1, y1);
+		}
+		void DrawLine(int x0, int y0, int x1, int y1, Pixel p) {
+			Push(Command::LINE, p, x0, y0, x1, y1);
+		}
+
+
+
+		void DrawLines(const Line* pLines, size_t nCount) {
+			for (size_t i = 0; i < nCount; i++) {
+				Push(Command::LINE, pLines[i].p, pLines[i].p0.x, pLines[i].p0.y, pLines[i].p1.x, pLines[i].p1.y);
+			}
+		}
+		void DrawLines(const std::vector<Line>& lines) {
+			DrawLines(lines.data(), lines.size());
+		}
+
+
+
+		void FillRectangle(int x, int y, int width, int height, uint8_t r, uint8_t g, uint8_t b) {
+			Push(Command::RECT, Pixel(r, g, b), x, y, x + width, y + height);
+		}
+		void FillRectangle(Vec2D position, int width, int height, uint8_t r, uint8_t g, uint8_t b) {
+			Push(Command::RECT, Pixel(r, g, b), position.x, position.y, position.x + width, position.y + height);
+		}
+		void FillRectangle(int x, int y, int width, int height, Pixel p) {
+			Push(Command::RECT, p, x, y, x + width, y + height);
+		}
+		void FillRectangle(Vec2D position, int width, int height, Pixel p) {
+			Push(Command::RECT, p, position.x, position.y, position.x + width, position.y + height);
+		}
+		void FillRectangle(Vec2D v0, Vec2D v1, Vec2D v2, Vec2D v3, Pixel p) {
+			Push(Command::QUAD, p, (int32_t)m_vertices.size());
+			m_vertices.push_back(v0);
+			m_vertices.push_back(v1);
+			m_vertices.push_back(v2);
+			m_vertices.push_back(v3);
+		}
+
+
+
+		void FillTriangle(Vec2D p0, Vec2D p1, Vec2D p2, uint8_t r, uint8_t g, uint8_t b) {
+			FillTriangle(p0, p1, p2, Pixel(r, g, b));
+		}
+		void FillTriangle(Vec2D p0, Vec2D p1, Vec2D p2, THPX::Pixel p) {
+			Push(Command::TRIANGLE, p, (int32_t)m_vertices.size());
+			m_vertices.push_back(p0);
+			m_vertices.push_back(p1);
+			m_vertices.push_back(p2);
+		}
+
+
+
+		// Batched forms of FillRectangle and FillTriangle, grow the arrays once per batch
+		void FillRects(const Rect* pRects, size_t nCount, Pixel p) {
+			m_commands.reserve(m_commands.size() + nCount);
+			for (size_t i = 0; i < nCount; i++)
+				Push(Command::RECT, p, pRects[i].x0, pRects[i].y0, pRects[i].x1, pRects[i].y1);
+		}
+		void FillRects(const std::vector<Rect>& rects, Pixel p) {
+			FillRects(rects.data(), rects.size(), p);
+		}
+
+
+
+		void FillTriangles(const Vec2D* pVertices, const uint32_t* pIndices, size_t nTriangles, Pixel p) {
+			m_commands.reserve(m_commands.size() + nTriangles);
+			m_vertices.reserve(m_vertices.size() + 3 * nTriangles);
+			for (size_t i = 0; i < 3 * nTriangles; i += 3) {
+				Push(Command::TRIANGLE, p, (int32_t)m_vertices.size());
+				for (size_t k = 0; k < 3; k++)
+					m_vertices.push_back(pVertices[pIndices ? pIndices[i + k] : i + k]);
+			}
+		}
+		void FillTriangles(const std::vector<Vec2D>& vertices, const std::vector<uint32_t>& indices, Pixel p) {
+			FillTriangles(vertices.data(), indices.data(), indices.size() / 3, p);
+		}
+		void FillTriangles(const std::vector<Vec2D>& vertices, Pixel p) {
+			FillTriangles(vertices.data(), nullptr, vertices.size() / 3, p);
+		}
+	};
+
+}
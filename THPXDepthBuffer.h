@@ -0,0 +1,203 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include <algorithm>
+
+#include "THPXTypes.h"
+
+
+namespace THPX {
+
+	//===== DEPTH BUFFER =====//
+
+	// Storage of one depth value
+	enum class DepthFormat : uint8_t {
+		D16,        // unsigned normalized, half the memory traffic
+		D32         // float
+	};
+
+
+
+	// Software depth buffer for the depth tested triangles of a framebuffer.
+	// Depth runs from 0 (nearest) to 1 (farthest), a pixel is drawn where it is
+	// nearer than the value stored. Values are kept in TILE_SIZE square tiles
+	// with each tile's values contiguous, plus the nearest and farthest value
+	// of every tile, so triangles can reject or accept whole tiles at once.
+	// Clear only resets the tile records; a tile's values are filled in when
+	// a triangle first draws into part of it.
+	class DepthBuffer {
+
+		template<typename> friend class BasicFramebuffer;
+
+	public:
+		static constexpr int TILE_SIZE = 8;
+		static constexpr int TILE_VALUES = TILE_SIZE * TILE_SIZE;
+
+
+	private:
+		DepthFormat m_format = DepthFormat::D32;
+
+		int         m_nWidth = 0;
+		int         m_nHeight = 0;
+		int         m_nTilesX = 0;
+		int         m_nTilesY = 0;
+
+		// Tile after tile, rows of TILE_SIZE values within a tile; one of them is used
+		std::vector<uint16_t> m_values16;
+		std::vector<float> m_values32;
+
+		// Per tile nearest and farthest value in storage units (0..65535 for D16),
+		// and whether the tile's values were never written since the last clear
+		std::vector<float> m_tileMin;
+		std::vector<float> m_tileMax;
+		std::vector<uint8_t> m_tileCleared;
+
+		// Last clear value in storage units
+		float       m_fClear = 1.0f;
+
+		// Triangle tiles skipped as hidden, and written without per pixel tests
+		uint64_t    m_nRejectedTiles = 0;
+		uint64_t    m_nAcceptedTiles = 0;
+
+
+	private:
+		size_t TileIndex(int x, int y) const {
+			return (size_t)(y / TILE_SIZE) * m_nTilesX + (size_t)(x / TILE_SIZE);
+		}
+
+
+
+		// Offset of value (x, y) in the value array
+		size_t ValueIndex(int x, int y) const {
+			return TileIndex(x, y) * TILE_VALUES + (size_t)(y % TILE_SIZE) * TILE_SIZE + (size_t)(x % TILE_SIZE);
+		}
+
+
+
+		// Depth in [0, 1] to storage units
+		float Scale() const {
+			return m_format == DepthFormat::D16 ? 65535.0f : 1.0f;
+		}
+
+
+
+		// Writes the clear value into a tile that is about to be partly drawn
+		template<typename T>
+		void Materialize(size_t nTile, T* pValues) {
+			if (!m_tileCleared[nTile])
+				return;
+			std::fill(pValues + nTile * TILE_VALUES, pValues + (nTile + 1) * TILE_VALUES, (T)m_fClear);
+			m_tileCleared[nTile] = 0;
+		}
+
+
+
+		uint16_t* Values(uint16_t*) {
+			return m_values16.data();
+		}
+		float* Values(float*) {
+			return m_values32.data();
+		}
+
+
+
+	public:
+		DepthBuffer() {}
+
+		DepthBuffer(int nWidth, int nHeight, DepthFormat format = DepthFormat::D32) {
+			Resize(nWidth, nHeight, format);
+		}
+
+
+
+		// Cleared to the far plane
+		void Resize(int nWidth, int nHeight, DepthFormat format) {
+			m_format = format;
+			m_nWidth = std::max(nWidth, 0);
+			m_nHeight = std::max(nHeight, 0);
+			m_nTilesX = (m_nWidth + TILE_SIZE - 1) / TILE_SIZE;
+			m_nTilesY = (m_nHeight + TILE_SIZE - 1) / TILE_SIZE;
+
+			size_t nTiles = (size_t)m_nTilesX * m_nTilesY;
+			m_values16.clear();
+			m_values32.clear();
+			if (format == DepthFormat::D16)
+				m_values16.resize(nTiles * TILE_VALUES);
+			else
+				m_values32.resize(nTiles * TILE_VALUES);
+
+			m_tileMin.resize(nTiles);
+			m_tileMax.resize(nTiles);
+			m_tileCleared.resize(nTiles);
+			Clear();
+		}
+		void Resize(int nWidth, int nHeight) {
+			Resize(nWidth, nHeight, m_format);
+		}
+
+
+
+		// Touches only the tile records, not the values
+		void Clear(float z = 1.0f) {
+			float fScale = Scale();
+			m_fClear = std::min(std::max(z, 0.0f), 1.0f) * fScale;
+			if (m_format == DepthFormat::D16)
+				m_fClear = (float)(uint16_t)(m_fClear + 0.5f);
+
+			std::fill(m_tileMin.begin(), m_tileMin.end(), m_fClear);
+			std::fill(m_tileMax.begin(), m_tileMax.end(), m_fClear);
+			std::fill(m_tileCleared.begin(), m_tileCleared.end(), (uint8_t)1);
+		}
+
+
+
+		// Depth in [0, 1], 1 outside the buffer
+		float GetDepth(int x, int y) const {
+			if (x < 0 || y < 0 || x >= m_nWidth || y >= m_nHeight)
+				return 1.0f;
+
+			size_t nTile = TileIndex(x, y);
+			float fValue = m_tileCleared[nTile] ? m_fClear
+				: m_format == DepthFormat::D16 ? (float)m_values16[ValueIndex(x, y)] : m_values32[ValueIndex(x, y)];
+			return fValue / Scale();
+		}
+
+
+
+		int Width() const {
+			return m_nWidth;
+		}
+
+
+
+		int Height() const {
+			return m_nHeight;
+		}
+
+
+
+		DepthFormat Format() const {
+			return m_format;
+		}
+
+
+
+		// Triangle tiles skipped because everything in them was nearer
+		uint64_t RejectedTiles() const {
+			return m_nRejectedTiles;
+		}
+
+		// Triangle tiles written without testing single pixels
+		uint64_t AcceptedTiles() const {
+			return m_nAcceptedTiles;
+		}
+
+		void ResetStats() {
+			m_nRejectedTiles = 0;
+			m_nAcceptedTiles = 0;
+		}
+	};
+
+}
@@ -0,0 +1,588 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <atomic>
+#include <algorithm>
+
+#include "THPXTypes.h"
+#include "THPXPixelFormat.h"
+#include "THPXSpanKernels.h"
+#include "THPXSprite.h"
+
+
+namespace THPX {
+
+	//===== FONT =====//
+
+	// Monospace bitmap font, one bit per pixel, up to 32 pixels wide.
+	// Every character is a cell of CellWidth() x CellHeight() pixels with the
+	// glyph in its top-left corner, so the cell size is both advance and line height.
+	// The default constructed font is the built-in 5x7 ASCII font in 6x9 cells.
+	class Font {
+
+	public:
+		static constexpr int NUM_GLYPHS = 256;
+
+
+	private:
+		int         m_nCellWidth = 0;
+		int         m_nCellHeight = 0;
+
+		// m_nCellHeight rows per glyph, bit x of a row is column x
+		std::vector<uint32_t> m_rows;
+
+		// Set bit for every glyph with at least one pixel, blank ones are never drawn
+		uint64_t    m_inked[NUM_GLYPHS / 64] = {};
+
+		// Changes whenever the glyphs do, caches key on it instead of the address
+		uint64_t    m_nID = 0;
+
+
+	private:
+		static uint64_t NextID() {
+			static std::atomic<uint64_t> s_nNext(1);
+			return s_nNext++;
+		}
+
+
+
+		void UpdateInked(int c) {
+			bool bInked = false;
+			for (int y = 0; y < m_nCellHeight; y++)
+				bInked |= m_rows[(size_t)c * m_nCellHeight + y] != 0;
+
+			if (bInked)
+				m_inked[c / 64] |= 1ull << (c % 64);
+			else
+				m_inked[c / 64] &= ~(1ull << (c % 64));
+		}
+
+
+
+	public:
+		// Built-in font
+		Font() {
+			// 5x7 glyphs for ' ' to '~', row 7 holds descenders
+			static const uint8_t BUILTIN[95 * 8] = {
+				0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,   // space
+				0x04, 0x04, 0x04, 0x04, 0x04, 0x00, 0x04, 0x00,   // !
+				0x0A, 0x0A, 0x0A, 0x00, 0x00, 0x00, 0x00, 0x00,   // "
+				0x0A, 0x0A, 0x1F, 0x0A, 0x1F, 0x0A, 0x0A, 0x00,   // #
+				0x04, 0x1E, 0x05, 0x0E, 0x14, 0x0F, 0x04, 0x00,   // $
+				0x03, 0x13, 0x08, 0x04, 0x02, 0x19, 0x18, 0x00,   // %
+				0x06, 0x09, 0x05, 0x02, 0x15, 0x09, 0x16, 0x00,   // &
+				0x04, 0x04, 0x02, 0x00, 0x00, 0x00, 0x00, 0x00,   // '
+				0x08, 0x04, 0x02, 0x02, 0x02, 0x04, 0x08, 0x00,   // (
+				0x02, 0x04, 0x08, 0x08, 0x08, 0x04, 0x02, 0x00,   // )
+				0x00, 0x04, 0x15, 0x0E, 0x15, 0x04, 0x00, 0x00,   // *
+				0x00, 0x04, 0x04, 0x1F, 0x04, 0x04, 0x00, 0x00,   // +
+				0x00, 0x00, 0x00, 0x00, 0x06, 0x04, 0x02, 0x00,   // ,
+				0x00, 0x00, 0x00, 0x1F, 0x00, 0x00, 0x00, 0x00,   // -
+				0x00, 0x00, 0x00, 0x00, 0x00, 0x06, 0x06, 0x00,   // .
+				0x00, 0x10, 0x08, 0x04, 0x02, 0x01, 0x00, 0x00,   // /
+				0x0E, 0x11, 0x19, 0x15, 0x13, 0x11, 0x0E, 0x00,   // 0
+				0x04, 0x06, 0x04, 0x04, 0x04, 0x04, 0x0E, 0x00,   // 1
+				0x0E, 0x11, 0x10, 0x08, 0x04, 0x02, 0x1F, 0x00,   // 2
+				0x1F, 0x08, 0x04, 0x08, 0x10, 0x11, 0x0E, 0x00,   // 3
+				0x08, 0x0C, 0x0A, 0x09, 0x1F, 0x08, 0x08, 0x00,   // 4
+				0x1F, 0x01, 0x0F, 0x10, 0x10, 0x11, 0x0E, 0x00,   // 5
+				0x0C, 0x02, 0x01, 0x0F, 0x11, 0x11, 0x0E, 0x00,   // 6
+				0x1F, 0x10, 0x08, 0x04, 0x02, 0x02, 0x02, 0x00,   // 7
+				0x0E, 0x11, 0x11, 0x0E, 0x11, 0x11, 0x0E, 0x00,   // 8
+				0x0E, 0x11, 0x11, 0x1E, 0x10, 0x08, 0x06, 0x00,   // 9
+				0x00, 0x06, 0x06, 0x00, 0x06, 0x06, 0x00, 0x00,   // :
+				0x00, 0x06, 0x06, 0x00, 0x06, 0x04, 0x02, 0x00,   // ;
+				0x08, 0x04, 0x02, 0x01, 0x02, 0x04, 0x08, 0x00,   // <
+				0x00, 0x00, 0x1F, 0x00, 0x1F, 0x00, 0x00, 0x00,   // =
+				0x02, 0x04, 0x08, 0x10, 0x08, 0x04, 0x02, 0x00,   // >
+				0x0E, 0x11, 0x10, 0x08, 0x04, 0x00, 0x04, 0x00,   // ?
+				0x0E, 0x11, 0x10, 0x16, 0x15, 0x15, 0x0E, 0x00,   // @
+				0x0E, 0x11, 0x11, 0x1F, 0x11, 0x11, 0x11, 0x00,   // A
+				0x0F, 0x11, 0x11, 0x0F, 0x11, 0x11, 0x0F, 0x00,   // B
+				0x0E, 0x11, 0x01, 0x01, 0x01, 0x11, 0x0E, 0x00,   // C
+				0x07, 0x09, 0x11, 0x11, 0x11, 0x09, 0x07, 0x00,   // D
+				0x1F, 0x01, 0x01, 0x0F, 0x01, 0x01, 0x1F, 0x00,   // E
+				0x1F, 0x01, 0x01, 0x0F, 0x01, 0x01, 0x01, 0x00,   // F
+				0x0E, 0x11, 0x01, 0x1D, 0x11, 0x11, 0x1E, 0x00,   // G
+				0x11, 0x11, 0x11, 0x1F, 0x11, 0x11, 0x11, 0x00,   // H
+				0x0E, 0x04, 0x04, 0x04, 0x04, 0x04, 0x0E, 0x00,   // I
+				0x1C, 0x08, 0x08, 0x08, 0x08, 0x09, 0x06, 0x00,   // J
+				0x11, 0x09, 0x05, 0x03, 0x05, 0x09, 0x11, 0x00,   // K
+				0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x1F, 0x00,   // L
+				0x11, 0x1B, 0x15, 0x15, 0x11, 0x11, 0x11, 0x00,   // M
+				0x11, 0x11, 0x13, 0x15, 0x19, 0x11, 0x11, 0x00,   // N
+				0x0E, 0x11, 0x11, 0x11, 0x11, 0x11, 0x0E, 0x00,   // O
+				0x0F, 0x11, 0x11, 0x0F, 0x01, 0x01, 0x01, 0x00,   // P
+				0x0E, 0x11, 0x11, 0x11, 0x15, 0x09, 0x16, 0x00,   // Q
+				0x0F, 0x11, 0x11, 0x0F, 0x05, 0x09, 0x11, 0x00,   // R
+				0x1E, 0x01, 0x01, 0x0E, 0x10, 0x10, 0x0F, 0x00,   // S
+				0x1F, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x00,   // T
+				0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x0E, 0x00,   // U
+				0x11, 0x11, 0x11, 0x11, 0x11, 0x0A, 0x04, 0x00,   // V
+				0x11, 0x11, 0x11, 0x15, 0x15, 0x15, 0x0A, 0x00,   // W
+				0x11, 0x11, 0x0A, 0x04, 0x0A, 0x11, 0x11, 0x00,   // X
+				0x11, 0x11, 0x11, 0x0A, 0x04, 0x04, 0x04, 0x00,   // Y
+				0x1F, 0x10, 0x08, 0x04, 0x02, 0x01, 0x1F, 0x00,   // Z
+				0x0E, 0x02, 0x02, 0x02, 0x02, 0x02, 0x0E, 0x00,   // [
+				0x00, 0x01, 0x02, 0x04, 0x08, 0x10, 0x00, 0x00,   // backslash
+				0x0E, 0x08, 0x08, 0x08, 0x08, 0x08, 0x0E, 0x00,   // ]
+				0x04, 0x0A, 0x11, 0x00, 0x00, 0x00, 0x00, 0x00,   // ^
+				0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x1F, 0x00,   // _
+				0x02, 0x04, 0x08, 0x00, 0x00, 0x00, 0x00, 0x00,   // `
+				0x00, 0x00, 0x0E, 0x10, 0x1E, 0x11, 0x1E, 0x00,   // a
+				0x01, 0x01, 0x0D, 0x13, 0x11, 0x11, 0x0F, 0x00,   // b
+				0x00, 0x00, 0x0E, 0x01, 0x01, 0x11, 0x0E, 0x00,   // c
+				0x10, 0x10, 0x16, 0x19, 0x11, 0x11, 0x1E, 0x00,   // d
+				0x00, 0x00, 0x0E, 0x11, 0x1F, 0x01, 0x0E, 0x00,   // e
+				0x0C, 0x12, 0x02, 0x07, 0x02, 0x02, 0x02, 0x00,   // f
+				0x00, 0x00, 0x1E, 0x11, 0x11, 0x1E, 0x10, 0x0E,   // g
+				0x01, 0x01, 0x0D, 0x13, 0x11, 0x11, 0x11, 0x00,   // h
+				0x04, 0x00, 0x06, 0x04, 0x04, 0x04, 0x0E, 0x00,   // i
+				0x08, 0x00, 0x0C, 0x08, 0x08, 0x08, 0x09, 0x06,   // j
+				0x01, 0x01, 0x09, 0x05, 0x03, 0x05, 0x09, 0x00,   // k
+				0x06, 0x04, 0x04, 0x04, 0x04, 0x04, 0x0E, 0x00,   // l
+				0x00, 0x00, 0x0B, 0x15, 0x15, 0x11, 0x11, 0x00,   // m
+				0x00, 0x00, 0x0D, 0x13, 0x11, 0x11, 0x11, 0x00,   // n
+				0x00, 0x00, 0x0E, 0x11, 0x11, 0x11, 0x0E, 0x00,   // o
+				0x00, 0x00, 0x0F, 0x11, 0x11, 0x0F, 0x01, 0x01,   // p
+				0x00, 0x00, 0x1E, 0x11, 0x11, 0x1E, 0x10, 0x10,   // q
+				0x00, 0x00, 0x0D, 0x13, 0x01, 0x01, 0x01, 0x00,   // r
+				0x00, 0x00, 0x1E, 0x01, 0x0E, 0x10, 0x0F, 0x00,   // s
+				0x02, 0x02, 0x07, 0x02, 0x02, 0x12, 0x0C, 0x00,   // t
+				0x00, 0x00, 0x11, 0x11, 0x11, 0x19, 0x16, 0x00,   // u
+				0x00, 0x00, 0x11, 0x11, 0x11, 0x0A, 0x04, 0x00,   // v
+				0x00, 0x00, 0x11, 0x11, 0x15, 0x15, 0x0A, 0x00,   // w
+				0x00, 0x00, 0x11, 0x0A, 0x04, 0x0A, 0x11, 0x00,   // x
+				0x00, 0x00, 0x11, 0x11, 0x11, 0x1E, 0x10, 0x0E,   // y
+				0x00, 0x00, 0x1F, 0x08, 0x04, 0x02, 0x1F, 0x00,   // z
+				0x08, 0x04, 0x04, 0x02, 0x04, 0x04, 0x08, 0x00,   // {
+				0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x00,   // |
+				0x02, 0x04, 0x04, 0x08, 0x04, 0x04, 0x02, 0x00,   // }
+				0x00, 0x00, 0x02, 0x15, 0x08, 0x00, 0x00, 0x00    // ~
+			};
+
+			Resize(6, 9);
+			for (int c = 0; c < 95; c++) {
+				uint32_t rows[9] = {};
+				for (int y = 0; y < 8; y++)
+					rows[y] = BUILTIN[c * 8 + y];
+				SetGlyph(32 + c, rows);
+			}
+		}
+
+		// Blank font of the given cell size, to be filled with Load or SetGlyph
+		Font(int nCellWidth, int nCellHeight) {
+			Resize(nCellWidth, nCellHeight);
+		}
+
+
+
+		// Shared built-in font, what framebuffers draw with until told otherwise
+		static const Font& Default() {
+			static const Font s_font;
+			return s_font;
+		}
+
+
+
+		// Clears all glyphs and changes the cell size
+		void Resize(int nCellWidth, int nCellHeight) {
+			m_nCellWidth = std::min(std::max(nCellWidth, 1), 32);
+			m_nCellHeight = std::max(nCellHeight, 1);
+			m_rows.assign((size_t)NUM_GLYPHS * m_nCellHeight, 0);
+			std::fill(std::begin(m_inked), std::end(m_inked), 0);
+			m_nID = NextID();
+		}
+
+
+
+		// Sets glyph c from CellHeight() rows of bits, bit x is column x
+		void SetGlyph(int c, const uint32_t* pRows) {
+			if (c < 0 || c >= NUM_GLYPHS)
+				return;
+
+			uint32_t nMask = m_nCellWidth < 32 ? (1u << m_nCellWidth) - 1 : ~0u;
+			for (int y = 0; y < m_nCellHeight; y++)
+				m_rows[(size_t)c * m_nCellHeight + y] = pRows[y] & nMask;
+
+			UpdateInked(c);
+			m_nID = NextID();
+		}
+
+
+
+		// Loads the glyphs from a sheet of nCellWidth x nCellHeight cells, left to
+		// right and top to bottom starting at character nFirstChar. Bright opaque
+		// pixels are ink, anything dark or transparent is background.
+		// Fonts on disk are loaded through ImageFile::Decode first.
+		template<typename FORMAT>
+		bool Load(const BasicSprite<FORMAT>& sheet, int nCellWidth, int nCellHeight, int nFirstChar = 32) {
+			if (nCellWidth <= 0 || nCellWidth > 32 || nCellHeight <= 0)
+				return false;
+
+			int nColumns = sheet.Width() / nCellWidth;
+			int nLines = sheet.Height() / nCellHeight;
+			if (nColumns == 0 || nLines == 0)
+				return false;
+
+			Resize(nCellWidth, nCellHeight);
+
+			std::vector<uint32_t> rows(nCellHeight);
+			for (int i = 0; i < nColumns * nLines && nFirstChar + i < NUM_GLYPHS; i++) {
+				int ox = (i % nColumns) * nCellWidth;
+				int oy = (i / nColumns) * nCellHeight;
+
+				for (int y = 0; y < nCellHeight; y++) {
+					rows[y] = 0;
+					for (int x = 0; x < nCellWidth; x++) {
+						Pixel p = sheet.GetPixel(ox + x, oy + y);
+						if (p.a >= 128 && p.r + p.g + p.b >= 3 * 128)
+							rows[y] |= 1u << x;
+					}
+				}
+
+				SetGlyph(nFirstChar + i, rows.data());
+			}
+			return true;
+		}
+
+
+
+		// Row y of glyph c as bits, bit x is column x
+		uint32_t GlyphRow(int c, int y) const {
+			return m_rows[(size_t)(c & (NUM_GLYPHS - 1)) * m_nCellHeight + y];
+		}
+
+
+
+		bool IsInked(int c) const {
+			c &= NUM_GLYPHS - 1;
+			return (m_inked[c / 64] >> (c % 64)) & 1;
+		}
+
+
+
+		// Size in pixels of text at scale 1, lines split at '\n'
+		void Measure(const char* sText, size_t nLength, int& nWidth, int& nHeight) const {
+			size_t nColumns = 0, nLongest = 0, nLines = nLength ? 1 : 0;
+			for (size_t i = 0; i < nLength; i++) {
+				if (sText[i] == '\n') {
+					nLines++;
+					nColumns = 0;
+				}
+				else {
+					nLongest = std::max(nLongest, ++nColumns);
+				}
+			}
+			nWidth = (int)nLongest * m_nCellWidth;
+			nHeight = (int)nLines * m_nCellHeight;
+		}
+
+
+
+		int CellWidth() const {
+			return m_nCellWidth;
+		}
+
+
+
+		int CellHeight() const {
+			return m_nCellHeight;
+		}
+
+
+
+		uint64_t ID() const {
+			return m_nID;
+		}
+	};
+
+
+
+	//===== TEXT CACHE =====//
+
+	// Text pre-rendered into FORMAT texels, so drawing it is row copies.
+	// Glyph atlases hold every glyph of a font in one color and scale.
+	// Layouts hold whole strings; a string drawn again unchanged is one keyed
+	// copy per row. Both are reused in place when evicted, so once the
+	// working set has been seen drawing text does not allocate.
+	// Text is color keyed, it is drawn opaque whatever the blend mode.
+	template<typename FORMAT>
+	class BasicTextCache {
+
+	public:
+		using SpriteType = BasicSprite<FORMAT>;
+
+		static constexpr int ATLAS_COLUMNS = 16;
+		static constexpr size_t MAX_ATLASES = 32;
+		static constexpr size_t LAYOUT_WAYS = 4;
+
+
+	private:
+		struct AtlasEntry {
+			uint64_t    nFont;
+			uint32_t    nColor;
+			int         nScale;
+			uint64_t    nLastUse;
+			SpriteType  sprite;
+		};
+
+		struct LayoutEntry {
+			uint64_t    nHash = 0;
+			uint64_t    nFont = 0;
+			uint32_t    nColor = 0;
+			uint32_t    nBackground = 0;
+			int         nScale = 0;
+			bool        bOpaque = false;
+			bool        bUsed = false;
+			uint64_t    nLastUse = 0;
+			std::string sText;
+			SpriteType  sprite;
+		};
+
+		std::vector<AtlasEntry> m_atlases;
+
+		// LAYOUT_WAYS entries per set, a string can only live in the set its hash picks
+		std::vector<LayoutEntry> m_layouts;
+		size_t      m_nLayoutSets;
+
+		uint64_t    m_nClock = 0;
+
+		uint64_t    m_nHits = 0;
+		uint64_t    m_nMisses = 0;
+
+
+	private:
+		static uint32_t Pack(Pixel p) {
+			return (uint32_t)p.r | (uint32_t)p.g << 8 | (uint32_t)p.b << 16 | (uint32_t)p.a << 24;
+		}
+
+
+
+		// Differs from the text color in every channel and so in every format
+		static Pixel KeyFor(Pixel p) {
+			return Pixel(255 - p.r, 255 - p.g, 255 - p.b);
+		}
+
+
+
+		static uint64_t Hash(const char* sText, size_t nLength, uint64_t nFont, uint32_t nColor, uint32_t nBackground, int nScale) {
+			uint64_t nHash = 14695981039346656037ull;
+			for (size_t i = 0; i < nLength; i++)
+				nHash = (nHash ^ (uint8_t)sText[i]) * 1099511628211ull;
+			nHash ^= nFont * 0x9E3779B97F4A7C15ull;
+			nHash ^= ((uint64_t)nColor << 32 | nBackground) * 0xC2B2AE3D27D4EB4Full;
+			nHash ^= (uint64_t)nScale * 0x165667B19E3779F9ull;
+			return nHash ^ (nHash >> 29);
+		}
+
+
+
+		void BuildAtlas(SpriteType& sprite, const Font& font, Pixel color, int nScale) {
+			int nCellWidth = font.CellWidth() * nScale;
+			int nCellHeight = font.CellHeight() * nScale;
+			Pixel key = KeyFor(color);
+
+			sprite.Resize(ATLAS_COLUMNS * nCellWidth, Font::NUM_GLYPHS / ATLAS_COLUMNS * nCellHeight, key);
+			sprite.SetColorKey(key);
+
+			typename FORMAT::Texel t = FORMAT::Encode(color);
+			for (int c = 0; c < Font::NUM_GLYPHS; c++) {
+				if (!font.IsInked(c))
+					continue;
+
+				int ox = (c % ATLAS_COLUMNS) * nCellWidth;
+				int oy = (c / ATLAS_COLUMNS) * nCellHeight;
+				for (int y = 0; y < nCellHeight; y++) {
+					uint32_t nBits = font.GlyphRow(c, y / nScale);
+					typename FORMAT::Texel* pRow = sprite.Row(oy + y) + ox;
+					for (int x = 0; x < nCellWidth; x++) {
+						if ((nBits >> (x / nScale)) & 1)
+							pRow[x] = t;
+					}
+				}
+			}
+		}
+
+
+
+		void BuildLayout(LayoutEntry& layout, const char* sText, size_t nLength, const Font& font, Pixel color, int nScale) {
+			const SpriteType& glyphs = Glyphs(font, color, nScale);
+
+			int nWidth, nHeight;
+			font.Measure(sText, nLength, nWidth, nHeight);
+			int nCellWidth = font.CellWidth() * nScale;
+			int nCellHeight = font.CellHeight() * nScale;
+
+			Pixel background;
+			if (layout.bOpaque) {
+				const uint32_t n = layout.nBackground;
+				background = Pixel((uint8_t)n, (uint8_t)(n >> 8), (uint8_t)(n >> 16), (uint8_t)(n >> 24));
+				layout.sprite.Resize(nWidth * nScale, nHeight * nScale, background);
+				layout.sprite.ClearMask();
+			}
+			else {
+				layout.sprite.Resize(nWidth * nScale, nHeight * nScale, KeyFor(color));
+				layout.sprite.SetColorKey(KeyFor(color));
+			}
+
+			int nX = 0, nY = 0;
+			for (size_t i = 0; i < nLength; i++) {
+				int c = (uint8_t)sText[i];
+				if (c == '\n') {
+					nX = 0;
+					nY += nCellHeight;
+					continue;
+				}
+
+				if (font.IsInked(c)) {
+					int ox = (c % ATLAS_COLUMNS) * nCellWidth;
+					int oy = (c / ATLAS_COLUMNS) * nCellHeight;
+					for (int y = 0; y < nCellHeight; y++) {
+						if (layout.bOpaque)
+							SpanKernels::CopyKeyed(layout.sprite.Row(nY + y) + nX, glyphs.Row(oy + y) + ox, (size_t)nCellWidth, glyphs.Key());
+						else
+							SpanKernels::Copy(layout.sprite.Row(nY + y) + nX, glyphs.Row(oy + y) + ox, (size_t)nCellWidth);
+					}
+				}
+				nX += nCellWidth;
+			}
+		}
+
+
+
+		const SpriteType& FindLayout(const char* sText, size_t nLength, const Font& font, Pixel color, const Pixel* pBackground, int nScale) {
+			if (m_layouts.empty())
+				m_layouts.resize(m_nLayoutSets * LAYOUT_WAYS);
+
+			uint32_t nColor = Pack(color);
+			uint32_t nBackground = pBackground ? Pack(*pBackground) : 0;
+			uint64_t nHash = Hash(sText, nLength, font.ID(), nColor, nBackground, nScale);
+
+			LayoutEntry* pSet = &m_layouts[(nHash & (m_nLayoutSets - 1)) * LAYOUT_WAYS];
+			LayoutEntry* pVictim = pSet;
+			m_nClock++;
+
+			for (size_t i = 0; i < LAYOUT_WAYS; i++) {
+				LayoutEntry& layout = pSet[i];
+				if (layout.bUsed && layout.nHash == nHash && layout.nFont == font.ID() && layout.nColor == nColor &&
+					layout.nBackground == nBackground && layout.nScale == nScale && layout.bOpaque == (pBackground != nullptr) &&
+					layout.sText.size() == nLength && std::memcmp(layout.sText.data(), sText, nLength) == 0) {
+					layout.nLastUse = m_nClock;
+					m_nHits++;
+					return layout.sprite;
+				}
+
+				if (!layout.bUsed || (pVictim->bUsed && layout.nLastUse < pVictim->nLastUse))
+					pVictim = &layout;
+			}
+
+			// Least recently used way of the set is overwritten, its buffers kept
+			m_nMisses++;
+			pVictim->nHash = nHash;
+			pVictim->nFont = font.ID();
+			pVictim->nColor = nColor;
+			pVictim->nBackground = nBackground;
+			pVictim->nScale = nScale;
+			pVictim->bOpaque = pBackground != nullptr;
+			pVictim->bUsed = true;
+			pVictim->nLastUse = m_nClock;
+			pVictim->sText.assign(sText, nLength);
+			BuildLayout(*pVictim, sText, nLength, font, color, nScale);
+
+			return pVictim->sprite;
+		}
+
+
+
+	public:
+		// Capacity for about nLayouts distinct strings, rounded up to whole sets
+		explicit BasicTextCache(size_t nLayouts = 1024) {
+			m_nLayoutSets = 1;
+			while (m_nLayoutSets * LAYOUT_WAYS < nLayouts)
+				m_nLayoutSets *= 2;
+		}
+
+
+
+		// Holds sprites, copies would have to be explicit
+		BasicTextCache(const BasicTextCache&) = delete;
+		BasicTextCache& operator=(const BasicTextCache&) = delete;
+
+
+
+		// Color keyed atlas of all glyphs of the font in color at nScale, glyph c
+		// in the cell at column c % ATLAS_COLUMNS and row c / ATLAS_COLUMNS
+		const SpriteType& Glyphs(const Font& font, Pixel color, int nScale) {
+			uint32_t nColor = Pack(color);
+			m_nClock++;
+
+			for (AtlasEntry& atlas : m_atlases) {
+				if (atlas.nFont == font.ID() && atlas.nColor == nColor && atlas.nScale == nScale) {
+					atlas.nLastUse = m_nClock;
+					return atlas.sprite;
+				}
+			}
+
+			AtlasEntry* pAtlas;
+			if (m_atlases.size() < MAX_ATLASES) {
+				// Reserved up front so handing out references stays safe as atlases are added
+				m_atlases.reserve(MAX_ATLASES);
+				m_atlases.emplace_back();
+				pAtlas = &m_atlases.back();
+			}
+			else {
+				pAtlas = &*std::min_element(m_atlases.begin(), m_atlases.end(),
+					[](const AtlasEntry& a, const AtlasEntry& b) { return a.nLastUse < b.nLastUse; });
+			}
+
+			pAtlas->nFont = font.ID();
+			pAtlas->nColor = nColor;
+			pAtlas->nScale = nScale;
+			pAtlas->nLastUse = m_nClock;
+			BuildAtlas(pAtlas->sprite, font, color, nScale);
+
+			return pAtlas->sprite;
+		}
+
+
+
+		// Color keyed sprite of the whole text, laid out once and then reused
+		const SpriteType& Layout(const char* sText, size_t nLength, const Font& font, Pixel color, int nScale) {
+			return FindLayout(sText, nLength, font, color, nullptr, nScale);
+		}
+
+		// Opaque sprite of the text over a background, drawn as plain row copies
+		const SpriteType& Layout(const char* sText, size_t nLength, const Font& font, Pixel color, Pixel background, int nScale) {
+			return FindLayout(sText, nLength, font, color, &background, nScale);
+		}
+
+
+
+		void Clear() {
+			m_atlases.clear();
+			m_layouts.clear();
+		}
+
+
+
+		uint64_t Hits() const {
+			return m_nHits;
+		}
+
+
+
+		uint64_t Misses() const {
+			return m_nMisses;
+		}
+	};
+
+
+
+	using TextCache = BasicTextCache<THPX_PIXEL_FORMAT>;
+
+}
@@ -0,0 +1,2050 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <algorithm>
+#include <cstdlib>
+#include <cstddef>
+#include <cstring>
+#include <cmath>
+#include <string>
+
+#include "THPXTypes.h"
+#include "THPXPixelFormat.h"
+#include "THPXSpanKernels.h"
+#include "THPXBlend.h"
+#include "THPXShadeKernels.h"
+#include "THPXDepthBuffer.h"
+#include "THPXSprite.h"
+#include "THPXFont.h"
+
+
+namespace THPX {
+
+	//===== FRAMEBUFFER BASE =====//
+
+	// What was drawn since the last ResetStats, pixels counted as processed
+	// (color keyed texels of a blit included)
+	struct DrawStats {
+		uint64_t    nPrimitives = 0;
+		uint64_t    nPixels = 0;
+	};
+
+
+
+
+	// Which parts of a self-overlapping polygon are inside
+	enum class FillRule : uint8_t {
+		NONZERO,        // inside where the edges wind around the point at least once
+		EVEN_ODD        // inside where a ray from the point crosses an odd number of edges
+	};
+
+
+
+
+	// Format independent part of a framebuffer: aligned storage, size and
+	// damage tracking. Presenters and the swap chain only need this much.
+	class FramebufferBase {
+
+	public:
+		// Side of the square tiles the rasterizers work in
+		static constexpr int TILE_SIZE = 8;
+
+		// Side of the square tiles damage is tracked in
+		static constexpr int DIRTY_TILE_SIZE = 32;
+
+		// Storage and every row start on this many bytes
+		static constexpr size_t ROW_ALIGNMENT = 64;
+
+
+	protected:
+		PixelFormat m_format;
+		size_t      m_nTexelSize;
+
+		// Pixel storage, m_nPitch texels per row
+		std::vector<uint8_t, AlignedAllocator<uint8_t, ROW_ALIGNMENT>> m_storage;
+
+		// Width, height in pixels
+		int         m_nWidth = 0;
+		int         m_nHeight = 0;
+
+		// Row pitch in texels, padded to ROW_ALIGNMENT bytes
+		int         m_nPitch = 0;
+
+		// One byte per DIRTY_TILE_SIZE tile, non-zero once something drew into it
+		std::vector<uint8_t> m_dirtyTiles;
+		int         m_nDirtyTilesX = 0;
+		int         m_nDirtyTilesY = 0;
+
+		DrawStats   m_stats;
+
+
+	public:
+		explicit FramebufferBase(PixelFormat format) {
+			m_format = format;
+			m_nTexelSize = THPX::TexelSize(format);
+		}
+
+
+
+		// Sets the size, pixel contents are undefined afterwards
+		void Allocate(int nWidth, int nHeight) {
+			m_nWidth = std::max(nWidth, 0);
+			m_nHeight = std::max(nHeight, 0);
+
+			size_t nRowBytes = (m_nWidth * m_nTexelSize + ROW_ALIGNMENT - 1) / ROW_ALIGNMENT * ROW_ALIGNMENT;
+			m_nPitch = (int)(nRowBytes / m_nTexelSize);
+			m_storage.resize(nRowBytes * m_nHeight);
+
+			m_nDirtyTilesX = (m_nWidth + DIRTY_TILE_SIZE - 1) / DIRTY_TILE_SIZE;
+			m_nDirtyTilesY = (m_nHeight + DIRTY_TILE_SIZE - 1) / DIRTY_TILE_SIZE;
+			m_dirtyTiles.assign((size_t)m_nDirtyTilesX * m_nDirtyTilesY, 1);
+		}
+
+
+
+		// Exchanges pixels and size with another framebuffer of the same format without copying
+		void Swap(FramebufferBase& other) {
+			if (m_format != other.m_format)
+				return;
+
+			m_storage.swap(other.m_storage);
+			std::swap(m_nWidth, other.m_nWidth);
+			std::swap(m_nHeight, other.m_nHeight);
+			std::swap(m_nPitch, other.m_nPitch);
+			m_dirtyTiles.swap(other.m_dirtyTiles);
+			std::swap(m_nDirtyTilesX, other.m_nDirtyTilesX);
+			std::swap(m_nDirtyTilesY, other.m_nDirtyTilesY);
+		}
+
+
+
+	protected:
+		// Flags the tiles under an inclusive rectangle that already lies inside the buffer
+		void MarkDirty(int x0, int y0, int x1, int y1) {
+			int tx0 = x0 / DIRTY_TILE_SIZE;
+			int tx1 = x1 / DIRTY_TILE_SIZE;
+
+			for (int ty = y0 / DIRTY_TILE_SIZE; ty <= y1 / DIRTY_TILE_SIZE; ty++) {
+				memset(&m_dirtyTiles[(size_t)ty * m_nDirtyTilesX + tx0], 1, tx1 - tx0 + 1);
+			}
+		}
+
+
+
+	public:
+		PixelFormat Format() const {
+			return m_format;
+		}
+
+
+
+		size_t TexelSize() const {
+			return m_nTexelSize;
+		}
+
+
+
+		// Row pitch in texels
+		int Pitch() const {
+			return m_nPitch;
+		}
+
+
+
+		size_t PitchBytes() const {
+			return (size_t)m_nPitch * m_nTexelSize;
+		}
+
+
+
+		// Storage as bytes, Height() rows of PitchBytes() each
+		uint8_t* RawData() {
+			return m_storage.data();
+		}
+		const uint8_t* RawData() const {
+			return m_storage.data();
+		}
+
+
+
+		size_t SizeBytes() const {
+			return m_storage.size();
+		}
+
+
+
+		// True if anything was drawn since the last ClearDirty
+		bool IsDirty() const {
+			return std::find(m_dirtyTiles.begin(), m_dirtyTiles.end(), (uint8_t)1) != m_dirtyTiles.end();
+		}
+
+
+
+		bool IsTileDirty(int tx, int ty) const {
+			return m_dirtyTiles[(size_t)ty * m_nDirtyTilesX + tx] != 0;
+		}
+
+
+
+		// Dirty flags, one byte per DIRTY_TILE_SIZE tile, DirtyTilesX() per row
+		const uint8_t* DirtyTiles() const {
+			return m_dirtyTiles.data();
+		}
+
+
+
+		int DirtyTilesX() const {
+			return m_nDirtyTilesX;
+		}
+
+
+
+		int DirtyTilesY() const {
+			return m_nDirtyTilesY;
+		}
+
+
+
+		// Marks everything as unchanged, called once the frame has been presented
+		void ClearDirty() {
+			std::fill(m_dirtyTiles.begin(), m_dirtyTiles.end(), (uint8_t)0);
+		}
+
+
+
+		// Marks an arbitrary region as changed, e.g. after writing through Data()
+		void Invalidate(int x0, int y0, int x1, int y1) {
+			x0 = std::max(x0, 0);
+			y0 = std::max(y0, 0);
+			x1 = std::min(x1, m_nWidth - 1);
+			y1 = std::min(y1, m_nHeight - 1);
+
+			if (x0 <= x1 && y0 <= y1)
+				MarkDirty(x0, y0, x1, y1);
+		}
+		void Invalidate() {
+			std::fill(m_dirtyTiles.begin(), m_dirtyTiles.end(), (uint8_t)1);
+		}
+
+
+
+		// Dirty tiles merged into pixel rectangles: runs of tiles per tile row,
+		// joined with the run above when they span the same columns
+		void GetDirtyRects(std::vector<Rect>& rects) const {
+			rects.clear();
+
+			for (int ty = 0; ty < m_nDirtyTilesY; ty++) {
+				size_t nRowStart = rects.size();
+				const uint8_t* pRow = &m_dirtyTiles[(size_t)ty * m_nDirtyTilesX];
+
+				int tx = 0;
+				while (tx < m_nDirtyTilesX) {
+					if (!pRow[tx]) {
+						tx++;
+						continue;
+					}
+
+					int nRunStart = tx;
+					while (tx < m_nDirtyTilesX && pRow[tx])
+						tx++;
+
+					int x0 = nRunStart * DIRTY_TILE_SIZE;
+					int x1 = std::min(tx * DIRTY_TILE_SIZE, m_nWidth) - 1;
+					int y0 = ty * DIRTY_TILE_SIZE;
+					int y1 = std::min((ty + 1) * DIRTY_TILE_SIZE, m_nHeight) - 1;
+
+					bool bMerged = false;
+					for (size_t i = 0; i < nRowStart; i++) {
+						if (rects[i].x0 == x0 && rects[i].x1 == x1 && rects[i].y1 == y0 - 1) {
+							rects[i].y1 = y1;
+							bMerged = true;
+							break;
+						}
+					}
+
+					if (!bMerged)
+						rects.push_back(Rect(x0, y0, x1, y1));
+				}
+			}
+		}
+
+
+
+		// Whole buffer as a clip rectangle
+		Rect Bounds() const {
+			return Rect(0, 0, m_nWidth - 1, m_nHeight - 1);
+		}
+
+
+
+		int ScreenWidth() const {
+			return m_nWidth;
+		}
+
+
+
+		int ScreenHeight() const {
+			return m_nHeight;
+		}
+
+
+
+		const DrawStats& Stats() const {
+			return m_stats;
+		}
+
+
+
+		void ResetStats() {
+			m_stats = DrawStats();
+		}
+	};
+
+
+
+	//===== FRAMEBUFFER =====//
+
+	// Framebuffer storing FORMAT texels, with all drawing primitives.
+	// Colors are converted to the texel format once per primitive, so the
+	// inner loops only ever copy ready made texels.
+	// Knows nothing about windows or GL, so it can be rendered into headless.
+	template<typename FORMAT>
+	class BasicFramebuffer : public FramebufferBase {
+
+		friend class TiledRasterizer;
+
+	public:
+		using Texel = typename FORMAT::Texel;
+
+
+	protected:
+		// Applied to every primitive drawn from now on, Clear always overwrites
+		BlendMode   m_blendMode = BlendMode::NONE;
+
+		// Scratch for scaled blits, kept between calls so drawing does not allocate.
+		// Nearest holds source columns, bilinear the column << 8 | weight.
+		std::vector<Texel> m_spriteRow;
+		std::vector<int32_t> m_spriteCols;
+
+		// Text is drawn with m_pFont out of glyphs and layouts cached in m_text
+		const Font* m_pFont = &Font::Default();
+		BasicTextCache<FORMAT> m_text;
+
+		// One line's worth of glyph spans, kept so drawing text does not allocate
+		struct GlyphSpan {
+			int         nDst;
+			int         nSrc;
+			int         nCount;
+			int         nSrcRow;
+		};
+		std::vector<GlyphSpan> m_glyphSpans;
+
+		// Polygon edges, active edge indices and one scanline's crossings, kept so
+		// filling polygons does not allocate
+		struct PolyEdge {
+			int         nY0;
+			int         nY1;
+			int         nWinding;
+
+			// ceil of the crossing x on the current scanline, and how far below the exact crossing it is, times nDy
+			int64_t     q;
+			int64_t     r;
+			int64_t     nStepQ;
+			int64_t     nStepR;
+			int64_t     nDy;
+		};
+		struct PolyCrossing {
+			int64_t     x;
+			int         nWinding;
+		};
+		std::vector<PolyEdge> m_polyEdges;
+		std::vector<uint32_t> m_polyActive;
+		std::vector<PolyCrossing> m_polyCrossings;
+
+		// Outline pixels of a circle or ellipse in the lower right quadrant,
+		// x min and max per row below the center
+		std::vector<int32_t> m_ellipseRows;
+
+		// One span of shaded or texture mapped texels before they are blended or
+		// masked, and shaded colors of formats that are not four bytes per texel
+		std::vector<Texel> m_shadeRow;
+		std::vector<Pixel> m_shadePixels;
+
+
+	protected:
+		Texel* Texels() {
+			return (Texel*)m_storage.data();
+		}
+		const Texel* Texels() const {
+			return (const Texel*)m_storage.data();
+		}
+
+
+
+		// Color and blend state of one primitive, ready for the span loops
+		struct Brush {
+			Texel       t;
+			BlendOp     op;
+			bool        bOpaque;
+
+			// Pixels painted with it, moved into the draw stats once the primitive is done
+			mutable uint64_t nPixels;
+		};
+
+		Brush MakeBrush(Pixel p, BlendMode blend) const {
+			Brush brush;
+			brush.t = FORMAT::Encode(p);
+			brush.op = BlendOp(p, blend);
+			brush.bOpaque = BlendOp::IsOpaque(p, blend);
+			brush.nPixels = 0;
+			return brush;
+		}
+		Brush MakeBrush(Pixel p) const {
+			return MakeBrush(p, m_blendMode);
+		}
+
+
+
+		void Plot(Texel* pDst, const Brush& brush) {
+			brush.nPixels++;
+			if (brush.bOpaque)
+				*pDst = brush.t;
+			else
+				BlendKernels::Span<FORMAT>(pDst, 1, brush.op);
+		}
+
+
+
+		void PaintSpan(Texel* pDst, size_t nCount, const Brush& brush) {
+			brush.nPixels += nCount;
+			if (brush.bOpaque)
+				SpanKernels::Fill(pDst, nCount, brush.t);
+			else
+				BlendKernels::Span<FORMAT>(pDst, nCount, brush.op);
+		}
+
+
+
+		void PaintRows(Texel* pDst, size_t nCount, size_t nRows, const Brush& brush) {
+			brush.nPixels += nCount * nRows;
+			if (brush.bOpaque)
+				SpanKernels::FillRows(pDst, nCount, nRows, m_nPitch, brush.t);
+			else
+				BlendKernels::Rows<FORMAT>(pDst, nCount, nRows, m_nPitch, brush.op);
+		}
+
+
+
+		// Books finished primitives in the draw stats
+		void Count(const Brush& brush, uint64_t nPrimitives = 1) {
+			m_stats.nPrimitives += nPrimitives;
+			m_stats.nPixels += brush.nPixels;
+		}
+
+
+
+		// One row of sprite texels written according to the sprite's mask
+		static void BlitRow(Texel* pDst, const Texel* pSrc, size_t nCount, const BasicSprite<FORMAT>& sprite) {
+			switch (sprite.Mask()) {
+			case SpriteMask::COLORKEY:
+				SpanKernels::CopyKeyed(pDst, pSrc, nCount, sprite.Key());
+				break;
+			case SpriteMask::ALPHA:
+				BlendKernels::Over<FORMAT>(pDst, pSrc, nCount);
+				break;
+			default:
+				SpanKernels::Copy(pDst, pSrc, nCount);
+				break;
+			}
+		}
+
+
+
+		// Sample position of destination pixel i of n over a source of nSize, 16.16 fixed point,
+		// pixel centers mapped onto pixel centers
+		static int64_t SamplePos(int i, int n, int nSize) {
+			return ((2 * (int64_t)i + 1) * nSize * 65536) / (2 * (int64_t)n) - 32768;
+		}
+
+
+
+		// Splits a sample position into a source index and an 8 bit weight towards index + 1
+		static void SampleSplit(int64_t nPos, int nSize, int& nIndex, int& nWeight) {
+			if (nPos < 0)
+				nPos = 0;
+			nIndex = (int)(nPos >> 16);
+			nWeight = (int)((nPos >> 8) & 0xFF);
+			if (nIndex >= nSize - 1) {
+				nIndex = nSize - 1;
+				nWeight = 0;
+			}
+		}
+
+
+
+		static uint8_t Lerp4(uint32_t a, uint32_t b, uint32_t c, uint32_t d, uint32_t fx, uint32_t fy) {
+			uint32_t top = a * (256 - fx) + b * fx;
+			uint32_t bottom = c * (256 - fx) + d * fx;
+			return (uint8_t)((top * (256 - fy) + bottom * fy + 32768) >> 16);
+		}
+
+
+
+		static int64_t FloorDiv(int64_t a, int64_t b) {
+			return a >= 0 ? a / b : -((-a + b - 1) / b);
+		}
+
+
+
+		static int64_t CeilDiv(int64_t a, int64_t b) {
+			return a >= 0 ? (a + b - 1) / b : -((-a) / b);
+		}
+
+
+
+		// Integer Bresenham along a major axis a with da >= |db|.
+		// Pixel i sits at (a0 + i, b0 + sign(db) * round(i * |db| / da)), so the
+		// range of i inside the clip can be solved for up front and the loop
+		// writes straight into the buffer with no bounds checks.
+		void RasterLineMajor(int64_t a0, int64_t b0, int64_t da, int64_t db, int64_t clipA0, int64_t clipA1, int64_t clipB0, int64_t clipB1, ptrdiff_t nStrideA, ptrdiff_t nStrideB, bool bMajorX, const Brush& brush) {
+			int64_t sb = db < 0 ? -1 : 1;
+			int64_t adb = db < 0 ? -db : db;
+
+			// Major axis must stay inside [clipA0, clipA1]
+			int64_t iMin = std::max<int64_t>(0, clipA0 - a0);
+			int64_t iMax = std::min<int64_t>(da, clipA1 - a0);
+
+			// Minor axis offset k must stay inside [clipB0, clipB1]
+			int64_t kMin = sb > 0 ? clipB0 - b0 : b0 - clipB1;
+			int64_t kMax = sb > 0 ? clipB1 - b0 : b0 - clipB0;
+
+			if (kMin > 0 && adb == 0)
+				return;
+			if (kMax < 0 || kMin > kMax)
+				return;
+
+			if (da == 0) {
+				if (iMin <= iMax && kMin <= 0) {
+					Plot(Texels() + (ptrdiff_t)(a0 * nStrideA + b0 * nStrideB), brush);
+					MarkDirty((int)(bMajorX ? a0 : b0), (int)(bMajorX ? b0 : a0), (int)(bMajorX ? a0 : b0), (int)(bMajorX ? b0 : a0));
+				}
+				return;
+			}
+
+			int64_t twoDa = 2 * da;
+			int64_t twoDb = 2 * adb;
+
+			if (adb > 0) {
+				// k(i) = floor((twoDb * i + da) / twoDa) is monotonic in i
+				iMin = std::max(iMin, CeilDiv(twoDa * kMin - da, twoDb));
+				iMax = std::min(iMax, FloorDiv(twoDa * (kMax + 1) - da - 1, twoDb));
+			}
+
+			if (iMin > iMax)
+				return;
+
+			// Error term at the first visible pixel
+			int64_t num = twoDb * iMin + da;
+			int64_t k = num / twoDa;
+			int64_t err = num % twoDa;
+
+			// Damage in one piece per dirty tile column (or row) crossed, so
+			// diagonal lines do not flag their whole bounding box
+			for (int64_t i = iMin; i <= iMax;) {
+				int64_t iEnd = std::min(iMax, (a0 + i) / DIRTY_TILE_SIZE * DIRTY_TILE_SIZE + DIRTY_TILE_SIZE - 1 - a0);
+				int64_t bFirst = b0 + sb * ((twoDb * i + da) / twoDa);
+				int64_t bLast = b0 + sb * ((twoDb * iEnd + da) / twoDa);
+				int64_t bLow = std::min(bFirst, bLast), bHigh = std::max(bFirst, bLast);
+
+				if (bMajorX)
+					MarkDirty((int)(a0 + i), (int)bLow, (int)(a0 + iEnd), (int)bHigh);
+				else
+					MarkDirty((int)bLow, (int)(a0 + i), (int)bHigh, (int)(a0 + iEnd));
+
+				i = iEnd + 1;
+			}
+
+			brush.nPixels += (uint64_t)(iMax - iMin + 1);
+
+			Texel* pData = Texels();
+			ptrdiff_t idx = (ptrdiff_t)((a0 + iMin) * nStrideA + (b0 + sb * k) * nStrideB);
+			ptrdiff_t stepB = (ptrdiff_t)sb * nStrideB;
+
+			// Opaque lines keep a loop with a plain store
+			if (brush.bOpaque) {
+				for (int64_t i = iMin; i <= iMax; i++) {
+					pData[idx] = brush.t;
+					idx += nStrideA;
+					err += twoDb;
+					if (err >= twoDa) {
+						err -= twoDa;
+						idx += stepB;
+					}
+				}
+				return;
+			}
+
+			for (int64_t i = iMin; i <= iMax; i++) {
+				BlendKernels::Span<FORMAT>(pData + idx, 1, brush.op);
+				idx += nStrideA;
+				err += twoDb;
+				if (err >= twoDa) {
+					err -= twoDa;
+					idx += stepB;
+				}
+			}
+		}
+
+
+
+		void RasterLine(int x0, int y0, int x1, int y1, const Brush& brush, const Rect& clip) {
+
+			// Horizontal lines are a single span
+			if (y0 == y1) {
+				FillSpan(x0, x1, y0, brush, clip);
+				return;
+			}
+
+			int64_t dx = (int64_t)x1 - x0;
+			int64_t dy = (int64_t)y1 - y0;
+
+			// Always step the major axis forwards so both directions draw the same pixels
+			if (std::abs(dx) >= std::abs(dy)) {
+				if (dx < 0) {
+					RasterLineMajor(x1, y1, -dx, -dy, clip.x0, clip.x1, clip.y0, clip.y1, 1, m_nPitch, true, brush);
+				}
+				else {
+					RasterLineMajor(x0, y0, dx, dy, clip.x0, clip.x1, clip.y0, clip.y1, 1, m_nPitch, true, brush);
+				}
+			}
+			else {
+				if (dy < 0) {
+					RasterLineMajor(y1, x1, -dy, -dx, clip.y0, clip.y1, clip.x0, clip.x1, m_nPitch, 1, false, brush);
+				}
+				else {
+					RasterLineMajor(y0, x0, dy, dx, clip.y0, clip.y1, clip.x0, clip.x1, m_nPitch, 1, false, brush);
+				}
+			}
+		}
+
+
+
+		// Edge function of a -> b, positive on the inside of a triangle wound
+		// so that EdgeFunction(v0, v1, v2) > 0. Biased by the top-left fill rule,
+		// so "inside" is always >= 0 and shared edges are drawn exactly once.
+		struct Edge {
+			int64_t A, B, C;
+
+			Edge(Vec2D a, Vec2D b) {
+				A = (int64_t)a.y - b.y;
+				B = (int64_t)b.x - a.x;
+				C = -(A * a.x + B * a.y);
+
+				// Top edges are horizontal with the inside below, left edges go upwards
+				bool bTopLeft = (A == 0 && B > 0) || A > 0;
+				if (!bTopLeft)
+					C -= 1;
+			}
+
+			int64_t At(int64_t x, int64_t y) const {
+				return A * x + B * y + C;
+			}
+
+			// Smallest and largest value over the inclusive rectangle
+			int64_t Min(int x0, int y0, int x1, int y1) const {
+				return At(A >= 0 ? x0 : x1, B >= 0 ? y0 : y1);
+			}
+			int64_t Max(int x0, int y0, int x1, int y1) const {
+				return At(A >= 0 ? x1 : x0, B >= 0 ? y1 : y0);
+			}
+		};
+
+
+
+		// Half-space triangle rasterizer, restricted to the clip rectangle.
+		// Walks TILE_SIZE square tiles of the bounding box: tiles outside an edge are
+		// skipped, tiles inside all edges are block filled, the rest go row by row.
+		void RasterTriangle(Vec2D v0, Vec2D v1, Vec2D v2, const Brush& brush, const Rect& clip) {
+			int64_t area = ((int64_t)v1.x - v0.x) * ((int64_t)v2.y - v0.y) - ((int64_t)v1.y - v0.y) * ((int64_t)v2.x - v0.x);
+
+			if (area == 0)
+				return;
+			if (area < 0)
+				std::swap(v1, v2);
+
+			int minX = std::max(std::min({ v0.x, v1.x, v2.x }), clip.x0);
+			int minY = std::max(std::min({ v0.y, v1.y, v2.y }), clip.y0);
+			int maxX = std::min(std::max({ v0.x, v1.x, v2.x }), clip.x1);
+			int maxY = std::min(std::max({ v0.y, v1.y, v2.y }), clip.y1);
+
+			if (minX > maxX || minY > maxY)
+				return;
+
+			MarkDirty(minX, minY, maxX, maxY);
+
+			const Edge e0(v1, v2), e1(v2, v0), e2(v0, v1);
+
+			for (int ty = minY & ~(TILE_SIZE - 1); ty <= maxY; ty += TILE_SIZE) {
+				int y0 = std::max(ty, minY);
+				int y1 = std::min(ty + TILE_SIZE - 1, maxY);
+
+				for (int tx = minX & ~(TILE_SIZE - 1); tx <= maxX; tx += TILE_SIZE) {
+					int x0 = std::max(tx, minX);
+					int x1 = std::min(tx + TILE_SIZE - 1, maxX);
+
+					// Whole tile outside one of the edges
+					if (e0.Max(x0, y0, x1, y1) < 0 || e1.Max(x0, y0, x1, y1) < 0 || e2.Max(x0, y0, x1, y1) < 0)
+						continue;
+
+					// Whole tile inside
+					if (e0.Min(x0, y0, x1, y1) >= 0 && e1.Min(x0, y0, x1, y1) >= 0 && e2.Min(x0, y0, x1, y1) >= 0) {
+						PaintRows(Row(y0) + x0, x1 - x0 + 1, y1 - y0 + 1, brush);
+						continue;
+					}
+
+					// Partial tile, covered pixels of a row are contiguous
+					int64_t w0Row = e0.At(x0, y0);
+					int64_t w1Row = e1.At(x0, y0);
+					int64_t w2Row = e2.At(x0, y0);
+
+					for (int y = y0; y <= y1; y++) {
+						int64_t w0 = w0Row, w1 = w1Row, w2 = w2Row;
+						int nStart = -1, nEnd = -1;
+
+						for (int x = x0; x <= x1; x++) {
+							if ((w0 | w1 | w2) >= 0) {
+								if (nStart < 0)
+									nStart = x;
+								nEnd = x;
+							}
+							w0 += e0.A;
+							w1 += e1.A;
+							w2 += e2.A;
+						}
+
+						if (nStart >= 0)
+							PaintSpan(Row(y) + nStart, nEnd - nStart + 1, brush);
+
+						w0Row += e0.B;
+						w1Row += e1.B;
+						w2Row += e2.B;
+					}
+				}
+			}
+		}
+
+
+
+		// The pixels RasterTriangle covers as one clipped span per row, top to bottom,
+		// for the triangles that interpolate attributes along their rows. Calls
+		// span(y, x0, x1) for every row with an inclusive span.
+		template<typename SPAN>
+		static void TriangleSpans(Vec2D v0, Vec2D v1, Vec2D v2, const Rect& clip, SPAN&& span) {
+			int64_t area = ((int64_t)v1.x - v0.x) * ((int64_t)v2.y - v0.y) - ((int64_t)v1.y - v0.y) * ((int64_t)v2.x - v0.x);
+
+			if (area == 0)
+				return;
+			if (area < 0)
+				std::swap(v1, v2);
+
+			int minX = std::max(std::min({ v0.x, v1.x, v2.x }), clip.x0);
+			int minY = std::max(std::min({ v0.y, v1.y, v2.y }), clip.y0);
+			int maxX = std::min(std::max({ v0.x, v1.x, v2.x }), clip.x1);
+			int maxY = std::min(std::max({ v0.y, v1.y, v2.y }), clip.y1);
+
+			if (minX > maxX || minY > maxY)
+				return;
+
+			const Edge edges[3] = { Edge(v1, v2), Edge(v2, v0), Edge(v0, v1) };
+
+			for (int y = minY; y <= maxY; y++) {
+				// A x + c >= 0 bounds x from the left for A > 0, from the right for A < 0
+				int64_t x0 = minX, x1 = maxX;
+				for (const Edge& e : edges) {
+					int64_t c = e.B * y + e.C;
+					if (e.A > 0)
+						x0 = std::max(x0, CeilDiv(-c, e.A));
+					else if (e.A < 0)
+						x1 = std::min(x1, FloorDiv(c, -e.A));
+					else if (c < 0)
+						x1 = x0 - 1;
+				}
+
+				if (x0 <= x1)
+					span(y, (int)x0, (int)x1);
+			}
+		}
+
+
+
+		// Plane of an attribute with values a0, a1, a2 at the corners:
+		// a(x, y) = a0 + dx * (x - v0.x) + dy * (y - v0.y)
+		static void AttributePlane(Vec2D v0, Vec2D v1, Vec2D v2, double a0, double a1, double a2, double& dx, double& dy) {
+			double area = ((double)v1.x - v0.x) * ((double)v2.y - v0.y) - ((double)v1.y - v0.y) * ((double)v2.x - v0.x);
+			dx = ((a1 - a0) * ((double)v2.y - v0.y) - (a2 - a0) * ((double)v1.y - v0.y)) / area;
+			dy = ((a2 - a0) * ((double)v1.x - v0.x) - (a1 - a0) * ((double)v2.x - v0.x)) / area;
+		}
+
+
+
+		// 16.16 fixed point, clamped to +-nLimit
+		static int32_t ToFixed(double f, int32_t nLimit) {
+			f = std::min(std::max(f * 65536.0, -(double)nLimit), (double)nLimit);
+			return (int32_t)std::lround(f);
+		}
+
+
+
+		// Span of a Gouraud shaded triangle. Four byte formats are shaded straight into
+		// the row when nothing is blended, everything else goes through the scratch row.
+		void ShadeSpan(Texel* pDst, size_t nCount, const int32_t pColor[4], const int32_t pStep[4], bool bOpaque) {
+			const bool bBytes = FORMAT::ID == PixelFormat::RGBA8888 || FORMAT::ID == PixelFormat::BGRA8888;
+			const int nRed = FORMAT::ID == PixelFormat::BGRA8888 ? 2 : 0;
+
+			if (bBytes && bOpaque) {
+				ShadeKernels::Gouraud((uint8_t*)pDst, nCount, pColor, pStep, nRed);
+				return;
+			}
+
+			if (bBytes) {
+				if (m_shadeRow.size() < nCount)
+					m_shadeRow.resize(nCount);
+				Texel* pSrc = m_shadeRow.data();
+				ShadeKernels::Gouraud((uint8_t*)pSrc, nCount, pColor, pStep, nRed);
+
+				if (m_blendMode == BlendMode::ALPHA) {
+					BlendKernels::Over<FORMAT>(pDst, pSrc, nCount);
+				}
+				else {
+					for (size_t i = 0; i < nCount; i++)
+						pDst[i] = FORMAT::Encode(BlendOp(FORMAT::Decode(pSrc[i]), m_blendMode).Apply(FORMAT::Decode(pDst[i])));
+				}
+				return;
+			}
+
+			if (m_shadePixels.size() < nCount)
+				m_shadePixels.resize(nCount);
+			Pixel* pSrc = m_shadePixels.data();
+			ShadeKernels::Gouraud((uint8_t*)pSrc, nCount, pColor, pStep, 0);
+
+			if (bOpaque) {
+				for (size_t i = 0; i < nCount; i++)
+					pDst[i] = FORMAT::Encode(pSrc[i]);
+			}
+			else {
+				for (size_t i = 0; i < nCount; i++)
+					pDst[i] = FORMAT::Encode(BlendOp(pSrc[i], m_blendMode).Apply(FORMAT::Decode(pDst[i])));
+			}
+		}
+
+
+
+		// Per triangle constants of a Gouraud shaded triangle
+		struct GouraudSetup {
+			Vec2D       v0;
+			double      c0[4];
+			double      dx[4];
+			double      dy[4];
+			int32_t     nStep[4];
+			bool        bOpaque;
+		};
+
+		// False if the triangle has no area
+		bool SetupGouraud(Vec2D p0, Pixel c0, Vec2D p1, Pixel c1, Vec2D p2, Pixel c2, GouraudSetup& setup) const {
+			if (((int64_t)p1.x - p0.x) * ((int64_t)p2.y - p0.y) == ((int64_t)p1.y - p0.y) * ((int64_t)p2.x - p0.x))
+				return false;
+
+			const uint8_t corners[3][4] = { { c0.r, c0.g, c0.b, c0.a }, { c1.r, c1.g, c1.b, c1.a }, { c2.r, c2.g, c2.b, c2.a } };
+			setup.v0 = p0;
+			for (int k = 0; k < 4; k++) {
+				setup.c0[k] = corners[0][k];
+				AttributePlane(p0, p1, p2, corners[0][k], corners[1][k], corners[2][k], setup.dx[k], setup.dy[k]);
+				setup.nStep[k] = ToFixed(setup.dx[k], GOURAUD_LIMIT);
+			}
+
+			setup.bOpaque = m_blendMode == BlendMode::NONE ||
+				(c0.a == 255 && c1.a == 255 && c2.a == 255 && (m_blendMode == BlendMode::ALPHA || m_blendMode == BlendMode::PREMULTIPLIED));
+			return true;
+		}
+
+		// Colors stay within +-256 in 16.16, far off the plane values are clamped
+		static constexpr int32_t GOURAUD_LIMIT = 256 << 16;
+
+
+
+		// Inclusive run x0..x1 of row y of a Gouraud shaded triangle
+		void GouraudRun(const GouraudSetup& setup, int y, int x0, int x1) {
+			int32_t nColor[4];
+			for (int k = 0; k < 4; k++)
+				nColor[k] = ToFixed(setup.c0[k] + setup.dx[k] * (x0 - setup.v0.x) + setup.dy[k] * (y - setup.v0.y), GOURAUD_LIMIT) + 32768;
+
+			ShadeSpan(Row(y) + x0, (size_t)(x1 - x0 + 1), nColor, setup.nStep, setup.bOpaque);
+			MarkDirty(x0, y, x1, y);
+			m_stats.nPixels += (uint64_t)(x1 - x0 + 1);
+		}
+
+
+
+		// Per triangle constants of a texture mapped triangle: planes of u, v or
+		// of u / w, v / w, 1 / w
+		struct TextureSetup {
+			TextureSampler<Texel> sampler;
+			Vec2D       v0;
+			double      a0[3];
+			double      dx[3];
+			double      dy[3];
+			bool        bPerspective;
+
+			TextureSetup(const BasicSprite<FORMAT>& texture, TextureWrap wrap)
+				: sampler(texture.Data(), texture.Width(), texture.Height(), texture.Pitch(), wrap == TextureWrap::REPEAT) {
+			}
+		};
+
+		// False if there is nothing to draw
+		static bool SetupTexture(const TexVertex& a, const TexVertex& b, const TexVertex& c, TextureSetup& setup) {
+			if (setup.sampler.nWidth <= 0 || setup.sampler.nHeight <= 0 || !(a.w > 0.0f && b.w > 0.0f && c.w > 0.0f))
+				return false;
+			if (((int64_t)b.pos.x - a.pos.x) * ((int64_t)c.pos.y - a.pos.y) == ((int64_t)b.pos.y - a.pos.y) * ((int64_t)c.pos.x - a.pos.x))
+				return false;
+
+			double attr[3][3] = { { a.u, a.v, 1.0 }, { b.u, b.v, 1.0 }, { c.u, c.v, 1.0 } };
+			auto planes = [&]() {
+				for (int k = 0; k < 3; k++) {
+					setup.a0[k] = attr[0][k];
+					AttributePlane(a.pos, b.pos, c.pos, attr[0][k], attr[1][k], attr[2][k], setup.dx[k], setup.dy[k]);
+				}
+			};
+
+			// Fixed point only covers +-16384 texels and steps of +-4096, beyond that
+			// the float path takes over
+			const double fFixedLimit = 16384.0;
+			setup.v0 = a.pos;
+			setup.bPerspective = a.w != b.w || b.w != c.w;
+			for (int i = 0; i < 3; i++)
+				setup.bPerspective |= std::fabs(attr[i][0]) > fFixedLimit || std::fabs(attr[i][1]) > fFixedLimit;
+
+			if (!setup.bPerspective) {
+				planes();
+				setup.bPerspective = std::fabs(setup.dx[0]) > 4096.0 || std::fabs(setup.dx[1]) > 4096.0;
+			}
+
+			if (setup.bPerspective) {
+				const float w[3] = { a.w, b.w, c.w };
+				for (int i = 0; i < 3; i++) {
+					attr[i][0] /= w[i];
+					attr[i][1] /= w[i];
+					attr[i][2] /= w[i];
+				}
+				planes();
+			}
+			return true;
+		}
+
+
+
+		// Inclusive run x0..x1 of row y of a texture mapped triangle
+		void TextureRun(const TextureSetup& setup, const BasicSprite<FORMAT>& texture, int y, int x0, int x1) {
+			size_t nCount = (size_t)(x1 - x0 + 1);
+			double at[3];
+			for (int k = 0; k < 3; k++)
+				at[k] = setup.a0[k] + setup.dx[k] * (x0 - setup.v0.x) + setup.dy[k] * (y - setup.v0.y);
+
+			const bool bDirect = texture.Mask() == SpriteMask::NONE;
+			if (!bDirect && m_shadeRow.size() < nCount)
+				m_shadeRow.resize(nCount);
+			Texel* pDst = Row(y) + x0;
+			Texel* pOut = bDirect ? pDst : m_shadeRow.data();
+
+			if (setup.bPerspective)
+				ShadeKernels::Perspective(pOut, nCount, setup.sampler, (float)at[0], (float)at[1], (float)at[2], (float)setup.dx[0], (float)setup.dx[1], (float)setup.dx[2]);
+			else
+				ShadeKernels::Affine(pOut, nCount, setup.sampler, ToFixed(at[0], INT32_MAX), ToFixed(at[1], INT32_MAX), ToFixed(setup.dx[0], INT32_MAX), ToFixed(setup.dx[1], INT32_MAX));
+
+			if (!bDirect)
+				BlitRow(pDst, pOut, nCount, texture);
+			MarkDirty(x0, y, x1, y);
+			m_stats.nPixels += nCount;
+		}
+
+
+
+		// Depth tested triangle, z per corner in [0, 1]. Walks DepthBuffer tiles of the
+		// bounding box: a tile is skipped if the triangle is nowhere nearer than its
+		// farthest value, and written without per pixel tests if the triangle covers it
+		// and is everywhere nearer than its nearest value. Writes the depth of every
+		// pixel that passes, then calls run(y, x0, x1) for each inclusive row run of them.
+		template<typename T, typename RUN>
+		void DepthTriangleRuns(Vec2D v0, Vec2D v1, Vec2D v2, float z0, float z1, float z2, DepthBuffer& depth, RUN&& run) {
+			static_assert(DepthBuffer::TILE_SIZE == TILE_SIZE, "depth tiles are walked like raster tiles");
+
+			int64_t area = ((int64_t)v1.x - v0.x) * ((int64_t)v2.y - v0.y) - ((int64_t)v1.y - v0.y) * ((int64_t)v2.x - v0.x);
+
+			if (area == 0)
+				return;
+			if (area < 0) {
+				std::swap(v1, v2);
+				std::swap(z1, z2);
+			}
+
+			int minX = std::max(std::min({ v0.x, v1.x, v2.x }), 0);
+			int minY = std::max(std::min({ v0.y, v1.y, v2.y }), 0);
+			int maxX = std::min({ std::max({ v0.x, v1.x, v2.x }), m_nWidth - 1, depth.m_nWidth - 1 });
+			int maxY = std::min({ std::max({ v0.y, v1.y, v2.y }), m_nHeight - 1, depth.m_nHeight - 1 });
+
+			if (minX > maxX || minY > maxY)
+				return;
+
+			// Depth plane in storage units, every value kept within the corners' range
+			const float fScale = depth.Scale();
+			const double zc[3] = {
+				std::min(std::max(z0, 0.0f), 1.0f) * (double)fScale,
+				std::min(std::max(z1, 0.0f), 1.0f) * (double)fScale,
+				std::min(std::max(z2, 0.0f), 1.0f) * (double)fScale };
+			double dzdx, dzdy;
+			AttributePlane(v0, v1, v2, zc[0], zc[1], zc[2], dzdx, dzdy);
+			const double zMin = std::min({ zc[0], zc[1], zc[2] });
+			const double zMax = std::max({ zc[0], zc[1], zc[2] });
+			auto plane = [&](int x, int y) {
+				return zc[0] + dzdx * (x - v0.x) + dzdy * (y - v0.y);
+			};
+
+			// Stored values are compared in storage precision, D16 rounds to the nearest unit
+			const bool bRound = depth.m_format == DepthFormat::D16;
+			auto quantize = [&](double z) {
+				return bRound ? std::floor(z + 0.5) : (double)(float)z;
+			};
+
+			const Edge e0(v1, v2), e1(v2, v0), e2(v0, v1);
+			T* pValues = depth.Values((T*)nullptr);
+
+			for (int ty = minY & ~(TILE_SIZE - 1); ty <= maxY; ty += TILE_SIZE) {
+				int y0 = std::max(ty, minY);
+				int y1 = std::min(ty + TILE_SIZE - 1, maxY);
+
+				for (int tx = minX & ~(TILE_SIZE - 1); tx <= maxX; tx += TILE_SIZE) {
+					int x0 = std::max(tx, minX);
+					int x1 = std::min(tx + TILE_SIZE - 1, maxX);
+
+					if (e0.Max(x0, y0, x1, y1) < 0 || e1.Max(x0, y0, x1, y1) < 0 || e2.Max(x0, y0, x1, y1) < 0)
+						continue;
+
+					// The plane is linear, so its range over the tile is at the corners
+					double a = plane(x0, y0), b = plane(x1, y0), c = plane(x0, y1), d = plane(x1, y1);
+					double zLo = std::max(std::min({ a, b, c, d }), zMin);
+					double zHi = std::min(std::max({ a, b, c, d }), zMax);
+					zLo = quantize(zLo);
+					zHi = quantize(zHi);
+
+					size_t nTile = depth.TileIndex(x0, y0);
+					float& fTileMin = depth.m_tileMin[nTile];
+					float& fTileMax = depth.m_tileMax[nTile];
+
+					// Everything already in the tile is at least as near
+					if (zLo >= fTileMax) {
+						depth.m_nRejectedTiles++;
+						continue;
+					}
+
+					T* pTile = pValues + nTile * DepthBuffer::TILE_VALUES;
+					bool bCovered = e0.Min(x0, y0, x1, y1) >= 0 && e1.Min(x0, y0, x1, y1) >= 0 && e2.Min(x0, y0, x1, y1) >= 0;
+
+					// Covered and nearer than everything in the tile, no per pixel tests
+					if (bCovered && zHi < fTileMin) {
+						bool bWhole = x1 - x0 == TILE_SIZE - 1 && y1 - y0 == TILE_SIZE - 1;
+						if (!bWhole)
+							depth.Materialize(nTile, pValues);
+						depth.m_tileCleared[nTile] = 0;
+
+						for (int y = y0; y <= y1; y++) {
+							T* pRow = pTile + (y - ty) * TILE_SIZE;
+							for (int x = x0; x <= x1; x++)
+								pRow[x - tx] = (T)std::min(std::max(quantize(plane(x, y)), zLo), zHi);
+							run(y, x0, x1);
+						}
+
+						fTileMin = (float)zLo;
+						if (bWhole)
+							fTileMax = (float)zHi;
+						depth.m_nAcceptedTiles++;
+						continue;
+					}
+
+					depth.Materialize(nTile, pValues);
+
+					double fWrittenMin = fTileMin;
+					bool bWritten = false;
+					int64_t w0Row = e0.At(x0, y0);
+					int64_t w1Row = e1.At(x0, y0);
+					int64_t w2Row = e2.At(x0, y0);
+
+					for (int y = y0; y <= y1; y++) {
+						int64_t w0 = w0Row, w1 = w1Row, w2 = w2Row;
+						T* pRow = pTile + (y - ty) * TILE_SIZE;
+						int nStart = -1;
+
+						for (int x = x0; x <= x1; x++) {
+							bool bPass = false;
+							if ((w0 | w1 | w2) >= 0) {
+								double z = std::min(std::max(quantize(plane(x, y)), zLo), zHi);
+								if (z < (double)pRow[x - tx]) {
+									pRow[x - tx] = (T)z;
+									fWrittenMin = std::min(fWrittenMin, z);
+									bPass = bWritten = true;
+								}
+							}
+
+							if (bPass && nStart < 0) {
+								nStart = x;
+							}
+							else if (!bPass && nStart >= 0) {
+								run(y, nStart, x - 1);
+								nStart = -1;
+							}
+
+							w0 += e0.A;
+							w1 += e1.A;
+							w2 += e2.A;
+						}
+
+						if (nStart >= 0)
+							run(y, nStart, x1);
+
+						w0Row += e0.B;
+						w1Row += e1.B;
+						w2Row += e2.B;
+					}
+
+					// Values only got nearer, the farthest one has to be looked up again
+					if (bWritten) {
+						fTileMin = (float)fWrittenMin;
+						fTileMax = (float)*std::max_element(pTile, pTile + DepthBuffer::TILE_VALUES);
+					}
+				}
+			}
+		}
+
+
+
+		// Depth tested triangle with the depth buffer's value type picked once
+		template<typename RUN>
+		void DepthTriangle(Vec2D v0, Vec2D v1, Vec2D v2, float z0, float z1, float z2, DepthBuffer& depth, RUN&& run) {
+			if (depth.Format() == DepthFormat::D16)
+				DepthTriangleRuns<uint16_t>(v0, v1, v2, z0, z1, z2, depth, run);
+			else
+				DepthTriangleRuns<float>(v0, v1, v2, z0, z1, z2, depth, run);
+		}
+
+
+
+		void RasterPixel(int x, int y, const Brush& brush, const Rect& clip) {
+			if (x >= clip.x0 && x <= clip.x1 && y >= clip.y0 && y <= clip.y1) {
+				Plot(Row(y) + x, brush);
+				MarkDirty(x, y, x, y);
+			}
+		}
+
+
+
+		// Inclusive horizontal span
+		void FillSpan(int x0, int x1, int y, const Brush& brush, const Rect& clip) {
+			if (y < clip.y0 || y > clip.y1)
+				return;
+
+			if (x0 > x1)
+				std::swap(x0, x1);
+
+			x0 = std::max(x0, clip.x0);
+			x1 = std::min(x1, clip.x1);
+
+			if (x0 > x1)
+				return;
+
+			PaintSpan(Row(y) + x0, x1 - x0 + 1, brush);
+			MarkDirty(x0, y, x1, y);
+		}
+
+
+
+		// Inclusive rectangle, clipped once and filled row by row
+		void FillRect(int x0, int y0, int x1, int y1, const Brush& brush, const Rect& clip) {
+			x0 = std::max(x0, clip.x0);
+			y0 = std::max(y0, clip.y0);
+			x1 = std::min(x1, clip.x1);
+			y1 = std::min(y1, clip.y1);
+
+			if (x0 > x1 || y0 > y1)
+				return;
+
+			PaintRows(Row(y0) + x0, x1 - x0 + 1, y1 - y0 + 1, brush);
+			MarkDirty(x0, y0, x1, y1);
+		}
+
+
+
+		// Fills the convex hull of the four corners, so their order doesn't matter.
+		// Two triangles sharing a diagonal, the fill rule draws it exactly once.
+		void RasterQuad(Vec2D v0, Vec2D v1, Vec2D v2, Vec2D v3, const Brush& brush, const Rect& clip) {
+			const Vec2D corners[4] = { v0, v1, v2, v3 };
+			Vec2D hull[4];
+
+			int n = QuadHull(corners, hull);
+			if (n >= 3)
+				RasterTriangle(hull[0], hull[1], hull[2], brush, clip);
+			if (n == 4)
+				RasterTriangle(hull[0], hull[2], hull[3], brush, clip);
+		}
+
+
+
+		// Scanline polygon fill with an active edge table. Samples the integer
+		// coordinates like RasterTriangle: scanline y crosses edges with y0 <= y < y1,
+		// and of a crossing at x the pixels from ceil(x) on are right of it, so a
+		// triangle covers the same pixels as with RasterTriangle.
+		void RasterPolygon(const Vec2D* pPoints, size_t nCount, FillRule rule, const Brush& brush, const Rect& clip) {
+			m_polyEdges.clear();
+
+			int yMin = INT32_MAX, yMax = INT32_MIN;
+			for (size_t i = 0; i < nCount; i++) {
+				Vec2D a = pPoints[i];
+				Vec2D b = pPoints[i + 1 < nCount ? i + 1 : 0];
+				if (a.y == b.y)
+					continue;
+
+				PolyEdge e;
+				e.nWinding = a.y < b.y ? 1 : -1;
+				if (a.y > b.y)
+					std::swap(a, b);
+
+				// Scanlines a.y .. b.y - 1, cut to the clip
+				e.nY0 = std::max(a.y, clip.y0);
+				e.nY1 = std::min(b.y - 1, clip.y1);
+				if (e.nY0 > e.nY1)
+					continue;
+
+				// x on scanline y is a.x + (y - a.y) * dx / dy, kept as ceil and remainder
+				int64_t dx = (int64_t)b.x - a.x;
+				e.nDy = (int64_t)b.y - a.y;
+				int64_t num = (int64_t)a.x * e.nDy + ((int64_t)e.nY0 - a.y) * dx;
+				e.q = CeilDiv(num, e.nDy);
+				e.r = e.q * e.nDy - num;
+				e.nStepQ = FloorDiv(dx, e.nDy);
+				e.nStepR = dx - e.nStepQ * e.nDy;
+
+				m_polyEdges.push_back(e);
+				yMin = std::min(yMin, e.nY0);
+				yMax = std::max(yMax, e.nY1);
+			}
+
+			if (m_polyEdges.empty())
+				return;
+
+			std::sort(m_polyEdges.begin(), m_polyEdges.end(), [](const PolyEdge& a, const PolyEdge& b) { return a.nY0 < b.nY0; });
+
+			m_polyActive.clear();
+			size_t nNext = 0;
+
+			for (int y = yMin; y <= yMax; y++) {
+				while (nNext < m_polyEdges.size() && m_polyEdges[nNext].nY0 == y)
+					m_polyActive.push_back((uint32_t)nNext++);
+
+				m_polyCrossings.clear();
+				for (size_t i = 0; i < m_polyActive.size(); ) {
+					const PolyEdge& e = m_polyEdges[m_polyActive[i]];
+					if (e.nY1 < y) {
+						m_polyActive[i] = m_polyActive.back();
+						m_polyActive.pop_back();
+						continue;
+					}
+					m_polyCrossings.push_back(PolyCrossing{ e.q, e.nWinding });
+					i++;
+				}
+
+				// Few crossings per line and mostly in order from the line before
+				for (size_t i = 1; i < m_polyCrossings.size(); i++) {
+					PolyCrossing c = m_polyCrossings[i];
+					size_t j = i;
+					for (; j > 0 && m_polyCrossings[j - 1].x > c.x; j--)
+						m_polyCrossings[j] = m_polyCrossings[j - 1];
+					m_polyCrossings[j] = c;
+				}
+
+				// Inside between crossings where the winding is odd, or not zero
+				int nWinding = 0;
+				int64_t nStart = 0;
+				for (const PolyCrossing& c : m_polyCrossings) {
+					int nBefore = nWinding;
+					nWinding += rule == FillRule::EVEN_ODD ? 1 : c.nWinding;
+					bool bInBefore = rule == FillRule::EVEN_ODD ? (nBefore & 1) != 0 : nBefore != 0;
+					bool bInAfter = rule == FillRule::EVEN_ODD ? (nWinding & 1) != 0 : nWinding != 0;
+
+					if (!bInBefore && bInAfter) {
+						nStart = c.x;
+					}
+					else if (bInBefore && !bInAfter && nStart < c.x) {
+						int64_t x0 = std::max<int64_t>(nStart, clip.x0);
+						int64_t x1 = std::min<int64_t>(c.x - 1, clip.x1);
+						if (x0 <= x1) {
+							PaintSpan(Row(y) + x0, (size_t)(x1 - x0 + 1), brush);
+							MarkDirty((int)x0, y, (int)x1, y);
+						}
+					}
+				}
+
+				for (uint32_t nEdge : m_polyActive) {
+					PolyEdge& e = m_polyEdges[nEdge];
+					e.q += e.nStepQ;
+					e.r -= e.nStepR;
+					if (e.r < 0) {
+						e.q++;
+						e.r += e.nDy;
+					}
+				}
+			}
+		}
+
+
+
+		// Adds pixel (x, y) of the quadrant to m_ellipseRows, -1 marks a row with none yet
+		void EllipsePixel(int64_t x, int64_t y) {
+			int32_t* pRow = &m_ellipseRows[2 * y];
+			if (pRow[0] < 0) {
+				pRow[0] = pRow[1] = (int32_t)x;
+				return;
+			}
+			pRow[0] = std::min(pRow[0], (int32_t)x);
+			pRow[1] = std::max(pRow[1], (int32_t)x);
+		}
+
+
+
+		// Lower right quadrant outline of a midpoint circle into m_ellipseRows
+		void CircleRows(int nRadius) {
+			m_ellipseRows.assign(2 * ((size_t)nRadius + 1), -1);
+
+			// One octant, x <= y, mirrored over the diagonal
+			int x = 0, y = nRadius, d = 1 - nRadius;
+			while (x <= y) {
+				EllipsePixel(x, y);
+				EllipsePixel(y, x);
+				x++;
+				if (d < 0) {
+					d += 2 * x + 1;
+				}
+				else {
+					y--;
+					d += 2 * (x - y) + 1;
+				}
+			}
+		}
+
+
+
+		// Lower right quadrant outline of a midpoint ellipse into m_ellipseRows.
+		// Decision variables are 4 times the implicit function at the midpoint.
+		void EllipseRows(int rx, int ry) {
+			m_ellipseRows.assign(2 * ((size_t)ry + 1), -1);
+
+			if (rx == 0 || ry == 0) {
+				for (int y = 0; y <= ry; y++) {
+					EllipsePixel(0, y);
+					EllipsePixel(y == 0 ? rx : 0, y);
+				}
+				return;
+			}
+
+			int64_t a2 = (int64_t)rx * rx, b2 = (int64_t)ry * ry;
+			int64_t x = 0, y = ry;
+
+			// Slope above -1, step x
+			int64_t d = 4 * b2 - 4 * a2 * ry + a2;
+			while (b2 * x < a2 * y) {
+				EllipsePixel(x, y);
+				if (d >= 0) {
+					d += 4 * a2 * (2 - 2 * y);
+					y--;
+				}
+				d += 4 * b2 * (2 * x + 3);
+				x++;
+			}
+
+			// Slope below -1, step y
+			d = b2 * (2 * x + 1) * (2 * x + 1) + 4 * a2 * (y - 1) * (y - 1) - 4 * a2 * b2;
+			while (y >= 0) {
+				EllipsePixel(x, y);
+				if (d <= 0) {
+					d += 4 * b2 * (2 * x + 2);
+					x++;
+				}
+				d += 4 * a2 * (3 - 2 * y);
+				y--;
+			}
+
+			// Flat ellipses leave the last step short of the tips
+			m_ellipseRows[1] = rx;
+		}
+
+
+
+		// Outline of m_ellipseRows mirrored around (cx, cy), every pixel once
+		void RasterEllipseOutline(int cx, int cy, const Brush& brush, const Rect& clip) {
+			int nRows = (int)(m_ellipseRows.size() / 2);
+			for (int dy = 0; dy < nRows; dy++) {
+				int x0 = m_ellipseRows[2 * dy], x1 = m_ellipseRows[2 * dy + 1];
+				if (x0 < 0)
+					continue;
+
+				for (int y : { cy - dy, cy + dy }) {
+					if (x0 == 0) {
+						FillSpan(cx - x1, cx + x1, y, brush, clip);
+					}
+					else {
+						FillSpan(cx - x1, cx - x0, y, brush, clip);
+						FillSpan(cx + x0, cx + x1, y, brush, clip);
+					}
+					if (dy == 0)
+						break;
+				}
+			}
+		}
+
+
+
+		// Inside of m_ellipseRows mirrored around (cx, cy), one span per row
+		void RasterEllipseFill(int cx, int cy, const Brush& brush, const Rect& clip) {
+			int nRows = (int)(m_ellipseRows.size() / 2);
+			for (int dy = std::max(0, std::max(clip.y0 - cy, cy - clip.y1)); dy < nRows; dy++) {
+				int x1 = m_ellipseRows[2 * dy + 1];
+				if (x1 < 0)
+					continue;
+
+				FillSpan(cx - x1, cx + x1, cy - dy, brush, clip);
+				if (dy != 0)
+					FillSpan(cx - x1, cx + x1, cy + dy, brush, clip);
+			}
+		}
+
+
+
+		// Line nWidth pixels wide with square ends flush with the end points
+		void RasterThickLine(int x0, int y0, int x1, int y1, int nWidth, const Brush& brush, const Rect& clip) {
+			double dx = (double)x1 - x0, dy = (double)y1 - y0;
+			double fLength = std::sqrt(dx * dx + dy * dy);
+
+			if (fLength == 0.0) {
+				int h = nWidth / 2;
+				FillRect(x0 - h, y0 - h, x0 - h + nWidth - 1, y0 - h + nWidth - 1, brush, clip);
+				return;
+			}
+
+			// Half width along the normal
+			double nx = -dy / fLength * nWidth * 0.5;
+			double ny = dx / fLength * nWidth * 0.5;
+			auto corner = [](double x, double y) {
+				return Vec2D((int)std::lround(x), (int)std::lround(y));
+			};
+
+			RasterQuad(corner(x0 + nx, y0 + ny), corner(x1 + nx, y1 + ny), corner(x1 - nx, y1 - ny), corner(x0 - nx, y0 - ny), brush, clip);
+		}
+
+
+
+		// Text out of the glyph atlas a line at a time: the clipped glyph spans of
+		// a line are gathered first, then every row of the line is written left to right.
+		void RasterText(int x, int y, const char* sText, size_t nLength, Pixel p, int nScale) {
+			nScale = std::max(nScale, 1);
+			const BasicSprite<FORMAT>& glyphs = m_text.Glyphs(*m_pFont, p, nScale);
+			int nCellWidth = m_pFont->CellWidth() * nScale;
+			int nCellHeight = m_pFont->CellHeight() * nScale;
+			Texel key = glyphs.Key();
+			m_stats.nPrimitives++;
+
+			int nLineY = y;
+			for (size_t i = 0; i <= nLength; nLineY += nCellHeight) {
+				size_t nEnd = i;
+				while (nEnd < nLength && sText[nEnd] != '\n')
+					nEnd++;
+
+				int y0 = std::max(nLineY, 0);
+				int y1 = std::min(nLineY + nCellHeight, m_nHeight) - 1;
+
+				if (y0 <= y1) {
+					m_glyphSpans.clear();
+					for (size_t k = i; k < nEnd; k++) {
+						int c = (uint8_t)sText[k];
+						int gx = x + (int)(k - i) * nCellWidth;
+						int x0 = std::max(gx, 0);
+						int x1 = std::min(gx + nCellWidth, m_nWidth) - 1;
+
+						if (x0 <= x1 && m_pFont->IsInked(c)) {
+							int ox = (c % BasicTextCache<FORMAT>::ATLAS_COLUMNS) * nCellWidth;
+							int oy = (c / BasicTextCache<FORMAT>::ATLAS_COLUMNS) * nCellHeight;
+							m_glyphSpans.push_back({ x0, ox + x0 - gx, x1 - x0 + 1, oy - nLineY });
+						}
+					}
+
+					if (!m_glyphSpans.empty()) {
+						const GlyphSpan& last = m_glyphSpans.back();
+						MarkDirty(m_glyphSpans.front().nDst, y0, last.nDst + last.nCount - 1, y1);
+
+						for (const GlyphSpan& span : m_glyphSpans)
+							m_stats.nPixels += (uint64_t)span.nCount * (y1 - y0 + 1);
+
+						for (int row = y0; row <= y1; row++) {
+							Texel* pDst = Row(row);
+							for (const GlyphSpan& span : m_glyphSpans)
+								SpanKernels::CopyKeyed(pDst + span.nDst, glyphs.Row(span.nSrcRow + row) + span.nSrc, (size_t)span.nCount, key);
+						}
+					}
+				}
+
+				i = nEnd + 1;
+			}
+		}
+
+
+
+	public:
+		BasicFramebuffer() : FramebufferBase(FORMAT::ID) {}
+
+		BasicFramebuffer(int nWidth, int nHeight, Pixel p = THPX::BLACK) : FramebufferBase(FORMAT::ID) {
+			Resize(nWidth, nHeight, p);
+		}
+
+
+
+		void Resize(int nWidth, int nHeight, Pixel p = THPX::BLACK) {
+			Allocate(nWidth, nHeight);
+			Clear(p);
+		}
+
+
+
+		void SetBlendMode(BlendMode blend) {
+			m_blendMode = blend;
+		}
+
+
+
+		BlendMode GetBlendMode() const {
+			return m_blendMode;
+		}
+
+
+
+		void DrawPixel(int x, int y, uint8_t r, uint8_t g, uint8_t b) {
+			DrawPixel(x, y, Pixel(r, g, b));
+		}
+		void DrawPixel(int x, int y, Pixel p) {
+			Brush brush = MakeBrush(p);
+			RasterPixel(x, y, brush, Bounds());
+			Count(brush);
+		}
+
+
+
+		void DrawLine(int x0, int y0, int x1, int y1, uint8_t r, uint8_t g, uint8_t b) {
+			DrawLine(x0, y0, x1, y1, Pixel(r, g, b));
+		}
+		void DrawLine(int x0, int y0, int x1, int y1, Pixel p) {
+			Brush brush = MakeBrush(p);
+			RasterLine(x0, y0, x1, y1, brush, Bounds());
+			Count(brush);
+		}
+
+
+
+		void DrawLines(const Line* pLines, size_t nCount) {
+			for (size_t i = 0; i < nCount; i++) {
+				Brush brush = MakeBrush(pLines[i].p);
+				RasterLine(pLines[i].p0.x, pLines[i].p0.y, pLines[i].p1.x, pLines[i].p1.y, brush, Bounds());
+				Count(brush);
+			}
+		}
+		void DrawLines(const std::vector<Line>& lines) {
+			DrawLines(lines.data(), lines.size());
+		}
+
+
+
+		void FillRectangle(int x, int y, int width, int height, uint8_t r, uint8_t g, uint8_t b) {
+			FillRectangle(x, y, width, height, Pixel(r, g, b));
+		}
+		void FillRectangle(Vec2D position, int width, int height, uint8_t r, uint8_t g, uint8_t b) {
+			FillRectangle(position.x, position.y, width, height, Pixel(r, g, b));
+		}
+		void FillRectangle(int x, int y, int width, int height, Pixel p) {
+			Brush brush = MakeBrush(p);
+			FillRect(x, y, x + width, y + height, brush, Bounds());
+			Count(brush);
+		}
+		void FillRectangle(Vec2D position, int width, int height, Pixel p) {
+			FillRectangle(position.x, position.y, width, height, p);
+		}
+		// Quad through four corners in any order, filled as their convex hull
+		void FillRectangle(Vec2D v0, Vec2D v1, Vec2D v2, Vec2D v3, Pixel p) {
+			Brush brush = MakeBrush(p);
+			RasterQuad(v0, v1, v2, v3, brush, Bounds());
+			Count(brush);
+		}
+
+
+
+		// Inclusive rectangles in one color, one brush for the whole batch
+		void FillRects(const Rect* pRects, size_t nCount, Pixel p) {
+			Brush brush = MakeBrush(p);
+			for (size_t i = 0; i < nCount; i++)
+				FillRect(pRects[i].x0, pRects[i].y0, pRects[i].x1, pRects[i].y1, brush, Bounds());
+			Count(brush, nCount);
+		}
+		void FillRects(const std::vector<Rect>& rects, Pixel p) {
+			FillRects(rects.data(), rects.size(), p);
+		}
+
+
+
+		void FillTriangle(Vec2D p0, Vec2D p1, Vec2D p2, uint8_t r, uint8_t g, uint8_t b) {
+			FillTriangle(p0, p1, p2, Pixel(r, g, b));
+		}
+		void FillTriangle(Vec2D p0, Vec2D p1, Vec2D p2, THPX::Pixel p) {
+			Brush brush = MakeBrush(p);
+			RasterTriangle(p0, p1, p2, brush, Bounds());
+			Count(brush);
+		}
+
+
+
+		// Triangle with the corner colors blended linearly across it (Gouraud shading)
+		void FillTriangle(Vec2D p0, Pixel c0, Vec2D p1, Pixel c1, Vec2D p2, Pixel c2) {
+			GouraudSetup setup;
+			if (!SetupGouraud(p0, c0, p1, c1, p2, c2, setup))
+				return;
+
+			TriangleSpans(p0, p1, p2, Bounds(), [&](int y, int x0, int x1) {
+				GouraudRun(setup, y, x0, x1);
+			});
+			m_stats.nPrimitives++;
+		}
+
+
+
+		// Flat triangle drawn where it is nearer than the depth buffer, which takes its
+		// depth there. z per corner from 0 (nearest) to 1 (farthest).
+		void FillTriangle(Vec2D p0, float z0, Vec2D p1, float z1, Vec2D p2, float z2, Pixel p, DepthBuffer& depth) {
+			Brush brush = MakeBrush(p);
+			DepthTriangle(p0, p1, p2, z0, z1, z2, depth, [&](int y, int x0, int x1) {
+				PaintSpan(Row(y) + x0, (size_t)(x1 - x0 + 1), brush);
+				MarkDirty(x0, y, x1, y);
+			});
+			Count(brush);
+		}
+
+
+
+		// Gouraud shaded triangle, depth tested
+		void FillTriangle(Vec2D p0, float z0, Pixel c0, Vec2D p1, float z1, Pixel c1, Vec2D p2, float z2, Pixel c2, DepthBuffer& depth) {
+			GouraudSetup setup;
+			if (!SetupGouraud(p0, c0, p1, c1, p2, c2, setup))
+				return;
+
+			DepthTriangle(p0, p1, p2, z0, z1, z2, depth, [&](int y, int x0, int x1) {
+				GouraudRun(setup, y, x0, x1);
+			});
+			m_stats.nPrimitives++;
+		}
+
+
+
+		// nTriangles triangles in one color, corners pVertices[pIndices[3 * i + k]],
+		// or pVertices[3 * i + k] without indices
+		void FillTriangles(const Vec2D* pVertices, const uint32_t* pIndices, size_t nTriangles, Pixel p) {
+			Brush brush = MakeBrush(p);
+			for (size_t i = 0; i < 3 * nTriangles; i += 3) {
+				if (pIndices)
+					RasterTriangle(pVertices[pIndices[i]], pVertices[pIndices[i + 1]], pVertices[pIndices[i + 2]], brush, Bounds());
+				else
+					RasterTriangle(pVertices[i], pVertices[i + 1], pVertices[i + 2], brush, Bounds());
+			}
+			Count(brush, nTriangles);
+		}
+		void FillTriangles(const std::vector<Vec2D>& vertices, const std::vector<uint32_t>& indices, Pixel p) {
+			FillTriangles(vertices.data(), indices.data(), indices.size() / 3, p);
+		}
+		void FillTriangles(const std::vector<Vec2D>& vertices, Pixel p) {
+			FillTriangles(vertices.data(), nullptr, vertices.size() / 3, p);
+		}
+
+
+
+		// Closed polygon through nCount points, self intersections resolved by rule
+		void FillPolygon(const Vec2D* pPoints, size_t nCount, Pixel p, FillRule rule = FillRule::NONZERO) {
+			Brush brush = MakeBrush(p);
+			RasterPolygon(pPoints, nCount, rule, brush, Bounds());
+			Count(brush);
+		}
+		void FillPolygon(const std::vector<Vec2D>& points, Pixel p, FillRule rule = FillRule::NONZERO) {
+			FillPolygon(points.data(), points.size(), p, rule);
+		}
+
+
+
+		// Connected line segments through nCount points, back to the first one if bClosed
+		void DrawPolyline(const Vec2D* pPoints, size_t nCount, Pixel p, bool bClosed = false) {
+			Brush brush = MakeBrush(p);
+			for (size_t i = 0; i + 1 < nCount; i++)
+				RasterLine(pPoints[i].x, pPoints[i].y, pPoints[i + 1].x, pPoints[i + 1].y, brush, Bounds());
+			if (bClosed && nCount > 2)
+				RasterLine(pPoints[nCount - 1].x, pPoints[nCount - 1].y, pPoints[0].x, pPoints[0].y, brush, Bounds());
+			Count(brush);
+		}
+		void DrawPolyline(const std::vector<Vec2D>& points, Pixel p, bool bClosed = false) {
+			DrawPolyline(points.data(), points.size(), p, bClosed);
+		}
+
+
+
+		// Line nWidth pixels wide, ends cut square at the end points
+		void DrawLine(int x0, int y0, int x1, int y1, int nWidth, Pixel p) {
+			Brush brush = MakeBrush(p);
+			if (nWidth <= 1)
+				RasterLine(x0, y0, x1, y1, brush, Bounds());
+			else
+				RasterThickLine(x0, y0, x1, y1, nWidth, brush, Bounds());
+			Count(brush);
+		}
+
+
+
+		// Midpoint circle, every outline pixel drawn once
+		void DrawCircle(int x, int y, int nRadius, Pixel p) {
+			if (nRadius < 0)
+				return;
+			Brush brush = MakeBrush(p);
+			CircleRows(nRadius);
+			RasterEllipseOutline(x, y, brush, Bounds());
+			Count(brush);
+		}
+
+
+
+		// Everything inside and on the outline DrawCircle draws
+		void FillCircle(int x, int y, int nRadius, Pixel p) {
+			if (nRadius < 0)
+				return;
+			Brush brush = MakeBrush(p);
+			CircleRows(nRadius);
+			RasterEllipseFill(x, y, brush, Bounds());
+			Count(brush);
+		}
+
+
+
+		// Circles of one radius and color, e.g. chart markers. The outline is worked out once.
+		void FillCircles(const Vec2D* pCenters, size_t nCount, int nRadius, Pixel p) {
+			if (nRadius < 0)
+				return;
+			Brush brush = MakeBrush(p);
+			CircleRows(nRadius);
+			for (size_t i = 0; i < nCount; i++)
+				RasterEllipseFill(pCenters[i].x, pCenters[i].y, brush, Bounds());
+			Count(brush, nCount);
+		}
+		void FillCircles(const std::vector<Vec2D>& centers, int nRadius, Pixel p) {
+			FillCircles(centers.data(), centers.size(), nRadius, p);
+		}
+
+
+
+		// Midpoint ellipse with axis aligned radii up to 32767
+		void DrawEllipse(int x, int y, int nRadiusX, int nRadiusY, Pixel p) {
+			if (nRadiusX < 0 || nRadiusY < 0 || nRadiusX > 32767 || nRadiusY > 32767)
+				return;
+			Brush brush = MakeBrush(p);
+			EllipseRows(nRadiusX, nRadiusY);
+			RasterEllipseOutline(x, y, brush, Bounds());
+			Count(brush);
+		}
+
+
+
+		void FillEllipse(int x, int y, int nRadiusX, int nRadiusY, Pixel p) {
+			if (nRadiusX < 0 || nRadiusY < 0 || nRadiusX > 32767 || nRadiusY > 32767)
+				return;
+			Brush brush = MakeBrush(p);
+			EllipseRows(nRadiusX, nRadiusY);
+			RasterEllipseFill(x, y, brush, Bounds());
+			Count(brush);
+		}
+
+
+
+		void DrawSprite(int x, int y, const BasicSprite<FORMAT>& sprite) {
+			DrawPartialSprite(x, y, sprite, 0, 0, sprite.Width(), sprite.Height());
+		}
+		void DrawSprite(Vec2D position, const BasicSprite<FORMAT>& sprite) {
+			DrawPartialSprite(position.x, position.y, sprite, 0, 0, sprite.Width(), sprite.Height());
+		}
+		void DrawSprite(int x, int y, const BasicSprite<FORMAT>& sprite, int nScale) {
+			DrawScaledSprite(x, y, sprite.Width() * nScale, sprite.Height() * nScale, sprite);
+		}
+
+
+
+		// Draws the w x h region at (ox, oy) of the sprite with its top-left corner at (x, y)
+		void DrawPartialSprite(int x, int y, const BasicSprite<FORMAT>& sprite, int ox, int oy, int w, int h) {
+			// Clip the region to the sprite, moving the destination along; in 64 bits
+			// so offsets and sizes anywhere in the int range can't overflow
+			int64_t dx = x, dy = y, sx = ox, sy = oy, sw = w, sh = h;
+			if (sx < 0) {
+				dx -= sx;
+				sw += sx;
+				sx = 0;
+			}
+			if (sy < 0) {
+				dy -= sy;
+				sh += sy;
+				sy = 0;
+			}
+			sw = std::min<int64_t>(sw, sprite.Width() - sx);
+			sh = std::min<int64_t>(sh, sprite.Height() - sy);
+
+			// Then the destination to the framebuffer
+			int64_t x0 = std::max<int64_t>(dx, 0);
+			int64_t y0 = std::max<int64_t>(dy, 0);
+			int64_t x1 = std::min<int64_t>(dx + sw, m_nWidth) - 1;
+			int64_t y1 = std::min<int64_t>(dy + sh, m_nHeight) - 1;
+
+			if (x0 > x1 || y0 > y1)
+				return;
+
+			MarkDirty((int)x0, (int)y0, (int)x1, (int)y1);
+			m_stats.nPrimitives++;
+			m_stats.nPixels += (uint64_t)(x1 - x0 + 1) * (y1 - y0 + 1);
+
+			for (int row = (int)y0; row <= (int)y1; row++)
+				BlitRow(Row(row) + x0, sprite.Row((int)(sy + row - dy)) + (sx + x0 - dx), (size_t)(x1 - x0 + 1), sprite);
+		}
+
+
+
+		// Triangle with the sprite mapped onto it, its texture coordinates repeating or
+		// clamped outside the sprite, written by the sprite's mask like a blit.
+		// Perspective correct when the corners' w differ, affine otherwise.
+		void DrawTexturedTriangle(const TexVertex& a, const TexVertex& b, const TexVertex& c, const BasicSprite<FORMAT>& texture, TextureWrap wrap = TextureWrap::REPEAT) {
+			TextureSetup setup(texture, wrap);
+			if (!SetupTexture(a, b, c, setup))
+				return;
+
+			TriangleSpans(a.pos, b.pos, c.pos, Bounds(), [&](int y, int x0, int x1) {
+				TextureRun(setup, texture, y, x0, x1);
+			});
+			m_stats.nPrimitives++;
+		}
+
+
+
+		// Texture mapped triangle, depth tested with the corners' z. Every covered
+		// pixel takes part, also where the texture's mask leaves it unchanged.
+		void DrawTexturedTriangle(const TexVertex& a, const TexVertex& b, const TexVertex& c, const BasicSprite<FORMAT>& texture, DepthBuffer& depth, TextureWrap wrap = TextureWrap::REPEAT) {
+			TextureSetup setup(texture, wrap);
+			if (!SetupTexture(a, b, c, setup))
+				return;
+
+			DepthTriangle(a.pos, b.pos, c.pos, a.z, b.z, c.z, depth, [&](int y, int x0, int x1) {
+				TextureRun(setup, texture, y, x0, x1);
+			});
+			m_stats.nPrimitives++;
+		}
+
+
+
+		// Stretches the whole sprite over the w x h rectangle at (x, y)
+		void DrawScaledSprite(int x, int y, int w, int h, const BasicSprite<FORMAT>& sprite, SpriteFilter filter = SpriteFilter::NEAREST) {
+			DrawScaledPartialSprite(x, y, w, h, sprite, 0, 0, sprite.Width(), sprite.Height(), filter);
+		}
+
+
+
+		// Stretches the ow x oh region at (ox, oy) of the sprite over the w x h rectangle at (x, y)
+		void DrawScaledPartialSprite(int x, int y, int w, int h, const BasicSprite<FORMAT>& sprite, int ox, int oy, int ow, int oh, SpriteFilter filter = SpriteFilter::NEAREST) {
+			// Region clamped to the sprite, the destination keeps its size
+			int sx0 = std::max(ox, 0);
+			int sy0 = std::max(oy, 0);
+			ow = std::min(ox + ow, sprite.Width()) - sx0;
+			oh = std::min(oy + oh, sprite.Height()) - sy0;
+			ox = sx0;
+			oy = sy0;
+
+			if (ow <= 0 || oh <= 0 || w <= 0 || h <= 0)
+				return;
+
+			if (w == ow && h == oh) {
+				DrawPartialSprite(x, y, sprite, ox, oy, ow, oh);
+				return;
+			}
+
+			int x0 = std::max(x, 0);
+			int y0 = std::max(y, 0);
+			int x1 = std::min(x + w, m_nWidth) - 1;
+			int y1 = std::min(y + h, m_nHeight) - 1;
+
+			if (x0 > x1 || y0 > y1)
+				return;
+
+			MarkDirty(x0, y0, x1, y1);
+			m_stats.nPrimitives++;
+			m_stats.nPixels += (uint64_t)(x1 - x0 + 1) * (y1 - y0 + 1);
+
+			// Key colored texels must stay exact, filtering would bleed the key into the edges
+			bool bBilinear = filter == SpriteFilter::BILINEAR && sprite.Mask() != SpriteMask::COLORKEY;
+
+			size_t nCount = (size_t)(x1 - x0 + 1);
+			if (m_spriteRow.size() < nCount) {
+				m_spriteRow.resize(nCount);
+				m_spriteCols.resize(nCount);
+			}
+
+			Texel* pRow = m_spriteRow.data();
+			int32_t* pCols = m_spriteCols.data();
+
+			// Source columns are the same for every row
+			for (size_t i = 0; i < nCount; i++) {
+				int nCol = x0 - x + (int)i;
+				if (bBilinear) {
+					int sx, fx;
+					SampleSplit(SamplePos(nCol, w, ow), ow, sx, fx);
+					pCols[i] = ((ox + sx) << 8) | fx;
+				}
+				else {
+					pCols[i] = ox + (int)(((2 * (int64_t)nCol + 1) * ow) / (2 * (int64_t)w));
+				}
+			}
+
+			for (int row = y0; row <= y1; row++) {
+				int nRow = row - y;
+
+				if (bBilinear) {
+					int sy, fy;
+					SampleSplit(SamplePos(nRow, h, oh), oh, sy, fy);
+					const Texel* pTop = sprite.Row(oy + sy);
+					const Texel* pBottom = sprite.Row(oy + std::min(sy + 1, oh - 1));
+
+					for (size_t i = 0; i < nCount; i++) {
+						int sx = pCols[i] >> 8;
+						int fx = pCols[i] & 0xFF;
+						int sx1 = fx ? sx + 1 : sx;
+
+						Pixel a = FORMAT::Decode(pTop[sx]), b = FORMAT::Decode(pTop[sx1]);
+						Pixel c = FORMAT::Decode(pBottom[sx]), d = FORMAT::Decode(pBottom[sx1]);
+						pRow[i] = FORMAT::Encode(Pixel(
+							Lerp4(a.r, b.r, c.r, d.r, fx, fy), Lerp4(a.g, b.g, c.g, d.g, fx, fy),
+							Lerp4(a.b, b.b, c.b, d.b, fx, fy), Lerp4(a.a, b.a, c.a, d.a, fx, fy)));
+					}
+				}
+				else {
+					const Texel* pSrc = sprite.Row(oy + (int)(((2 * (int64_t)nRow + 1) * oh) / (2 * (int64_t)h)));
+					for (size_t i = 0; i < nCount; i++)
+						pRow[i] = pSrc[pCols[i]];
+				}
+
+				BlitRow(Row(row) + x0, pRow, nCount, sprite);
+			}
+		}
+
+
+
+		// Font DrawString and DrawText use, the built-in one by default. Not owned.
+		void SetFont(const Font& font) {
+			m_pFont = &font;
+		}
+
+
+
+		const Font& GetFont() const {
+			return *m_pFont;
+		}
+
+
+
+		// Text with its top-left corner at (x, y), glyphs nScale times their size.
+		// Laid out every call, for text that changes from frame to frame.
+		void DrawString(int x, int y, const char* sText, Pixel p, int nScale = 1) {
+			RasterText(x, y, sText, std::strlen(sText), p, nScale);
+		}
+		void DrawString(int x, int y, const std::string& sText, Pixel p, int nScale = 1) {
+			RasterText(x, y, sText.data(), sText.size(), p, nScale);
+		}
+
+
+
+		// Like DrawString, but laid out once into the text cache, drawing the same
+		// string again is a single blit. For labels that rarely change.
+		void DrawText(int x, int y, const char* sText, Pixel p, int nScale = 1) {
+			DrawSprite(x, y, m_text.Layout(sText, std::strlen(sText), *m_pFont, p, std::max(nScale, 1)));
+		}
+		void DrawText(int x, int y, const std::string& sText, Pixel p, int nScale = 1) {
+			DrawSprite(x, y, m_text.Layout(sText.data(), sText.size(), *m_pFont, p, std::max(nScale, 1)));
+		}
+
+		// Over a solid background, which makes the blit plain row copies
+		void DrawText(int x, int y, const char* sText, Pixel p, Pixel background, int nScale = 1) {
+			DrawSprite(x, y, m_text.Layout(sText, std::strlen(sText), *m_pFont, p, background, std::max(nScale, 1)));
+		}
+		void DrawText(int x, int y, const std::string& sText, Pixel p, Pixel background, int nScale = 1) {
+			DrawSprite(x, y, m_text.Layout(sText.data(), sText.size(), *m_pFont, p, background, std::max(nScale, 1)));
+		}
+
+
+
+		BasicTextCache<FORMAT>& TextCache() {
+			return m_text;
+		}
+
+
+
+		void Clear(Pixel clearPixel) {
+			// Padding included, so the whole buffer is one contiguous fill
+			SpanKernels::Fill(Texels(), (size_t)m_nPitch * m_nHeight, FORMAT::Encode(clearPixel));
+			Invalidate();
+
+			m_stats.nPrimitives++;
+			m_stats.nPixels += (uint64_t)m_nWidth * m_nHeight;
+		}
+
+
+
+		Pixel GetPixel(int x, int y) const {
+			if (x >= 0 && x < m_nWidth && y >= 0 && y < m_nHeight) {
+				return FORMAT::Decode(Row(y)[x]);
+			}
+			return THPX::BLACK;
+		}
+
+
+
+		// Texels of the first row, rows are Pitch() texels apart
+		Texel* Data() {
+			return Texels();
+		}
+		const Texel* Data() const {
+			return Texels();
+		}
+
+
+
+		Texel* Row(int y) {
+			return Texels() + (size_t)y * m_nPitch;
+		}
+		const Texel* Row(int y) const {
+			return Texels() + (size_t)y * m_nPitch;
+		}
+
+
+
+	};
+
+
+
+	using Framebuffer = BasicFramebuffer<THPX_PIXEL_FORMAT>;
+
+}
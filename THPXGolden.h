@@ -0,0 +1,1114 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <cmath>
+#include <string>
+#include <vector>
+#include <tuple>
+#include <algorithm>
+
+#include "THPXTypes.h"
+#include "THPXPixelFormat.h"
+#include "THPXFramebuffer.h"
+#include "THPXCommandList.h"
+#include "THPXTiledRasterizer.h"
+#include "THPXImageFile.h"
+#include "THPXLayers.h"
+#include "THPXBenchmark.h"
+
+
+namespace THPX {
+
+	//===== REFERENCE RASTERIZER =====//
+
+	// Runs a command list one pixel at a time straight from the definition of
+	// each primitive: no spans, tiles, incremental edges or SIMD. Meant to be
+	// slow and obviously right, the fast paths are compared against it.
+	// Blending goes through the blend kernels one pixel at a time, those are
+	// checked against BlendOp separately; this defines which pixels are covered.
+	class ReferenceRasterizer {
+
+	private:
+		template<typename FORMAT>
+		static void Plot(BasicFramebuffer<FORMAT>& fb, int x, int y, Pixel p, BlendMode blend) {
+			if (x < 0 || y < 0 || x >= fb.ScreenWidth() || y >= fb.ScreenHeight())
+				return;
+
+			typename FORMAT::Texel* pTexel = fb.Row(y) + x;
+			if (BlendOp::IsOpaque(p, blend))
+				*pTexel = FORMAT::Encode(p);
+			else
+				BlendKernels::Span<FORMAT>(pTexel, 1, BlendOp(p, blend));
+		}
+
+
+
+		// Pixel i of n along the major axis sits round(i * |db| / |da|) off it
+		template<typename FORMAT>
+		static void Line(BasicFramebuffer<FORMAT>& fb, int x0, int y0, int x1, int y1, Pixel p, BlendMode blend) {
+			int64_t dx = (int64_t)x1 - x0;
+			int64_t dy = (int64_t)y1 - y0;
+			bool bMajorX = std::llabs(dx) >= std::llabs(dy);
+
+			// Walk the major axis forwards
+			if ((bMajorX && dx < 0) || (!bMajorX && dy < 0)) {
+				std::swap(x0, x1);
+				std::swap(y0, y1);
+				dx = -dx;
+				dy = -dy;
+			}
+
+			int64_t da = bMajorX ? dx : dy;
+			int64_t db = bMajorX ? dy : dx;
+			int64_t adb = std::llabs(db);
+			int64_t sb = db < 0 ? -1 : 1;
+
+			if (da == 0) {
+				Plot(fb, x0, y0, p, blend);
+				return;
+			}
+
+			// Only the part over the screen, far off screen endpoints would take forever
+			int64_t nSize = bMajorX ? fb.ScreenWidth() : fb.ScreenHeight();
+			int64_t a0 = bMajorX ? x0 : y0;
+			int64_t iFirst = std::max<int64_t>(0, -a0);
+			int64_t iLast = std::min<int64_t>(da, nSize - 1 - a0);
+
+			for (int64_t i = iFirst; i <= iLast; i++) {
+				int64_t b = sb * ((2 * i * adb + da) / (2 * da));
+				int64_t x = bMajorX ? x0 + i : x0 + b;
+				int64_t y = bMajorX ? y0 + b : y0 + i;
+				if (x >= 0 && y >= 0 && x < fb.ScreenWidth() && y < fb.ScreenHeight())
+					Plot(fb, (int)x, (int)y, p, blend);
+			}
+		}
+
+
+
+		// Pixel centers are the integer coordinates. A pixel on an edge belongs to
+		// the triangle if the edge is a top edge or a left edge. Calls plot(x, y)
+		// for every covered pixel of the framebuffer.
+		template<typename FORMAT, typename PLOT>
+		static void Cover(const BasicFramebuffer<FORMAT>& fb, Vec2D v0, Vec2D v1, Vec2D v2, PLOT&& plot) {
+			auto orient = [](Vec2D a, Vec2D b, int64_t x, int64_t y) {
+				return ((int64_t)b.x - a.x) * (y - a.y) - ((int64_t)b.y - a.y) * (x - a.x);
+			};
+
+			int64_t area = orient(v0, v1, v2.x, v2.y);
+			if (area == 0)
+				return;
+			if (area < 0)
+				std::swap(v1, v2);
+
+			auto topLeft = [](Vec2D a, Vec2D b) {
+				return (a.y == b.y && b.x > a.x) || b.y < a.y;
+			};
+
+			const Vec2D edges[3][2] = { { v1, v2 }, { v2, v0 }, { v0, v1 } };
+
+			for (int y = 0; y < fb.ScreenHeight(); y++) {
+				for (int x = 0; x < fb.ScreenWidth(); x++) {
+					bool bInside = true;
+					for (const auto& e : edges) {
+						int64_t w = orient(e[0], e[1], x, y);
+						bInside &= w > 0 || (w == 0 && topLeft(e[0], e[1]));
+					}
+					if (bInside)
+						plot(x, y);
+				}
+			}
+		}
+
+
+
+		template<typename FORMAT>
+		static void Triangle(BasicFramebuffer<FORMAT>& fb, Vec2D v0, Vec2D v1, Vec2D v2, Pixel p, BlendMode blend) {
+			Cover(fb, v0, v1, v2, [&](int x, int y) { Plot(fb, x, y, p, blend); });
+		}
+
+
+
+		template<typename FORMAT>
+		static void Box(BasicFramebuffer<FORMAT>& fb, int x0, int y0, int x1, int y1, Pixel p, BlendMode blend) {
+			for (int y = std::max(y0, 0); y <= std::min(y1, fb.ScreenHeight() - 1); y++) {
+				for (int x = std::max(x0, 0); x <= std::min(x1, fb.ScreenWidth() - 1); x++)
+					Plot(fb, x, y, p, blend);
+			}
+		}
+
+
+
+	public:
+		// Flat triangle tested against one depth per pixel, row by row in storage
+		// units (0..65535 for D16). z comes from the barycentric weights at the
+		// pixel center, kept within the corners' range and rounded like DepthBuffer
+		// stores it; the pixel is drawn and takes it where it is nearer.
+		template<typename FORMAT>
+		static void DepthTriangle(BasicFramebuffer<FORMAT>& fb, std::vector<double>& depth, DepthFormat format,
+			Vec2D v0, float z0, Vec2D v1, float z1, Vec2D v2, float z2, Pixel p, BlendMode blend) {
+			double area = ((double)v1.x - v0.x) * ((double)v2.y - v0.y) - ((double)v1.y - v0.y) * ((double)v2.x - v0.x);
+			if (area == 0.0)
+				return;
+
+			const bool bD16 = format == DepthFormat::D16;
+			const double fScale = bD16 ? 65535.0 : 1.0;
+			auto store = [&](double z) {
+				return bD16 ? std::floor(z + 0.5) : (double)(float)z;
+			};
+
+			const double z[3] = {
+				std::min(std::max(z0, 0.0f), 1.0f) * fScale,
+				std::min(std::max(z1, 0.0f), 1.0f) * fScale,
+				std::min(std::max(z2, 0.0f), 1.0f) * fScale };
+			const double zNear = store(std::min({ z[0], z[1], z[2] }));
+			const double zFar = store(std::max({ z[0], z[1], z[2] }));
+
+			Cover(fb, v0, v1, v2, [&](int x, int y) {
+				double l0 = (((double)v1.x - x) * ((double)v2.y - y) - ((double)v1.y - y) * ((double)v2.x - x)) / area;
+				double l1 = (((double)v2.x - x) * ((double)v0.y - y) - ((double)v2.y - y) * ((double)v0.x - x)) / area;
+				double zPixel = std::min(std::max(store(l0 * z[0] + l1 * z[1] + (1.0 - l0 - l1) * z[2]), zNear), zFar);
+
+				double& fStored = depth[(size_t)y * fb.ScreenWidth() + x];
+				if (zPixel < fStored) {
+					fStored = zPixel;
+					Plot(fb, x, y, p, blend);
+				}
+			});
+		}
+
+
+
+		template<typename FORMAT>
+		static void Execute(const CommandList& list, BasicFramebuffer<FORMAT>& fb) {
+			const Vec2D* pVerts = list.Vertices();
+
+			for (size_t i = 0; i < list.Size(); i++) {
+				const Command& cmd = list.Commands()[i];
+
+				switch (cmd.nType) {
+				case Command::CLEAR:
+					Box(fb, 0, 0, fb.ScreenWidth() - 1, fb.ScreenHeight() - 1, cmd.p, BlendMode::NONE);
+					break;
+
+				case Command::PIXEL:
+					Plot(fb, cmd.a[0], cmd.a[1], cmd.p, cmd.blend);
+					break;
+
+				case Command::LINE:
+					Line(fb, cmd.a[0], cmd.a[1], cmd.a[2], cmd.a[3], cmd.p, cmd.blend);
+					break;
+
+				case Command::RECT:
+					Box(fb, cmd.a[0], cmd.a[1], cmd.a[2], cmd.a[3], cmd.p, cmd.blend);
+					break;
+
+				case Command::TRIANGLE: {
+					const Vec2D* v = pVerts + cmd.a[0];
+					Triangle(fb, v[0], v[1], v[2], cmd.p, cmd.blend);
+					break;
+				}
+
+				case Command::QUAD: {
+					// The convex hull of the corners, split along a diagonal
+					Vec2D hull[4];
+					int nHull = QuadHull(pVerts + cmd.a[0], hull);
+					if (nHull >= 3)
+						Triangle(fb, hull[0], hull[1], hull[2], cmd.p, cmd.blend);
+					if (nHull == 4)
+						Triangle(fb, hull[0], hull[2], hull[3], cmd.p, cmd.blend);
+					break;
+				}
+				}
+			}
+
+			fb.Invalidate();
+		}
+	};
+
+
+
+	//===== GOLDEN IMAGES =====//
+
+	// Where two images differ
+	struct ImageDiff {
+		size_t      nPixels = 0;
+		Rect        bounds = Rect(0, 0, -1, -1);
+
+		// Largest difference of any channel, after decoding to 8 bits
+		int         nMaxDelta = 0;
+
+		// Largest difference of any channel of a float format, before decoding
+		float       fMaxDelta = 0.0f;
+	};
+
+
+
+	struct GoldenResult {
+		enum Status : uint8_t {
+			MATCH,      // equal, usually found by the hash alone
+			MISMATCH,   // differs, a diff image was written
+			MISSING,    // there is no golden and updating was not asked for
+			RECORDED,   // updating was asked for, the golden was written
+			FAILED      // the golden could not be read or written
+		};
+
+		Status      status = FAILED;
+		ImageDiff   diff;
+		std::string sMessage;
+	};
+
+
+
+	class GoldenImages {
+
+	private:
+		std::string m_sDirectory;
+
+		// Write goldens instead of comparing against them
+		bool        m_bUpdate;
+
+		// Float formats may differ this much per channel: FMA contraction and
+		// vector widths change the last bits between builds
+		float       m_fTolerance = 1.0f / 4096.0f;
+
+
+	private:
+		static bool WritePPM(const char* sPath, const BasicSprite<FormatRGBA8888>& image) {
+			FILE* pFile = std::fopen(sPath, "wb");
+			if (!pFile)
+				return false;
+
+			std::fprintf(pFile, "P6\n%d %d\n255\n", image.Width(), image.Height());
+			std::vector<uint8_t> row((size_t)image.Width() * 3);
+			for (int y = 0; y < image.Height(); y++) {
+				for (int x = 0; x < image.Width(); x++) {
+					const Pixel& p = image.Row(y)[x];
+					row[x * 3] = p.r;
+					row[x * 3 + 1] = p.g;
+					row[x * 3 + 2] = p.b;
+				}
+				std::fwrite(row.data(), 1, row.size(), pFile);
+			}
+			return std::fclose(pFile) == 0;
+		}
+
+
+
+	public:
+		explicit GoldenImages(const std::string& sDirectory, bool bUpdate = false) {
+			m_sDirectory = sDirectory;
+			m_bUpdate = bUpdate;
+		}
+
+
+
+		// FNV-1a of the visible texels, padding excluded
+		template<typename FORMAT>
+		static uint64_t Hash(const BasicSprite<FORMAT>& image) {
+			uint64_t nHash = 14695981039346656037ull;
+			nHash = (nHash ^ (uint64_t)image.Width()) * 1099511628211ull;
+			nHash = (nHash ^ (uint64_t)image.Height()) * 1099511628211ull;
+			for (int y = 0; y < image.Height(); y++) {
+				const uint8_t* pRow = (const uint8_t*)image.Row(y);
+				for (size_t i = 0; i < (size_t)image.Width() * sizeof(typename FORMAT::Texel); i++)
+					nHash = (nHash ^ pRow[i]) * 1099511628211ull;
+			}
+			return nHash;
+		}
+
+
+
+		// Framebuffer contents as a sprite borrowing its texels
+		template<typename FORMAT>
+		static BasicSprite<FORMAT> View(BasicFramebuffer<FORMAT>& fb) {
+			return BasicSprite<FORMAT>(fb.Data(), fb.ScreenWidth(), fb.ScreenHeight(), fb.Pitch());
+		}
+
+
+
+		// Per pixel comparison. pDiff, if given, gets the expected image dimmed
+		// to gray with every differing pixel in red. Float texels count as equal
+		// when no channel differs by more than fTolerance.
+		template<typename FORMAT>
+		static ImageDiff Compare(const BasicSprite<FORMAT>& actual, const BasicSprite<FORMAT>& expected, BasicSprite<FormatRGBA8888>* pDiff = nullptr, float fTolerance = 0.0f) {
+			ImageDiff diff;
+			int w = std::max(actual.Width(), expected.Width());
+			int h = std::max(actual.Height(), expected.Height());
+
+			if (pDiff)
+				pDiff->Resize(w, h);
+
+			for (int y = 0; y < h; y++) {
+				for (int x = 0; x < w; x++) {
+					bool bInside = x < actual.Width() && y < actual.Height() && x < expected.Width() && y < expected.Height();
+					Pixel e = expected.GetPixel(x, y);
+					int nDelta = 255;
+
+					if (bInside) {
+						bool bEqual = std::memcmp(&actual.Row(y)[x], &expected.Row(y)[x], sizeof(typename FORMAT::Texel)) == 0;
+						if constexpr (FORMAT::ID == PixelFormat::RGBAF32) {
+							const PixelF& fa = actual.Row(y)[x];
+							const PixelF& fe = expected.Row(y)[x];
+							float fDelta = std::max({ std::fabs(fa.r - fe.r), std::fabs(fa.g - fe.g), std::fabs(fa.b - fe.b), std::fabs(fa.a - fe.a) });
+							bEqual |= fDelta <= fTolerance;
+							if (!bEqual)
+								diff.fMaxDelta = std::max(diff.fMaxDelta, fDelta);
+						}
+
+						if (bEqual) {
+							if (pDiff) {
+								uint8_t l = (uint8_t)((e.r * 77 + e.g * 150 + e.b * 29) >> 10);
+								pDiff->SetPixel(x, y, Pixel(l, l, l));
+							}
+							continue;
+						}
+
+						Pixel a = actual.GetPixel(x, y);
+						nDelta = std::max({ std::abs(a.r - e.r), std::abs(a.g - e.g), std::abs(a.b - e.b), std::abs(a.a - e.a) });
+					}
+
+					if (diff.nPixels == 0)
+						diff.bounds = Rect(x, y, x, y);
+					diff.bounds = Rect(std::min(diff.bounds.x0, x), std::min(diff.bounds.y0, y), std::max(diff.bounds.x1, x), std::max(diff.bounds.y1, y));
+					diff.nPixels++;
+					diff.nMaxDelta = std::max(diff.nMaxDelta, nDelta);
+
+					if (pDiff)
+						pDiff->SetPixel(x, y, THPX::RED);
+				}
+			}
+			return diff;
+		}
+
+
+
+		// Compares against <directory>/<name>.tpxi. Equal hashes settle it without
+		// a per pixel pass; on a mismatch <name>.actual.tpxi and <name>.diff.ppm are written.
+		template<typename FORMAT>
+		GoldenResult Check(const std::string& sName, const BasicSprite<FORMAT>& actual) const {
+			GoldenResult result;
+			std::string sBase = m_sDirectory + "/" + sName;
+			std::string sPath = sBase + ".tpxi";
+
+			ImageFile file;
+			if (!m_bUpdate && !file.Open(sPath.c_str())) {
+				result.status = GoldenResult::MISSING;
+				result.sMessage = "no golden " + sPath + ", record it with --update";
+				return result;
+			}
+
+			if (m_bUpdate) {
+				file.Close();
+				if (!ImageFile::Write(sPath.c_str(), actual)) {
+					result.sMessage = "cannot write " + sPath;
+					return result;
+				}
+				result.status = GoldenResult::RECORDED;
+				result.sMessage = "recorded " + sPath;
+				return result;
+			}
+
+			// Zero copy when the golden is in FORMAT already, converted otherwise
+			BasicSprite<FORMAT> expected = file.View<FORMAT>();
+			if (expected.Width() == 0)
+				expected = file.Decode<FORMAT>();
+
+			if (expected.Width() == actual.Width() && expected.Height() == actual.Height() && Hash(expected) == Hash(actual)) {
+				result.status = GoldenResult::MATCH;
+				return result;
+			}
+
+			BasicSprite<FormatRGBA8888> diffImage;
+			result.diff = Compare(actual, expected, &diffImage, m_fTolerance);
+			if (result.diff.nPixels == 0) {
+				result.status = GoldenResult::MATCH;
+				return result;
+			}
+
+			result.status = GoldenResult::MISMATCH;
+			ImageFile::Write((sBase + ".actual.tpxi").c_str(), actual);
+			WritePPM((sBase + ".diff.ppm").c_str(), diffImage);
+
+			char sDelta[32];
+			if (FORMAT::ID == PixelFormat::RGBAF32)
+				std::snprintf(sDelta, sizeof(sDelta), "%g", result.diff.fMaxDelta);
+			else
+				std::snprintf(sDelta, sizeof(sDelta), "%d", result.diff.nMaxDelta);
+
+			char sMessage[192];
+			std::snprintf(sMessage, sizeof(sMessage), "%zu pixels differ in (%d, %d)-(%d, %d), max delta %s, see %s.diff.ppm",
+				result.diff.nPixels, result.diff.bounds.x0, result.diff.bounds.y0, result.diff.bounds.x1, result.diff.bounds.y1,
+				sDelta, sName.c_str());
+			result.sMessage = sMessage;
+			return result;
+		}
+	};
+
+
+
+	//===== GOLDEN SCENES =====//
+
+	// A scripted scene, recorded into a command list so the same script can
+	// be run immediately, tiled and by the reference rasterizer
+	struct GoldenScene {
+		const char* sName;
+		void        (*Build)(CommandList& list, int nWidth, int nHeight);
+	};
+
+
+
+	inline const std::vector<GoldenScene>& GoldenScenes() {
+		static const std::vector<GoldenScene> s_scenes = {
+			{ "lines_star", [](CommandList& list, int w, int h) {
+				// Every octant and both directions, including exact axis and diagonal lines
+				list.Clear(THPX::BLACK);
+				Vec2D c(w / 2, h / 2);
+				for (int i = 0; i < 64; i++) {
+					double a = i * 3.14159265358979 / 32.0;
+					Vec2D v(c.x + (int)std::lround(std::cos(a) * h * 0.45), c.y + (int)std::lround(std::sin(a) * h * 0.45));
+					if (i % 2)
+						list.DrawLine(c.x, c.y, v.x, v.y, Pixel((uint8_t)(i * 4), 255, 128));
+					else
+						list.DrawLine(v.x, v.y, c.x, c.y, Pixel(255, (uint8_t)(i * 4), 128));
+				}
+			} },
+
+			{ "lines_steep_clipped", [](CommandList& list, int w, int h) {
+				list.Clear(Pixel(20, 20, 40));
+				for (int i = 0; i < 16; i++) {
+					list.DrawLine(3 + i * 5, 2, 3 + i * 5, h - 3, THPX::WHITE);
+					list.DrawLine(2 + i * 7, h - 1, 4 + i * 7, 0, THPX::GREEN);
+					list.DrawLine(i * 9, i * 3, i * 9, i * 3, THPX::RED);
+				}
+				list.DrawLine(-100000, -50000, 100000, 60000, THPX::BLUE);
+				list.DrawLine(w / 2, -100000, w / 2 + 3, 100000, Pixel(255, 255, 0));
+				list.DrawLine(-5, h / 3, w + 5, h / 3, Pixel(0, 255, 255));
+				list.DrawLine(w + 10, 0, w + 50, h, THPX::RED);
+			} },
+
+			{ "triangles_fan", [](CommandList& list, int w, int h) {
+				// Half transparent, so a pixel drawn by two triangles shows up darker
+				list.Clear(THPX::BLACK);
+				list.SetBlendMode(BlendMode::ALPHA);
+				Vec2D c(w / 2, h / 2);
+				for (int i = 0; i < 24; i++) {
+					double a0 = i * 3.14159265358979 / 12.0, a1 = (i + 1) * 3.14159265358979 / 12.0;
+					Vec2D v0(c.x + (int)std::lround(std::cos(a0) * w), c.y + (int)std::lround(std::sin(a0) * w));
+					Vec2D v1(c.x + (int)std::lround(std::cos(a1) * w), c.y + (int)std::lround(std::sin(a1) * w));
+					list.FillTriangle(c, v0, v1, Pixel(255, 255, 255, 128));
+				}
+			} },
+
+			{ "triangles_grid", [](CommandList& list, int w, int h) {
+				list.Clear(THPX::BLACK);
+				list.SetBlendMode(BlendMode::ADDITIVE);
+				for (int y = -7; y < h; y += 13) {
+					for (int x = -5; x < w; x += 11) {
+						Vec2D a(x, y), b(x + 11, y + 2), c(x - 1, y + 13), d(x + 12, y + 14);
+						list.FillTriangle(a, b, c, Pixel(60, 40, 20));
+						list.FillTriangle(b, d, c, Pixel(60, 40, 20));
+					}
+				}
+			} },
+
+			{ "triangles_random", [](CommandList& list, int w, int h) {
+				BenchmarkRandom rng(16);
+				list.Clear(Pixel(10, 10, 10));
+				for (int i = 0; i < 150; i++) {
+					Vec2D a(rng.Range(-w / 2, w * 3 / 2), rng.Range(-h / 2, h * 3 / 2));
+					Vec2D b(a.x + rng.Range(-40, 40), a.y + rng.Range(-40, 40));
+					Vec2D c = i % 10 == 0 ? b : Vec2D(a.x + rng.Range(-40, 40), a.y + rng.Range(-40, 40));
+					list.SetBlendMode(i % 3 == 0 ? BlendMode::ALPHA : BlendMode::NONE);
+					list.FillTriangle(a, b, c, rng.Color(200));
+				}
+			} },
+
+			{ "rects_and_pixels", [](CommandList& list, int w, int h) {
+				BenchmarkRandom rng(17);
+				list.Clear(THPX::BLACK);
+				for (int i = 0; i < 120; i++) {
+					list.SetBlendMode((BlendMode)(i % 5));
+					list.FillRectangle(rng.Range(-20, w), rng.Range(-20, h), rng.Range(-3, 40), rng.Range(-3, 40), rng.Color(150));
+				}
+				list.SetBlendMode(BlendMode::NONE);
+				for (int i = 0; i < 300; i++)
+					list.DrawPixel(rng.Range(-2, w + 1), rng.Range(-2, h + 1), rng.Color());
+				list.FillRectangle(Vec2D(10, 10), Vec2D(40, 10), Vec2D(12, 30), Vec2D(41, 31), THPX::BLUE);
+			} },
+
+			{ "quads_and_batches", [](CommandList& list, int w, int h) {
+				// Half transparent, a pixel on a quad's diagonal or shared by two batched
+				// triangles shows up darker if it is drawn twice
+				BenchmarkRandom rng(18);
+				list.Clear(THPX::BLACK);
+				list.SetBlendMode(BlendMode::ALPHA);
+				for (int i = 0; i < 40; i++) {
+					Vec2D a(rng.Range(-10, w), rng.Range(-10, h));
+					Vec2D c[4] = { a, Vec2D(a.x + rng.Range(-30, 30), a.y + rng.Range(-30, 30)),
+						Vec2D(a.x + rng.Range(-30, 30), a.y + rng.Range(-30, 30)), Vec2D(a.x + rng.Range(-30, 30), a.y + rng.Range(-30, 30)) };
+					list.FillRectangle(c[0], c[1], c[2], c[3], Pixel(255, 255, 255, 128));
+				}
+
+				std::vector<Vec2D> grid;
+				std::vector<uint32_t> indices;
+				for (int y = 0; y < 6; y++)
+					for (int x = 0; x < 8; x++)
+						grid.push_back(Vec2D(x * w / 7 + rng.Range(-4, 4), y * h / 5 + rng.Range(-4, 4)));
+				for (uint32_t y = 0; y < 5; y++) {
+					for (uint32_t x = 0; x < 7; x++) {
+						uint32_t i = y * 8 + x;
+						indices.insert(indices.end(), { i, i + 1, i + 8, i + 1, i + 9, i + 8 });
+					}
+				}
+				list.FillTriangles(grid, indices, Pixel(0, 120, 255, 100));
+
+				std::vector<Rect> rects;
+				for (int i = 0; i < 30; i++) {
+					int x = rng.Range(-10, w), y = rng.Range(-10, h);
+					rects.push_back(Rect(x, y, x + rng.Range(0, 20), y + rng.Range(0, 20)));
+				}
+				list.FillRects(rects, Pixel(255, 60, 0, 90));
+			} },
+
+			{ "clear_midway", [](CommandList& list, int w, int h) {
+				// Everything before the second clear must vanish, also in the tiled path
+				list.Clear(THPX::RED);
+				list.FillRectangle(0, 0, w / 2, h / 2, THPX::GREEN);
+				list.Clear(Pixel(30, 60, 90));
+				list.DrawLine(0, 0, w - 1, h - 1, THPX::WHITE);
+				list.SetBlendMode(BlendMode::MULTIPLY);
+				list.FillTriangle(Vec2D(0, h - 1), Vec2D(w - 1, h / 2), Vec2D(w / 3, 0), Pixel(200, 100, 50));
+			} },
+		};
+		return s_scenes;
+	}
+
+
+
+	// A scene drawn straight into a framebuffer, for what a command list cannot
+	// record (sprites, text, ...). Only checked against its golden. Draw is a
+	// captureless generic lambda (auto& fb, int nWidth, int nHeight), turned into
+	// one function per pixel format.
+	struct GoldenDrawing {
+		template<typename FORMAT>
+		using Function = void (*)(BasicFramebuffer<FORMAT>& fb, int nWidth, int nHeight);
+
+		const char* sName;
+		std::tuple<Function<FormatRGBA8888>, Function<FormatBGRA8888>, Function<FormatRGB565>, Function<FormatRGBAF32>> draw;
+
+		template<typename DRAW>
+		GoldenDrawing(const char* sDrawingName, DRAW Draw)
+			: sName(sDrawingName), draw(Draw, Draw, Draw, Draw) {
+		}
+
+		template<typename FORMAT>
+		void Run(BasicFramebuffer<FORMAT>& fb, int nWidth, int nHeight) const {
+			std::get<Function<FORMAT>>(draw)(fb, nWidth, nHeight);
+		}
+	};
+
+
+
+	// Test image for the sprite scenes, in the framebuffer's format: a gradient
+	// with a checker in alpha and a border in the color key
+	template<typename FORMAT>
+	inline BasicSprite<FORMAT> GoldenSprite(const BasicFramebuffer<FORMAT>&, int nWidth, int nHeight) {
+		BasicSprite<FORMAT> sprite(nWidth, nHeight);
+		for (int y = 0; y < nHeight; y++) {
+			for (int x = 0; x < nWidth; x++) {
+				bool bBorder = x == 0 || y == 0 || x == nWidth - 1 || y == nHeight - 1;
+				uint8_t a = ((x / 4 + y / 4) % 2) ? 255 : 96;
+				sprite.SetPixel(x, y, bBorder ? Pixel(255, 0, 255) : Pixel((uint8_t)(x * 255 / nWidth), (uint8_t)(y * 255 / nHeight), 160, a));
+			}
+		}
+		return sprite;
+	}
+
+
+
+	// Frames of a layer stack presented like the renderers do: drawing straight
+	// into the output before the composite, an overlay on top that moves every
+	// frame. Neither the direct drawing nor an earlier overlay may show.
+	template<typename FORMAT>
+	inline void GoldenLayerFrames(BasicFramebuffer<FORMAT>& fb, int nWidth, int nHeight) {
+		BasicLayerStack<FORMAT> layers;
+		layers.Resize(nWidth, nHeight);
+		layers.SetBackground(Pixel(0, 0, 80));
+		BasicLayer<FORMAT>* pBack = layers.Add("back", 0);
+		BasicLayer<FORMAT>* pFront = layers.Add("front", 1);
+		pBack->FillRectangle(0, nHeight / 2, nWidth, nHeight / 2, Pixel(40, 90, 40));
+		pFront->SetOpacity(0.75f);
+
+		for (int nFrame = 0; nFrame < 4; nFrame++) {
+			fb.DrawLine(0, 5 + nFrame * 20, nWidth - 1, 5 + nFrame * 20, THPX::WHITE);
+			pFront->FillRectangle(10 + nFrame * 25, 60, 20, 20, Pixel(255, 200, 0, 160));
+			layers.Composite(fb);
+
+			fb.FillRectangle(8 + nFrame * 35, 12, 12, 12, THPX::RED);
+			layers.TrackForeign(fb);
+			fb.ClearDirty();
+		}
+	}
+
+
+
+	inline const std::vector<GoldenDrawing>& GoldenDrawings() {
+		static const std::vector<GoldenDrawing> s_drawings = {
+			{ "sprites", [](auto& fb, int w, int h) {
+				fb.Clear(Pixel(40, 50, 60));
+				for (int x = 0; x < w; x += 8)
+					fb.FillRectangle(x, 0, 3, h, Pixel(90, 90, 90));
+
+				auto plain = GoldenSprite(fb, 19, 13);
+				auto keyed = GoldenSprite(fb, 19, 13);
+				keyed.SetColorKey(Pixel(255, 0, 255));
+				auto alpha = GoldenSprite(fb, 19, 13);
+				alpha.SetAlphaMask();
+
+				// Inside, clipped on every edge, scaled and partial
+				fb.DrawSprite(4, 4, plain);
+				fb.DrawSprite(-7, h - 9, plain);
+				fb.DrawSprite(w - 11, -5, keyed);
+				fb.DrawSprite(30, 6, keyed, 3);
+				fb.DrawSprite(Vec2D(90, 4), alpha);
+				fb.DrawPartialSprite(4, 30, plain, 3, 2, 10, 8);
+				fb.DrawPartialSprite(112, 30, alpha, -4, 5, 30, 30);
+				fb.DrawScaledSprite(4, 50, 45, 31, plain);
+				fb.DrawScaledSprite(54, 50, 45, 31, plain, SpriteFilter::BILINEAR);
+				fb.DrawScaledSprite(104, 50, 7, 40, alpha, SpriteFilter::BILINEAR);
+				fb.DrawScaledSprite(120, 60, 50, 9, keyed);
+				fb.DrawScaledPartialSprite(4, 88, 60, 20, plain, 2, 2, 9, 5, SpriteFilter::BILINEAR);
+				fb.DrawScaledPartialSprite(70, 88, 30, 30, keyed, 0, 0, 19, 13);
+			} },
+
+			{ "text", [](auto& fb, int w, int h) {
+				fb.Clear(THPX::BLACK);
+				fb.FillRectangle(0, h / 2, w, h / 2, Pixel(0, 60, 120));
+				fb.DrawString(2, 2, "The quick brown fox 0123456789", THPX::WHITE);
+				fb.DrawString(-5, 14, "Clipped {|}~ !\"#$%&'()*+,-./", Pixel(255, 255, 0));
+				fb.DrawString(2, 26, "x2 Ag", THPX::GREEN, 2);
+				fb.DrawString(w - 40, h - 12, "edge\nwrap", Pixel(0, 255, 255));
+				fb.DrawText(2, 50, "cached label", Pixel(255, 128, 0));
+				fb.DrawText(2, 50, "cached label", Pixel(255, 128, 0));
+				fb.DrawText(2, 62, "on a box", THPX::WHITE, Pixel(128, 0, 64));
+				fb.DrawText(60, 74, "x3", THPX::RED, Pixel(20, 20, 20), 3);
+				fb.SetBlendMode(BlendMode::ALPHA);
+				fb.DrawString(8, 100, "blended text", Pixel(255, 255, 255, 120));
+				fb.SetBlendMode(BlendMode::NONE);
+			} },
+
+			{ "polygons", [](auto& fb, int w, int h) {
+				// Self-intersecting stars and overlapping loops tell the fill rules
+				// apart: the inner parts are filled with NONZERO, holes with EVEN_ODD
+				fb.Clear(THPX::BLACK);
+				for (int nRule = 0; nRule < 2; nRule++) {
+					FillRule rule = nRule ? FillRule::EVEN_ODD : FillRule::NONZERO;
+					int cx = w / 4 + nRule * w / 2, cy = h / 4;
+					std::vector<Vec2D> star;
+					for (int i = 0; i < 5; i++) {
+						double a = i * 4.0 * 3.14159265358979 / 5.0 - 1.5707963267949;
+						star.push_back(Vec2D(cx + (int)std::lround(std::cos(a) * 26), cy + (int)std::lround(std::sin(a) * 26)));
+					}
+					fb.FillPolygon(star, Pixel(255, 200, 0), rule);
+					fb.DrawPolyline(star, THPX::WHITE, true);
+
+					// Two loops around the same area, wound the same way
+					std::vector<Vec2D> loops = { Vec2D(cx - 30, cy + 30), Vec2D(cx + 30, cy + 30), Vec2D(cx + 30, cy + 70),
+						Vec2D(cx - 20, cy + 70), Vec2D(cx - 20, cy + 40), Vec2D(cx + 20, cy + 40), Vec2D(cx + 20, cy + 60), Vec2D(cx - 30, cy + 60) };
+					fb.FillPolygon(loops, Pixel(0, 160, 255), rule);
+				}
+
+				// Bow tie, clipped, degenerate and open polylines
+				fb.SetBlendMode(BlendMode::ALPHA);
+				fb.FillPolygon({ Vec2D(-20, h - 40), Vec2D(60, h + 10), Vec2D(60, h - 40), Vec2D(-20, h + 10) }, Pixel(255, 0, 128, 160));
+				fb.FillPolygon({ Vec2D(w - 30, h - 30), Vec2D(w + 40, h - 20), Vec2D(w - 10, h + 30), Vec2D(w - 50, h - 5) }, Pixel(0, 255, 128, 160), FillRule::EVEN_ODD);
+				fb.SetBlendMode(BlendMode::NONE);
+				fb.FillPolygon({ Vec2D(70, h - 10), Vec2D(90, h - 10), Vec2D(110, h - 10) }, THPX::RED);
+				fb.DrawPolyline({ Vec2D(70, h - 30), Vec2D(90, h - 45), Vec2D(110, h - 30), Vec2D(130, h - 45) }, THPX::GREEN);
+			} },
+
+			{ "circles_ellipses_lines", [](auto& fb, int w, int h) {
+				fb.Clear(Pixel(20, 20, 30));
+				for (int r = 0; r < 6; r++) {
+					fb.FillCircle(12 + r * 22, 14, r * 2, Pixel(255, (uint8_t)(r * 40), 0));
+					fb.DrawCircle(12 + r * 22, 38, r * 2 + 1, Pixel(0, 255, (uint8_t)(r * 40)));
+				}
+				fb.FillEllipse(30, 70, 25, 9, Pixel(80, 80, 255));
+				fb.DrawEllipse(30, 70, 25, 9, THPX::WHITE);
+				fb.FillEllipse(75, 70, 6, 18, Pixel(255, 80, 255));
+				fb.DrawEllipse(75, 70, 1, 18, THPX::WHITE);
+				fb.DrawEllipse(75, 95, 18, 0, THPX::WHITE);
+
+				// Clipped on every edge, half transparent so overlap shows
+				fb.SetBlendMode(BlendMode::ALPHA);
+				fb.FillCircle(0, 0, 20, Pixel(255, 255, 255, 100));
+				fb.FillCircle(w, h, 30, Pixel(255, 255, 255, 100));
+				fb.FillEllipse(w - 10, h / 2, 30, 70, Pixel(0, 255, 0, 100));
+				std::vector<Vec2D> centers;
+				for (int i = 0; i < 12; i++)
+					centers.push_back(Vec2D(100 + (i % 4) * 9, 55 + (i / 4) * 9));
+				fb.FillCircles(centers, 6, Pixel(255, 200, 0, 120));
+
+				// Thick lines in every direction, even and odd widths
+				for (int i = 0; i < 8; i++) {
+					double a = i * 3.14159265358979 / 8.0;
+					int dx = (int)std::lround(std::cos(a) * 22), dy = (int)std::lround(std::sin(a) * 22);
+					fb.DrawLine(128 - dx, 95 - dy, 128 + dx, 95 + dy, 1 + i % 4 * 2, Pixel(255, 255, 255, 140));
+				}
+				fb.SetBlendMode(BlendMode::NONE);
+				fb.DrawLine(-10, h - 4, w + 10, h - 20, 4, THPX::RED);
+				fb.DrawLine(90, 20, 90, 20, 5, THPX::BLUE);
+			} },
+
+			{ "gouraud_triangles", [](auto& fb, int w, int h) {
+				BenchmarkRandom rng(24);
+				fb.Clear(Pixel(10, 10, 10));
+				fb.FillTriangle(Vec2D(2, 2), THPX::RED, Vec2D(w - 3, 10), THPX::GREEN, Vec2D(20, h - 3), THPX::BLUE);
+
+				// Small, clipped and sliver triangles, then half transparent corners blended over them
+				for (int i = 0; i < 60; i++) {
+					Vec2D a(rng.Range(-20, w + 20), rng.Range(-20, h + 20));
+					fb.FillTriangle(a, rng.Color(), Vec2D(a.x + rng.Range(-35, 35), a.y + rng.Range(-35, 35)), rng.Color(),
+						Vec2D(a.x + rng.Range(-35, 35), a.y + rng.Range(-3, 3)), rng.Color());
+				}
+				fb.SetBlendMode(BlendMode::ALPHA);
+				for (int i = 0; i < 20; i++) {
+					Vec2D a(rng.Range(0, w), rng.Range(0, h));
+					fb.FillTriangle(a, rng.Color(0), Vec2D(a.x + rng.Range(-60, 60), a.y + rng.Range(-60, 60)), rng.Color(255),
+						Vec2D(a.x + rng.Range(-60, 60), a.y + rng.Range(-60, 60)), rng.Color(128));
+				}
+				fb.SetBlendMode(BlendMode::ADDITIVE);
+				fb.FillTriangle(Vec2D(w / 2, 0), Pixel(0, 0, 0), Vec2D(w, h), Pixel(90, 90, 90), Vec2D(0, h), Pixel(0, 90, 0));
+				fb.SetBlendMode(BlendMode::NONE);
+			} },
+
+			{ "textured_triangles", [](auto& fb, int w, int h) {
+				// Power of two and odd sized textures take different wrapping paths
+				auto square = GoldenSprite(fb, 16, 16);
+				auto odd = GoldenSprite(fb, 19, 13);
+				auto keyed = GoldenSprite(fb, 16, 16);
+				keyed.SetColorKey(Pixel(255, 0, 255));
+				auto alpha = GoldenSprite(fb, 19, 13);
+				alpha.SetAlphaMask();
+
+				fb.Clear(Pixel(30, 30, 30));
+				auto quad = [&](int x, int y, int s, float u0, float u1, float w0, float w1, const auto& texture, TextureWrap wrap) {
+					TexVertex a(Vec2D(x, y), u0, u0, w0), b(Vec2D(x + s, y), u1, u0, w1);
+					TexVertex c(Vec2D(x + s, y + s), u1, u1, w1), d(Vec2D(x, y + s), u0, u1, w0);
+					fb.DrawTexturedTriangle(a, b, c, texture, wrap);
+					fb.DrawTexturedTriangle(a, c, d, texture, wrap);
+				};
+
+				// Affine repeat and clamp, perspective, masked, then far off coordinates
+				quad(2, 2, 36, -8.0f, 40.0f, 1.0f, 1.0f, square, TextureWrap::REPEAT);
+				quad(41, 2, 36, -8.0f, 40.0f, 1.0f, 1.0f, odd, TextureWrap::REPEAT);
+				quad(80, 2, 36, -8.0f, 40.0f, 1.0f, 1.0f, odd, TextureWrap::CLAMP);
+				quad(119, 2, 36, 0.0f, 64.0f, 1.0f, 4.0f, square, TextureWrap::REPEAT);
+				quad(2, 41, 36, 0.0f, 48.0f, 3.0f, 1.0f, odd, TextureWrap::REPEAT);
+				quad(41, 41, 36, -5.0f, 30.0f, 1.0f, 2.0f, odd, TextureWrap::CLAMP);
+				quad(80, 41, 36, 0.0f, 40.0f, 1.0f, 1.0f, keyed, TextureWrap::REPEAT);
+				quad(119, 41, 36, 0.0f, 40.0f, 2.0f, 1.0f, alpha, TextureWrap::REPEAT);
+				quad(2, 80, 30, 100000.0f, 100050.0f, 1.0f, 1.0f, square, TextureWrap::REPEAT);
+				quad(35, 80, 30, -70000.0f, -69950.0f, 1.0f, 1.0f, odd, TextureWrap::REPEAT);
+
+				// A large clipped triangle under strong perspective
+				fb.DrawTexturedTriangle(TexVertex(Vec2D(70, 75), 0.0f, 0.0f, 1.0f), TexVertex(Vec2D(w + 40, 80), 200.0f, 0.0f, 8.0f),
+					TexVertex(Vec2D(80, h + 30), 0.0f, 120.0f, 1.5f), square);
+			} },
+
+			{ "depth_triangles", [](auto& fb, int w, int h) {
+				// Pairs sloped through each other, so which one shows flips along the
+				// line where they cross; D16 on the left half, D32 on the right
+				auto texture = GoldenSprite(fb, 16, 16);
+				fb.Clear(Pixel(20, 20, 40));
+
+				for (int nFormat = 0; nFormat < 2; nFormat++) {
+					DepthBuffer depth(w, h, nFormat ? DepthFormat::D32 : DepthFormat::D16);
+					const int x0 = nFormat * (w / 2), x1 = x0 + w / 2 - 2;
+
+					fb.FillTriangle(Vec2D(x0, 2), 0.1f, Vec2D(x1, 8), 0.9f, Vec2D(x0 + 10, 40), 0.5f, Pixel(255, 80, 0), depth);
+					fb.FillTriangle(Vec2D(x1, 2), 0.1f, Vec2D(x0, 12), 0.9f, Vec2D(x1 - 14, 40), 0.5f, Pixel(0, 160, 255), depth);
+
+					fb.FillTriangle(Vec2D(x0 + 4, 42), 0.8f, THPX::RED, Vec2D(x1, 46), 0.2f, THPX::GREEN, Vec2D(x0 + 20, 74), 0.5f, THPX::BLUE, depth);
+					fb.FillTriangle(Vec2D(x1 - 4, 42), 0.8f, THPX::WHITE, Vec2D(x0, 50), 0.2f, Pixel(80, 0, 80), Vec2D(x1 - 10, 76), 0.3f, Pixel(255, 255, 0), depth);
+
+					TexVertex a(Vec2D(x0 + 2, 78), 0.0f, 0.0f, 1.0f, 0.3f), b(Vec2D(x1, 80), 32.0f, 0.0f, 2.0f, 0.7f);
+					TexVertex c(Vec2D(x1 - 6, h - 2), 32.0f, 32.0f, 2.0f, 0.7f), d(Vec2D(x0 + 4, h - 4), 0.0f, 32.0f, 1.0f, 0.3f);
+					fb.DrawTexturedTriangle(a, b, c, texture, depth);
+					fb.DrawTexturedTriangle(a, c, d, texture, depth);
+					TexVertex e(Vec2D(x1, 76), 0.0f, 0.0f, 1.0f, 0.2f), f(Vec2D(x0, 90), 16.0f, 0.0f, 1.0f, 0.8f), g(Vec2D(x1 - 20, h), 0.0f, 16.0f, 1.0f, 0.5f);
+					fb.DrawTexturedTriangle(e, f, g, texture, depth, TextureWrap::CLAMP);
+
+					// A blended plane halfway back over everything, shown only in front
+					fb.SetBlendMode(BlendMode::ALPHA);
+					fb.FillTriangle(Vec2D(x0 - 40, -10), 0.5f, Vec2D(x1 + 40, -10), 0.5f, Vec2D(x0 + w / 4, h + 200), 0.5f, Pixel(255, 255, 255, 96), depth);
+					fb.SetBlendMode(BlendMode::NONE);
+				}
+			} },
+
+			{ "layers_moving_overlay", [](auto& fb, int w, int h) {
+				GoldenLayerFrames(fb, w, h);
+			} },
+		};
+		return s_drawings;
+	}
+
+
+
+	//===== GOLDEN HARNESS =====//
+
+	// Runs every scene through the immediate, tiled and reference rasterizers in
+	// every pixel format, requires all of them to be bit exact, then checks the
+	// immediate result against the stored golden. Drawings only have the golden,
+	// depth tested triangles only the reference.
+	class GoldenHarness {
+
+	private:
+		GoldenImages m_goldens;
+		TiledRasterizer m_serial;
+		TiledRasterizer m_parallel;
+		FILE*       m_pReport;
+
+		int         m_nWidth;
+		int         m_nHeight;
+
+		size_t      m_nChecks = 0;
+		size_t      m_nFailures = 0;
+
+
+	private:
+		void Report(const char* sScene, const char* sFormat, const char* sWhat, const std::string& sMessage) {
+			if (m_pReport)
+				std::fprintf(m_pReport, "%-22s %-9s %-10s %s\n", sScene, sFormat, sWhat, sMessage.c_str());
+		}
+
+
+
+		template<typename FORMAT>
+		void Expect(const char* sScene, const char* sWhat, const BasicSprite<FORMAT>& actual, const BasicSprite<FORMAT>& expected) {
+			m_nChecks++;
+			if (GoldenImages::Hash(actual) == GoldenImages::Hash(expected))
+				return;
+
+			ImageDiff diff = GoldenImages::Compare(actual, expected);
+			if (diff.nPixels == 0)
+				return;
+
+			char sMessage[128];
+			std::snprintf(sMessage, sizeof(sMessage), "%zu pixels differ from immediate in (%d, %d)-(%d, %d)",
+				diff.nPixels, diff.bounds.x0, diff.bounds.y0, diff.bounds.x1, diff.bounds.y1);
+			Report(sScene, PixelFormatName(FORMAT::ID), sWhat, sMessage);
+			m_nFailures++;
+		}
+
+
+
+		template<typename FORMAT>
+		void CheckGolden(const char* sScene, const BasicSprite<FORMAT>& result) {
+			std::string sName = std::string(sScene) + "_" + PixelFormatName(FORMAT::ID);
+			GoldenResult golden = m_goldens.Check(sName, result);
+			m_nChecks++;
+			if (golden.status != GoldenResult::MATCH && golden.status != GoldenResult::RECORDED)
+				m_nFailures++;
+			if (golden.status != GoldenResult::MATCH)
+				Report(sScene, PixelFormatName(FORMAT::ID), "golden", golden.sMessage);
+		}
+
+
+
+	public:
+		GoldenHarness(const std::string& sDirectory, bool bUpdate = false, FILE* pReport = stdout, int nWidth = 157, int nHeight = 113)
+			: m_goldens(sDirectory, bUpdate), m_serial(1), m_parallel(0) {
+			m_pReport = pReport;
+			m_nWidth = nWidth;
+			m_nHeight = nHeight;
+		}
+
+
+
+		// Replays a command list through the framebuffer's own draw calls
+		template<typename FORMAT>
+		static void DrawImmediate(const CommandList& list, BasicFramebuffer<FORMAT>& fb) {
+			const Vec2D* pVerts = list.Vertices();
+			BlendMode blend = fb.GetBlendMode();
+
+			for (size_t i = 0; i < list.Size(); i++) {
+				const Command& cmd = list.Commands()[i];
+				fb.SetBlendMode(cmd.blend);
+
+				switch (cmd.nType) {
+				case Command::CLEAR:    fb.Clear(cmd.p); break;
+				case Command::PIXEL:    fb.DrawPixel(cmd.a[0], cmd.a[1], cmd.p); break;
+				case Command::LINE:     fb.DrawLine(cmd.a[0], cmd.a[1], cmd.a[2], cmd.a[3], cmd.p); break;
+				case Command::RECT:     fb.FillRectangle(cmd.a[0], cmd.a[1], cmd.a[2] - cmd.a[0], cmd.a[3] - cmd.a[1], cmd.p); break;
+				case Command::TRIANGLE: fb.FillTriangle(pVerts[cmd.a[0]], pVerts[cmd.a[0] + 1], pVerts[cmd.a[0] + 2], cmd.p); break;
+				case Command::QUAD:     fb.FillRectangle(pVerts[cmd.a[0]], pVerts[cmd.a[0] + 1], pVerts[cmd.a[0] + 2], pVerts[cmd.a[0] + 3], cmd.p); break;
+				}
+			}
+
+			fb.SetBlendMode(blend);
+		}
+
+
+
+		template<typename FORMAT>
+		void RunScene(const GoldenScene& scene) {
+			CommandList list;
+			scene.Build(list, m_nWidth, m_nHeight);
+
+			// Start from garbage so anything a path forgets to draw shows up
+			BasicFramebuffer<FORMAT> immediate(m_nWidth, m_nHeight, Pixel(1, 2, 3));
+			BasicFramebuffer<FORMAT> serial(m_nWidth, m_nHeight, Pixel(1, 2, 3));
+			BasicFramebuffer<FORMAT> parallel(m_nWidth, m_nHeight, Pixel(1, 2, 3));
+			BasicFramebuffer<FORMAT> reference(m_nWidth, m_nHeight, Pixel(1, 2, 3));
+
+			DrawImmediate(list, immediate);
+			m_serial.Execute(list, serial);
+			m_parallel.Execute(list, parallel);
+			ReferenceRasterizer::Execute(list, reference);
+
+			BasicSprite<FORMAT> result = GoldenImages::View(immediate);
+			Expect(scene.sName, "tiled", GoldenImages::View(serial), result);
+			Expect(scene.sName, "threaded", GoldenImages::View(parallel), result);
+			Expect(scene.sName, "reference", GoldenImages::View(reference), result);
+
+			CheckGolden(scene.sName, result);
+		}
+
+
+
+		// Depth tested triangles against the reference: colors bit exact, stored depth
+		// equal within storage precision. A near triangle over half the screen comes first,
+		// so whole tiles get accepted and later ones rejected behind it.
+		template<typename FORMAT>
+		void RunDepth(DepthFormat format) {
+			const char* sScene = format == DepthFormat::D16 ? "depth_d16" : "depth_d32";
+			const double fScale = format == DepthFormat::D16 ? 65535.0 : 1.0;
+
+			BasicFramebuffer<FORMAT> immediate(m_nWidth, m_nHeight, Pixel(1, 2, 3));
+			BasicFramebuffer<FORMAT> reference(m_nWidth, m_nHeight, Pixel(1, 2, 3));
+			DepthBuffer depth(m_nWidth, m_nHeight, format);
+			std::vector<double> values((size_t)m_nWidth * m_nHeight, fScale);
+
+			auto draw = [&](Vec2D a, float za, Vec2D b, float zb, Vec2D c, float zc, Pixel p, BlendMode blend) {
+				immediate.SetBlendMode(blend);
+				immediate.FillTriangle(a, za, b, zb, c, zc, p, depth);
+				ReferenceRasterizer::DepthTriangle(reference, values, format, a, za, b, zb, c, zc, p, blend);
+			};
+
+			const int w = m_nWidth, h = m_nHeight;
+			BenchmarkRandom rng(25);
+			draw(Vec2D(-5, -5), 0.3f, Vec2D(2 * w, -5), 0.3f, Vec2D(-5, h / 2), 0.35f, Pixel(60, 60, 60), BlendMode::NONE);
+
+			// Large, small and sliver triangles, some flat, some reaching past the near and far planes
+			for (int i = 0; i < 300; i++) {
+				Vec2D a(rng.Range(-20, w + 20), rng.Range(-20, h + 20));
+				int nReach = i % 3 == 0 ? 120 : 20;
+				Vec2D b(a.x + rng.Range(-nReach, nReach), a.y + rng.Range(-nReach, nReach));
+				Vec2D c(a.x + rng.Range(-nReach, nReach), a.y + rng.Range(i % 7 == 0 ? -2 : -nReach, i % 7 == 0 ? 2 : nReach));
+				float z[3];
+				for (float& fZ : z)
+					fZ = rng.Range(-100, 1100) * 0.001f;
+				if (i % 5 == 0)
+					z[1] = z[2] = z[0];
+				draw(a, z[0], b, z[1], c, z[2], rng.Color(i % 4 == 0 ? 128 : 255), i % 4 == 0 ? BlendMode::ALPHA : BlendMode::NONE);
+			}
+
+			Expect(sScene, "reference", GoldenImages::View(reference), GoldenImages::View(immediate));
+
+			// D16 values are whole units; a D32 value may be a float step off where the
+			// plane is clamped to a tile's range, which only moves it within rounding
+			const double fTolerance = format == DepthFormat::D16 ? 0.25 : 1.0 / (1 << 22);
+			m_nChecks++;
+			size_t nDiffer = 0;
+			for (int y = 0; y < h; y++) {
+				for (int x = 0; x < w; x++)
+					nDiffer += std::fabs(depth.GetDepth(x, y) * fScale - values[(size_t)y * w + x]) > fTolerance;
+			}
+			if (nDiffer) {
+				char sMessage[128];
+				std::snprintf(sMessage, sizeof(sMessage), "%zu depth values differ from the reference", nDiffer);
+				Report(sScene, PixelFormatName(FORMAT::ID), "depth", sMessage);
+				m_nFailures++;
+			}
+		}
+
+
+
+		template<typename FORMAT>
+		void RunDrawing(const GoldenDrawing& drawing) {
+			BasicFramebuffer<FORMAT> fb(m_nWidth, m_nHeight, Pixel(1, 2, 3));
+			drawing.Run(fb, m_nWidth, m_nHeight);
+			CheckGolden(drawing.sName, GoldenImages::View(fb));
+		}
+
+
+
+		// Number of failed checks
+		size_t Run() {
+			for (const GoldenScene& scene : GoldenScenes()) {
+				RunScene<FormatRGBA8888>(scene);
+				RunScene<FormatBGRA8888>(scene);
+				RunScene<FormatRGB565>(scene);
+				RunScene<FormatRGBAF32>(scene);
+			}
+			for (const GoldenDrawing& drawing : GoldenDrawings()) {
+				RunDrawing<FormatRGBA8888>(drawing);
+				RunDrawing<FormatBGRA8888>(drawing);
+				RunDrawing<FormatRGB565>(drawing);
+				RunDrawing<FormatRGBAF32>(drawing);
+			}
+			for (DepthFormat format : { DepthFormat::D16, DepthFormat::D32 }) {
+				RunDepth<FormatRGBA8888>(format);
+				RunDepth<FormatBGRA8888>(format);
+				RunDepth<FormatRGB565>(format);
+				RunDepth<FormatRGBAF32>(format);
+			}
+			return m_nFailures;
+		}
+
+
+
+		size_t Checks() const {
+			return m_nChecks;
+		}
+
+
+
+		size_t Failures() const {
+			return m_nFailures;
+		}
+	};
+
+
+
+	// Command line driver, like BenchmarkMain:
+	//     int main(int argc, char** argv) { return THPX::GoldenMain(argc, argv); }
+	// Options: --dir PATH (default "golden", the goldens kept with the sources),
+	// --update to rewrite the goldens.
+	// Returns 1 if any check failed, a missing golden counts as failed.
+	inline int GoldenMain(int argc, char** argv) {
+		std::string sDirectory = "golden";
+		bool bUpdate = false;
+
+		for (int i = 1; i < argc; i++) {
+			if (std::strcmp(argv[i], "--update") == 0)
+				bUpdate = true;
+			else if (std::strcmp(argv[i], "--dir") == 0 && i + 1 < argc)
+				sDirectory = argv[++i];
+			else {
+				std::fprintf(stderr, "unknown option %s\n", argv[i]);
+				return 2;
+			}
+		}
+
+		GoldenHarness harness(sDirectory, bUpdate);
+		harness.Run();
+		std::printf("%zu checks, %zu failed\n", harness.Checks(), harness.Failures());
+		return harness.Failures() ? 1 : 0;
+	}
+
+}
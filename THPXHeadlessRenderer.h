@@ -0,0 +1,145 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+
+#include "THPXRendererBase.h"
+
+
+namespace THPX {
+
+	//===== HEADLESS RENDERER CLASS =====//
+
+	// Runs the onCreate / onUpdate loop straight into the framebuffer,
+	// without a window, message pump or GL context.
+	class HeadlessRenderer : public RendererBase {
+
+	private:
+		// Frames rendered since Start
+		uint64_t    m_nFrameCount = 0;
+
+
+	private:
+		int MainLoop() {
+			m_profiler.BeginFrame();
+
+			m_profiler.BeginPhase(FramePhase::INPUT);
+			ScanInput();
+
+			m_profiler.BeginPhase(FramePhase::UPDATE);
+			RunUpdate();
+
+			m_profiler.BeginPhase(FramePhase::RASTER);
+			CompositeLayers();
+			FlushDeferred();
+			DrawProfilerOverlay();
+
+			m_profiler.BeginPhase(FramePhase::PRESENT);
+			PresentFrame();
+
+			EndProfiledFrame();
+
+			m_nFrameCount++;
+
+			return 0;
+		}
+
+
+
+	public:
+		// Synthetic input wakes an idle on-demand loop
+		HeadlessRenderer() {
+			m_inputQueue.SetWakeHook([](void* pPacer) { ((FramePacer*)pPacer)->Wake(); }, &m_pacer);
+		}
+
+
+
+		bool Construct(int nWidth, int nHeight) {
+			if (nWidth <= 0 || nHeight <= 0)
+				return false;
+
+			Resize(nWidth, nHeight, THPX::BLACK);
+
+			m_isRunning = true;
+
+			onCreate();
+
+			return true;
+		}
+
+
+
+		// Runs until m_isRunning is cleared, or for nFrames frames if nFrames is not 0.
+		// Paced and on-demand as set by SetLoopConfig, as fast as possible by default.
+		int Start(uint64_t nFrames = 0) {
+			m_nFrameCount = 0;
+
+			while (m_isRunning && (nFrames == 0 || m_nFrameCount < nFrames)) {
+				if (!FrameDue()) {
+					m_pacer.WaitForWake();
+					continue;
+				}
+
+				MainLoop();
+				PaceFrame();
+			}
+
+			StopPresentThread();
+
+			return 0;
+		}
+
+
+
+		// Plays a log written by StartRecording back as fast as possible: every frame
+		// gets the recorded input and delta time, or with ReplayMode::COMMANDS just
+		// the recorded command stream. Resizes to the recorded size, runs onCreate
+		// and returns the number of frames played, or -1 if the log can't be read.
+		int64_t Replay(const char* sPath, ReplayMode mode = ReplayMode::INPUT) {
+			FrameLog log;
+			if (!log.Open(sPath) || log.Format() != Format())
+				return -1;
+			if (mode == ReplayMode::COMMANDS && !log.HasCommands())
+				return -1;
+
+			Resize(log.Width(), log.Height(), THPX::BLACK);
+
+			std::memset(m_KeyNewState, 0, sizeof(m_KeyNewState));
+			std::memset(m_KeyOldState, 0, sizeof(m_KeyOldState));
+			std::memset(m_MouseNewState, 0, sizeof(m_MouseNewState));
+			std::memset(m_MouseOldState, 0, sizeof(m_MouseOldState));
+			for (HWButton& button : m_KeyboardState)
+				button = HWButton();
+			for (HWButton& button : m_MouseState)
+				button = HWButton();
+
+			m_pReplay = &log;
+			m_replayMode = mode;
+			m_nDivergentFrames = 0;
+			m_nFirstDivergentFrame = -1;
+			m_nFrameCount = 0;
+			m_nAccumulator = 0;
+			m_commandList.Reset();
+
+			m_isRunning = true;
+			if (mode == ReplayMode::INPUT)
+				onCreate();
+
+			while (m_isRunning && log.Next(m_replayFrame)) {
+				MainLoop();
+			}
+
+			StopPresentThread();
+			m_pReplay = nullptr;
+
+			return (int64_t)m_nFrameCount;
+		}
+
+
+
+		uint64_t FrameCount() const {
+			return m_nFrameCount;
+		}
+	};
+
+}
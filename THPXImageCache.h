@@ -0,0 +1,184 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <list>
+#include <memory>
+#include <unordered_map>
+#include <utility>
+
+#include "THPXSprite.h"
+
+
+namespace THPX {
+
+	//===== IMAGE CACHE =====//
+
+	using AssetID = uint64_t;
+
+	// FNV-1a of an asset name, for callers that address assets by path
+	constexpr AssetID AssetIDFromName(const char* sName, AssetID nHash = 14695981039346656037ull) {
+		return *sName ? AssetIDFromName(sName + 1, (nHash ^ (uint8_t)*sName) * 1099511628211ull) : nHash;
+	}
+
+
+
+	// Decoded sprites keyed by asset ID, already in the framebuffer's format, so
+	// a frame that draws the same images again never decodes or converts.
+	// Least recently used entries are dropped once the budget is exceeded;
+	// callers holding a SpritePtr keep that sprite alive regardless.
+	// Lookups do not allocate. Not thread safe, use it from the drawing thread.
+	template<typename FORMAT>
+	class BasicImageCache {
+
+	public:
+		using SpriteType = BasicSprite<FORMAT>;
+		using SpritePtr = std::shared_ptr<const SpriteType>;
+
+
+	private:
+		struct Entry {
+			SpritePtr   pSprite;
+			size_t      nBytes;
+			std::list<AssetID>::iterator lru;
+		};
+
+		std::unordered_map<AssetID, Entry> m_entries;
+
+		// Most recently used first
+		std::list<AssetID> m_lru;
+
+		size_t      m_nBudget;
+		size_t      m_nUsed = 0;
+
+		uint64_t    m_nHits = 0;
+		uint64_t    m_nMisses = 0;
+
+
+	private:
+		// Drops least recently used entries until the budget holds. The most
+		// recent one stays even if it alone is over budget, it is about to be drawn.
+		void Trim() {
+			while (m_nUsed > m_nBudget && m_lru.size() > 1)
+				Remove(m_lru.back());
+		}
+
+
+
+	public:
+		explicit BasicImageCache(size_t nBudgetBytes = 64 * 1024 * 1024) {
+			m_nBudget = nBudgetBytes;
+		}
+
+
+
+		// Cached sprite for id, or null
+		SpritePtr Find(AssetID id) {
+			auto it = m_entries.find(id);
+			if (it == m_entries.end())
+				return nullptr;
+
+			m_lru.splice(m_lru.begin(), m_lru, it->second.lru);
+			return it->second.pSprite;
+		}
+
+
+
+		// Cached sprite for id, decoded with load() on a miss. load returns a SpriteType.
+		template<typename LOADER>
+		SpritePtr Get(AssetID id, LOADER&& load) {
+			SpritePtr pSprite = Find(id);
+			if (pSprite) {
+				m_nHits++;
+				return pSprite;
+			}
+
+			m_nMisses++;
+			return Insert(id, load());
+		}
+
+
+
+		// Adds or replaces the sprite for id
+		SpritePtr Insert(AssetID id, SpriteType&& sprite) {
+			Remove(id);
+
+			SpritePtr pSprite = std::make_shared<const SpriteType>(std::move(sprite));
+			m_lru.push_front(id);
+
+			Entry entry;
+			entry.pSprite = pSprite;
+			entry.nBytes = pSprite->SizeBytes();
+			entry.lru = m_lru.begin();
+			m_entries.emplace(id, std::move(entry));
+
+			m_nUsed += pSprite->SizeBytes();
+			Trim();
+
+			return pSprite;
+		}
+
+
+
+		void Remove(AssetID id) {
+			auto it = m_entries.find(id);
+			if (it == m_entries.end())
+				return;
+
+			m_nUsed -= it->second.nBytes;
+			m_lru.erase(it->second.lru);
+			m_entries.erase(it);
+		}
+
+
+
+		void Clear() {
+			m_entries.clear();
+			m_lru.clear();
+			m_nUsed = 0;
+		}
+
+
+
+		void SetBudget(size_t nBudgetBytes) {
+			m_nBudget = nBudgetBytes;
+			Trim();
+		}
+
+
+
+		size_t Budget() const {
+			return m_nBudget;
+		}
+
+
+
+		// Bytes held by cached sprites
+		size_t MemoryUsed() const {
+			return m_nUsed;
+		}
+
+
+
+		size_t Size() const {
+			return m_entries.size();
+		}
+
+
+
+		uint64_t Hits() const {
+			return m_nHits;
+		}
+
+
+
+		uint64_t Misses() const {
+			return m_nMisses;
+		}
+	};
+
+
+
+	using ImageCache = BasicImageCache<THPX_PIXEL_FORMAT>;
+
+}
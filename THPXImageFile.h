@@ -0,0 +1,670 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+#include <algorithm>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#include "THPXTypes.h"
+#include "THPXPixelFormat.h"
+#include "THPXSprite.h"
+
+
+namespace THPX {
+
+	//===== MAPPED FILE =====//
+
+	// Read-only file mapped copy-on-write: pages are read from disk the first
+	// time they are touched, and writes through the mapping stay private.
+	class MappedFile {
+
+	private:
+		uint8_t*    m_pData = nullptr;
+		size_t      m_nSize = 0;
+
+#ifdef _WIN32
+		HANDLE      m_hFile = INVALID_HANDLE_VALUE;
+		HANDLE      m_hMapping = NULL;
+#endif
+
+
+	public:
+		MappedFile() {}
+
+		~MappedFile() {
+			Close();
+		}
+
+		MappedFile(const MappedFile&) = delete;
+		MappedFile& operator=(const MappedFile&) = delete;
+
+
+
+		bool Open(const char* sPath) {
+			Close();
+
+#ifdef _WIN32
+			m_hFile = CreateFileA(sPath, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+			if (m_hFile == INVALID_HANDLE_VALUE)
+				return false;
+
+			LARGE_INTEGER size;
+			if (!GetFileSizeEx(m_hFile, &size) || size.QuadPart == 0) {
+				Close();
+				return false;
+			}
+
+			m_hMapping = CreateFileMappingA(m_hFile, NULL, PAGE_WRITECOPY, 0, 0, NULL);
+			if (!m_hMapping) {
+				Close();
+				return false;
+			}
+
+			m_pData = (uint8_t*)MapViewOfFile(m_hMapping, FILE_MAP_COPY, 0, 0, 0);
+			m_nSize = (size_t)size.QuadPart;
+#else
+			int fd = open(sPath, O_RDONLY);
+			if (fd < 0)
+				return false;
+
+			struct stat st;
+			if (fstat(fd, &st) != 0 || st.st_size == 0) {
+				close(fd);
+				return false;
+			}
+
+			void* p = mmap(nullptr, (size_t)st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+			close(fd);
+
+			m_pData = p == MAP_FAILED ? nullptr : (uint8_t*)p;
+			m_nSize = (size_t)st.st_size;
+#endif
+
+			if (!m_pData) {
+				Close();
+				return false;
+			}
+			return true;
+		}
+
+
+
+		void Close() {
+#ifdef _WIN32
+			if (m_pData)
+				UnmapViewOfFile(m_pData);
+			if (m_hMapping)
+				CloseHandle(m_hMapping);
+			if (m_hFile != INVALID_HANDLE_VALUE)
+				CloseHandle(m_hFile);
+			m_hMapping = NULL;
+			m_hFile = INVALID_HANDLE_VALUE;
+#else
+			if (m_pData)
+				munmap(m_pData, m_nSize);
+#endif
+			m_pData = nullptr;
+			m_nSize = 0;
+		}
+
+
+
+		// Hints that a range is about to be read, so the OS can start paging it in
+		void Prefetch(size_t nOffset, size_t nSize) const {
+#ifndef _WIN32
+			if (!m_pData || nOffset >= m_nSize)
+				return;
+
+			size_t nPage = (size_t)sysconf(_SC_PAGESIZE);
+			size_t nStart = nOffset / nPage * nPage;
+			size_t nEnd = std::min(nOffset + nSize, m_nSize);
+			madvise(m_pData + nStart, nEnd - nStart, MADV_WILLNEED);
+#else
+			(void)nOffset;
+			(void)nSize;
+#endif
+		}
+
+
+
+		bool IsOpen() const {
+			return m_pData != nullptr;
+		}
+
+
+
+		uint8_t* Data() const {
+			return m_pData;
+		}
+
+
+
+		size_t Size() const {
+			return m_nSize;
+		}
+	};
+
+
+
+	//===== IMAGE FILE =====//
+
+	// Header of the native container. Texels follow at nDataOffset exactly as a
+	// sprite stores them, so a mapped file can be drawn from without copying.
+	// Tiled files store nTileSize square tiles one after another, each with
+	// its own padded rows, so one tile is one contiguous range of the file.
+	struct ImageFileHeader {
+		char        magic[4];       // "TPXI"
+		uint16_t    nVersion;
+		uint8_t     nFormat;        // PixelFormat
+		uint8_t     nReserved;
+		uint32_t    nWidth;
+		uint32_t    nHeight;
+		uint32_t    nPitchBytes;    // of a row, or of a tile row when tiled
+		uint32_t    nTileSize;      // 0 when stored as plain rows
+		uint64_t    nDataOffset;
+	};
+
+	static_assert(sizeof(ImageFileHeader) == 32, "header layout is part of the file format");
+
+
+
+	// An image file opened through a memory mapping. Reads the native container
+	// (zero copy, optionally tiled), binary PPM (P6) and uncompressed 24 / 32 bit
+	// BMP. Rows of any of them are exposed as raw bytes without copying; PPM and
+	// BMP are converted when a sprite is asked for, the container only when the
+	// formats differ. Multi-byte fields are read as little endian.
+	class ImageFile {
+
+	public:
+		enum class Type : uint8_t {
+			NONE, CONTAINER, PPM, BMP
+		};
+
+		static constexpr uint16_t VERSION = 1;
+		static constexpr size_t DATA_ALIGNMENT = 64;
+
+
+	private:
+		MappedFile  m_file;
+		Type        m_type = Type::NONE;
+
+		int         m_nWidth = 0;
+		int         m_nHeight = 0;
+
+		// Raw rows: first row and signed distance between rows (BMP is bottom-up)
+		const uint8_t* m_pFirstRow = nullptr;
+		ptrdiff_t   m_nRowStride = 0;
+
+		// Source layout: container texel format, or 3 / 4 bytes per pixel for PPM and BMP
+		PixelFormat m_format = PixelFormat::RGBA8888;
+		size_t      m_nBytesPerPixel = 0;
+
+		// First tile of a tiled container
+		uint8_t*    m_pTiles = nullptr;
+		int         m_nTileSize = 0;
+		int         m_nTilesX = 0;
+		int         m_nTilesY = 0;
+		size_t      m_nTileBytes = 0;
+
+		// 32 bit BMP with a real alpha mask
+		bool        m_bAlpha = false;
+
+
+	private:
+		template<typename T>
+		static T ReadLE(const uint8_t* p) {
+			T v;
+			memcpy(&v, p, sizeof(T));
+			return v;
+		}
+
+
+
+		static size_t AlignUp(size_t n, size_t nAlignment) {
+			return (n + nAlignment - 1) / nAlignment * nAlignment;
+		}
+
+
+
+		// n = a * b, false if that exceeds nLimit
+		static bool MulWithin(size_t a, size_t b, size_t nLimit, size_t& n) {
+			if (b != 0 && a > nLimit / b)
+				return false;
+			n = a * b;
+			return true;
+		}
+
+
+
+		bool OpenContainer() {
+			const uint8_t* p = m_file.Data();
+			if (m_file.Size() < sizeof(ImageFileHeader))
+				return false;
+
+			ImageFileHeader header;
+			memcpy(&header, p, sizeof(header));
+			if (header.nVersion != VERSION || header.nFormat > (uint8_t)PixelFormat::RGBAF32)
+				return false;
+
+			if (header.nWidth > INT32_MAX || header.nHeight > INT32_MAX || header.nTileSize > INT32_MAX || header.nDataOffset > m_file.Size())
+				return false;
+
+			m_format = (PixelFormat)header.nFormat;
+			m_nBytesPerPixel = TexelSize(m_format);
+			m_nWidth = (int)header.nWidth;
+			m_nHeight = (int)header.nHeight;
+			m_nTileSize = (int)header.nTileSize;
+
+			if (header.nPitchBytes < m_nBytesPerPixel * (m_nTileSize > 0 ? m_nTileSize : m_nWidth))
+				return false;
+
+			// Texels are read in place, the mapping is page aligned so the offset has
+			// to keep them aligned (texel sizes are multiples of their alignment)
+			if (header.nDataOffset % m_nBytesPerPixel != 0)
+				return false;
+
+			// Everything the pixel data spans has to lie within the file
+			size_t nAvailable = m_file.Size() - (size_t)header.nDataOffset;
+			size_t nNeeded;
+			if (m_nTileSize > 0) {
+				m_nTilesX = (int)(((int64_t)m_nWidth + m_nTileSize - 1) / m_nTileSize);
+				m_nTilesY = (int)(((int64_t)m_nHeight + m_nTileSize - 1) / m_nTileSize);
+				m_pTiles = m_file.Data() + header.nDataOffset;
+				return MulWithin(header.nPitchBytes, (size_t)m_nTileSize, nAvailable, m_nTileBytes) &&
+					MulWithin(m_nTileBytes, (size_t)m_nTilesX, nAvailable, nNeeded) &&
+					MulWithin(nNeeded, (size_t)m_nTilesY, nAvailable, nNeeded);
+			}
+
+			m_pFirstRow = p + header.nDataOffset;
+			m_nRowStride = (ptrdiff_t)header.nPitchBytes;
+			return MulWithin(header.nPitchBytes, (size_t)m_nHeight, nAvailable, nNeeded);
+		}
+
+
+
+		// Next whitespace separated number of a PPM header, skipping comments
+		static bool ReadPPMNumber(const uint8_t*& p, const uint8_t* pEnd, int& nValue) {
+			for (;;) {
+				while (p < pEnd && (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n'))
+					p++;
+				if (p < pEnd && *p == '#') {
+					while (p < pEnd && *p != '\n')
+						p++;
+					continue;
+				}
+				break;
+			}
+
+			if (p >= pEnd || *p < '0' || *p > '9')
+				return false;
+
+			nValue = 0;
+			while (p < pEnd && *p >= '0' && *p <= '9' && nValue < (1 << 24))
+				nValue = nValue * 10 + (*p++ - '0');
+			return true;
+		}
+
+
+
+		bool OpenPPM() {
+			const uint8_t* p = m_file.Data() + 2;
+			const uint8_t* pEnd = m_file.Data() + m_file.Size();
+
+			int nMax;
+			if (!ReadPPMNumber(p, pEnd, m_nWidth) || !ReadPPMNumber(p, pEnd, m_nHeight) || !ReadPPMNumber(p, pEnd, nMax))
+				return false;
+
+			// 16 bit samples are not supported
+			if (nMax != 255 || p >= pEnd)
+				return false;
+
+			// Exactly one whitespace byte before the samples
+			p++;
+
+			m_nBytesPerPixel = 3;
+			m_pFirstRow = p;
+			m_nRowStride = (ptrdiff_t)m_nWidth * 3;
+
+			return (size_t)(pEnd - p) >= (size_t)m_nWidth * 3 * m_nHeight;
+		}
+
+
+
+		bool OpenBMP() {
+			const uint8_t* p = m_file.Data();
+			if (m_file.Size() < 54)
+				return false;
+
+			uint32_t nOffBits = ReadLE<uint32_t>(p + 10);
+			uint32_t nInfoSize = ReadLE<uint32_t>(p + 14);
+			int32_t nWidth = ReadLE<int32_t>(p + 18);
+			int32_t nHeight = ReadLE<int32_t>(p + 22);
+			uint16_t nBitCount = ReadLE<uint16_t>(p + 28);
+			uint32_t nCompression = ReadLE<uint32_t>(p + 30);
+
+			// BI_RGB, or 32 bit BI_BITFIELDS with the usual BGRA masks
+			if ((nBitCount != 24 && nBitCount != 32) || (nCompression != 0 && (nCompression != 3 || nBitCount != 32)))
+				return false;
+			if (nInfoSize < 40 || nInfoSize > m_file.Size() - 14 || nWidth <= 0 || nHeight == 0 || nHeight == INT32_MIN)
+				return false;
+
+			// Masks are part of V2+ headers, or follow a 40 byte one
+			if (nCompression == 3) {
+				if (14 + (size_t)std::max<uint32_t>(nInfoSize, 52) > m_file.Size())
+					return false;
+				if (ReadLE<uint32_t>(p + 54) != 0x00FF0000 || ReadLE<uint32_t>(p + 58) != 0x0000FF00 || ReadLE<uint32_t>(p + 62) != 0x000000FF)
+					return false;
+			}
+
+			// Alpha mask of V3+ headers
+			uint32_t nAlphaMask = nCompression == 3 && nInfoSize >= 56 ? ReadLE<uint32_t>(p + 66) : 0;
+			if (nAlphaMask != 0 && nAlphaMask != 0xFF000000)
+				return false;
+
+			bool bTopDown = nHeight < 0;
+			m_nWidth = nWidth;
+			m_nHeight = bTopDown ? -nHeight : nHeight;
+			m_nBytesPerPixel = nBitCount / 8;
+			m_bAlpha = nAlphaMask != 0;
+
+			size_t nStride = AlignUp((size_t)m_nWidth * m_nBytesPerPixel, 4);
+			size_t nPixelBytes;
+			if (nOffBits > m_file.Size() || !MulWithin(nStride, (size_t)m_nHeight, m_file.Size() - nOffBits, nPixelBytes))
+				return false;
+
+			if (bTopDown) {
+				m_pFirstRow = p + nOffBits;
+				m_nRowStride = (ptrdiff_t)nStride;
+			}
+			else {
+				m_pFirstRow = p + nOffBits + nStride * (m_nHeight - 1);
+				m_nRowStride = -(ptrdiff_t)nStride;
+			}
+			return true;
+		}
+
+
+
+		uint8_t* TileData(int tx, int ty) const {
+			return m_pTiles + ((size_t)ty * m_nTilesX + tx) * m_nTileBytes;
+		}
+
+
+
+		// Source pixel x of a raw row
+		Pixel RawPixel(const uint8_t* pRow, int x) const {
+			const uint8_t* p = pRow + x * m_nBytesPerPixel;
+			switch (m_type) {
+			case Type::PPM:
+				return Pixel(p[0], p[1], p[2]);
+			case Type::BMP:
+				return Pixel(p[2], p[1], p[0], m_bAlpha ? p[3] : 255);
+			default:
+				return DecodeTexel(m_format, p);
+			}
+		}
+
+
+
+	public:
+		ImageFile() {}
+
+		explicit ImageFile(const char* sPath) {
+			Open(sPath);
+		}
+
+
+
+		// Maps the file and reads its header, no pixel data is touched yet
+		bool Open(const char* sPath) {
+			Close();
+
+			if (!m_file.Open(sPath) || m_file.Size() < 2)
+				return false;
+
+			const uint8_t* p = m_file.Data();
+			bool bOk = false;
+
+			if (m_file.Size() >= 4 && memcmp(p, "TPXI", 4) == 0) {
+				m_type = Type::CONTAINER;
+				bOk = OpenContainer();
+			}
+			else if (p[0] == 'P' && p[1] == '6') {
+				m_type = Type::PPM;
+				bOk = OpenPPM();
+			}
+			else if (p[0] == 'B' && p[1] == 'M') {
+				m_type = Type::BMP;
+				bOk = OpenBMP();
+			}
+
+			if (!bOk || m_nWidth <= 0 || m_nHeight <= 0) {
+				Close();
+				return false;
+			}
+			return true;
+		}
+
+
+
+		void Close() {
+			m_file.Close();
+			m_type = Type::NONE;
+			m_nWidth = m_nHeight = 0;
+			m_pFirstRow = nullptr;
+			m_nRowStride = 0;
+			m_pTiles = nullptr;
+			m_nTileSize = m_nTilesX = m_nTilesY = 0;
+			m_nTileBytes = 0;
+			m_bAlpha = false;
+		}
+
+
+
+		// Raw bytes of row y straight from the mapping, null for tiled containers
+		const uint8_t* Row(int y) const {
+			if (!m_pFirstRow || y < 0 || y >= m_nHeight)
+				return nullptr;
+			return m_pFirstRow + y * m_nRowStride;
+		}
+
+
+
+		// Whole image as a sprite borrowing the mapping. Only a plain container
+		// already in FORMAT qualifies, anything else returns an empty sprite.
+		// The mapping is copy-on-write, so drawing into the sprite is allowed.
+		template<typename FORMAT>
+		BasicSprite<FORMAT> View() const {
+			if (m_type != Type::CONTAINER || m_nTileSize > 0 || m_format != FORMAT::ID || m_nRowStride % sizeof(typename FORMAT::Texel) != 0)
+				return BasicSprite<FORMAT>();
+
+			return BasicSprite<FORMAT>((typename FORMAT::Texel*)m_pFirstRow, m_nWidth, m_nHeight, (int)(m_nRowStride / sizeof(typename FORMAT::Texel)));
+		}
+
+
+
+		// One tile of a tiled container as a sprite borrowing the mapping. Only
+		// the pages of this tile are read from disk, on first access.
+		template<typename FORMAT>
+		BasicSprite<FORMAT> Tile(int tx, int ty) const {
+			if (m_nTileSize <= 0 || m_format != FORMAT::ID || tx < 0 || ty < 0 || tx >= m_nTilesX || ty >= m_nTilesY)
+				return BasicSprite<FORMAT>();
+
+			size_t nPitchBytes = m_nTileBytes / m_nTileSize;
+			if (nPitchBytes % sizeof(typename FORMAT::Texel) != 0)
+				return BasicSprite<FORMAT>();
+			uint8_t* pTile = TileData(tx, ty);
+			int w = std::min(m_nTileSize, m_nWidth - tx * m_nTileSize);
+			int h = std::min(m_nTileSize, m_nHeight - ty * m_nTileSize);
+
+			return BasicSprite<FORMAT>((typename FORMAT::Texel*)pTile, w, h, (int)(nPitchBytes / sizeof(typename FORMAT::Texel)));
+		}
+
+
+
+		// Starts paging in a tile ahead of drawing it
+		void PrefetchTile(int tx, int ty) const {
+			if (m_nTileSize > 0 && tx >= 0 && ty >= 0 && tx < m_nTilesX && ty < m_nTilesY)
+				m_file.Prefetch((size_t)(TileData(tx, ty) - m_file.Data()), m_nTileBytes);
+		}
+
+
+
+		// Owned sprite in FORMAT, converting from whatever the file holds
+		template<typename FORMAT>
+		BasicSprite<FORMAT> Decode() const {
+			BasicSprite<FORMAT> sprite;
+			if (m_type == Type::NONE)
+				return sprite;
+
+			sprite.Resize(m_nWidth, m_nHeight);
+
+			if (m_nTileSize > 0) {
+				for (int ty = 0; ty < m_nTilesY; ty++) {
+					for (int tx = 0; tx < m_nTilesX; tx++) {
+						const uint8_t* pTile = TileData(tx, ty);
+						size_t nPitchBytes = m_nTileBytes / m_nTileSize;
+						int w = std::min(m_nTileSize, m_nWidth - tx * m_nTileSize);
+						int h = std::min(m_nTileSize, m_nHeight - ty * m_nTileSize);
+
+						for (int y = 0; y < h; y++) {
+							typename FORMAT::Texel* pDst = sprite.Row(ty * m_nTileSize + y) + tx * m_nTileSize;
+							for (int x = 0; x < w; x++)
+								pDst[x] = FORMAT::Encode(RawPixel(pTile + y * nPitchBytes, x));
+						}
+					}
+				}
+				return sprite;
+			}
+
+			for (int y = 0; y < m_nHeight; y++) {
+				const uint8_t* pSrc = Row(y);
+				typename FORMAT::Texel* pDst = sprite.Row(y);
+
+				if (m_type == Type::CONTAINER && m_format == FORMAT::ID) {
+					SpanKernels::Copy(pDst, (const typename FORMAT::Texel*)pSrc, (size_t)m_nWidth);
+					continue;
+				}
+
+				for (int x = 0; x < m_nWidth; x++)
+					pDst[x] = FORMAT::Encode(RawPixel(pSrc, x));
+			}
+			return sprite;
+		}
+
+
+
+		// Writes a sprite as a native container, tiled when nTileSize > 0
+		template<typename FORMAT>
+		static bool Write(const char* sPath, const BasicSprite<FORMAT>& sprite, int nTileSize = 0) {
+			using Texel = typename FORMAT::Texel;
+
+			int nRowTexels = nTileSize > 0 ? nTileSize : sprite.Width();
+			size_t nPitchBytes = AlignUp(nRowTexels * sizeof(Texel), DATA_ALIGNMENT);
+
+			ImageFileHeader header;
+			memcpy(header.magic, "TPXI", 4);
+			header.nVersion = VERSION;
+			header.nFormat = (uint8_t)FORMAT::ID;
+			header.nReserved = 0;
+			header.nWidth = (uint32_t)sprite.Width();
+			header.nHeight = (uint32_t)sprite.Height();
+			header.nPitchBytes = (uint32_t)nPitchBytes;
+			header.nTileSize = (uint32_t)std::max(nTileSize, 0);
+			// Tiles start on a page, so tiles of a page multiple in size never share pages
+			header.nDataOffset = nTileSize > 0 ? 4096 : DATA_ALIGNMENT;
+
+			FILE* f = fopen(sPath, "wb");
+			if (!f)
+				return false;
+
+			std::vector<uint8_t> row(std::max<size_t>(nPitchBytes, (size_t)header.nDataOffset), 0);
+
+			bool bOk = fwrite(&header, sizeof(header), 1, f) == 1;
+			bOk = bOk && fwrite(row.data(), 1, (size_t)header.nDataOffset - sizeof(header), f) == (size_t)header.nDataOffset - sizeof(header);
+
+			// One padded row at a time, tiles padded to full size so every tile has the same layout
+			auto writeRow = [&](int x, int y, int nCount) {
+				std::fill(row.begin(), row.begin() + nPitchBytes, (uint8_t)0);
+				if (y < sprite.Height() && nCount > 0)
+					memcpy(row.data(), sprite.Row(y) + x, nCount * sizeof(Texel));
+				bOk = bOk && fwrite(row.data(), 1, nPitchBytes, f) == nPitchBytes;
+			};
+
+			if (nTileSize > 0) {
+				for (int ty = 0; ty * nTileSize < sprite.Height(); ty++) {
+					for (int tx = 0; tx * nTileSize < sprite.Width(); tx++) {
+						int w = std::min(nTileSize, sprite.Width() - tx * nTileSize);
+						for (int y = 0; y < nTileSize; y++)
+							writeRow(tx * nTileSize, ty * nTileSize + y, w);
+					}
+				}
+			}
+			else {
+				for (int y = 0; y < sprite.Height(); y++)
+					writeRow(0, y, sprite.Width());
+			}
+
+			return fclose(f) == 0 && bOk;
+		}
+
+
+
+		Type FileType() const {
+			return m_type;
+		}
+
+
+
+		// Texel format of a container; PPM and BMP rows are 3 or 4 byte RGB / BGR(A)
+		PixelFormat Format() const {
+			return m_format;
+		}
+
+
+
+		int Width() const {
+			return m_nWidth;
+		}
+
+
+
+		int Height() const {
+			return m_nHeight;
+		}
+
+
+
+		int TileSize() const {
+			return m_nTileSize;
+		}
+
+
+
+		int TilesX() const {
+			return m_nTilesX;
+		}
+
+
+
+		int TilesY() const {
+			return m_nTilesY;
+		}
+
+	};
+
+}
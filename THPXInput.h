@@ -0,0 +1,267 @@
+#pragma once
+
+#include <cstdint>
+#include <atomic>
+#include <chrono>
+
+#include "THPXSPSCQueue.h"
+
+
+namespace THPX {
+
+	enum Key
+	{
+		NONE,
+		A, B, C, D, E, F, G, H, I, J, K, L, M, N, O, P, Q, R, S, T, U, V, W, X, Y, Z,
+		K0, K1, K2, K3, K4, K5, K6, K7, K8, K9,
+		F1, F2, F3, F4, F5, F6, F7, F8, F9, F10, F11, F12,
+		UP, DOWN, LEFT, RIGHT,
+		SPACE, TAB, SHIFT, CTRL, INS, DEL, HOME, END, PGUP, PGDN,
+		BACK, ESCAPE, RETURN, ENTER, PAUSE, SCROLL,
+		NP0, NP1, NP2, NP3, NP4, NP5, NP6, NP7, NP8, NP9,
+		NP_MUL, NP_DIV, NP_ADD, NP_SUB, NP_DECIMAL, PERIOD,
+		EQUALS, COMMA, MINUS,
+		OEM_1, OEM_2, OEM_3, OEM_4, OEM_5, OEM_6, OEM_7, OEM_8,
+		CAPS_LOCK, ENUM_END
+	};
+
+	struct HWButton
+	{
+		bool bPressed = false;
+		bool bReleased = false;
+		bool bHeld = false;
+	};
+
+
+
+	//===== KEY TABLE =====//
+
+	// Windows virtual key code to Key, built at compile time. Codes are spelled
+	// out so the table is the same on every platform, unknown codes map to NONE.
+	struct VirtualKeyTable {
+		uint8_t     keys[256];
+	};
+
+	constexpr VirtualKeyTable MakeVirtualKeyTable() {
+		VirtualKeyTable table = {};
+
+		for (int i = 0; i < 26; i++)
+			table.keys[0x41 + i] = (uint8_t)(Key::A + i);
+		for (int i = 0; i < 10; i++)
+			table.keys[0x30 + i] = (uint8_t)(Key::K0 + i);
+		for (int i = 0; i < 12; i++)
+			table.keys[0x70 + i] = (uint8_t)(Key::F1 + i);
+		for (int i = 0; i < 10; i++)
+			table.keys[0x60 + i] = (uint8_t)(Key::NP0 + i);
+
+		table.keys[0x25] = Key::LEFT;   table.keys[0x26] = Key::UP;
+		table.keys[0x27] = Key::RIGHT;  table.keys[0x28] = Key::DOWN;
+
+		table.keys[0x20] = Key::SPACE;  table.keys[0x09] = Key::TAB;
+		table.keys[0x10] = Key::SHIFT;  table.keys[0x11] = Key::CTRL;
+		table.keys[0x2D] = Key::INS;    table.keys[0x2E] = Key::DEL;
+		table.keys[0x24] = Key::HOME;   table.keys[0x23] = Key::END;
+		table.keys[0x21] = Key::PGUP;   table.keys[0x22] = Key::PGDN;
+
+		table.keys[0x08] = Key::BACK;   table.keys[0x1B] = Key::ESCAPE;
+		table.keys[0x0D] = Key::ENTER;  table.keys[0x13] = Key::PAUSE;
+		table.keys[0x91] = Key::SCROLL; table.keys[0x14] = Key::CAPS_LOCK;
+
+		table.keys[0x6A] = Key::NP_MUL; table.keys[0x6F] = Key::NP_DIV;
+		table.keys[0x6B] = Key::NP_ADD; table.keys[0x6D] = Key::NP_SUB;
+		table.keys[0x6E] = Key::NP_DECIMAL;
+
+		table.keys[0xBB] = Key::EQUALS; table.keys[0xBC] = Key::COMMA;
+		table.keys[0xBD] = Key::MINUS;  table.keys[0xBE] = Key::PERIOD;
+
+		table.keys[0xBA] = Key::OEM_1;  table.keys[0xBF] = Key::OEM_2;
+		table.keys[0xC0] = Key::OEM_3;  table.keys[0xDB] = Key::OEM_4;
+		table.keys[0xDC] = Key::OEM_5;  table.keys[0xDD] = Key::OEM_6;
+		table.keys[0xDE] = Key::OEM_7;  table.keys[0xDF] = Key::OEM_8;
+
+		return table;
+	}
+
+	inline constexpr VirtualKeyTable VIRTUAL_KEYS = MakeVirtualKeyTable();
+
+	constexpr uint8_t KeyFromVirtualKey(uint64_t nVirtualKey) {
+		return nVirtualKey < 256 ? VIRTUAL_KEYS.keys[nVirtualKey] : (uint8_t)Key::NONE;
+	}
+
+	static_assert(KeyFromVirtualKey(0x41) == Key::A && KeyFromVirtualKey(0x7B) == Key::F12, "virtual key table");
+
+
+
+	//===== INPUT EVENTS =====//
+
+	enum class InputEventType : uint8_t {
+		KEY_DOWN,       // nCode is a Key, bRepeat for auto-repeat
+		KEY_UP,
+		MOUSE_DOWN,     // nCode is the button, 0 left, 1 right, 2 middle
+		MOUSE_UP,
+		MOUSE_MOVE,     // x, y in framebuffer pixels
+		MOUSE_WHEEL,    // y in 1/120 notches, positive away from the user
+		TEXT            // nChar is a Unicode code point, control characters included
+	};
+
+
+
+	struct InputEvent {
+		// InputQueue::Timestamp when the platform saw the event
+		int64_t         nTime = 0;
+		InputEventType  type = InputEventType::KEY_DOWN;
+		uint8_t         nCode = 0;
+		bool            bRepeat = false;
+		int32_t         x = 0;
+		int32_t         y = 0;
+		uint32_t        nChar = 0;
+	};
+
+
+
+	//===== INPUT QUEUE =====//
+
+	// Events from one producer (the platform layer, or a test or benchmark
+	// thread injecting synthetic input) to the renderer, which drains it once
+	// per frame. Never blocks; events that don't fit are counted and dropped.
+	class InputQueue {
+
+	public:
+		static constexpr size_t CAPACITY = 1024;
+
+
+	private:
+		SPSCQueue<InputEvent, CAPACITY> m_queue;
+		std::atomic<uint64_t> m_nDropped;
+
+		// Called after every push, lets an idle loop sleep until input arrives
+		void        (*m_pfnWake)(void*) = nullptr;
+		void*       m_pWakeContext = nullptr;
+
+
+	public:
+		InputQueue() : m_nDropped(0) {}
+
+
+
+		// Steady clock in nanoseconds, the time base of every event
+		static int64_t Timestamp() {
+			return (int64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+				std::chrono::steady_clock::now().time_since_epoch()).count();
+		}
+
+
+
+		bool Push(const InputEvent& event) {
+			if (!m_queue.Push(event)) {
+				m_nDropped.fetch_add(1, std::memory_order_relaxed);
+				return false;
+			}
+
+			if (m_pfnWake)
+				m_pfnWake(m_pWakeContext);
+			return true;
+		}
+
+
+
+		bool Pop(InputEvent& event) {
+			return m_queue.Pop(event);
+		}
+
+
+
+		// Consumer side
+		bool Empty() const {
+			return m_queue.Size() == 0;
+		}
+
+
+
+		// Set before the producer starts pushing
+		void SetWakeHook(void (*pfnWake)(void*), void* pContext) {
+			m_pfnWake = pfnWake;
+			m_pWakeContext = pContext;
+		}
+
+
+
+		bool KeyDown(uint8_t nKey, bool bRepeat = false, int64_t nTime = Timestamp()) {
+			InputEvent event;
+			event.nTime = nTime;
+			event.type = InputEventType::KEY_DOWN;
+			event.nCode = nKey;
+			event.bRepeat = bRepeat;
+			return Push(event);
+		}
+
+
+
+		bool KeyUp(uint8_t nKey, int64_t nTime = Timestamp()) {
+			InputEvent event;
+			event.nTime = nTime;
+			event.type = InputEventType::KEY_UP;
+			event.nCode = nKey;
+			return Push(event);
+		}
+
+
+
+		bool MouseDown(uint8_t nButton, int64_t nTime = Timestamp()) {
+			InputEvent event;
+			event.nTime = nTime;
+			event.type = InputEventType::MOUSE_DOWN;
+			event.nCode = nButton;
+			return Push(event);
+		}
+
+
+
+		bool MouseUp(uint8_t nButton, int64_t nTime = Timestamp()) {
+			InputEvent event;
+			event.nTime = nTime;
+			event.type = InputEventType::MOUSE_UP;
+			event.nCode = nButton;
+			return Push(event);
+		}
+
+
+
+		bool MouseMove(int x, int y, int64_t nTime = Timestamp()) {
+			InputEvent event;
+			event.nTime = nTime;
+			event.type = InputEventType::MOUSE_MOVE;
+			event.x = x;
+			event.y = y;
+			return Push(event);
+		}
+
+
+
+		bool MouseWheel(int nDelta, int64_t nTime = Timestamp()) {
+			InputEvent event;
+			event.nTime = nTime;
+			event.type = InputEventType::MOUSE_WHEEL;
+			event.y = nDelta;
+			return Push(event);
+		}
+
+
+
+		bool Text(uint32_t nChar, int64_t nTime = Timestamp()) {
+			InputEvent event;
+			event.nTime = nTime;
+			event.type = InputEventType::TEXT;
+			event.nChar = nChar;
+			return Push(event);
+		}
+
+
+
+		// Events lost because the renderer fell CAPACITY events behind
+		uint64_t Dropped() const {
+			return m_nDropped.load(std::memory_order_relaxed);
+		}
+	};
+
+}
@@ -0,0 +1,411 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <memory>
+#include <algorithm>
+
+#include "THPXFramebuffer.h"
+#include "THPXBlend.h"
+#include "THPXThreadPool.h"
+
+
+namespace THPX {
+
+	//===== LAYER =====//
+
+	// Framebuffer of its own that a layer stack composites into the output.
+	// Pixels are straight alpha; a new layer is fully transparent. Its dirty
+	// tiles say what the next composite has to redo.
+	template<typename FORMAT>
+	class BasicLayer : public BasicFramebuffer<FORMAT> {
+
+		template<typename> friend class BasicLayerStack;
+
+	private:
+		std::string m_sName;
+		int         m_nZOrder = 0;
+		uint8_t     m_nOpacity = 255;
+		bool        m_bVisible = true;
+
+		// Every pixel has alpha 255, the layer hides everything below it
+		bool        m_bOpaque = false;
+
+		// A property changed, the whole output has to be recomposited
+		bool        m_bChanged = true;
+
+
+	public:
+		BasicLayer(const std::string& sName, int nZOrder, int nWidth, int nHeight)
+			: BasicFramebuffer<FORMAT>(nWidth, nHeight, THPX::BLANK) {
+			m_sName = sName;
+			m_nZOrder = nZOrder;
+		}
+
+
+
+		const std::string& Name() const {
+			return m_sName;
+		}
+
+
+
+		int ZOrder() const {
+			return m_nZOrder;
+		}
+
+
+
+		// 0 is invisible, 1 shows the layer's own alpha unchanged
+		void SetOpacity(float fOpacity) {
+			uint8_t nOpacity = (uint8_t)(std::min(std::max(fOpacity, 0.0f), 1.0f) * 255.0f + 0.5f);
+			m_bChanged |= nOpacity != m_nOpacity;
+			m_nOpacity = nOpacity;
+		}
+
+		float GetOpacity() const {
+			return m_nOpacity * (1.0f / 255.0f);
+		}
+
+
+
+		void SetVisible(bool bVisible) {
+			m_bChanged |= bVisible != m_bVisible;
+			m_bVisible = bVisible;
+		}
+
+		bool IsVisible() const {
+			return m_bVisible;
+		}
+
+
+
+		// Promise that the layer is completely opaque (e.g. a background), so the
+		// layers below it are never composited
+		void SetOpaque(bool bOpaque) {
+			m_bChanged |= bOpaque != m_bOpaque;
+			m_bOpaque = bOpaque;
+		}
+
+		bool IsOpaque() const {
+			return m_bOpaque;
+		}
+	};
+
+
+
+	//===== LAYER STACK =====//
+
+	// Named layers composited bottom to top (ascending z order, ties in creation
+	// order) over a background color. Only DIRTY_TILE_SIZE tiles that changed in
+	// a visible layer are redone, in parallel tile rows, so a frame that only
+	// redraws a small HUD leaves the rest of the output untouched.
+	template<typename FORMAT>
+	class BasicLayerStack {
+
+	public:
+		using Layer = BasicLayer<FORMAT>;
+		using Texel = typename FORMAT::Texel;
+
+
+	private:
+		// Bottom first
+		std::vector<std::unique_ptr<Layer>> m_layers;
+
+		Pixel       m_background = THPX::BLACK;
+
+		// Size of every layer, and of the output they were last composited into
+		int         m_nWidth = 0;
+		int         m_nHeight = 0;
+
+		// Output tiles to redo, one byte per DIRTY_TILE_SIZE tile
+		std::vector<uint8_t> m_tiles;
+
+		// Output tiles the last composite wrote, and the ones drawn into on top of
+		// it before the frame was presented (these get restored next time)
+		std::vector<uint8_t> m_written;
+		std::vector<uint8_t> m_foreign;
+
+		// Layers were added, removed or resized since the last composite
+		bool        m_bFull = true;
+
+		// Layers that take part in this composite, bottom first
+		std::vector<const Layer*> m_active;
+
+		uint64_t    m_nCompositedTiles = 0;
+
+
+	private:
+		void Sort() {
+			std::stable_sort(m_layers.begin(), m_layers.end(),
+				[](const std::unique_ptr<Layer>& a, const std::unique_ptr<Layer>& b) { return a->m_nZOrder < b->m_nZOrder; });
+		}
+
+
+
+		// One output row of a tile run, all layers blended while the row is in cache
+		void CompositeRow(Texel* pDst, int y, int x0, size_t nCount, Texel background) const {
+			size_t nFirst = 0;
+			const Layer* pBottom = m_active.front();
+
+			if (pBottom->m_bOpaque && pBottom->m_nOpacity == 255) {
+				SpanKernels::Copy(pDst, pBottom->Row(y) + x0, nCount);
+				nFirst = 1;
+			}
+			else {
+				SpanKernels::Fill(pDst, nCount, background);
+			}
+
+			for (size_t i = nFirst; i < m_active.size(); i++) {
+				const Layer* pLayer = m_active[i];
+				if (pLayer->m_nOpacity == 255)
+					BlendKernels::Over<FORMAT>(pDst, pLayer->Row(y) + x0, nCount);
+				else
+					BlendKernels::OverScaled<FORMAT>(pDst, pLayer->Row(y) + x0, nCount, pLayer->m_nOpacity);
+			}
+		}
+
+
+
+	public:
+		// Creates a transparent layer of the current size, nullptr if the name is taken
+		Layer* Add(const std::string& sName, int nZOrder = 0) {
+			if (Find(sName))
+				return nullptr;
+
+			m_layers.emplace_back(new Layer(sName, nZOrder, m_nWidth, m_nHeight));
+			Layer* pLayer = m_layers.back().get();
+			Sort();
+			m_bFull = true;
+			return pLayer;
+		}
+
+
+
+		Layer* Find(const std::string& sName) {
+			for (auto& pLayer : m_layers) {
+				if (pLayer->m_sName == sName)
+					return pLayer.get();
+			}
+			return nullptr;
+		}
+
+
+
+		bool Remove(const std::string& sName) {
+			for (size_t i = 0; i < m_layers.size(); i++) {
+				if (m_layers[i]->m_sName == sName) {
+					m_layers.erase(m_layers.begin() + i);
+					m_bFull = true;
+					return true;
+				}
+			}
+			return false;
+		}
+
+
+
+		// Moves a layer in the stack, equal z orders keep their current relative order
+		void SetZOrder(Layer* pLayer, int nZOrder) {
+			if (pLayer->m_nZOrder != nZOrder) {
+				pLayer->m_nZOrder = nZOrder;
+				Sort();
+				m_bFull = true;
+			}
+		}
+
+
+
+		// Bottom to top
+		size_t Count() const {
+			return m_layers.size();
+		}
+
+		Layer* At(size_t i) {
+			return m_layers[i].get();
+		}
+
+
+
+		bool Empty() const {
+			return m_layers.empty();
+		}
+
+
+
+		// Something changed that the next composite has to show
+		bool IsDirty() const {
+			if (m_bFull)
+				return true;
+			for (auto& pLayer : m_layers) {
+				if (pLayer->m_bChanged || (pLayer->m_bVisible && pLayer->FramebufferBase::IsDirty()))
+					return true;
+			}
+			return false;
+		}
+
+
+
+		// Shows where no opaque layer covers the output
+		void SetBackground(Pixel p) {
+			m_background = p;
+			m_bFull = true;
+		}
+
+
+
+		// Resizes every layer, clearing it to transparent
+		void Resize(int nWidth, int nHeight) {
+			m_nWidth = nWidth;
+			m_nHeight = nHeight;
+			for (auto& pLayer : m_layers)
+				pLayer->Resize(nWidth, nHeight, THPX::BLANK);
+			m_bFull = true;
+		}
+
+
+
+		// Redoes the output tiles that changed in any layer, or that were drawn into
+		// outside the layers, on pPool if given. Resizes the layers first if the
+		// output changed size. Leaves the output's dirty tiles cleared so TrackForeign
+		// sees what is drawn on top; returns false if nothing changed.
+		bool Composite(BasicFramebuffer<FORMAT>& output, ThreadPool* pPool = nullptr) {
+			if (output.ScreenWidth() != m_nWidth || output.ScreenHeight() != m_nHeight)
+				Resize(output.ScreenWidth(), output.ScreenHeight());
+
+			size_t nTiles = (size_t)output.DirtyTilesX() * output.DirtyTilesY();
+			if (m_tiles.size() != nTiles) {
+				m_tiles.assign(nTiles, 0);
+				m_written.assign(nTiles, 0);
+				m_foreign.assign(nTiles, 0);
+				m_bFull = true;
+			}
+
+			// Layers below the topmost opaque one are hidden, hidden layers only
+			// matter when their visibility changes
+			m_active.clear();
+			for (auto& pLayer : m_layers) {
+				m_bFull |= pLayer->m_bChanged;
+				pLayer->m_bChanged = false;
+
+				if (!pLayer->m_bVisible || pLayer->m_nOpacity == 0)
+					continue;
+				if (pLayer->m_bOpaque && pLayer->m_nOpacity == 255)
+					m_active.clear();
+				m_active.push_back(pLayer.get());
+			}
+
+			bool bAny = m_bFull;
+			if (m_bFull) {
+				std::fill(m_tiles.begin(), m_tiles.end(), (uint8_t)1);
+			}
+			else {
+				// Direct drawing since the last present is composited over as well
+				m_tiles.assign(output.DirtyTiles(), output.DirtyTiles() + nTiles);
+				for (size_t i = 0; i < nTiles; i++)
+					m_tiles[i] |= m_foreign[i];
+				for (const Layer* pLayer : m_active) {
+					const uint8_t* pDirty = pLayer->DirtyTiles();
+					for (size_t i = 0; i < nTiles; i++)
+						m_tiles[i] |= pDirty[i];
+				}
+				bAny = std::find(m_tiles.begin(), m_tiles.end(), (uint8_t)1) != m_tiles.end();
+			}
+
+			for (auto& pLayer : m_layers)
+				pLayer->ClearDirty();
+			std::fill(m_foreign.begin(), m_foreign.end(), (uint8_t)0);
+			m_bFull = false;
+
+			m_written = m_tiles;
+			if (!bAny)
+				return false;
+
+			const int T = FramebufferBase::DIRTY_TILE_SIZE;
+			const int nTilesX = output.DirtyTilesX();
+			const Texel background = FORMAT::Encode(m_background);
+
+			// Workers own whole tile rows, output rows and dirty flags are never shared
+			auto compositeTileRow = [&](size_t ty) {
+				const uint8_t* pRow = &m_tiles[ty * nTilesX];
+				int y0 = (int)ty * T;
+				int y1 = std::min(y0 + T, m_nHeight) - 1;
+
+				for (int tx = 0; tx < nTilesX; ) {
+					if (!pRow[tx]) {
+						tx++;
+						continue;
+					}
+
+					int tx0 = tx;
+					while (tx < nTilesX && pRow[tx])
+						tx++;
+
+					int x0 = tx0 * T;
+					int x1 = std::min(tx * T, m_nWidth) - 1;
+
+					if (m_active.empty()) {
+						for (int y = y0; y <= y1; y++)
+							SpanKernels::Fill(output.Row(y) + x0, x1 - x0 + 1, background);
+					}
+					else {
+						for (int y = y0; y <= y1; y++)
+							CompositeRow(output.Row(y) + x0, y, x0, x1 - x0 + 1, background);
+					}
+
+					output.Invalidate(x0, y0, x1, y1);
+				}
+			};
+
+			size_t nTileRows = (size_t)output.DirtyTilesY();
+			if (pPool)
+				pPool->ParallelFor(nTileRows, compositeTileRow);
+			else
+				for (size_t ty = 0; ty < nTileRows; ty++)
+					compositeTileRow(ty);
+
+			for (uint8_t nTile : m_tiles)
+				m_nCompositedTiles += nTile;
+			output.ClearDirty();
+			return true;
+		}
+
+
+
+		// Call after Composite and whatever is drawn on top of it (deferred commands,
+		// overlays), before the output is presented. Tiles drawn into since the
+		// composite are redone next time, so nothing drawn on top stays behind;
+		// the composited tiles are marked dirty again for the presenter.
+		void TrackForeign(FramebufferBase& output) {
+			if (output.ScreenWidth() != m_nWidth || output.ScreenHeight() != m_nHeight || m_foreign.size() != m_written.size())
+				return;
+
+			const int T = FramebufferBase::DIRTY_TILE_SIZE;
+			const int nTilesX = output.DirtyTilesX();
+			const uint8_t* pDirty = output.DirtyTiles();
+			for (size_t i = 0; i < m_foreign.size(); i++) {
+				m_foreign[i] |= pDirty[i];
+				if (m_written[i]) {
+					int x0 = (int)(i % nTilesX) * T;
+					int y0 = (int)(i / nTilesX) * T;
+					output.Invalidate(x0, y0, std::min(x0 + T, m_nWidth) - 1, std::min(y0 + T, m_nHeight) - 1);
+				}
+			}
+			std::fill(m_written.begin(), m_written.end(), (uint8_t)0);
+		}
+
+
+
+		// Output tiles composited since the stack was created
+		uint64_t CompositedTiles() const {
+			return m_nCompositedTiles;
+		}
+	};
+
+
+
+	using Layer = BasicLayer<THPX_PIXEL_FORMAT>;
+	using LayerStack = BasicLayerStack<THPX_PIXEL_FORMAT>;
+
+}
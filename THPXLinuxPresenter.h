@@ -0,0 +1,853 @@
+#pragma once
+
+#ifdef __linux__
+
+#include <cstdint>
+#include <cstring>
+#include <climits>
+#include <string>
+#include <vector>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <new>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/fb.h>
+#include <linux/futex.h>
+
+#include "THPXFramebuffer.h"
+#include "THPXPresenter.h"
+
+
+namespace THPX {
+
+	//===== SHARED FRAME RING =====//
+
+	// Layout of the POSIX shared memory object a SharedMemoryPresenter writes
+	// and any number of viewers map. A SharedRingHeader at offset 0, then
+	// nSlots slots of nSlotStride bytes, each a SharedFrameSlot followed by the
+	// pixels. All times are CLOCK_MONOTONIC nanoseconds (FramePacer::Now).
+	constexpr uint32_t SHARED_RING_VERSION = 1;
+
+	// Most slots a ring can have, the slot index shares a word with the sequence
+	constexpr uint32_t SHARED_RING_MAX_SLOTS = 256;
+
+	static_assert(std::atomic<uint64_t>::is_always_lock_free && std::atomic<uint32_t>::is_always_lock_free,
+		"shared memory atomics have to be lock free");
+
+
+
+	struct alignas(64) SharedRingHeader {
+		char        sMagic[4];                  // "TPXS"
+		uint32_t    nVersion;
+		uint32_t    nSlots;
+		uint32_t    nWriterPid;
+		uint64_t    nSlotStride;                // Bytes from one slot header to the next
+		uint64_t    nCapacity;                  // Pixel bytes a slot can hold
+
+		// Newest complete frame: sequence << 8 | slot, 0 before the first frame
+		std::atomic<uint64_t> nPublished;
+
+		// Sequence of the frame a consumer holds, the writer never overwrites it
+		std::atomic<uint64_t> nHeld;
+
+		// Bumped on every publish, consumers futex-wait on it
+		std::atomic<uint32_t> nFutex;
+		std::atomic<uint32_t> nWaiters;
+
+		// Set when the writer closes the ring, viewers should reopen it
+		std::atomic<uint32_t> nClosed;
+	};
+
+
+
+	struct alignas(64) SharedFrameSlot {
+		// Frame sequence, starting at 1 and without gaps on the writer side.
+		// 0 while the slot is being written.
+		std::atomic<uint64_t> nSequence;
+
+		// When the frame was published
+		int64_t     nPresentTime;
+
+		uint32_t    nWidth;
+		uint32_t    nHeight;
+		uint32_t    nPitch;                     // Bytes per pixel row
+		uint8_t     nFormat;                    // PixelFormat
+		uint8_t     reserved[3];
+
+		// Inclusive bounds of what changed since frame nSequence - 1, everything on a resize
+		int32_t     nDamageX0, nDamageY0, nDamageX1, nDamageY1;
+	};
+
+	static_assert(sizeof(SharedRingHeader) == 64 && sizeof(SharedFrameSlot) == 64, "shared ring layout");
+
+
+
+	// A frame as a consumer sees it, pPixels points into the mapping
+	struct SharedFrame {
+		uint64_t    nSequence = 0;
+		int64_t     nPresentTime = 0;
+		int         nWidth = 0;
+		int         nHeight = 0;
+		size_t      nPitch = 0;
+		PixelFormat format = PixelFormat::RGBA8888;
+		Rect        damage = Rect(0, 0, -1, -1);
+		const uint8_t* pPixels = nullptr;
+		unsigned    nSlot = 0;
+	};
+
+
+
+	namespace SharedRing {
+
+		inline std::string ObjectName(const char* sName) {
+			return sName[0] == '/' ? std::string(sName) : "/" + std::string(sName);
+		}
+
+
+
+		inline SharedFrameSlot* Slot(SharedRingHeader* pHeader, unsigned nSlot) {
+			return (SharedFrameSlot*)((uint8_t*)pHeader + sizeof(SharedRingHeader) + nSlot * pHeader->nSlotStride);
+		}
+
+
+
+		inline int64_t Now() {
+			return (int64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+				std::chrono::steady_clock::now().time_since_epoch()).count();
+		}
+
+
+
+		// Shared (not process private) futex, the ring is mapped by several processes
+		inline void FutexWait(std::atomic<uint32_t>* pWord, uint32_t nExpected, int64_t nTimeout) {
+			timespec ts;
+			ts.tv_sec = (time_t)(nTimeout / 1000000000);
+			ts.tv_nsec = (long)(nTimeout % 1000000000);
+			syscall(SYS_futex, (uint32_t*)pWord, FUTEX_WAIT, nExpected, nTimeout < 0 ? nullptr : &ts, nullptr, 0);
+		}
+
+
+
+		inline void FutexWakeAll(std::atomic<uint32_t>* pWord) {
+			syscall(SYS_futex, (uint32_t*)pWord, FUTEX_WAKE, INT_MAX, nullptr, nullptr, 0);
+		}
+	}
+
+
+
+	//===== SHARED MEMORY PRESENTER =====//
+
+	// Publishes frames into a ring of slots in POSIX shared memory, for viewers
+	// and compositors in other processes that map the ring and read the pixels
+	// in place. Each slot only receives the tiles that changed since that slot
+	// last held a frame, so a static scene costs no copies at all.
+	class SharedMemoryPresenter : public Presenter {
+
+	private:
+		std::string m_sName;
+		SharedRingHeader* m_pHeader = nullptr;
+		size_t      m_nMapSize = 0;
+		unsigned    m_nSlots = 0;
+
+		uint64_t    m_nSequence = 0;
+		unsigned    m_nLatestSlot = 0;
+
+		// Geometry the slots were last written with, a change rewrites them completely
+		int         m_nWidth = -1;
+		int         m_nHeight = -1;
+		size_t      m_nPitch = 0;
+		PixelFormat m_format = PixelFormat::RGBA8888;
+
+		// Per slot, one byte per DIRTY_TILE_SIZE tile that is older in the slot than in the frame
+		std::vector<uint8_t> m_staleTiles;
+		size_t      m_nTiles = 0;
+
+		uint64_t    m_nSkipped = 0;
+
+
+	private:
+		// Copies the stale tiles of one slot, runs of neighbouring tiles in a row go in one memcpy per line
+		void CopyStale(const FramebufferBase& frame, uint8_t* pDst, uint8_t* pStale) {
+			const int T = FramebufferBase::DIRTY_TILE_SIZE;
+			int nTilesX = frame.DirtyTilesX();
+			size_t nTexel = frame.TexelSize();
+
+			for (int ty = 0; ty < frame.DirtyTilesY(); ty++) {
+				uint8_t* pRow = pStale + (size_t)ty * nTilesX;
+				int y0 = ty * T;
+				int y1 = std::min(y0 + T, m_nHeight);
+
+				for (int tx = 0; tx < nTilesX; ) {
+					if (!pRow[tx]) {
+						tx++;
+						continue;
+					}
+
+					int tx0 = tx;
+					while (tx < nTilesX && pRow[tx])
+						pRow[tx++] = 0;
+
+					size_t nOffset = tx0 * T * nTexel;
+					size_t nBytes = (std::min(tx * T, m_nWidth) - tx0 * T) * nTexel;
+					for (int y = y0; y < y1; y++)
+						memcpy(pDst + y * m_nPitch + nOffset, frame.RawData() + y * m_nPitch + nOffset, nBytes);
+				}
+			}
+		}
+
+
+
+	public:
+		~SharedMemoryPresenter() {
+			Close();
+		}
+
+
+
+		// Creates the ring, replacing a stale one of the same name. Frames up to
+		// nMaxWidth x nMaxHeight in format (or any smaller texel size) fit.
+		bool Open(const char* sName, int nMaxWidth, int nMaxHeight, PixelFormat format = THPX_PIXEL_FORMAT::ID, unsigned nSlots = 3) {
+			Close();
+
+			if (nMaxWidth <= 0 || nMaxHeight <= 0 || nSlots < 2 || nSlots > SHARED_RING_MAX_SLOTS)
+				return false;
+
+			// Same row padding as the framebuffers, so slot rows line up with frame rows
+			size_t nAlign = FramebufferBase::ROW_ALIGNMENT;
+			size_t nPitch = (nMaxWidth * TexelSize(format) + nAlign - 1) / nAlign * nAlign;
+			size_t nCapacity = nPitch * nMaxHeight;
+			size_t nStride = sizeof(SharedFrameSlot) + nCapacity;
+
+			// Readers of a previous ring keep their mapping of the unlinked object
+			std::string sObject = SharedRing::ObjectName(sName);
+			shm_unlink(sObject.c_str());
+
+			int nFile = shm_open(sObject.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+			if (nFile < 0)
+				return false;
+
+			size_t nSize = sizeof(SharedRingHeader) + nSlots * nStride;
+			void* pMemory = MAP_FAILED;
+			if (ftruncate(nFile, (off_t)nSize) == 0)
+				pMemory = mmap(nullptr, nSize, PROT_READ | PROT_WRITE, MAP_SHARED, nFile, 0);
+			close(nFile);
+
+			if (pMemory == MAP_FAILED) {
+				shm_unlink(sObject.c_str());
+				return false;
+			}
+
+			// ftruncate zero fills, every slot starts out empty
+			m_pHeader = new (pMemory) SharedRingHeader();
+			m_pHeader->nVersion = SHARED_RING_VERSION;
+			m_pHeader->nSlots = nSlots;
+			m_pHeader->nWriterPid = (uint32_t)getpid();
+			m_pHeader->nSlotStride = nStride;
+			m_pHeader->nCapacity = nCapacity;
+			m_pHeader->nPublished.store(0);
+			m_pHeader->nHeld.store(0);
+			m_pHeader->nFutex.store(0);
+			m_pHeader->nWaiters.store(0);
+			m_pHeader->nClosed.store(0);
+			for (unsigned i = 0; i < nSlots; i++)
+				new (SharedRing::Slot(m_pHeader, i)) SharedFrameSlot();
+
+			// Magic last, a viewer that finds it sees an initialized ring
+			std::atomic_thread_fence(std::memory_order_release);
+			memcpy(m_pHeader->sMagic, "TPXS", 4);
+
+			m_sName = sObject;
+			m_nMapSize = nSize;
+			m_nSlots = nSlots;
+			m_nSequence = 0;
+			m_nLatestSlot = nSlots - 1;
+			m_nWidth = -1;
+			m_nHeight = -1;
+			m_nSkipped = 0;
+			return true;
+		}
+
+
+
+		// Removes the ring, viewers that still map it keep their memory
+		void Close() {
+			if (!m_pHeader)
+				return;
+
+			m_pHeader->nClosed.store(1);
+			m_pHeader->nFutex.fetch_add(1);
+			SharedRing::FutexWakeAll(&m_pHeader->nFutex);
+
+			munmap(m_pHeader, m_nMapSize);
+			shm_unlink(m_sName.c_str());
+			m_pHeader = nullptr;
+		}
+
+
+
+		bool IsOpen() const {
+			return m_pHeader != nullptr;
+		}
+
+
+
+		bool Present(const FramebufferBase& frame) override {
+			if (!m_pHeader)
+				return false;
+
+			int w = frame.ScreenWidth();
+			int h = frame.ScreenHeight();
+			size_t nPitch = frame.PitchBytes();
+			if (w <= 0 || h <= 0 || nPitch * h > m_pHeader->nCapacity)
+				return false;
+
+			Rect damage(0, 0, w - 1, h - 1);
+			size_t nTiles = (size_t)frame.DirtyTilesX() * frame.DirtyTilesY();
+
+			if (w != m_nWidth || h != m_nHeight || nPitch != m_nPitch || frame.Format() != m_format) {
+				m_nWidth = w;
+				m_nHeight = h;
+				m_nPitch = nPitch;
+				m_format = frame.Format();
+				m_nTiles = nTiles;
+				m_staleTiles.assign(nTiles * m_nSlots, 1);
+			}
+			else {
+				// What changed in this frame is now stale in every slot
+				const int T = FramebufferBase::DIRTY_TILE_SIZE;
+				const uint8_t* pDirty = frame.DirtyTiles();
+				damage = Rect(INT_MAX, INT_MAX, -1, -1);
+
+				for (size_t i = 0; i < nTiles; i++) {
+					if (!pDirty[i])
+						continue;
+
+					for (unsigned s = 0; s < m_nSlots; s++)
+						m_staleTiles[s * nTiles + i] = 1;
+
+					int tx = (int)(i % frame.DirtyTilesX());
+					int ty = (int)(i / frame.DirtyTilesX());
+					damage.x0 = std::min(damage.x0, tx * T);
+					damage.y0 = std::min(damage.y0, ty * T);
+					damage.x1 = std::max(damage.x1, std::min(tx * T + T, w) - 1);
+					damage.y1 = std::max(damage.y1, std::min(ty * T + T, h) - 1);
+				}
+
+				if (damage.x1 < 0)
+					damage = Rect(0, 0, -1, -1);
+			}
+
+			// Next slot in rotation that no consumer holds. Storing 0 before checking
+			// nHeld again pairs with the consumer storing nHeld before checking the
+			// slot, so one of the two always sees the other.
+			for (unsigned i = 1; i <= m_nSlots; i++) {
+				unsigned nSlot = (m_nLatestSlot + i) % m_nSlots;
+				SharedFrameSlot* pSlot = SharedRing::Slot(m_pHeader, nSlot);
+
+				uint64_t nOld = pSlot->nSequence.load(std::memory_order_relaxed);
+				if (nOld != 0 && m_pHeader->nHeld.load() == nOld)
+					continue;
+
+				pSlot->nSequence.store(0);
+				if (nOld != 0 && m_pHeader->nHeld.load() == nOld) {
+					pSlot->nSequence.store(nOld, std::memory_order_release);
+					continue;
+				}
+				std::atomic_thread_fence(std::memory_order_release);
+
+				CopyStale(frame, (uint8_t*)(pSlot + 1), &m_staleTiles[nSlot * m_nTiles]);
+
+				pSlot->nPresentTime = SharedRing::Now();
+				pSlot->nWidth = (uint32_t)w;
+				pSlot->nHeight = (uint32_t)h;
+				pSlot->nPitch = (uint32_t)nPitch;
+				pSlot->nFormat = (uint8_t)m_format;
+				pSlot->nDamageX0 = damage.x0;
+				pSlot->nDamageY0 = damage.y0;
+				pSlot->nDamageX1 = damage.x1;
+				pSlot->nDamageY1 = damage.y1;
+
+				m_nSequence++;
+				m_nLatestSlot = nSlot;
+				pSlot->nSequence.store(m_nSequence, std::memory_order_release);
+				m_pHeader->nPublished.store(m_nSequence << 8 | nSlot, std::memory_order_release);
+
+				// Only pay for the syscall when a viewer sleeps
+				m_pHeader->nFutex.fetch_add(1);
+				if (m_pHeader->nWaiters.load() > 0)
+					SharedRing::FutexWakeAll(&m_pHeader->nFutex);
+				return true;
+			}
+
+			// Only reachable with a single free slot held, the frame is lost
+			m_nSkipped++;
+			return false;
+		}
+
+
+
+		// Sequence of the last published frame
+		uint64_t Sequence() const {
+			return m_nSequence;
+		}
+
+
+
+		uint64_t Skipped() const {
+			return m_nSkipped;
+		}
+	};
+
+
+
+	//===== SHARED FRAME READER =====//
+
+	// Viewer side of a SharedMemoryPresenter ring. Frames are read in place:
+	// Acquire holds the newest frame, so the writer leaves its slot alone, until
+	// Release or the next Acquire. One reader per ring can hold frames, further
+	// readers call Acquire(frame, false) and check Valid after reading.
+	class SharedFrameReader {
+
+	private:
+		SharedRingHeader* m_pHeader = nullptr;
+		size_t      m_nMapSize = 0;
+
+		// Layout as checked by Open, the shared header could change under us later
+		unsigned    m_nSlots = 0;
+		size_t      m_nSlotStride = 0;
+		size_t      m_nCapacity = 0;
+
+		uint64_t    m_nLastSequence = 0;
+		uint64_t    m_nDropped = 0;
+		bool        m_bHolding = false;
+
+
+	public:
+		~SharedFrameReader() {
+			Close();
+		}
+
+
+
+		bool Open(const char* sName) {
+			Close();
+
+			int nFile = shm_open(SharedRing::ObjectName(sName).c_str(), O_RDWR, 0);
+			if (nFile < 0)
+				return false;
+
+			struct stat st;
+			void* pMemory = MAP_FAILED;
+			if (fstat(nFile, &st) == 0 && (size_t)st.st_size >= sizeof(SharedRingHeader))
+				pMemory = mmap(nullptr, (size_t)st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, nFile, 0);
+			close(nFile);
+
+			if (pMemory == MAP_FAILED)
+				return false;
+
+			SharedRingHeader* pHeader = (SharedRingHeader*)pMemory;
+			bool bValid = memcmp(pHeader->sMagic, "TPXS", 4) == 0;
+			std::atomic_thread_fence(std::memory_order_acquire);
+
+			// Every slot with its pixels has to lie within the segment, slot headers aligned
+			uint32_t nSlots = pHeader->nSlots;
+			uint64_t nSlotStride = pHeader->nSlotStride;
+			uint64_t nCapacity = pHeader->nCapacity;
+			bValid = bValid && pHeader->nVersion == SHARED_RING_VERSION
+				&& nSlots >= 2 && nSlots <= SHARED_RING_MAX_SLOTS
+				&& nSlotStride % alignof(SharedFrameSlot) == 0
+				&& nSlotStride >= sizeof(SharedFrameSlot)
+				&& nCapacity <= nSlotStride - sizeof(SharedFrameSlot)
+				&& nSlotStride <= ((size_t)st.st_size - sizeof(SharedRingHeader)) / nSlots;
+
+			if (!bValid) {
+				munmap(pMemory, (size_t)st.st_size);
+				return false;
+			}
+
+			m_pHeader = pHeader;
+			m_nMapSize = (size_t)st.st_size;
+			m_nSlots = nSlots;
+			m_nSlotStride = (size_t)nSlotStride;
+			m_nCapacity = (size_t)nCapacity;
+			m_nLastSequence = 0;
+			m_nDropped = 0;
+			m_bHolding = false;
+			return true;
+		}
+
+
+
+		void Close() {
+			if (!m_pHeader)
+				return;
+
+			Release();
+			munmap(m_pHeader, m_nMapSize);
+			m_pHeader = nullptr;
+		}
+
+
+
+		bool IsOpen() const {
+			return m_pHeader != nullptr;
+		}
+
+
+
+
+	private:
+		SharedFrameSlot* Slot(unsigned nSlot) const {
+			return (SharedFrameSlot*)((uint8_t*)m_pHeader + sizeof(SharedRingHeader) + nSlot * m_nSlotStride);
+		}
+
+
+
+	public:
+
+
+
+		// The newest frame if it is newer than the last one acquired, false otherwise
+		bool Acquire(SharedFrame& frame, bool bHold = true) {
+			if (!m_pHeader)
+				return false;
+
+			for (;;) {
+				uint64_t nPublished = m_pHeader->nPublished.load(std::memory_order_acquire);
+				uint64_t nSequence = nPublished >> 8;
+				unsigned nSlot = (unsigned)(nPublished & 0xFF);
+
+				if (nSequence == 0 || nSequence <= m_nLastSequence || nSlot >= m_nSlots)
+					return false;
+
+				if (bHold) {
+					m_pHeader->nHeld.store(nSequence);
+					m_bHolding = true;
+				}
+
+				// Already being overwritten, a newer frame is about to be published
+				SharedFrameSlot* pSlot = Slot(nSlot);
+				if (pSlot->nSequence.load() != nSequence) {
+					std::this_thread::yield();
+					continue;
+				}
+
+				// A corrupt writer must not send us past the slot: rows at least as
+				// wide as the frame, all of them within the slot's capacity
+				uint32_t nWidth = pSlot->nWidth, nHeight = pSlot->nHeight, nPitch = pSlot->nPitch;
+				uint8_t nFormat = pSlot->nFormat;
+				if (nFormat > (uint8_t)PixelFormat::RGBAF32 || nWidth > INT32_MAX || nHeight > INT32_MAX
+					|| nPitch < (uint64_t)nWidth * TexelSize((PixelFormat)nFormat)
+					|| (uint64_t)nPitch * nHeight > m_nCapacity) {
+					if (bHold)
+						Release();
+					m_nLastSequence = nSequence;
+					return false;
+				}
+
+				frame.nSequence = nSequence;
+				frame.nPresentTime = pSlot->nPresentTime;
+				frame.nWidth = (int)nWidth;
+				frame.nHeight = (int)nHeight;
+				frame.nPitch = nPitch;
+				frame.format = (PixelFormat)nFormat;
+				frame.damage = Rect(pSlot->nDamageX0, pSlot->nDamageY0, pSlot->nDamageX1, pSlot->nDamageY1);
+				frame.pPixels = (const uint8_t*)(pSlot + 1);
+				frame.nSlot = nSlot;
+
+				// Damage is relative to the previous sequence, after a gap everything counts
+				if (m_nLastSequence != 0 && nSequence != m_nLastSequence + 1) {
+					m_nDropped += nSequence - m_nLastSequence - 1;
+					frame.damage = Rect(0, 0, frame.nWidth - 1, frame.nHeight - 1);
+				}
+				m_nLastSequence = nSequence;
+				return true;
+			}
+		}
+
+
+
+		// Lets the writer reuse the held slot
+		void Release() {
+			if (m_pHeader && m_bHolding) {
+				m_pHeader->nHeld.store(0);
+				m_bHolding = false;
+			}
+		}
+
+
+
+		// False once the writer started overwriting the frame, for frames acquired without holding
+		bool Valid(const SharedFrame& frame) const {
+			std::atomic_thread_fence(std::memory_order_acquire);
+			return m_pHeader && frame.nSlot < m_nSlots && Slot(frame.nSlot)->nSequence.load(std::memory_order_relaxed) == frame.nSequence;
+		}
+
+
+
+		// Sleeps until a frame newer than the last acquired one is published or
+		// nTimeout nanoseconds pass (forever if negative), true if there is one
+		bool WaitForFrame(int64_t nTimeout = -1) {
+			if (!m_pHeader)
+				return false;
+
+			uint32_t nFutex = m_pHeader->nFutex.load();
+			m_pHeader->nWaiters.fetch_add(1);
+			if ((m_pHeader->nPublished.load() >> 8) <= m_nLastSequence && !m_pHeader->nClosed.load())
+				SharedRing::FutexWait(&m_pHeader->nFutex, nFutex, nTimeout);
+			m_pHeader->nWaiters.fetch_sub(1);
+
+			return (m_pHeader->nPublished.load(std::memory_order_acquire) >> 8) > m_nLastSequence;
+		}
+
+
+
+		// The writer closed or replaced the ring, Open it again to follow the new one
+		bool WriterClosed() const {
+			return m_pHeader && m_pHeader->nClosed.load(std::memory_order_relaxed) != 0;
+		}
+
+
+
+		// Published frames this reader never acquired
+		uint64_t Dropped() const {
+			return m_nDropped;
+		}
+
+
+
+		// Nanoseconds from publish to now
+		static int64_t Latency(const SharedFrame& frame) {
+			return SharedRing::Now() - frame.nPresentTime;
+		}
+	};
+
+
+
+	//===== FRAMEBUFFER DEVICE PRESENTER =====//
+
+	// Writes frames straight into a memory mapped fbdev device (/dev/fb0), for
+	// machines without a GPU or display server. Frames are drawn at the top left
+	// of the visible area and clipped to it, in the device's pixel layout.
+	class FramebufferDevicePresenter : public Presenter {
+
+	private:
+		int         m_nFile = -1;
+		uint8_t*    m_pMemory = nullptr;
+		size_t      m_nMapSize = 0;
+
+		// Visible area, m_pScreen is its top left texel
+		uint8_t*    m_pScreen = nullptr;
+		int         m_nScreenWidth = 0;
+		int         m_nScreenHeight = 0;
+		size_t      m_nScreenPitch = 0;
+		PixelFormat m_screenFormat = PixelFormat::BGRA8888;
+
+		bool        m_bVSync = false;
+
+		// Geometry of the last frame, a change redraws everything
+		int         m_nFrameWidth = -1;
+		int         m_nFrameHeight = -1;
+		PixelFormat m_frameFormat = PixelFormat::RGBA8888;
+
+		std::vector<Rect> m_dirtyRects;
+
+		uint64_t    m_nSequence = 0;
+		int64_t     m_nPresentTime = 0;
+
+
+	private:
+		// Device layouts the pixel formats can express, false for palettes and exotic packings
+		static bool DeviceFormat(const fb_var_screeninfo& var, PixelFormat& format) {
+			if (var.bits_per_pixel == 32 && var.green.offset == 8) {
+				if (var.red.offset == 16 && var.blue.offset == 0) {
+					format = PixelFormat::BGRA8888;
+					return true;
+				}
+				if (var.red.offset == 0 && var.blue.offset == 16) {
+					format = PixelFormat::RGBA8888;
+					return true;
+				}
+			}
+			if (var.bits_per_pixel == 16 && var.red.offset == 11 && var.green.offset == 5 && var.green.length == 6) {
+				format = PixelFormat::RGB565;
+				return true;
+			}
+			return false;
+		}
+
+
+
+		void ConvertRow(const uint8_t* pSrc, uint8_t* pDst, int nCount) const {
+			if (m_frameFormat == m_screenFormat) {
+				memcpy(pDst, pSrc, nCount * TexelSize(m_screenFormat));
+			}
+			else if ((m_frameFormat == PixelFormat::RGBA8888 && m_screenFormat == PixelFormat::BGRA8888)
+				|| (m_frameFormat == PixelFormat::BGRA8888 && m_screenFormat == PixelFormat::RGBA8888)) {
+				for (int i = 0; i < nCount; i++, pSrc += 4, pDst += 4) {
+					pDst[0] = pSrc[2];
+					pDst[1] = pSrc[1];
+					pDst[2] = pSrc[0];
+					pDst[3] = pSrc[3];
+				}
+			}
+			else {
+				size_t nSrcTexel = TexelSize(m_frameFormat);
+				size_t nDstTexel = TexelSize(m_screenFormat);
+				for (int i = 0; i < nCount; i++, pSrc += nSrcTexel, pDst += nDstTexel)
+					EncodeTexel(m_screenFormat, DecodeTexel(m_frameFormat, pSrc), pDst);
+			}
+		}
+
+
+
+	public:
+		~FramebufferDevicePresenter() {
+			Close();
+		}
+
+
+
+		// bVSync waits for the vertical blank before writing, where the driver supports it
+		bool Open(const char* sDevice = "/dev/fb0", bool bVSync = false) {
+			Close();
+
+			int nFile = open(sDevice, O_RDWR | O_CLOEXEC);
+			if (nFile < 0)
+				return false;
+
+			fb_var_screeninfo var;
+			fb_fix_screeninfo fix;
+			PixelFormat format;
+			if (ioctl(nFile, FBIOGET_VSCREENINFO, &var) != 0 || ioctl(nFile, FBIOGET_FSCREENINFO, &fix) != 0
+				|| fix.type != FB_TYPE_PACKED_PIXELS || !DeviceFormat(var, format)) {
+				close(nFile);
+				return false;
+			}
+
+			void* pMemory = mmap(nullptr, fix.smem_len, PROT_READ | PROT_WRITE, MAP_SHARED, nFile, 0);
+			if (pMemory == MAP_FAILED) {
+				close(nFile);
+				return false;
+			}
+
+			m_nFile = nFile;
+			m_pMemory = (uint8_t*)pMemory;
+			m_nMapSize = fix.smem_len;
+			m_screenFormat = format;
+			m_nScreenWidth = (int)var.xres;
+			m_nScreenHeight = (int)var.yres;
+			m_nScreenPitch = fix.line_length;
+
+			// Panned devices show a window of a larger virtual screen
+			m_pScreen = m_pMemory + var.yoffset * m_nScreenPitch + var.xoffset * TexelSize(format);
+
+			m_bVSync = bVSync;
+			m_nFrameWidth = -1;
+			m_nFrameHeight = -1;
+			return true;
+		}
+
+
+
+		void Close() {
+			if (m_pMemory)
+				munmap(m_pMemory, m_nMapSize);
+			if (m_nFile >= 0)
+				close(m_nFile);
+
+			m_pMemory = nullptr;
+			m_pScreen = nullptr;
+			m_nFile = -1;
+		}
+
+
+
+		bool IsOpen() const {
+			return m_pMemory != nullptr;
+		}
+
+
+
+		bool Present(const FramebufferBase& frame) override {
+			if (!m_pScreen)
+				return false;
+
+			int w = std::min(frame.ScreenWidth(), m_nScreenWidth);
+			int h = std::min(frame.ScreenHeight(), m_nScreenHeight);
+
+			if (frame.ScreenWidth() != m_nFrameWidth || frame.ScreenHeight() != m_nFrameHeight || frame.Format() != m_frameFormat) {
+				m_nFrameWidth = frame.ScreenWidth();
+				m_nFrameHeight = frame.ScreenHeight();
+				m_frameFormat = frame.Format();
+				m_dirtyRects.assign(1, Rect(0, 0, w - 1, h - 1));
+			}
+			else {
+				frame.GetDirtyRects(m_dirtyRects);
+			}
+
+			if (m_bVSync) {
+				uint32_t nCrtc = 0;
+				ioctl(m_nFile, FBIO_WAITFORVSYNC, &nCrtc);
+			}
+
+			size_t nSrcTexel = frame.TexelSize();
+			size_t nDstTexel = TexelSize(m_screenFormat);
+
+			for (const Rect& r : m_dirtyRects) {
+				int x1 = std::min(r.x1, w - 1);
+				int y1 = std::min(r.y1, h - 1);
+				if (r.x0 > x1)
+					continue;
+
+				for (int y = r.y0; y <= y1; y++) {
+					ConvertRow(frame.RawData() + y * frame.PitchBytes() + r.x0 * nSrcTexel,
+						m_pScreen + y * m_nScreenPitch + r.x0 * nDstTexel, x1 - r.x0 + 1);
+				}
+			}
+
+			m_nSequence++;
+			m_nPresentTime = SharedRing::Now();
+			return true;
+		}
+
+
+
+		int ScreenWidth() const {
+			return m_nScreenWidth;
+		}
+
+
+
+		int ScreenHeight() const {
+			return m_nScreenHeight;
+		}
+
+
+
+		PixelFormat ScreenFormat() const {
+			return m_screenFormat;
+		}
+
+
+
+		// Frames written so far, and when the last one finished (FramePacer::Now time base)
+		uint64_t Sequence() const {
+			return m_nSequence;
+		}
+
+		int64_t LastPresentTime() const {
+			return m_nPresentTime;
+		}
+	};
+
+}
+
+#endif
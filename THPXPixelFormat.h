@@ -0,0 +1,167 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+
+#include "THPXTypes.h"
+
+
+namespace THPX {
+
+	//===== PIXEL FORMATS =====//
+
+	// Storage layouts a framebuffer can use. Each format struct below converts
+	// between Pixel and its Texel, and framebuffers are templated on it so the
+	// conversion happens once per primitive, never per pixel.
+	enum class PixelFormat : uint8_t {
+		RGBA8888, BGRA8888, RGB565, RGBAF32
+	};
+
+
+
+	// Byte order r, g, b, a
+	struct FormatRGBA8888 {
+		using Texel = Pixel;
+		static constexpr PixelFormat ID = PixelFormat::RGBA8888;
+
+		static Texel Encode(Pixel p) {
+			return p;
+		}
+
+		static Pixel Decode(Texel t) {
+			return t;
+		}
+	};
+
+
+
+	struct PixelBGRA {
+		uint8_t b, g, r, a;
+	};
+
+	// Byte order b, g, r, a, the native layout of most present paths
+	struct FormatBGRA8888 {
+		using Texel = PixelBGRA;
+		static constexpr PixelFormat ID = PixelFormat::BGRA8888;
+
+		static Texel Encode(Pixel p) {
+			return Texel{ p.b, p.g, p.r, p.a };
+		}
+
+		static Pixel Decode(Texel t) {
+			return Pixel(t.r, t.g, t.b, t.a);
+		}
+	};
+
+
+
+	// 5 bits red, 6 bits green, 5 bits blue, no alpha
+	struct FormatRGB565 {
+		using Texel = uint16_t;
+		static constexpr PixelFormat ID = PixelFormat::RGB565;
+
+		static Texel Encode(Pixel p) {
+			return (Texel)(((p.r >> 3) << 11) | ((p.g >> 2) << 5) | (p.b >> 3));
+		}
+
+		static Pixel Decode(Texel t) {
+			uint8_t r = (t >> 11) & 0x1F;
+			uint8_t g = (t >> 5) & 0x3F;
+			uint8_t b = t & 0x1F;
+			return Pixel((uint8_t)((r << 3) | (r >> 2)), (uint8_t)((g << 2) | (g >> 4)), (uint8_t)((b << 3) | (b >> 2)));
+		}
+	};
+
+
+
+	struct PixelF {
+		float r, g, b, a;
+	};
+
+	// One float per channel, 1.0 is full intensity but values may exceed it
+	struct FormatRGBAF32 {
+		using Texel = PixelF;
+		static constexpr PixelFormat ID = PixelFormat::RGBAF32;
+
+		static Texel Encode(Pixel p) {
+			const float s = 1.0f / 255.0f;
+			return Texel{ p.r * s, p.g * s, p.b * s, p.a * s };
+		}
+
+		static uint8_t ToByte(float f) {
+			return f <= 0.0f ? 0 : f >= 1.0f ? 255 : (uint8_t)(f * 255.0f + 0.5f);
+		}
+
+		static Pixel Decode(Texel t) {
+			return Pixel(ToByte(t.r), ToByte(t.g), ToByte(t.b), ToByte(t.a));
+		}
+	};
+
+
+
+	inline size_t TexelSize(PixelFormat format) {
+		switch (format) {
+		case PixelFormat::RGB565:  return sizeof(FormatRGB565::Texel);
+		case PixelFormat::RGBAF32: return sizeof(FormatRGBAF32::Texel);
+		default:                   return 4;
+		}
+	}
+
+
+
+	// Lower case name for logs and result files
+	inline const char* PixelFormatName(PixelFormat format) {
+		switch (format) {
+		case PixelFormat::RGBA8888: return "rgba8888";
+		case PixelFormat::BGRA8888: return "bgra8888";
+		case PixelFormat::RGB565:   return "rgb565";
+		case PixelFormat::RGBAF32:  return "rgbaf32";
+		}
+		return "";
+	}
+
+
+
+	// Runtime dispatched decode, for code that only knows the format at run time
+	inline Pixel DecodeTexel(PixelFormat format, const void* pTexel) {
+		switch (format) {
+		case PixelFormat::RGBA8888:
+			return FormatRGBA8888::Decode(*(const FormatRGBA8888::Texel*)pTexel);
+		case PixelFormat::BGRA8888:
+			return FormatBGRA8888::Decode(*(const FormatBGRA8888::Texel*)pTexel);
+		case PixelFormat::RGB565:
+			return FormatRGB565::Decode(*(const FormatRGB565::Texel*)pTexel);
+		case PixelFormat::RGBAF32:
+			return FormatRGBAF32::Decode(*(const FormatRGBAF32::Texel*)pTexel);
+		}
+		return THPX::BLACK;
+	}
+
+
+
+	// Runtime dispatched encode, writes TexelSize(format) bytes
+	inline void EncodeTexel(PixelFormat format, Pixel p, void* pTexel) {
+		switch (format) {
+		case PixelFormat::RGBA8888:
+			*(FormatRGBA8888::Texel*)pTexel = FormatRGBA8888::Encode(p);
+			break;
+		case PixelFormat::BGRA8888:
+			*(FormatBGRA8888::Texel*)pTexel = FormatBGRA8888::Encode(p);
+			break;
+		case PixelFormat::RGB565:
+			*(FormatRGB565::Texel*)pTexel = FormatRGB565::Encode(p);
+			break;
+		case PixelFormat::RGBAF32:
+			*(FormatRGBAF32::Texel*)pTexel = FormatRGBAF32::Encode(p);
+			break;
+		}
+	}
+
+
+
+	// Pixel format of Framebuffer, Sprite and the renderers, override before including to change it
+#ifndef THPX_PIXEL_FORMAT
+#define THPX_PIXEL_FORMAT THPX::FormatRGBA8888
+#endif
+
+}
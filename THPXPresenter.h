@@ -0,0 +1,128 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include "THPXFramebuffer.h"
+
+
+namespace THPX {
+
+	//===== PRESENTER =====//
+
+	// Backend that takes a finished frame and shows it somewhere.
+	// The whole framebuffer is handed over at once, never pixel by pixel.
+	class Presenter {
+
+	public:
+		virtual ~Presenter() {}
+
+		virtual bool Present(const FramebufferBase& frame) = 0;
+
+		// Present is about to be called from the calling thread from now on
+		virtual void Attach() {}
+
+		// The calling thread stops presenting, release anything bound to it
+		virtual void Detach() {}
+	};
+
+
+
+	// CPU only backend, keeps a tightly packed copy of the last presented frame in memory
+	class MemoryPresenter : public Presenter {
+
+	private:
+		// Last presented frame, Width() * TexelSize() bytes per row
+		std::vector<uint8_t> m_frontBuffer;
+		PixelFormat m_format = PixelFormat::RGBA8888;
+		size_t      m_nTexelSize = 4;
+
+		// Scratch list for the changed regions of a frame
+		std::vector<Rect> m_dirtyRects;
+
+		int         m_nWidth = 0;
+		int         m_nHeight = 0;
+
+		uint64_t    m_nPresentCount = 0;
+
+
+	public:
+		// Copies only the tiles that changed since the previous frame
+		bool Present(const FramebufferBase& frame) override {
+			int w = frame.ScreenWidth();
+			int h = frame.ScreenHeight();
+			size_t nSrcPitch = frame.PitchBytes();
+
+			if (w != m_nWidth || h != m_nHeight || frame.Format() != m_format) {
+				m_format = frame.Format();
+				m_nTexelSize = frame.TexelSize();
+				m_nWidth = w;
+				m_nHeight = h;
+
+				m_frontBuffer.resize((size_t)w * h * m_nTexelSize);
+				m_dirtyRects.assign(1, frame.Bounds());
+				if (w <= 0 || h <= 0)
+					m_dirtyRects.clear();
+			}
+			else {
+				frame.GetDirtyRects(m_dirtyRects);
+			}
+
+			size_t nDstPitch = (size_t)w * m_nTexelSize;
+
+			for (const Rect& r : m_dirtyRects) {
+				for (int y = r.y0; y <= r.y1; y++) {
+					memcpy(&m_frontBuffer[y * nDstPitch + r.x0 * m_nTexelSize],
+						frame.RawData() + y * nSrcPitch + r.x0 * m_nTexelSize,
+						(r.x1 - r.x0 + 1) * m_nTexelSize);
+				}
+			}
+
+			m_nPresentCount++;
+
+			return true;
+		}
+
+
+
+		// Texels in Format(), rows are tightly packed
+		const uint8_t* Data() const {
+			return m_frontBuffer.data();
+		}
+
+
+
+		PixelFormat Format() const {
+			return m_format;
+		}
+
+
+
+		Pixel GetPixel(int x, int y) const {
+			if (x >= 0 && x < m_nWidth && y >= 0 && y < m_nHeight) {
+				return DecodeTexel(m_format, &m_frontBuffer[((size_t)y * m_nWidth + x) * m_nTexelSize]);
+			}
+			return THPX::BLACK;
+		}
+
+
+
+		int Width() const {
+			return m_nWidth;
+		}
+
+
+
+		int Height() const {
+			return m_nHeight;
+		}
+
+
+
+		uint64_t PresentCount() const {
+			return m_nPresentCount;
+		}
+	};
+
+}
@@ -0,0 +1,406 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+#include <type_traits>
+#include <atomic>
+#include <chrono>
+#include <algorithm>
+
+#include "THPXTypes.h"
+#include "THPXFramebuffer.h"
+
+
+namespace THPX {
+
+	//===== PROFILER =====//
+
+	// Parts of a frame the renderers time
+	enum class FramePhase : uint8_t {
+		INPUT,      // input scan
+		UPDATE,     // onUpdate
+		RASTER,     // deferred commands and overlays
+		PRESENT,    // hand off to the presenter or the present thread
+		COUNT
+	};
+
+	inline const char* FramePhaseName(FramePhase phase) {
+		static const char* NAMES[] = { "Input", "onUpdate", "Rasterize", "Present" };
+		return phase < FramePhase::COUNT ? NAMES[(size_t)phase] : "";
+	}
+
+
+
+	// Per frame counters, the renderers fill the first two from the framebuffer's
+	// draw stats and the third with the nanoseconds from the oldest input event
+	// of the frame to the end of its present. The rest are free for the application.
+	enum ProfileCounter : uint8_t {
+		COUNTER_PRIMITIVES,
+		COUNTER_PIXELS,
+		COUNTER_INPUT_LATENCY,
+		COUNTER_USER,
+		COUNTER_MAX = 8
+	};
+
+
+
+	// One finished frame, times in nanoseconds since the profiler was created
+	struct FrameRecord {
+		uint64_t    nFrame;
+		int64_t     nStart;
+
+		// Since the previous frame started, what the frame rate is made of
+		int64_t     nInterval;
+
+		// BeginFrame to EndFrame
+		int64_t     nDuration;
+
+		// Time spent in each phase and when it was first entered, -1 if it never was
+		int64_t     phases[(size_t)FramePhase::COUNT];
+		int64_t     phaseStarts[(size_t)FramePhase::COUNT];
+
+		uint64_t    counters[COUNTER_MAX];
+	};
+
+	static_assert(sizeof(FrameRecord) % sizeof(uint64_t) == 0 && std::is_trivially_copyable<FrameRecord>::value,
+		"frame records are copied through the ring as 64 bit words");
+
+
+
+	// Summary over recent frames, times in milliseconds
+	struct FrameStats {
+		size_t      nFrames = 0;
+		double      fMean = 0.0;
+		double      fP50 = 0.0;
+		double      fP95 = 0.0;
+		double      fP99 = 0.0;
+		double      fMax = 0.0;
+		double      phases[(size_t)FramePhase::COUNT] = {};
+	};
+
+
+
+	// Frame timing on steady_clock. The recording thread writes finished frames
+	// into a ring of the last CAPACITY frames, each slot guarded by a sequence
+	// number (a seqlock), so it never waits on readers; readers copy a slot and
+	// drop it if the writer started overwriting it meanwhile.
+	// Recording and Summarize belong to one thread, Snapshot and
+	// ExportChromeTrace are safe from any.
+	class Profiler {
+
+	public:
+		static constexpr size_t CAPACITY = 1024;
+
+		using Clock = std::chrono::steady_clock;
+
+
+	private:
+		Clock::time_point m_epoch;
+
+		// Frame n lives in slot n % CAPACITY. Its sequence is 2n + 1 while the frame
+		// is written and 2n + 2 once it is complete; the words are atomic so a
+		// reader racing the writer copies stale words, never undefined ones.
+		static constexpr size_t RECORD_WORDS = sizeof(FrameRecord) / sizeof(uint64_t);
+
+		struct Slot {
+			std::atomic<uint64_t> nSequence{ 0 };
+			std::atomic<uint64_t> words[RECORD_WORDS];
+		};
+
+		std::vector<Slot> m_ring;
+
+		// Frames published so far
+		std::atomic<uint64_t> m_nWritten;
+
+		// Frame being recorded
+		FrameRecord m_current;
+		bool        m_bInFrame = false;
+		int         m_nPhase = -1;
+		int64_t     m_nPhaseStart = 0;
+		int64_t     m_nLastStart = -1;
+
+		// Scratch for Summarize and the overlay, reserved up front
+		std::vector<FrameRecord> m_snapshot;
+		std::vector<int64_t> m_times;
+
+
+	private:
+		void ClosePhase(int64_t nNow) {
+			if (m_nPhase >= 0) {
+				m_current.phases[m_nPhase] += nNow - m_nPhaseStart;
+				m_nPhase = -1;
+			}
+		}
+
+
+
+		static double Milliseconds(int64_t nNanoseconds) {
+			return (double)nNanoseconds * 1e-6;
+		}
+
+
+
+	public:
+		Profiler() : m_ring(CAPACITY), m_nWritten(0) {
+			m_epoch = Clock::now();
+			m_snapshot.reserve(CAPACITY);
+			m_times.reserve(CAPACITY);
+		}
+
+
+
+		// Nanoseconds since the profiler was created
+		int64_t Now() const {
+			return (int64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - m_epoch).count();
+		}
+
+
+
+		void BeginFrame() {
+			int64_t nNow = Now();
+
+			m_current.nFrame = m_nWritten.load(std::memory_order_relaxed);
+			m_current.nStart = nNow;
+			m_current.nInterval = m_nLastStart >= 0 ? nNow - m_nLastStart : 0;
+			m_current.nDuration = 0;
+			for (size_t i = 0; i < (size_t)FramePhase::COUNT; i++) {
+				m_current.phases[i] = 0;
+				m_current.phaseStarts[i] = -1;
+			}
+			std::fill(std::begin(m_current.counters), std::end(m_current.counters), 0);
+
+			m_nLastStart = nNow;
+			m_nPhase = -1;
+			m_bInFrame = true;
+		}
+
+
+
+		// Ends the running phase, if any, and starts timing this one
+		void BeginPhase(FramePhase phase) {
+			if (!m_bInFrame || phase >= FramePhase::COUNT)
+				return;
+
+			int64_t nNow = Now();
+			ClosePhase(nNow);
+
+			m_nPhase = (int)phase;
+			m_nPhaseStart = nNow;
+			if (m_current.phaseStarts[m_nPhase] < 0)
+				m_current.phaseStarts[m_nPhase] = nNow;
+		}
+
+
+
+		void EndPhase() {
+			if (m_bInFrame)
+				ClosePhase(Now());
+		}
+
+
+
+		// Adds n to a counter of the frame being recorded
+		void Count(size_t nCounter, uint64_t n) {
+			if (m_bInFrame && nCounter < COUNTER_MAX)
+				m_current.counters[nCounter] += n;
+		}
+
+
+
+		// Publishes the frame
+		void EndFrame() {
+			if (!m_bInFrame)
+				return;
+
+			int64_t nNow = Now();
+			ClosePhase(nNow);
+
+			m_current.nDuration = nNow - m_current.nStart;
+			if (m_current.nInterval == 0)
+				m_current.nInterval = m_current.nDuration;
+
+			uint64_t words[RECORD_WORDS];
+			std::memcpy(words, &m_current, sizeof(words));
+
+			// Odd first, so no reader takes the slot for complete while the words change
+			uint64_t n = m_nWritten.load(std::memory_order_relaxed);
+			Slot& slot = m_ring[n % CAPACITY];
+			slot.nSequence.store(2 * n + 1, std::memory_order_relaxed);
+			std::atomic_thread_fence(std::memory_order_release);
+			for (size_t i = 0; i < RECORD_WORDS; i++)
+				slot.words[i].store(words[i], std::memory_order_relaxed);
+			slot.nSequence.store(2 * n + 2, std::memory_order_release);
+
+			m_nWritten.store(n + 1, std::memory_order_release);
+
+			m_bInFrame = false;
+		}
+
+
+
+		uint64_t FrameCount() const {
+			return m_nWritten.load(std::memory_order_acquire);
+		}
+
+
+
+		// Copies up to the last nMax frames, oldest first
+		size_t Snapshot(std::vector<FrameRecord>& frames, size_t nMax = CAPACITY) const {
+			frames.clear();
+
+			uint64_t nEnd = m_nWritten.load(std::memory_order_acquire);
+			uint64_t nCount = std::min<uint64_t>(std::min(nMax, CAPACITY), nEnd);
+			for (uint64_t n = nEnd - nCount; n < nEnd; n++) {
+				const Slot& slot = m_ring[n % CAPACITY];
+				uint64_t nSequence = slot.nSequence.load(std::memory_order_acquire);
+				if (nSequence != 2 * n + 2)
+					continue;
+
+				uint64_t words[RECORD_WORDS];
+				for (size_t i = 0; i < RECORD_WORDS; i++)
+					words[i] = slot.words[i].load(std::memory_order_relaxed);
+
+				// Frames the writer has started to overwrite meanwhile are dropped
+				std::atomic_thread_fence(std::memory_order_acquire);
+				if (slot.nSequence.load(std::memory_order_relaxed) != nSequence)
+					continue;
+
+				frames.emplace_back();
+				std::memcpy(&frames.back(), words, sizeof(words));
+			}
+
+			return frames.size();
+		}
+
+
+
+		// Percentiles of the frame time over the last nFrames frames
+		FrameStats Summarize(size_t nFrames = CAPACITY) {
+			FrameStats stats;
+			Snapshot(m_snapshot, nFrames);
+			if (m_snapshot.empty())
+				return stats;
+
+			m_times.clear();
+			int64_t nTotal = 0;
+			int64_t phases[(size_t)FramePhase::COUNT] = {};
+			for (const FrameRecord& frame : m_snapshot) {
+				m_times.push_back(frame.nInterval);
+				nTotal += frame.nInterval;
+				for (size_t i = 0; i < (size_t)FramePhase::COUNT; i++)
+					phases[i] += frame.phases[i];
+			}
+
+			auto percentile = [&](double f) {
+				size_t k = std::min(m_times.size() - 1, (size_t)(f * (double)m_times.size()));
+				std::nth_element(m_times.begin(), m_times.begin() + k, m_times.end());
+				return Milliseconds(m_times[k]);
+			};
+
+			stats.nFrames = m_snapshot.size();
+			stats.fMean = Milliseconds(nTotal) / (double)stats.nFrames;
+			stats.fP50 = percentile(0.50);
+			stats.fP95 = percentile(0.95);
+			stats.fP99 = percentile(0.99);
+			stats.fMax = Milliseconds(*std::max_element(m_times.begin(), m_times.end()));
+			for (size_t i = 0; i < (size_t)FramePhase::COUNT; i++)
+				stats.phases[i] = Milliseconds(phases[i]) / (double)stats.nFrames;
+
+			return stats;
+		}
+
+
+
+		// Writes the recorded frames as Chrome trace events (chrome://tracing,
+		// Perfetto): one slice per frame with its phases nested inside, and the
+		// primitive and pixel counters as counter tracks
+		bool ExportChromeTrace(const char* sPath) const {
+			std::vector<FrameRecord> frames;
+			frames.reserve(CAPACITY);
+			Snapshot(frames);
+
+			FILE* pFile = std::fopen(sPath, "wb");
+			if (!pFile)
+				return false;
+
+			std::fprintf(pFile, "{\"traceEvents\":[\n");
+			bool bFirst = true;
+			auto separator = [&]() {
+				const char* s = bFirst ? "" : ",\n";
+				bFirst = false;
+				return s;
+			};
+
+			for (const FrameRecord& frame : frames) {
+				std::fprintf(pFile, "%s{\"name\":\"Frame %llu\",\"cat\":\"frame\",\"ph\":\"X\",\"pid\":1,\"tid\":1,\"ts\":%.3f,\"dur\":%.3f}",
+					separator(), (unsigned long long)frame.nFrame, frame.nStart * 1e-3, frame.nDuration * 1e-3);
+
+				for (size_t i = 0; i < (size_t)FramePhase::COUNT; i++) {
+					if (frame.phaseStarts[i] < 0)
+						continue;
+					std::fprintf(pFile, "%s{\"name\":\"%s\",\"cat\":\"phase\",\"ph\":\"X\",\"pid\":1,\"tid\":1,\"ts\":%.3f,\"dur\":%.3f}",
+						separator(), FramePhaseName((FramePhase)i), frame.phaseStarts[i] * 1e-3, frame.phases[i] * 1e-3);
+				}
+
+				std::fprintf(pFile, "%s{\"name\":\"Draw\",\"ph\":\"C\",\"pid\":1,\"ts\":%.3f,\"args\":{\"primitives\":%llu,\"pixels\":%llu}}",
+					separator(), frame.nStart * 1e-3, (unsigned long long)frame.counters[COUNTER_PRIMITIVES], (unsigned long long)frame.counters[COUNTER_PIXELS]);
+			}
+
+			std::fprintf(pFile, "\n],\"displayTimeUnit\":\"ms\"}\n");
+			return std::fclose(pFile) == 0;
+		}
+
+
+
+		// Graph of the last frames at (x, y): one column per frame, stacked by
+		// phase, the remainder of the frame time in gray and a line at 60 Hz.
+		// The full height is 2 / 60 s. Percentiles are printed above it.
+		template<typename FORMAT>
+		void DrawOverlay(BasicFramebuffer<FORMAT>& fb, int x, int y, int nWidth = 240, int nHeight = 60) {
+			static const Pixel PHASE_COLORS[] = {
+				Pixel(255, 200, 0), Pixel(0, 200, 80), Pixel(60, 140, 255), Pixel(255, 70, 70)
+			};
+			const int64_t RANGE = 2 * 1000000000ll / 60;
+
+			FrameStats stats = Summarize();
+
+			BlendMode blend = fb.GetBlendMode();
+			fb.SetBlendMode(BlendMode::ALPHA);
+			fb.FillRectangle(x, y, nWidth - 1, nHeight + 9, Pixel(0, 0, 0, 160));
+			fb.SetBlendMode(BlendMode::NONE);
+
+			char sText[96];
+			std::snprintf(sText, sizeof(sText), "p50 %.1f p95 %.1f p99 %.1f ms", stats.fP50, stats.fP95, stats.fP99);
+			fb.DrawString(x + 2, y + 1, sText, THPX::WHITE);
+
+			// Newest frame on the right
+			int nBottom = y + 10 + nHeight;
+			size_t nColumns = std::min(m_snapshot.size(), (size_t)std::max(nWidth, 0));
+			for (size_t i = 0; i < nColumns; i++) {
+				const FrameRecord& frame = m_snapshot[m_snapshot.size() - nColumns + i];
+				int nx = x + nWidth - (int)nColumns + (int)i;
+
+				int64_t nTotal = 0;
+				int nTop = nBottom;
+				for (size_t p = 0; p < (size_t)FramePhase::COUNT; p++) {
+					nTotal += frame.phases[p];
+					int nNext = nBottom - (int)(std::min(nTotal, RANGE) * nHeight / RANGE);
+					if (nNext < nTop)
+						fb.DrawLine(nx, nTop - 1, nx, nNext, PHASE_COLORS[p]);
+					nTop = nNext;
+				}
+
+				int nEnd = nBottom - (int)(std::min(frame.nInterval, RANGE) * nHeight / RANGE);
+				if (nEnd < nTop)
+					fb.DrawLine(nx, nTop - 1, nx, nEnd, Pixel(128, 128, 128));
+			}
+
+			fb.DrawLine(x, nBottom - nHeight / 2, x + nWidth - 1, nBottom - nHeight / 2, Pixel(255, 255, 255));
+			fb.SetBlendMode(blend);
+		}
+	};
+
+}
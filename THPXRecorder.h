@@ -0,0 +1,493 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#include "THPXTypes.h"
+#include "THPXPixelFormat.h"
+#include "THPXCommandList.h"
+#include "THPXImageFile.h"
+
+
+namespace THPX {
+
+	//===== FRAME LOG FORMAT =====//
+
+	// A recorded session: this header, then one record per frame.
+	//
+	//   uint8  flags       FRAME_INPUT, FRAME_COMMANDS
+	//   int64  delta       frame delta time in nanoseconds
+	//   [FRAME_INPUT]      32 bytes of key bits, 1 byte of mouse button bits, int32
+	//                      mouse x, y and wheel, only written when the input changed
+	//                      since the last record
+	//   [FRAME_COMMANDS]   uint32 command count, uint32 vertex count, padding to
+	//                      8 bytes, Command[], Vec2D[]
+	//
+	// Records hold the raw key and button states ScanHardware is fed with, so
+	// replaying them yields the same pressed / released / held snapshots.
+	// Integers and commands are stored in native byte order.
+	struct FrameLogHeader {
+		char        sMagic[4];      // "TPXR"
+		uint16_t    nVersion;
+		uint8_t     nFormat;        // PixelFormat of the recorded renderer
+		uint8_t     nFlags;         // FRAME_COMMANDS if command streams were recorded
+		uint32_t    nWidth;
+		uint32_t    nHeight;
+	};
+
+	static_assert(sizeof(FrameLogHeader) == 16, "frame log header is written as is");
+
+	enum FrameLogFlags : uint8_t {
+		FRAME_INPUT     = 1 << 0,
+		FRAME_COMMANDS  = 1 << 1
+	};
+
+	constexpr uint16_t FRAME_LOG_VERSION = 2;
+	constexpr size_t FRAME_LOG_KEYS = 256;
+	constexpr size_t FRAME_LOG_BUTTONS = 3;
+	constexpr size_t FRAME_LOG_INPUT_SIZE = FRAME_LOG_KEYS / 8 + 1 + 3 * sizeof(int32_t);
+
+	// Largest width or height a log may claim, a replay resizes the renderer to it
+	constexpr uint32_t FRAME_LOG_MAX_SIZE = 16384;
+
+
+
+	// What replaying a log drives
+	enum class ReplayMode : uint8_t {
+		INPUT,      // onUpdate runs on the recorded input and delta times
+		COMMANDS    // onUpdate is skipped, the recorded command streams are rasterized
+	};
+
+
+
+	//===== FRAME RECORDER =====//
+
+	// Appends frame records to a buffer on the render thread and hands full
+	// chunks to a writer thread, so the frame never waits on the disk.
+	// Chunks are recycled, recording allocates nothing once the pool is warm.
+	class FrameRecorder {
+
+	public:
+		static constexpr size_t CHUNK_SIZE = 64 * 1024;
+
+
+	private:
+		FILE*       m_pFile = nullptr;
+		bool        m_bCommands = false;
+
+		// Chunk being filled by the render thread
+		std::vector<uint8_t> m_chunk;
+
+		// Offset of the next byte in the log, for aligning the command arrays
+		uint64_t    m_nOffset = 0;
+
+		// Last input written, records after the first only repeat it on change
+		uint8_t     m_input[FRAME_LOG_INPUT_SIZE] = {};
+		bool        m_bHaveInput = false;
+
+		// Frame started by Input and waiting for EndFrame
+		uint8_t     m_pending[FRAME_LOG_INPUT_SIZE] = {};
+		int64_t     m_nPendingDelta = 0;
+		bool        m_bPending = false;
+
+		uint64_t    m_nFrames = 0;
+
+		std::thread m_writer;
+		std::mutex  m_mutex;
+		std::condition_variable m_cvFull;
+		std::deque<std::vector<uint8_t>> m_fullChunks;
+		std::vector<std::vector<uint8_t>> m_freeChunks;
+		bool        m_bQuit = false;
+		bool        m_bFailed = false;
+
+
+	private:
+		void WriterMain() {
+			for (;;) {
+				std::vector<uint8_t> chunk;
+				{
+					std::unique_lock<std::mutex> lock(m_mutex);
+					m_cvFull.wait(lock, [&] { return m_bQuit || !m_fullChunks.empty(); });
+					if (m_fullChunks.empty())
+						break;
+					chunk.swap(m_fullChunks.front());
+					m_fullChunks.pop_front();
+				}
+
+				bool bWritten = std::fwrite(chunk.data(), 1, chunk.size(), m_pFile) == chunk.size();
+				chunk.clear();
+
+				std::lock_guard<std::mutex> lock(m_mutex);
+				m_bFailed |= !bWritten;
+				m_freeChunks.push_back(std::move(chunk));
+			}
+		}
+
+
+
+		void Append(const void* pData, size_t nSize) {
+			const uint8_t* p = (const uint8_t*)pData;
+			m_chunk.insert(m_chunk.end(), p, p + nSize);
+			m_nOffset += nSize;
+		}
+
+
+
+		void Pad(size_t nAlign) {
+			static const uint8_t ZEROS[8] = {};
+			size_t nPad = (size_t)((nAlign - m_nOffset % nAlign) % nAlign);
+			Append(ZEROS, nPad);
+		}
+
+
+
+		// Queues the current chunk for the writer and takes a recycled one
+		void Submit() {
+			if (m_chunk.empty())
+				return;
+
+			{
+				std::lock_guard<std::mutex> lock(m_mutex);
+				m_fullChunks.push_back(std::move(m_chunk));
+				if (!m_freeChunks.empty()) {
+					m_chunk = std::move(m_freeChunks.back());
+					m_freeChunks.pop_back();
+				}
+				else {
+					m_chunk = std::vector<uint8_t>();
+				}
+			}
+			m_cvFull.notify_one();
+
+			m_chunk.clear();
+			m_chunk.reserve(CHUNK_SIZE);
+		}
+
+
+
+		static void PackInput(uint8_t* pBits, const bool* pKeys, const bool* pButtons, int32_t nMouseX, int32_t nMouseY, int32_t nWheel) {
+			std::memset(pBits, 0, FRAME_LOG_INPUT_SIZE);
+			for (size_t i = 0; i < FRAME_LOG_KEYS; i++)
+				pBits[i >> 3] |= (uint8_t)(pKeys[i] ? 1 << (i & 7) : 0);
+			for (size_t i = 0; i < FRAME_LOG_BUTTONS; i++)
+				pBits[FRAME_LOG_KEYS / 8] |= (uint8_t)(pButtons[i] ? 1 << i : 0);
+
+			uint8_t* pMouse = pBits + FRAME_LOG_KEYS / 8 + 1;
+			std::memcpy(pMouse, &nMouseX, 4);
+			std::memcpy(pMouse + 4, &nMouseY, 4);
+			std::memcpy(pMouse + 8, &nWheel, 4);
+		}
+
+
+
+	public:
+		FrameRecorder() {}
+
+		~FrameRecorder() {
+			Close();
+		}
+
+		FrameRecorder(const FrameRecorder&) = delete;
+		FrameRecorder& operator=(const FrameRecorder&) = delete;
+
+
+
+		// Starts a log for a renderer of the given size and format. With bCommands
+		// every frame also stores the command list passed to EndFrame.
+		bool Open(const char* sPath, int nWidth, int nHeight, PixelFormat format, bool bCommands = false) {
+			Close();
+
+			// A log FrameLog would refuse to replay
+			if (nWidth <= 0 || nHeight <= 0 || (uint32_t)nWidth > FRAME_LOG_MAX_SIZE || (uint32_t)nHeight > FRAME_LOG_MAX_SIZE)
+				return false;
+
+			m_pFile = std::fopen(sPath, "wb");
+			if (!m_pFile)
+				return false;
+
+			m_bCommands = bCommands;
+			m_bHaveInput = false;
+			m_bPending = false;
+			m_bQuit = false;
+			m_bFailed = false;
+			m_nFrames = 0;
+			m_nOffset = 0;
+
+			m_chunk.clear();
+			m_chunk.reserve(CHUNK_SIZE);
+
+			FrameLogHeader header = {};
+			std::memcpy(header.sMagic, "TPXR", 4);
+			header.nVersion = FRAME_LOG_VERSION;
+			header.nFormat = (uint8_t)format;
+			header.nFlags = bCommands ? FRAME_COMMANDS : 0;
+			header.nWidth = (uint32_t)nWidth;
+			header.nHeight = (uint32_t)nHeight;
+			Append(&header, sizeof(header));
+
+			m_writer = std::thread(&FrameRecorder::WriterMain, this);
+			return true;
+		}
+
+
+
+		// Writes everything still queued and closes the file. Returns false if any write failed.
+		bool Close() {
+			if (!m_pFile)
+				return true;
+
+			if (m_bPending)
+				EndFrame(nullptr);
+			Submit();
+
+			{
+				std::lock_guard<std::mutex> lock(m_mutex);
+				m_bQuit = true;
+			}
+			m_cvFull.notify_one();
+			m_writer.join();
+
+			bool bOk = !m_bFailed && std::fclose(m_pFile) == 0;
+			m_pFile = nullptr;
+			return bOk;
+		}
+
+
+
+		bool IsOpen() const {
+			return m_pFile != nullptr;
+		}
+
+
+
+		// Starts a frame with the states ScanHardware is about to read, the mouse and the frame's delta time
+		void Input(const bool* pKeys, const bool* pButtons, int32_t nMouseX, int32_t nMouseY, int32_t nWheel, int64_t nDelta) {
+			if (!m_pFile)
+				return;
+			if (m_bPending)
+				EndFrame(nullptr);
+
+			PackInput(m_pending, pKeys, pButtons, nMouseX, nMouseY, nWheel);
+			m_nPendingDelta = nDelta;
+			m_bPending = true;
+		}
+
+
+
+		// Finishes the frame started by Input, with the commands recorded during the update
+		void EndFrame(const CommandList* pCommands) {
+			if (!m_pFile || !m_bPending)
+				return;
+
+			bool bInput = !m_bHaveInput || std::memcmp(m_pending, m_input, sizeof(m_input)) != 0;
+
+			uint8_t nFlags = (uint8_t)((bInput ? FRAME_INPUT : 0) | (m_bCommands ? FRAME_COMMANDS : 0));
+			Append(&nFlags, 1);
+			Append(&m_nPendingDelta, sizeof(m_nPendingDelta));
+
+			if (bInput) {
+				Append(m_pending, sizeof(m_pending));
+				std::memcpy(m_input, m_pending, sizeof(m_input));
+				m_bHaveInput = true;
+			}
+
+			if (m_bCommands) {
+				uint32_t nCommands = pCommands ? (uint32_t)pCommands->Size() : 0;
+				uint32_t nVertices = pCommands ? (uint32_t)pCommands->VertexCount() : 0;
+				Append(&nCommands, sizeof(nCommands));
+				Append(&nVertices, sizeof(nVertices));
+				Pad(8);
+				if (nCommands)
+					Append(pCommands->Commands(), nCommands * sizeof(Command));
+				if (nVertices)
+					Append(pCommands->Vertices(), nVertices * sizeof(Vec2D));
+			}
+
+			m_bPending = false;
+			m_nFrames++;
+
+			if (m_chunk.size() >= CHUNK_SIZE)
+				Submit();
+		}
+
+
+
+		uint64_t Frames() const {
+			return m_nFrames;
+		}
+	};
+
+
+
+	//===== FRAME LOG =====//
+
+	// Reads a log written by FrameRecorder from a mapped file, one frame at a time.
+	// Command arrays point straight into the mapping.
+	class FrameLog {
+
+	public:
+		struct Frame {
+			int64_t         nDelta = 0;
+			bool            keys[FRAME_LOG_KEYS] = {};
+			bool            buttons[FRAME_LOG_BUTTONS] = {};
+			int32_t         nMouseX = 0;
+			int32_t         nMouseY = 0;
+			int32_t         nMouseWheel = 0;
+
+			// Only set when the log has command streams
+			const Command*  pCommands = nullptr;
+			uint32_t        nCommands = 0;
+			const Vec2D*    pVertices = nullptr;
+			uint32_t        nVertices = 0;
+		};
+
+
+	private:
+		MappedFile  m_file;
+		FrameLogHeader m_header = {};
+
+		size_t      m_nCursor = 0;
+		uint64_t    m_nFrame = 0;
+
+		// Input carried over from the last record that had some
+		bool        m_keys[FRAME_LOG_KEYS] = {};
+		bool        m_buttons[FRAME_LOG_BUTTONS] = {};
+		int32_t     m_mouse[3] = {};
+
+
+	public:
+		FrameLog() {}
+
+		FrameLog(const FrameLog&) = delete;
+		FrameLog& operator=(const FrameLog&) = delete;
+
+
+
+		bool Open(const char* sPath) {
+			if (!m_file.Open(sPath) || m_file.Size() < sizeof(FrameLogHeader))
+				return false;
+
+			std::memcpy(&m_header, m_file.Data(), sizeof(m_header));
+			if (std::memcmp(m_header.sMagic, "TPXR", 4) != 0 || m_header.nVersion != FRAME_LOG_VERSION
+				|| m_header.nFormat > (uint8_t)PixelFormat::RGBAF32
+				|| m_header.nWidth == 0 || m_header.nHeight == 0
+				|| m_header.nWidth > FRAME_LOG_MAX_SIZE || m_header.nHeight > FRAME_LOG_MAX_SIZE) {
+				m_file.Close();
+				return false;
+			}
+
+			Rewind();
+			return true;
+		}
+
+
+
+		void Rewind() {
+			m_nCursor = sizeof(FrameLogHeader);
+			m_nFrame = 0;
+			std::memset(m_keys, 0, sizeof(m_keys));
+			std::memset(m_buttons, 0, sizeof(m_buttons));
+			std::memset(m_mouse, 0, sizeof(m_mouse));
+		}
+
+
+
+		// Reads the next frame, false at the end of the log, on a truncated record
+		// or on commands that cannot be run
+		bool Next(Frame& frame) {
+			const uint8_t* pData = m_file.Data();
+			size_t nSize = m_file.Size();
+			size_t n = m_nCursor;
+
+			if (!pData || n + 1 + sizeof(int64_t) > nSize)
+				return false;
+
+			uint8_t nFlags = pData[n];
+			std::memcpy(&frame.nDelta, pData + n + 1, sizeof(int64_t));
+			n += 1 + sizeof(int64_t);
+
+			if (nFlags & FRAME_INPUT) {
+				if (n + FRAME_LOG_INPUT_SIZE > nSize)
+					return false;
+				for (size_t i = 0; i < FRAME_LOG_KEYS; i++)
+					m_keys[i] = (pData[n + (i >> 3)] >> (i & 7)) & 1;
+				for (size_t i = 0; i < FRAME_LOG_BUTTONS; i++)
+					m_buttons[i] = (pData[n + FRAME_LOG_KEYS / 8] >> i) & 1;
+				std::memcpy(m_mouse, pData + n + FRAME_LOG_KEYS / 8 + 1, sizeof(m_mouse));
+				n += FRAME_LOG_INPUT_SIZE;
+			}
+			std::memcpy(frame.keys, m_keys, sizeof(m_keys));
+			std::memcpy(frame.buttons, m_buttons, sizeof(m_buttons));
+			frame.nMouseX = m_mouse[0];
+			frame.nMouseY = m_mouse[1];
+			frame.nMouseWheel = m_mouse[2];
+
+			frame.pCommands = nullptr;
+			frame.nCommands = 0;
+			frame.pVertices = nullptr;
+			frame.nVertices = 0;
+
+			if (nFlags & FRAME_COMMANDS) {
+				if (n + 2 * sizeof(uint32_t) > nSize)
+					return false;
+				std::memcpy(&frame.nCommands, pData + n, sizeof(uint32_t));
+				std::memcpy(&frame.nVertices, pData + n + 4, sizeof(uint32_t));
+				n += 2 * sizeof(uint32_t);
+				n = (n + 7) & ~(size_t)7;
+
+				size_t nBytes = (size_t)frame.nCommands * sizeof(Command) + (size_t)frame.nVertices * sizeof(Vec2D);
+				if (n > nSize || nBytes > nSize - n)
+					return false;
+				frame.pCommands = (const Command*)(pData + n);
+				frame.pVertices = (const Vec2D*)(pData + n + (size_t)frame.nCommands * sizeof(Command));
+				if (!CommandList::Validate(frame.pCommands, frame.nCommands, frame.nVertices))
+					return false;
+				n += nBytes;
+			}
+
+			m_nCursor = n;
+			m_nFrame++;
+			return true;
+		}
+
+
+
+		// Recorded size, 1 to FRAME_LOG_MAX_SIZE in a log that opened
+		int Width() const {
+			return (int)m_header.nWidth;
+		}
+
+
+
+		int Height() const {
+			return (int)m_header.nHeight;
+		}
+
+
+
+		PixelFormat Format() const {
+			return (PixelFormat)m_header.nFormat;
+		}
+
+
+
+		bool HasCommands() const {
+			return (m_header.nFlags & FRAME_COMMANDS) != 0;
+		}
+
+
+
+		// Frames read since Open or Rewind
+		uint64_t Position() const {
+			return m_nFrame;
+		}
+	};
+
+}
@@ -0,0 +1,712 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <cstring>
+#include <memory>
+#include <atomic>
+#include <algorithm>
+
+#include "THPXFramebuffer.h"
+#include "THPXPresenter.h"
+#include "THPXCommandList.h"
+#include "THPXTiledRasterizer.h"
+#include "THPXSwapChain.h"
+#include "THPXProfiler.h"
+#include "THPXInput.h"
+#include "THPXRecorder.h"
+#include "THPXCapture.h"
+#include "THPXScheduler.h"
+#include "THPXLayers.h"
+
+
+namespace THPX {
+
+	//===== RENDERER BASE =====//
+
+	// Everything a renderer needs apart from the platform: the framebuffer,
+	// input state and the user callbacks. Window and headless renderers derive from it.
+	class RendererBase : public Framebuffer {
+
+	protected:
+		// State of keyboard
+		bool		m_KeyNewState[256] = { 0 };
+		bool		m_KeyOldState[256] = { 0 };
+		HWButton	m_KeyboardState[256] = {};
+
+		// State of mouse
+		bool		m_MouseNewState[3] = { 0 };
+		bool		m_MouseOldState[3] = { 0 };
+		HWButton	m_MouseState[3] = {};
+
+		// Mouse position in framebuffer pixels, wheel notches (1/120) moved this frame
+		int32_t     m_nMouseX = 0;
+		int32_t     m_nMouseY = 0;
+		int32_t     m_nMouseWheel = 0;
+
+		// Events from the platform layer or synthetic input, drained by ScanInput
+		InputQueue  m_inputQueue;
+		std::vector<InputEvent> m_inputEvents;
+		std::vector<uint32_t> m_textInput;
+
+		// Timestamp of the oldest event of this frame, -1 if there was none
+		int64_t     m_nOldestInput = -1;
+
+		// Releases of keys (0-255) and buttons (256 + button) pressed in the same
+		// frame, applied a frame later so taps shorter than a frame still register
+		std::vector<uint16_t> m_deferredReleases;
+
+		// User app name
+		std::wstring m_sAppName;
+
+		// Where finished frames go, not owned
+		Presenter*  m_pPresenter = nullptr;
+
+		// Export stage every finished frame is copied to, not owned
+		FrameCapture* m_pCapture = nullptr;
+
+		// Present thread, created on the first frame when m_nSwapBuffers >= 2
+		std::unique_ptr<SwapChain> m_pSwapChain;
+		unsigned    m_nSwapBuffers = 0;
+
+		// Deferred draw calls, rasterized in parallel by FlushDeferred
+		CommandList m_commandList;
+		TiledRasterizer m_tiledRasterizer;
+
+		// Layers composited into the framebuffer every frame, once there is one
+		LayerStack  m_layers;
+
+		// Software depth buffer for the depth tested triangles, once enabled,
+		// cleared before every frame's update unless the app clears it itself
+		std::unique_ptr<DepthBuffer> m_pDepthBuffer;
+		bool        m_bClearDepth = true;
+
+		// Phase timings and draw counters of every frame
+		Profiler    m_profiler;
+		bool        m_bProfilerOverlay = false;
+
+		// Nanoseconds between the last two input scans, or the recorded delta during a replay
+		int64_t     m_nFrameDelta = 0;
+		int64_t     m_nLastInput = -1;
+
+		// Frame scheduling, the next pacing deadline (FramePacer::Now) and on-demand redraw requests
+		LoopConfig  m_loop;
+		FramePacer  m_pacer;
+		int64_t     m_nNextFrame = -1;
+		std::atomic<bool> m_bRedraw{ true };
+
+		// Fixed step: nanoseconds not simulated yet, and their fraction of a step
+		int64_t     m_nAccumulator = 0;
+		float       m_fInterpolation = 1.0f;
+
+		// Session recording, and the log driving the loop during a replay (not owned)
+		std::unique_ptr<FrameRecorder> m_pRecorder;
+		FrameLog*   m_pReplay = nullptr;
+		FrameLog::Frame m_replayFrame;
+		ReplayMode  m_replayMode = ReplayMode::INPUT;
+
+		// Replayed frames whose command stream differs from the recorded one
+		uint64_t    m_nDivergentFrames = 0;
+		int64_t     m_nFirstDivergentFrame = -1;
+
+
+	public:
+		bool        m_isRunning = false;
+
+
+	protected:
+		static void ScanHardware(HWButton* pKeys, bool* pStateOld, bool* pStateNew, uint32_t nKeyCount)
+		{
+			for (uint32_t i = 0; i < nKeyCount; i++)
+			{
+				pKeys[i].bPressed = false;
+				pKeys[i].bReleased = false;
+				if (pStateNew[i] != pStateOld[i])
+				{
+					if (pStateNew[i])
+					{
+						pKeys[i].bPressed = !pKeys[i].bHeld;
+						pKeys[i].bHeld = true;
+					}
+					else
+					{
+						pKeys[i].bReleased = true;
+						pKeys[i].bHeld = false;
+					}
+				}
+				pStateOld[i] = pStateNew[i];
+			}
+		};
+
+
+
+		void SetInputState(uint16_t nCode, bool& bNew, bool bOld, bool bDown) {
+			auto it = std::find(m_deferredReleases.begin(), m_deferredReleases.end(), nCode);
+			if (it != m_deferredReleases.end())
+				m_deferredReleases.erase(it);
+
+			if (!bDown && bNew && !bOld)
+				m_deferredReleases.push_back(nCode);
+			else
+				bNew = bDown;
+		}
+
+
+
+		// Applies the queued events to the raw states and keeps them for GetInputEvents
+		void DrainInput() {
+			m_inputEvents.clear();
+			m_textInput.clear();
+			m_nMouseWheel = 0;
+			m_nOldestInput = -1;
+
+			for (uint16_t nCode : m_deferredReleases) {
+				if (nCode < 256)
+					m_KeyNewState[nCode] = false;
+				else
+					m_MouseNewState[nCode - 256] = false;
+			}
+			m_deferredReleases.clear();
+
+			InputEvent event;
+			while (m_inputQueue.Pop(event)) {
+				// Replays only see the recorded input
+				if (m_pReplay)
+					continue;
+
+				switch (event.type) {
+				case InputEventType::KEY_DOWN:
+					SetInputState(event.nCode, m_KeyNewState[event.nCode], m_KeyOldState[event.nCode], true);
+					break;
+				case InputEventType::KEY_UP:
+					SetInputState(event.nCode, m_KeyNewState[event.nCode], m_KeyOldState[event.nCode], false);
+					break;
+				case InputEventType::MOUSE_DOWN:
+					SetInputState(256 + event.nCode % 3, m_MouseNewState[event.nCode % 3], m_MouseOldState[event.nCode % 3], true);
+					break;
+				case InputEventType::MOUSE_UP:
+					SetInputState(256 + event.nCode % 3, m_MouseNewState[event.nCode % 3], m_MouseOldState[event.nCode % 3], false);
+					break;
+				case InputEventType::MOUSE_MOVE:
+					m_nMouseX = event.x;
+					m_nMouseY = event.y;
+					break;
+				case InputEventType::MOUSE_WHEEL:
+					m_nMouseWheel += event.y;
+					break;
+				case InputEventType::TEXT:
+					m_textInput.push_back(event.nChar);
+					break;
+				}
+
+				if (m_nOldestInput < 0)
+					m_nOldestInput = event.nTime;
+				m_inputEvents.push_back(event);
+			}
+		}
+
+
+
+		// During a replay the raw states come from the log instead of the platform.
+		// A fixed step frame that won't run an update leaves the input queued for
+		// the next one, so no press or release is lost between updates.
+		void ScanInput() {
+			int64_t nNow = m_profiler.Now();
+			if (m_pReplay) {
+				m_nFrameDelta = m_replayFrame.nDelta;
+			}
+			else {
+				m_nFrameDelta = m_nLastInput < 0 ? 0 : nNow - m_nLastInput;
+				if (m_loop.fMaxDelta > 0.0)
+					m_nFrameDelta = std::min(m_nFrameDelta, (int64_t)(m_loop.fMaxDelta * 1e9));
+			}
+			m_nLastInput = nNow;
+
+			bool bUpdates = FixedStep() <= 0 || m_nAccumulator + m_nFrameDelta >= FixedStep();
+			if (bUpdates)
+				DrainInput();
+			else
+				ClearInputEdges();
+
+			if (m_pReplay) {
+				std::memcpy(m_KeyNewState, m_replayFrame.keys, sizeof(m_KeyNewState));
+				std::memcpy(m_MouseNewState, m_replayFrame.buttons, sizeof(m_MouseNewState));
+				m_nMouseX = m_replayFrame.nMouseX;
+				m_nMouseY = m_replayFrame.nMouseY;
+				m_nMouseWheel = m_replayFrame.nMouseWheel;
+			}
+
+			if (m_pRecorder)
+				m_pRecorder->Input(m_KeyNewState, m_MouseNewState, m_nMouseX, m_nMouseY, m_nMouseWheel, m_nFrameDelta);
+
+			if (bUpdates) {
+				ScanHardware(m_KeyboardState, m_KeyOldState, m_KeyNewState, 256);
+				ScanHardware(m_MouseState, m_MouseOldState, m_MouseNewState, 3);
+			}
+		}
+
+
+
+		// Nanoseconds per update with a fixed step, 0 without
+		int64_t FixedStep() const {
+			return (int64_t)(m_loop.fFixedStep * 1e9 + 0.5);
+		}
+
+
+
+		// Input edges, wheel, text and events belong to the first update of a frame only
+		void ClearInputEdges() {
+			for (HWButton& key : m_KeyboardState)
+				key.bPressed = key.bReleased = false;
+			for (HWButton& button : m_MouseState)
+				button.bPressed = button.bReleased = false;
+
+			m_nMouseWheel = 0;
+			m_textInput.clear();
+			m_inputEvents.clear();
+		}
+
+
+
+		// onUpdate once with the frame's delta time, or with a fixed step as many
+		// times as the accumulated time holds
+		void UpdateSteps() {
+			int64_t nStep = FixedStep();
+			if (nStep <= 0) {
+				onUpdate(GetElapsedTime());
+				m_fInterpolation = 1.0f;
+				return;
+			}
+
+			m_nAccumulator += m_nFrameDelta;
+
+			unsigned nSteps = 0;
+			while (m_nAccumulator >= nStep && nSteps < std::max(1u, m_loop.nMaxSteps)) {
+				if (nSteps > 0)
+					ClearInputEdges();
+				onUpdate((float)m_loop.fFixedStep);
+				m_nAccumulator -= nStep;
+				nSteps++;
+			}
+
+			// Too far behind to catch up, drop the backlog instead of spiralling
+			if (m_nAccumulator >= nStep)
+				m_nAccumulator %= nStep;
+
+			m_fInterpolation = (float)((double)m_nAccumulator / (double)nStep);
+		}
+
+
+
+		// Runs onUpdate, or feeds the recorded command stream in a command replay,
+		// and records the deferred commands still pending at the end of the update
+		void RunUpdate() {
+			if (m_pReplay && m_replayMode == ReplayMode::COMMANDS) {
+				m_commandList.Assign(m_replayFrame.pCommands, m_replayFrame.nCommands, m_replayFrame.pVertices, m_replayFrame.nVertices);
+			}
+			else {
+				// Follows the framebuffer size even when the game clears it itself
+				if (m_pDepthBuffer) {
+					if (m_pDepthBuffer->Width() != ScreenWidth() || m_pDepthBuffer->Height() != ScreenHeight())
+						m_pDepthBuffer->Resize(ScreenWidth(), ScreenHeight());
+					if (m_bClearDepth)
+						m_pDepthBuffer->Clear();
+				}
+
+				UpdateSteps();
+				onRender(m_fInterpolation);
+
+				if (m_pReplay && m_pReplay->HasCommands()
+					&& !m_commandList.Equals(m_replayFrame.pCommands, m_replayFrame.nCommands, m_replayFrame.pVertices, m_replayFrame.nVertices)) {
+					if (m_nFirstDivergentFrame < 0)
+						m_nFirstDivergentFrame = (int64_t)m_pReplay->Position() - 1;
+					m_nDivergentFrames++;
+				}
+			}
+
+			if (m_pRecorder)
+				m_pRecorder->EndFrame(&m_commandList);
+		}
+
+
+
+		// Redoes the parts of the framebuffer that changed in a layer, and covers up
+		// anything drawn straight into it during the update. Runs before FlushDeferred,
+		// so deferred drawing and overlays land on top for one frame.
+		void CompositeLayers() {
+			if (!m_layers.Empty())
+				m_layers.Composite(*this, &m_tiledRasterizer.Pool());
+		}
+
+
+
+		// Hands the finished frame to the presenter, or to the present thread,
+		// and starts tracking damage for the next frame
+		void PresentFrame() {
+			if (!m_layers.Empty())
+				m_layers.TrackForeign(*this);
+
+			if (m_pCapture)
+				m_pCapture->Capture(*this);
+
+			if (m_pPresenter) {
+				if (m_nSwapBuffers >= 2) {
+					if (!m_pSwapChain)
+						m_pSwapChain.reset(new SwapChain(m_pPresenter, Format(), m_nSwapBuffers));
+					m_pSwapChain->Submit(*this);
+				}
+				else {
+					m_pPresenter->Present(*this);
+				}
+			}
+
+			ClearDirty();
+		}
+
+
+
+		// Whether the loop has to run a frame now. Always, unless on-demand: then only
+		// for pending input, a RequestRedraw, or changes made to the framebuffer outside a frame.
+		bool FrameDue() {
+			if (!m_loop.bOnDemand)
+				return true;
+
+			return m_bRedraw.exchange(false) || !m_inputQueue.Empty() || !m_deferredReleases.empty() || IsDirty() || m_layers.IsDirty();
+		}
+
+
+
+		// Sleeps until the next frame is due at the target frame rate. A loop that
+		// fell more than a frame behind starts over from now instead of bursting.
+		void PaceFrame() {
+			if (m_loop.fTargetFPS <= 0.0)
+				return;
+
+			int64_t nInterval = (int64_t)(1e9 / m_loop.fTargetFPS);
+			int64_t nNow = FramePacer::Now();
+
+			if (m_nNextFrame < 0 || nNow - m_nNextFrame > nInterval)
+				m_nNextFrame = nNow;
+			m_nNextFrame += nInterval;
+
+			m_pacer.SleepUntil(m_nNextFrame, (int64_t)(m_loop.fSpinSeconds * 1e9));
+		}
+
+
+
+		// Drawn last in the rasterize phase, so it shows up in the frame it describes
+		void DrawProfilerOverlay() {
+			if (m_bProfilerOverlay)
+				m_profiler.DrawOverlay(*this, 4, 4);
+		}
+
+
+
+		// Moves the frame's draw stats and input latency into the profiler and publishes the frame
+		void EndProfiledFrame() {
+			m_profiler.Count(COUNTER_PRIMITIVES, Stats().nPrimitives);
+			m_profiler.Count(COUNTER_PIXELS, Stats().nPixels);
+			if (m_nOldestInput >= 0)
+				m_profiler.Count(COUNTER_INPUT_LATENCY, (uint64_t)(InputQueue::Timestamp() - m_nOldestInput));
+			ResetStats();
+
+			m_profiler.EndFrame();
+		}
+
+
+
+		// Presents all queued frames and joins the present thread
+		void StopPresentThread() {
+			m_pSwapChain.reset();
+		}
+
+
+
+		void UpdateKeyState(uint32_t keycode, bool value) {
+			m_KeyNewState[keycode & 0xFF] = value;
+		}
+
+
+
+	public:
+		virtual ~RendererBase() {}
+
+
+
+		// Draw calls made here are only recorded, and rasterized at the end
+		// of the frame (or on FlushDeferred) by all render threads
+		CommandList& Deferred() {
+			return m_commandList;
+		}
+
+
+
+		// Rasterizes and drops everything recorded through Deferred so far
+		void FlushDeferred() {
+			if (!m_commandList.Empty()) {
+				m_tiledRasterizer.Execute(m_commandList, *this);
+				m_commandList.Reset();
+			}
+		}
+
+
+
+		// Threads used by FlushDeferred including the calling one, 0 uses all hardware threads
+		void SetRenderThreads(unsigned nThreads) {
+			m_tiledRasterizer.SetThreadCount(nThreads);
+		}
+
+
+
+		// Replaces the presenter finished frames are handed to, nullptr disables presenting.
+		// The presenter is not owned and has to outlive the renderer or be replaced.
+		void SetPresenter(Presenter* pPresenter) {
+			StopPresentThread();
+			m_pPresenter = pPresenter;
+		}
+
+
+
+		// 2 or 3 presents on a separate thread with double or triple buffering,
+		// so drawing frame N + 1 overlaps presenting frame N. 0 presents inline.
+		void SetPipelinedPresent(unsigned nBuffers) {
+			StopPresentThread();
+			m_nSwapBuffers = nBuffers;
+		}
+
+
+
+		// Adds a named layer of the framebuffer's size, nullptr if the name is taken.
+		// With layers the framebuffer holds their composite: draw into the layers.
+		// Drawing straight into the renderer in onUpdate or onRender is covered by
+		// the composite, deferred commands show on top for the frame they were made in.
+		Layer* AddLayer(const std::string& sName, int nZOrder = 0) {
+			if (m_layers.Empty())
+				m_layers.Resize(ScreenWidth(), ScreenHeight());
+			return m_layers.Add(sName, nZOrder);
+		}
+
+
+
+		Layer* GetLayer(const std::string& sName) {
+			return m_layers.Find(sName);
+		}
+
+
+
+		bool RemoveLayer(const std::string& sName) {
+			bool bRemoved = m_layers.Remove(sName);
+			if (bRemoved && m_layers.Empty())
+				Invalidate();
+			return bRemoved;
+		}
+
+
+
+		// Z order, background color and statistics
+		LayerStack& Layers() {
+			return m_layers;
+		}
+
+
+
+		// Creates the depth buffer of the framebuffer's size, or changes its format.
+		// With bClearEveryFrame it is cleared to the far plane before every update,
+		// which only resets its tile records.
+		DepthBuffer* EnableDepthBuffer(DepthFormat format = DepthFormat::D32, bool bClearEveryFrame = true) {
+			if (!m_pDepthBuffer)
+				m_pDepthBuffer.reset(new DepthBuffer());
+			m_pDepthBuffer->Resize(ScreenWidth(), ScreenHeight(), format);
+			m_bClearDepth = bClearEveryFrame;
+			return m_pDepthBuffer.get();
+		}
+
+
+
+		void DisableDepthBuffer() {
+			m_pDepthBuffer.reset();
+		}
+
+
+
+		// nullptr until EnableDepthBuffer
+		DepthBuffer* GetDepthBuffer() {
+			return m_pDepthBuffer.get();
+		}
+
+
+
+		// Hands a copy of every finished frame to a capture before it is presented,
+		// nullptr stops capturing. The capture is not owned and is not closed here.
+		void SetFrameCapture(FrameCapture* pCapture) {
+			m_pCapture = pCapture;
+		}
+
+
+
+		// Frame pacing, fixed timestep and on-demand rendering, see LoopConfig
+		void SetLoopConfig(const LoopConfig& config) {
+			m_loop = config;
+			m_nNextFrame = -1;
+			m_nAccumulator = 0;
+			RequestRedraw();
+		}
+
+
+
+		const LoopConfig& GetLoopConfig() const {
+			return m_loop;
+		}
+
+
+
+		// Runs one more frame in on-demand mode, safe from any thread. Call it from
+		// onUpdate to keep animating, and after clearing m_isRunning to stop an idle loop.
+		void RequestRedraw() {
+			m_bRedraw.store(true);
+			m_pacer.Wake();
+		}
+
+
+
+		// Fraction of a fixed step not simulated yet, for interpolating in onRender. 1 without a fixed step.
+		float GetInterpolation() const {
+			return m_fInterpolation;
+		}
+
+
+
+		// Frame timings, percentiles and the Chrome trace export
+		Profiler& GetProfiler() {
+			return m_profiler;
+		}
+
+
+
+		// Frame time graph in the top-left corner of every frame
+		void ShowProfilerOverlay(bool bShow) {
+			m_bProfilerOverlay = bShow;
+		}
+
+
+
+		// Seconds since the previous frame. Updates that step by this instead of
+		// reading a clock replay deterministically.
+		float GetElapsedTime() const {
+			return (float)((double)m_nFrameDelta * 1e-9);
+		}
+
+
+
+		// Records every following frame's input and delta time to a log on a writer thread.
+		// With bCommands the deferred command stream of each frame is stored as well.
+		// Time not simulated yet by a fixed step is dropped, replays start from zero too.
+		bool StartRecording(const char* sPath, bool bCommands = false) {
+			m_nAccumulator = 0;
+			if (!m_pRecorder)
+				m_pRecorder.reset(new FrameRecorder());
+			return m_pRecorder->Open(sPath, ScreenWidth(), ScreenHeight(), Format(), bCommands);
+		}
+
+
+
+		// Flushes and closes the log, false if writing it failed
+		bool StopRecording() {
+			return m_pRecorder ? m_pRecorder->Close() : true;
+		}
+
+
+
+		// Frames of the last replay that recorded different commands than the log,
+		// and the index of the first one (-1 if none)
+		uint64_t ReplayDivergences() const {
+			return m_nDivergentFrames;
+		}
+		int64_t FirstReplayDivergence() const {
+			return m_nFirstDivergentFrame;
+		}
+
+
+
+		THPX::HWButton GetKey(uint32_t keycode) const {
+			return m_KeyboardState[keycode & 0xFF];
+		}
+
+
+
+		THPX::HWButton GetMouse(uint32_t button) const {
+			return m_MouseState[button % 3];
+		}
+
+
+
+		int GetMouseX() const {
+			return m_nMouseX;
+		}
+
+
+
+		int GetMouseY() const {
+			return m_nMouseY;
+		}
+
+
+
+		// Wheel movement this frame in 1/120 notches, positive away from the user
+		int GetMouseWheel() const {
+			return m_nMouseWheel;
+		}
+
+
+
+		// Every event delivered this frame in arrival order, with its timestamp
+		const std::vector<InputEvent>& GetInputEvents() const {
+			return m_inputEvents;
+		}
+
+
+
+		// Code points typed this frame
+		const std::vector<uint32_t>& GetTextInput() const {
+			return m_textInput;
+		}
+
+
+
+		// Where the platform layer pushes events. Headless renderers, tests and
+		// latency benchmarks can push synthetic input from one producer thread.
+		InputQueue& GetInputQueue() {
+			return m_inputQueue;
+		}
+
+
+
+		virtual void onUpdate() {
+
+		}
+
+
+
+		// Called with the seconds to advance, the frame's delta time or the fixed step.
+		// The default calls onUpdate() for applications that read GetElapsedTime instead.
+		virtual void onUpdate(float fElapsedTime) {
+			(void)fElapsedTime;
+			onUpdate();
+		}
+
+
+
+		// Called once per frame after the updates, with GetInterpolation
+		virtual void onRender(float fInterpolation) {
+			(void)fInterpolation;
+		}
+
+
+
+		virtual void onCreate() {
+
+		}
+	};
+
+}
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <atomic>
+
+
+namespace THPX {
+
+	//===== SPSC QUEUE =====//
+
+	// Bounded lock-free queue for exactly one producer and one consumer thread.
+	// Each side only writes its own index; the indices sit on separate cache
+	// lines and each side caches the other's so it rarely has to reload it.
+	template<typename T, size_t CAPACITY>
+	class SPSCQueue {
+
+		static_assert(CAPACITY >= 2 && (CAPACITY & (CAPACITY - 1)) == 0, "capacity has to be a power of two");
+
+	private:
+		static constexpr size_t MASK = CAPACITY - 1;
+
+		T           m_items[CAPACITY];
+
+		// Next slot to write, owned by the producer
+		alignas(64) std::atomic<size_t> m_nHead;
+		size_t      m_nCachedTail = 0;
+
+		// Next slot to read, owned by the consumer
+		alignas(64) std::atomic<size_t> m_nTail;
+		size_t      m_nCachedHead = 0;
+
+
+	public:
+		SPSCQueue() : m_nHead(0), m_nTail(0) {}
+
+		SPSCQueue(const SPSCQueue&) = delete;
+		SPSCQueue& operator=(const SPSCQueue&) = delete;
+
+
+
+		// Producer side, false if the queue is full
+		bool Push(const T& item) {
+			size_t nHead = m_nHead.load(std::memory_order_relaxed);
+			if (nHead - m_nCachedTail == CAPACITY) {
+				m_nCachedTail = m_nTail.load(std::memory_order_acquire);
+				if (nHead - m_nCachedTail == CAPACITY)
+					return false;
+			}
+
+			m_items[nHead & MASK] = item;
+			m_nHead.store(nHead + 1, std::memory_order_release);
+			return true;
+		}
+
+
+
+		// Consumer side, false if the queue is empty
+		bool Pop(T& item) {
+			size_t nTail = m_nTail.load(std::memory_order_relaxed);
+			if (nTail == m_nCachedHead) {
+				m_nCachedHead = m_nHead.load(std::memory_order_acquire);
+				if (nTail == m_nCachedHead)
+					return false;
+			}
+
+			item = m_items[nTail & MASK];
+			m_nTail.store(nTail + 1, std::memory_order_release);
+			return true;
+		}
+
+
+
+		// Approximate from any thread other than the two sides
+		size_t Size() const {
+			return m_nHead.load(std::memory_order_acquire) - m_nTail.load(std::memory_order_acquire);
+		}
+
+
+
+		static constexpr size_t Capacity() {
+			return CAPACITY;
+		}
+	};
+
+}
@@ -0,0 +1,177 @@
+#pragma once
+
+#include <cstdint>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#endif
+
+
+namespace THPX {
+
+	//===== LOOP CONFIG =====//
+
+	// How the renderers schedule frames
+	struct LoopConfig {
+		// Frames per second to pace to, 0 runs as fast as possible
+		double      fTargetFPS = 0.0;
+
+		// Seconds per onUpdate call, 0 calls it once per frame with the frame's delta time.
+		// With a fixed step onUpdate runs 0..nMaxSteps times per frame and onRender once
+		// with the fraction of a step left over, for interpolating between states.
+		double      fFixedStep = 0.0;
+		unsigned    nMaxSteps = 5;
+
+		// Longest delta time handed to the update, longer gaps (stalls, breakpoints,
+		// idle on-demand periods) are clamped so the simulation doesn't jump
+		double      fMaxDelta = 0.25;
+
+		// Only run a frame when input arrives, RequestRedraw is called or the
+		// framebuffer was changed outside the frame. The loop sleeps otherwise.
+		bool        bOnDemand = false;
+
+		// Window messages handled between two frames, 0 handles all pending ones
+		unsigned    nMaxMessages = 0;
+
+		// The last part of every pacing wait is spun instead of slept, OS sleeps overshoot
+		double      fSpinSeconds = 0.001;
+	};
+
+
+
+	//===== FRAME PACER =====//
+
+	// High resolution sleeps for frame pacing and a wake signal for loops that
+	// idle until something happens. Sleeps go to the OS until fSpin seconds are
+	// left, then yield-spin to the deadline.
+	class FramePacer {
+
+	private:
+#ifdef _WIN32
+		HANDLE      m_hTimer = NULL;
+		HANDLE      m_hWake = NULL;
+#else
+		std::mutex  m_mutex;
+		std::condition_variable m_cvWake;
+		bool        m_bWake = false;
+#endif
+
+
+	private:
+		void SleepFor(int64_t nNanoseconds) {
+#ifdef _WIN32
+			if (m_hTimer) {
+				// Relative due time in 100 ns units
+				LARGE_INTEGER due;
+				due.QuadPart = -(nNanoseconds / 100);
+				if (SetWaitableTimer(m_hTimer, &due, 0, NULL, NULL, FALSE)) {
+					WaitForSingleObject(m_hTimer, INFINITE);
+					return;
+				}
+			}
+			Sleep((DWORD)(nNanoseconds / 1000000));
+#else
+			std::this_thread::sleep_for(std::chrono::nanoseconds(nNanoseconds));
+#endif
+		}
+
+
+
+	public:
+		FramePacer() {
+#ifdef _WIN32
+			// High resolution timers exist since Windows 10 1803, older versions get the default one
+			m_hTimer = CreateWaitableTimerExW(NULL, NULL, CREATE_WAITABLE_TIMER_HIGH_RESOLUTION, TIMER_ALL_ACCESS);
+			if (!m_hTimer)
+				m_hTimer = CreateWaitableTimerExW(NULL, NULL, 0, TIMER_ALL_ACCESS);
+			m_hWake = CreateEventW(NULL, FALSE, FALSE, NULL);
+#endif
+		}
+
+		~FramePacer() {
+#ifdef _WIN32
+			if (m_hTimer)
+				CloseHandle(m_hTimer);
+			if (m_hWake)
+				CloseHandle(m_hWake);
+#endif
+		}
+
+		FramePacer(const FramePacer&) = delete;
+		FramePacer& operator=(const FramePacer&) = delete;
+
+
+
+		// Steady clock in nanoseconds, same time base as InputQueue::Timestamp
+		static int64_t Now() {
+			return (int64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+				std::chrono::steady_clock::now().time_since_epoch()).count();
+		}
+
+
+
+		// Returns at nDeadline, never much later: the OS sleep stops nSpin early
+		void SleepUntil(int64_t nDeadline, int64_t nSpin) {
+			for (;;) {
+				int64_t nLeft = nDeadline - Now();
+				if (nLeft <= 0)
+					return;
+
+				if (nLeft > nSpin)
+					SleepFor(nLeft - nSpin);
+				else
+					std::this_thread::yield();
+			}
+		}
+
+
+
+		// Blocks until Wake is called, or nTimeout nanoseconds pass if nTimeout >= 0.
+		// A Wake before the wait makes it return at once.
+		void WaitForWake(int64_t nTimeout = -1) {
+#ifdef _WIN32
+			WaitForSingleObject(m_hWake, nTimeout < 0 ? INFINITE : (DWORD)(nTimeout / 1000000));
+#else
+			std::unique_lock<std::mutex> lock(m_mutex);
+			if (nTimeout < 0)
+				m_cvWake.wait(lock, [&] { return m_bWake; });
+			else
+				m_cvWake.wait_for(lock, std::chrono::nanoseconds(nTimeout), [&] { return m_bWake; });
+			m_bWake = false;
+#endif
+		}
+
+
+
+		// Safe from any thread
+		void Wake() {
+#ifdef _WIN32
+			SetEvent(m_hWake);
+#else
+			{
+				std::lock_guard<std::mutex> lock(m_mutex);
+				m_bWake = true;
+			}
+			m_cvWake.notify_one();
+#endif
+		}
+
+
+
+#ifdef _WIN32
+		// Auto-reset event signalled by Wake, for waits that also watch the message queue
+		HANDLE WakeHandle() const {
+			return m_hWake;
+		}
+#endif
+	};
+
+}
@@ -0,0 +1,291 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+
+#include "THPXTypes.h"
+#include "THPXSpanKernels.h"
+
+
+namespace THPX {
+
+	//===== TEXTURE SAMPLER =====//
+
+	// Nearest texel lookups into one texture, with the addressing worked out once
+	// per triangle. Texel (x, y) covers texture coordinates [x, x + 1) x [y, y + 1).
+	template<typename T>
+	struct TextureSampler {
+		const T*    pData;
+		int         nWidth;
+		int         nHeight;
+		int         nPitch;
+
+		// Coordinates outside the texture repeat it, otherwise they are clamped to the edge
+		bool        bRepeat;
+
+		// Repeating power of two sizes wrap with a mask, the rest with a multiply
+		bool        bMask;
+		int         nMaskX;
+		int         nMaskY;
+		double      fInvWidth;
+		double      fInvHeight;
+
+		// Sizes fit the 16 bit lanes of the vector index math
+		bool        bVector;
+
+
+		TextureSampler(const T* pTexels, int nTexWidth, int nTexHeight, int nTexPitch, bool bRepeatTexture) {
+			pData = pTexels;
+			nWidth = nTexWidth;
+			nHeight = nTexHeight;
+			nPitch = nTexPitch;
+			bRepeat = bRepeatTexture;
+			bMask = (nWidth & (nWidth - 1)) == 0 && (nHeight & (nHeight - 1)) == 0;
+			nMaskX = nWidth - 1;
+			nMaskY = nHeight - 1;
+			fInvWidth = 1.0 / nWidth;
+			fInvHeight = 1.0 / nHeight;
+			bVector = (!bRepeat || bMask) && nWidth <= 32767 && nHeight <= 32767 && nPitch <= 32767;
+		}
+
+
+
+		static int Wrap(int i, int n, double fInv) {
+			i -= n * (int)std::floor(i * fInv);
+			return i < 0 ? i + n : i >= n ? i - n : i;
+		}
+
+
+
+		const T& At(int x, int y) const {
+			if (!bRepeat) {
+				x = std::min(std::max(x, 0), nWidth - 1);
+				y = std::min(std::max(y, 0), nHeight - 1);
+			}
+			else if (bMask) {
+				x &= nMaskX;
+				y &= nMaskY;
+			}
+			else {
+				x = Wrap(x, nWidth, fInvWidth);
+				y = Wrap(y, nHeight, fInvHeight);
+			}
+			return pData[(size_t)y * nPitch + x];
+		}
+	};
+
+
+
+	//===== SHADE KERNELS =====//
+
+	// Texels are picked by flooring float coordinates, a fused multiply-add would
+	// pick a different texel now and then depending on the build. GCC fuses even
+	// separate vector intrinsics, so contraction is off for the kernels.
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC push_options
+#pragma GCC optimize("fp-contract=off")
+#endif
+
+	// Inner loops of the shaded and texture mapped triangles. Attributes step
+	// across 4 pixels per SSE2 vector (8 with AVX2 for colors); texel fetches
+	// stay scalar loads from vector computed indices. Scalar fallback as usual.
+	class ShadeKernels {
+
+	private:
+		// Largest texture coordinate the scalar paths convert to int
+		static constexpr float COORD_LIMIT = 1.0e9f;
+
+
+#if defined(THPX_SPAN_SSE2)
+		// Four pixels' texel indices from their integer texel coordinates, both
+		// addressed in 16 bit lanes and combined as x + y * pitch in one multiply-add
+		template<typename T>
+		static __m128i Index4(__m128i x, __m128i y, const TextureSampler<T>& tex) {
+			if (tex.bRepeat) {
+				x = _mm_and_si128(x, _mm_set1_epi32(tex.nMaskX));
+				y = _mm_and_si128(y, _mm_set1_epi32(tex.nMaskY));
+			}
+
+			__m128i xy = _mm_packs_epi32(x, y);
+			if (!tex.bRepeat) {
+				xy = _mm_max_epi16(xy, _mm_setzero_si128());
+				xy = _mm_min_epi16(xy, _mm_setr_epi16(
+					(int16_t)(tex.nWidth - 1), (int16_t)(tex.nWidth - 1), (int16_t)(tex.nWidth - 1), (int16_t)(tex.nWidth - 1),
+					(int16_t)(tex.nHeight - 1), (int16_t)(tex.nHeight - 1), (int16_t)(tex.nHeight - 1), (int16_t)(tex.nHeight - 1)));
+			}
+
+			xy = _mm_unpacklo_epi16(xy, _mm_srli_si128(xy, 8));
+			return _mm_madd_epi16(xy, _mm_set1_epi32(1 | (tex.nPitch << 16)));
+		}
+
+
+
+		// floor, cvttps rounds towards zero
+		static __m128i Floor4(__m128 f) {
+			__m128i i = _mm_cvttps_epi32(f);
+			return _mm_add_epi32(i, _mm_castps_si128(_mm_cmplt_ps(f, _mm_cvtepi32_ps(i))));
+		}
+
+
+
+		template<typename T>
+		static void Fetch4(T* pDst, __m128i index, const TextureSampler<T>& tex) {
+			alignas(16) int32_t nIndex[4];
+			_mm_store_si128((__m128i*)nIndex, index);
+			pDst[0] = tex.pData[nIndex[0]];
+			pDst[1] = tex.pData[nIndex[1]];
+			pDst[2] = tex.pData[nIndex[2]];
+			pDst[3] = tex.pData[nIndex[3]];
+		}
+
+
+
+		// r, g, b, a 16.16 lanes of four pixels to four byte texels, saturated
+		static __m128i Texels4(__m128i r, __m128i g, __m128i b, __m128i a) {
+			__m128i x = _mm_packus_epi16(
+				_mm_packs_epi32(_mm_srai_epi32(r, 16), _mm_srai_epi32(g, 16)),
+				_mm_packs_epi32(_mm_srai_epi32(b, 16), _mm_srai_epi32(a, 16)));
+
+			// r0..r3 g0..g3 b0..b3 a0..a3 transposed to r0 g0 b0 a0 r1 ..
+			x = _mm_unpacklo_epi8(x, _mm_srli_si128(x, 8));
+			return _mm_unpacklo_epi8(x, _mm_srli_si128(x, 8));
+		}
+#endif
+
+
+	public:
+		// nCount four byte texels with each channel stepping linearly, channels in
+		// Pixel order as 16.16 fixed point with the rounding already added, colors
+		// and steps within +-256. nRed is the byte offset of red in the texel (0 or 2).
+		static void Gouraud(uint8_t* pDst, size_t nCount, const int32_t pColor[4], const int32_t pStep[4], int nRed) {
+			const int order[4] = { nRed, 1, 2 - nRed, 3 };
+			size_t i = 0;
+
+#if defined(THPX_SPAN_AVX2)
+			if (nCount >= 8) {
+				__m256i c[4], step[4];
+				for (int k = 0; k < 4; k++) {
+					int32_t s = pStep[order[k]];
+					c[k] = _mm256_add_epi32(_mm256_set1_epi32(pColor[order[k]]), _mm256_mullo_epi32(_mm256_set1_epi32(s), _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7)));
+					step[k] = _mm256_set1_epi32(s * 8);
+				}
+
+				// Packs work within 128 bit lanes, so each lane ends up with its own four pixels
+				const __m256i transpose = _mm256_setr_epi8(
+					0, 4, 8, 12, 1, 5, 9, 13, 2, 6, 10, 14, 3, 7, 11, 15,
+					0, 4, 8, 12, 1, 5, 9, 13, 2, 6, 10, 14, 3, 7, 11, 15);
+
+				for (; i + 8 <= nCount; i += 8) {
+					__m256i x = _mm256_packus_epi16(
+						_mm256_packs_epi32(_mm256_srai_epi32(c[0], 16), _mm256_srai_epi32(c[1], 16)),
+						_mm256_packs_epi32(_mm256_srai_epi32(c[2], 16), _mm256_srai_epi32(c[3], 16)));
+					_mm256_storeu_si256((__m256i*)(pDst + i * 4), _mm256_shuffle_epi8(x, transpose));
+					for (int k = 0; k < 4; k++)
+						c[k] = _mm256_add_epi32(c[k], step[k]);
+				}
+			}
+#endif
+
+#if defined(THPX_SPAN_SSE2)
+			__m128i c[4], step[4];
+			for (int k = 0; k < 4; k++) {
+				int32_t s = pStep[order[k]];
+				int32_t v = (int32_t)(pColor[order[k]] + (int64_t)s * i);
+				c[k] = _mm_setr_epi32(v, v + s, v + 2 * s, v + 3 * s);
+				step[k] = _mm_set1_epi32(s * 4);
+			}
+
+			for (; i + 4 <= nCount; i += 4) {
+				_mm_storeu_si128((__m128i*)(pDst + i * 4), Texels4(c[0], c[1], c[2], c[3]));
+				for (int k = 0; k < 4; k++)
+					c[k] = _mm_add_epi32(c[k], step[k]);
+			}
+
+			// The last few pixels of a full vector
+			if (i < nCount) {
+				alignas(16) uint8_t tail[16];
+				_mm_store_si128((__m128i*)tail, Texels4(c[0], c[1], c[2], c[3]));
+				memcpy(pDst + i * 4, tail, (nCount - i) * 4);
+			}
+#else
+			for (; i < nCount; i++) {
+				for (int k = 0; k < 4; k++) {
+					int64_t v = (pColor[order[k]] + (int64_t)pStep[order[k]] * i) >> 16;
+					pDst[i * 4 + k] = (uint8_t)std::min<int64_t>(std::max<int64_t>(v, 0), 255);
+				}
+			}
+#endif
+		}
+
+
+
+		// Affine mapped span, texture coordinates u, v in 16.16 fixed point stepping by du, dv.
+		// Coordinates within +-16384 texels and steps within +-4096 never overflow.
+		template<typename T>
+		static void Affine(T* pDst, size_t nCount, const TextureSampler<T>& tex, int32_t u, int32_t v, int32_t du, int32_t dv) {
+			size_t i = 0;
+
+#if defined(THPX_SPAN_SSE2)
+			if (tex.bVector) {
+				__m128i vu = _mm_add_epi32(_mm_set1_epi32(u), _mm_setr_epi32(0, du, 2 * du, 3 * du));
+				__m128i vv = _mm_add_epi32(_mm_set1_epi32(v), _mm_setr_epi32(0, dv, 2 * dv, 3 * dv));
+				__m128i stepU = _mm_set1_epi32(4 * du);
+				__m128i stepV = _mm_set1_epi32(4 * dv);
+
+				for (; i + 4 <= nCount; i += 4) {
+					Fetch4(pDst + i, Index4(_mm_srai_epi32(vu, 16), _mm_srai_epi32(vv, 16), tex), tex);
+					vu = _mm_add_epi32(vu, stepU);
+					vv = _mm_add_epi32(vv, stepV);
+				}
+			}
+#endif
+
+			for (; i < nCount; i++)
+				pDst[i] = tex.At((int)((u + (int64_t)du * i) >> 16), (int)((v + (int64_t)dv * i) >> 16));
+		}
+
+
+
+		// Perspective correct span: s = u / w, t = v / w and q = 1 / w step linearly
+		// by ds, dt, dq, and every pixel divides them back into u and v
+		template<typename T>
+		static void Perspective(T* pDst, size_t nCount, const TextureSampler<T>& tex, float s, float t, float q, float ds, float dt, float dq) {
+			size_t i = 0;
+
+#if defined(THPX_SPAN_SSE2)
+			if (tex.bVector) {
+				const __m128 ramp = _mm_setr_ps(0.0f, 1.0f, 2.0f, 3.0f);
+				const __m128 limit = _mm_set1_ps(COORD_LIMIT);
+				const __m128 vds = _mm_set1_ps(ds), vdt = _mm_set1_ps(dt), vdq = _mm_set1_ps(dq);
+
+				// Positions from the span start each time, so long spans don't drift
+				for (; i + 4 <= nCount; i += 4) {
+					__m128 x = _mm_add_ps(_mm_set1_ps((float)i), ramp);
+					__m128 vq = _mm_add_ps(_mm_set1_ps(q), _mm_mul_ps(x, vdq));
+					__m128 vu = _mm_div_ps(_mm_add_ps(_mm_set1_ps(s), _mm_mul_ps(x, vds)), vq);
+					__m128 vv = _mm_div_ps(_mm_add_ps(_mm_set1_ps(t), _mm_mul_ps(x, vdt)), vq);
+					vu = _mm_min_ps(_mm_max_ps(vu, _mm_sub_ps(_mm_setzero_ps(), limit)), limit);
+					vv = _mm_min_ps(_mm_max_ps(vv, _mm_sub_ps(_mm_setzero_ps(), limit)), limit);
+					Fetch4(pDst + i, Index4(Floor4(vu), Floor4(vv), tex), tex);
+				}
+			}
+#endif
+
+			for (; i < nCount; i++) {
+				float x = (float)i;
+				float fq = q + x * dq;
+				float u = std::min(std::max((s + x * ds) / fq, -COORD_LIMIT), COORD_LIMIT);
+				float v = std::min(std::max((t + x * dt) / fq, -COORD_LIMIT), COORD_LIMIT);
+				pDst[i] = tex.At((int)std::floor(u), (int)std::floor(v));
+			}
+		}
+	};
+
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC pop_options
+#endif
+
+}
@@ -0,0 +1,139 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <type_traits>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define THPX_SPAN_AVX2
+#endif
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define THPX_SPAN_SSE2
+#endif
+
+
+namespace THPX {
+
+	//===== SPAN KERNELS =====//
+
+	// Row span fills and copies for 2, 4 and 16 byte texels. The texel is
+	// broadcast into a vector register once and stored 16 or 32 bytes at a
+	// time; the ISA is picked at compile time, with a scalar loop for the tail
+	// and fallback.
+	class SpanKernels {
+
+	private:
+		template<typename T>
+		static void FillScalar(T* pDst, size_t nCount, T value) {
+			for (size_t i = 0; i < nCount; i++)
+				pDst[i] = value;
+		}
+
+
+
+		// Stores the 32 byte pattern over nBytes / 32 blocks, returns the bytes written
+		static size_t FillPattern(uint8_t* pDst, size_t nBytes, const uint8_t* pPattern) {
+			size_t nDone = 0;
+#if defined(THPX_SPAN_AVX2)
+			__m256i v = _mm256_loadu_si256((const __m256i*)pPattern);
+			for (; nDone + 32 <= nBytes; nDone += 32)
+				_mm256_storeu_si256((__m256i*)(pDst + nDone), v);
+#elif defined(THPX_SPAN_SSE2)
+			__m128i v = _mm_loadu_si128((const __m128i*)pPattern);
+			for (; nDone + 32 <= nBytes; nDone += 32) {
+				_mm_storeu_si128((__m128i*)(pDst + nDone), v);
+				_mm_storeu_si128((__m128i*)(pDst + nDone + 16), v);
+			}
+#else
+			for (; nDone + 32 <= nBytes; nDone += 32)
+				memcpy(pDst + nDone, pPattern, 32);
+#endif
+			return nDone;
+		}
+
+
+
+	public:
+		// Fills nCount consecutive texels starting at pDst
+		template<typename T>
+		static void Fill(T* pDst, size_t nCount, T value) {
+			static_assert(std::is_trivially_copyable<T>::value, "texels must be trivially copyable");
+			static_assert(32 % sizeof(T) == 0, "texel size must divide the 32 byte pattern");
+
+			uint8_t bytes[sizeof(T)];
+			memcpy(bytes, &value, sizeof(T));
+
+			// Every byte the same (black, white, greys) is a plain memset
+			bool bUniform = true;
+			for (size_t i = 1; i < sizeof(T); i++)
+				bUniform &= bytes[i] == bytes[0];
+
+			if (bUniform) {
+				memset((void*)pDst, bytes[0], nCount * sizeof(T));
+				return;
+			}
+
+			uint8_t pattern[32];
+			for (size_t i = 0; i < 32; i += sizeof(T))
+				memcpy(pattern + i, bytes, sizeof(T));
+
+			size_t nDone = FillPattern((uint8_t*)pDst, nCount * sizeof(T), pattern) / sizeof(T);
+			FillScalar(pDst + nDone, nCount - nDone, value);
+		}
+
+
+
+		// Fills the same span of nRows rows, each nPitch texels apart
+		template<typename T>
+		static void FillRows(T* pDst, size_t nCount, size_t nRows, size_t nPitch, T value) {
+			for (size_t row = 0; row < nRows; row++) {
+				Fill(pDst, nCount, value);
+				pDst += nPitch;
+			}
+		}
+
+
+
+		// Copies nCount texels, the runtime memcpy is already vectorized for long rows
+		template<typename T>
+		static void Copy(T* pDst, const T* pSrc, size_t nCount) {
+			memcpy((void*)pDst, (const void*)pSrc, nCount * sizeof(T));
+		}
+
+
+
+		// Copies every texel that is not bitwise equal to key
+		template<typename T>
+		static void CopyKeyed(T* pDst, const T* pSrc, size_t nCount, T key) {
+			static_assert(std::is_trivially_copyable<T>::value, "texels must be trivially copyable");
+
+			size_t i = 0;
+#if defined(THPX_SPAN_SSE2)
+			if (sizeof(T) == 4 || sizeof(T) == 2) {
+				const size_t nPerVector = 16 / sizeof(T);
+
+				uint32_t nKey = 0;
+				memcpy(&nKey, &key, sizeof(T));
+				__m128i vKey = sizeof(T) == 4 ? _mm_set1_epi32((int32_t)nKey) : _mm_set1_epi16((int16_t)nKey);
+
+				// Select source where it differs from the key, destination where it matches
+				for (; i + nPerVector <= nCount; i += nPerVector) {
+					__m128i src = _mm_loadu_si128((const __m128i*)(pSrc + i));
+					__m128i dst = _mm_loadu_si128((const __m128i*)(pDst + i));
+					__m128i eq = sizeof(T) == 4 ? _mm_cmpeq_epi32(src, vKey) : _mm_cmpeq_epi16(src, vKey);
+					_mm_storeu_si128((__m128i*)(pDst + i), _mm_or_si128(_mm_and_si128(eq, dst), _mm_andnot_si128(eq, src)));
+				}
+			}
+#endif
+			for (; i < nCount; i++) {
+				if (memcmp(&pSrc[i], &key, sizeof(T)) != 0)
+					pDst[i] = pSrc[i];
+			}
+		}
+	};
+
+}
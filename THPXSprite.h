@@ -0,0 +1,257 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <vector>
+#include <algorithm>
+#include <utility>
+
+#include "THPXTypes.h"
+#include "THPXPixelFormat.h"
+#include "THPXSpanKernels.h"
+
+
+namespace THPX {
+
+	//===== SPRITE =====//
+
+	// Which source texels a sprite blit writes
+	enum class SpriteMask : uint8_t {
+		NONE,       // all of them
+		COLORKEY,   // all except those equal to the key color
+		ALPHA       // all, blended over the destination by their own alpha
+	};
+
+
+
+	// Sampling of scaled blits
+	enum class SpriteFilter : uint8_t {
+		NEAREST, BILINEAR
+	};
+
+
+
+	// Texture coordinates outside a sprite drawn as a texture
+	enum class TextureWrap : uint8_t {
+		REPEAT,     // tile the sprite
+		CLAMP       // stretch its edge texels outwards
+	};
+
+
+
+	// Image stored in FORMAT texels, so blitting into a framebuffer of the same
+	// format is a row copy. The pixels are either owned (64 byte aligned, rows
+	// padded like a framebuffer) or borrowed from memory the caller keeps alive.
+	template<typename FORMAT>
+	class BasicSprite {
+
+	public:
+		using Format = FORMAT;
+		using Texel = typename FORMAT::Texel;
+
+		static constexpr size_t ROW_ALIGNMENT = 64;
+
+
+	private:
+		std::vector<uint8_t, AlignedAllocator<uint8_t, ROW_ALIGNMENT>> m_storage;
+
+		// Owned storage or borrowed memory
+		Texel*      m_pData = nullptr;
+
+		int         m_nWidth = 0;
+		int         m_nHeight = 0;
+
+		// Row pitch in texels
+		int         m_nPitch = 0;
+
+		SpriteMask  m_mask = SpriteMask::NONE;
+		Texel       m_key = Texel();
+
+
+	public:
+		BasicSprite() {}
+
+		BasicSprite(int nWidth, int nHeight, Pixel p = THPX::BLACK) {
+			Resize(nWidth, nHeight, p);
+		}
+
+		// Converts tightly packed pixels once, drawing never converts again
+		BasicSprite(const Pixel* pPixels, int nWidth, int nHeight) {
+			Resize(nWidth, nHeight);
+			for (int y = 0; y < m_nHeight; y++) {
+				for (int x = 0; x < m_nWidth; x++)
+					Row(y)[x] = FORMAT::Encode(pPixels[(size_t)y * nWidth + x]);
+			}
+		}
+
+		// Borrows nHeight rows of nPitch texels, nothing is copied
+		BasicSprite(Texel* pData, int nWidth, int nHeight, int nPitch) {
+			m_pData = pData;
+			m_nWidth = std::max(nWidth, 0);
+			m_nHeight = std::max(nHeight, 0);
+			m_nPitch = nPitch;
+		}
+
+
+
+		// Owned pixels can be large, copies have to be explicit
+		BasicSprite(const BasicSprite&) = delete;
+		BasicSprite& operator=(const BasicSprite&) = delete;
+
+		BasicSprite(BasicSprite&& other) {
+			*this = std::move(other);
+		}
+
+		BasicSprite& operator=(BasicSprite&& other) {
+			if (this != &other) {
+				bool bOwned = other.IsOwned();
+				m_storage = std::move(other.m_storage);
+				m_pData = bOwned ? (Texel*)m_storage.data() : other.m_pData;
+				m_nWidth = other.m_nWidth;
+				m_nHeight = other.m_nHeight;
+				m_nPitch = other.m_nPitch;
+				m_mask = other.m_mask;
+				m_key = other.m_key;
+
+				other.m_storage.clear();
+				other.m_pData = nullptr;
+				other.m_nWidth = other.m_nHeight = other.m_nPitch = 0;
+			}
+			return *this;
+		}
+
+
+
+		// Owned deep copy, also of a borrowed sprite
+		BasicSprite Clone() const {
+			BasicSprite copy;
+			copy.Resize(m_nWidth, m_nHeight);
+			for (int y = 0; y < m_nHeight; y++)
+				SpanKernels::Copy(copy.Row(y), Row(y), (size_t)m_nWidth);
+			copy.m_mask = m_mask;
+			copy.m_key = m_key;
+			return copy;
+		}
+
+
+
+		// Switches to owned storage of the given size
+		void Resize(int nWidth, int nHeight, Pixel p = THPX::BLACK) {
+			m_nWidth = std::max(nWidth, 0);
+			m_nHeight = std::max(nHeight, 0);
+
+			size_t nRowBytes = (m_nWidth * sizeof(Texel) + ROW_ALIGNMENT - 1) / ROW_ALIGNMENT * ROW_ALIGNMENT;
+			m_nPitch = (int)(nRowBytes / sizeof(Texel));
+			m_storage.resize(nRowBytes * m_nHeight);
+			m_pData = (Texel*)m_storage.data();
+
+			SpanKernels::Fill(m_pData, (size_t)m_nPitch * m_nHeight, FORMAT::Encode(p));
+		}
+
+
+
+		// Texels equal to the key color are skipped when drawn
+		void SetColorKey(Pixel key) {
+			m_mask = SpriteMask::COLORKEY;
+			m_key = FORMAT::Encode(key);
+		}
+
+
+
+		// Texels are blended over the destination by their alpha when drawn
+		void SetAlphaMask() {
+			m_mask = SpriteMask::ALPHA;
+		}
+
+
+
+		void ClearMask() {
+			m_mask = SpriteMask::NONE;
+		}
+
+
+
+		SpriteMask Mask() const {
+			return m_mask;
+		}
+
+
+
+		Texel Key() const {
+			return m_key;
+		}
+
+
+
+		Pixel GetPixel(int x, int y) const {
+			if (x >= 0 && x < m_nWidth && y >= 0 && y < m_nHeight) {
+				return FORMAT::Decode(Row(y)[x]);
+			}
+			return THPX::BLACK;
+		}
+
+
+
+		void SetPixel(int x, int y, Pixel p) {
+			if (x >= 0 && x < m_nWidth && y >= 0 && y < m_nHeight) {
+				Row(y)[x] = FORMAT::Encode(p);
+			}
+		}
+
+
+
+		Texel* Data() {
+			return m_pData;
+		}
+		const Texel* Data() const {
+			return m_pData;
+		}
+
+
+
+		Texel* Row(int y) {
+			return m_pData + (size_t)y * m_nPitch;
+		}
+		const Texel* Row(int y) const {
+			return m_pData + (size_t)y * m_nPitch;
+		}
+
+
+
+		bool IsOwned() const {
+			return m_pData != nullptr && m_pData == (const Texel*)m_storage.data();
+		}
+
+
+
+		// Bytes the pixels take up, what an image cache charges for it
+		size_t SizeBytes() const {
+			return (size_t)m_nPitch * m_nHeight * sizeof(Texel);
+		}
+
+
+
+		int Width() const {
+			return m_nWidth;
+		}
+
+
+
+		int Height() const {
+			return m_nHeight;
+		}
+
+
+
+		// Row pitch in texels
+		int Pitch() const {
+			return m_nPitch;
+		}
+	};
+
+
+
+	using Sprite = BasicSprite<THPX_PIXEL_FORMAT>;
+
+}
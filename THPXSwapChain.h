@@ -0,0 +1,160 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#include "THPXFramebuffer.h"
+#include "THPXPresenter.h"
+
+
+namespace THPX {
+
+	//===== SWAP CHAIN =====//
+
+	// Rotates frame buffers between the thread that draws (the producer) and a
+	// present thread, so frame N is presented while frame N + 1 is drawn.
+	// With nBuffers buffers the producer runs at most nBuffers - 1 frames ahead.
+	class SwapChain {
+
+	private:
+		Presenter*  m_pPresenter;
+
+		// Buffers not currently held by the producer
+		std::vector<std::unique_ptr<FramebufferBase>> m_slots;
+		std::deque<size_t> m_freeSlots;
+		std::deque<size_t> m_readySlots;
+
+		// Copy the submitted frame back into the new back buffer
+		bool        m_bPreserve;
+
+		std::thread m_thread;
+		std::mutex  m_mutex;
+		std::condition_variable m_cvReady;
+		std::condition_variable m_cvFree;
+		bool        m_bQuit = false;
+
+		uint64_t    m_nPresented = 0;
+
+
+	private:
+		void PresentMain() {
+			m_pPresenter->Attach();
+
+			for (;;) {
+				size_t nSlot;
+				{
+					std::unique_lock<std::mutex> lock(m_mutex);
+					m_cvReady.wait(lock, [&] { return m_bQuit || !m_readySlots.empty(); });
+					if (m_readySlots.empty())
+						break;
+					nSlot = m_readySlots.front();
+					m_readySlots.pop_front();
+				}
+
+				m_pPresenter->Present(*m_slots[nSlot]);
+
+				{
+					std::lock_guard<std::mutex> lock(m_mutex);
+					m_freeSlots.push_back(nSlot);
+					m_nPresented++;
+				}
+				m_cvFree.notify_all();
+			}
+
+			m_pPresenter->Detach();
+		}
+
+
+
+	public:
+		// nBuffers counts the producer's own buffer, so 2 is double and 3 triple buffering.
+		// Only frames of the given format can be submitted.
+		SwapChain(Presenter* pPresenter, PixelFormat format, unsigned nBuffers = 2, bool bPreserve = true) {
+			m_pPresenter = pPresenter;
+			m_bPreserve = bPreserve;
+
+			if (nBuffers < 2)
+				nBuffers = 2;
+
+			for (unsigned i = 0; i + 1 < nBuffers; i++) {
+				m_slots.emplace_back(new FramebufferBase(format));
+				m_freeSlots.push_back(i);
+			}
+
+			// The presenter now belongs to the present thread
+			m_pPresenter->Detach();
+			m_thread = std::thread(&SwapChain::PresentMain, this);
+		}
+
+
+
+		// Presents everything still queued, then hands the presenter back to the calling thread
+		~SwapChain() {
+			{
+				std::lock_guard<std::mutex> lock(m_mutex);
+				m_bQuit = true;
+			}
+			m_cvReady.notify_all();
+			m_thread.join();
+
+			m_pPresenter->Attach();
+		}
+
+
+
+		SwapChain(const SwapChain&) = delete;
+		SwapChain& operator=(const SwapChain&) = delete;
+
+
+
+		// Queues the finished frame for presenting and swaps a free buffer into it.
+		// Blocks while the present thread is a full chain behind.
+		void Submit(FramebufferBase& frame) {
+			size_t nSlot;
+			{
+				std::unique_lock<std::mutex> lock(m_mutex);
+				m_cvFree.wait(lock, [&] { return !m_freeSlots.empty(); });
+				nSlot = m_freeSlots.front();
+				m_freeSlots.pop_front();
+			}
+
+			FramebufferBase& slot = *m_slots[nSlot];
+			slot.Swap(frame);
+
+			if (frame.ScreenWidth() != slot.ScreenWidth() || frame.ScreenHeight() != slot.ScreenHeight())
+				frame.Allocate(slot.ScreenWidth(), slot.ScreenHeight());
+
+			// Same size means same pitch, so the padded storage copies as one block
+			if (m_bPreserve && slot.SizeBytes() > 0)
+				memcpy(frame.RawData(), slot.RawData(), slot.SizeBytes());
+
+			{
+				std::lock_guard<std::mutex> lock(m_mutex);
+				m_readySlots.push_back(nSlot);
+			}
+			m_cvReady.notify_one();
+		}
+
+
+
+		// Waits until every submitted frame has been presented
+		void Flush() {
+			std::unique_lock<std::mutex> lock(m_mutex);
+			m_cvFree.wait(lock, [&] { return m_readySlots.empty() && m_freeSlots.size() == m_slots.size(); });
+		}
+
+
+
+		uint64_t PresentedCount() {
+			std::lock_guard<std::mutex> lock(m_mutex);
+			return m_nPresented;
+		}
+	};
+
+}
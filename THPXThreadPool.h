@@ -0,0 +1,190 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <memory>
+#include <type_traits>
+#include <algorithm>
+
+
+namespace THPX {
+
+	//===== THREAD POOL =====//
+
+	// Fork-join pool with work stealing. Every participant (the calling thread
+	// plus nThreads - 1 workers) gets a contiguous range of task indices, takes
+	// from the front of its own range and steals from the back of the others.
+	class ThreadPool {
+
+	private:
+		struct TaskRange {
+			std::mutex  mutex;
+			size_t      nBegin = 0;
+			size_t      nEnd = 0;
+		};
+
+		std::vector<std::thread> m_threads;
+		std::vector<std::unique_ptr<TaskRange>> m_ranges;
+
+		// Current job, type erased without allocating
+		void        (*m_pfnJob)(void*, size_t) = nullptr;
+		void*       m_pJobContext = nullptr;
+
+		std::mutex  m_mutex;
+		std::condition_variable m_cvWork;
+		std::condition_variable m_cvDone;
+		uint64_t    m_nGeneration = 0;
+		bool        m_bQuit = false;
+
+		std::atomic<size_t> m_nRemaining{ 0 };
+
+
+	private:
+		bool PopOwn(size_t nParticipant, size_t& nTask) {
+			TaskRange& range = *m_ranges[nParticipant];
+			std::lock_guard<std::mutex> lock(range.mutex);
+			if (range.nBegin == range.nEnd)
+				return false;
+			nTask = range.nBegin++;
+			return true;
+		}
+
+
+
+		bool Steal(size_t nParticipant, size_t& nTask) {
+			size_t nCount = m_ranges.size();
+			for (size_t i = 1; i < nCount; i++) {
+				TaskRange& range = *m_ranges[(nParticipant + i) % nCount];
+				std::lock_guard<std::mutex> lock(range.mutex);
+				if (range.nBegin != range.nEnd) {
+					nTask = --range.nEnd;
+					return true;
+				}
+			}
+			return false;
+		}
+
+
+
+		void Work(size_t nParticipant) {
+			size_t nTask;
+			while (PopOwn(nParticipant, nTask) || Steal(nParticipant, nTask)) {
+				m_pfnJob(m_pJobContext, nTask);
+
+				if (m_nRemaining.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+					std::lock_guard<std::mutex> lock(m_mutex);
+					m_cvDone.notify_all();
+				}
+			}
+		}
+
+
+
+		void WorkerMain(size_t nParticipant) {
+			uint64_t nSeen = 0;
+
+			for (;;) {
+				{
+					std::unique_lock<std::mutex> lock(m_mutex);
+					m_cvWork.wait(lock, [&] { return m_bQuit || m_nGeneration != nSeen; });
+					if (m_bQuit)
+						return;
+					nSeen = m_nGeneration;
+				}
+
+				Work(nParticipant);
+			}
+		}
+
+
+
+		void Run(size_t nTasks, void (*pfnJob)(void*, size_t), void* pContext) {
+			if (nTasks == 0)
+				return;
+
+			// Nothing to share the work with
+			if (m_threads.empty() || nTasks == 1) {
+				for (size_t i = 0; i < nTasks; i++)
+					pfnJob(pContext, i);
+				return;
+			}
+
+			m_pfnJob = pfnJob;
+			m_pJobContext = pContext;
+			m_nRemaining.store(nTasks, std::memory_order_relaxed);
+
+			// Contiguous slices keep neighbouring tasks on the same thread
+			size_t nCount = m_ranges.size();
+			for (size_t i = 0; i < nCount; i++) {
+				std::lock_guard<std::mutex> lock(m_ranges[i]->mutex);
+				m_ranges[i]->nBegin = nTasks * i / nCount;
+				m_ranges[i]->nEnd = nTasks * (i + 1) / nCount;
+			}
+
+			{
+				std::lock_guard<std::mutex> lock(m_mutex);
+				m_nGeneration++;
+			}
+			m_cvWork.notify_all();
+
+			Work(0);
+
+			std::unique_lock<std::mutex> lock(m_mutex);
+			m_cvDone.wait(lock, [&] { return m_nRemaining.load(std::memory_order_acquire) == 0; });
+		}
+
+
+
+	public:
+		// nThreads counts the calling thread, 0 picks the hardware thread count
+		explicit ThreadPool(unsigned nThreads = 0) {
+			if (nThreads == 0)
+				nThreads = std::max(1u, std::thread::hardware_concurrency());
+
+			for (unsigned i = 0; i < nThreads; i++)
+				m_ranges.emplace_back(new TaskRange());
+
+			for (unsigned i = 1; i < nThreads; i++)
+				m_threads.emplace_back(&ThreadPool::WorkerMain, this, (size_t)i);
+		}
+
+
+
+		~ThreadPool() {
+			{
+				std::lock_guard<std::mutex> lock(m_mutex);
+				m_bQuit = true;
+			}
+			m_cvWork.notify_all();
+
+			for (std::thread& t : m_threads)
+				t.join();
+		}
+
+
+
+		ThreadPool(const ThreadPool&) = delete;
+		ThreadPool& operator=(const ThreadPool&) = delete;
+
+
+
+		unsigned ThreadCount() const {
+			return (unsigned)m_ranges.size();
+		}
+
+
+
+		// Calls fn(i) for every i in [0, nTasks) and returns once all calls are done
+		template<typename F>
+		void ParallelFor(size_t nTasks, F&& fn) {
+			using Fn = typename std::remove_reference<F>::type;
+			Run(nTasks, [](void* pContext, size_t i) { (*(Fn*)pContext)(i); }, (void*)&fn);
+		}
+	};
+
+}
@@ -0,0 +1,250 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <memory>
+#include <algorithm>
+
+#include "THPXFramebuffer.h"
+#include "THPXCommandList.h"
+#include "THPXThreadPool.h"
+
+
+namespace THPX {
+
+	//===== TILED RASTERIZER =====//
+
+	// Runs a command list on a framebuffer in parallel. Commands are binned into
+	// BIN_SIZE square screen bins and every bin is rasterized by exactly one
+	// worker, in submission order and clipped to the bin, so no pixel is shared
+	// between threads and the result matches running the commands serially.
+	class TiledRasterizer {
+
+	public:
+		static constexpr int BIN_SIZE = 64;
+
+		static_assert(BIN_SIZE % FramebufferBase::TILE_SIZE == 0, "bins must hold whole raster tiles");
+		static_assert(BIN_SIZE % FramebufferBase::DIRTY_TILE_SIZE == 0, "bins must hold whole dirty tiles, workers write their flags unsynchronized");
+
+
+	private:
+		std::unique_ptr<ThreadPool> m_pPool;
+		unsigned    m_nThreads = 0;
+
+		// Command indices per bin, kept between frames to avoid allocations
+		std::vector<std::vector<uint32_t>> m_bins;
+		std::vector<uint32_t> m_activeBins;
+
+		// Pixels painted per active bin, summed into the draw stats after the workers are done
+		std::vector<uint64_t> m_binPixels;
+
+		int         m_nBinsX = 0;
+		int         m_nBinsY = 0;
+
+
+	private:
+		// Screen area a command can touch, false if it touches the whole screen
+		static bool CommandBounds(const CommandList& list, const Command& cmd, Rect& bounds) {
+			const Vec2D* pVerts = list.Vertices();
+
+			switch (cmd.nType) {
+			case Command::CLEAR:
+				return false;
+
+			case Command::PIXEL:
+				bounds = Rect(cmd.a[0], cmd.a[1], cmd.a[0], cmd.a[1]);
+				break;
+
+			case Command::LINE:
+			case Command::RECT:
+				bounds = Rect(std::min(cmd.a[0], cmd.a[2]), std::min(cmd.a[1], cmd.a[3]), std::max(cmd.a[0], cmd.a[2]), std::max(cmd.a[1], cmd.a[3]));
+				break;
+
+			case Command::TRIANGLE:
+			case Command::QUAD: {
+				int nVerts = cmd.nType == Command::TRIANGLE ? 3 : 4;
+				const Vec2D* v = pVerts + cmd.a[0];
+				bounds = Rect(v[0].x, v[0].y, v[0].x, v[0].y);
+				for (int i = 1; i < nVerts; i++) {
+					bounds.x0 = std::min(bounds.x0, v[i].x);
+					bounds.y0 = std::min(bounds.y0, v[i].y);
+					bounds.x1 = std::max(bounds.x1, v[i].x);
+					bounds.y1 = std::max(bounds.y1, v[i].y);
+				}
+				break;
+			}
+
+			default:
+				// Unknown command, an empty area bins it nowhere
+				bounds = Rect(0, 0, -1, -1);
+				break;
+			}
+
+			return true;
+		}
+
+
+
+		void Bin(const CommandList& list, const FramebufferBase& fb) {
+			m_nBinsX = (fb.ScreenWidth() + BIN_SIZE - 1) / BIN_SIZE;
+			m_nBinsY = (fb.ScreenHeight() + BIN_SIZE - 1) / BIN_SIZE;
+
+			size_t nBinCount = (size_t)m_nBinsX * m_nBinsY;
+
+			if (m_bins.size() < nBinCount)
+				m_bins.resize(nBinCount);
+
+			for (size_t i = 0; i < nBinCount; i++)
+				m_bins[i].clear();
+
+			const Command* pCommands = list.Commands();
+			Rect screen = fb.Bounds();
+
+			for (uint32_t i = 0; i < (uint32_t)list.Size(); i++) {
+				Rect bounds(0, 0, -1, -1);
+
+				if (!CommandBounds(list, pCommands[i], bounds)) {
+					// A full screen clear hides everything recorded before it
+					for (size_t nBin = 0; nBin < nBinCount; nBin++) {
+						m_bins[nBin].clear();
+						m_bins[nBin].push_back(i);
+					}
+					continue;
+				}
+
+				int x0 = std::max(bounds.x0, screen.x0);
+				int y0 = std::max(bounds.y0, screen.y0);
+				int x1 = std::min(bounds.x1, screen.x1);
+				int y1 = std::min(bounds.y1, screen.y1);
+
+				if (x0 > x1 || y0 > y1)
+					continue;
+
+				for (int by = y0 / BIN_SIZE; by <= y1 / BIN_SIZE; by++) {
+					for (int bx = x0 / BIN_SIZE; bx <= x1 / BIN_SIZE; bx++) {
+						m_bins[(size_t)by * m_nBinsX + bx].push_back(i);
+					}
+				}
+			}
+
+			m_activeBins.clear();
+			for (uint32_t i = 0; i < (uint32_t)nBinCount; i++) {
+				if (!m_bins[i].empty())
+					m_activeBins.push_back(i);
+			}
+		}
+
+
+
+		// Returns the number of pixels painted
+		template<typename FORMAT>
+		uint64_t RasterBin(const CommandList& list, BasicFramebuffer<FORMAT>& fb, uint32_t nBin) {
+			int bx = nBin % m_nBinsX;
+			int by = nBin / m_nBinsX;
+
+			Rect clip(bx * BIN_SIZE, by * BIN_SIZE,
+				std::min((bx + 1) * BIN_SIZE, fb.ScreenWidth()) - 1,
+				std::min((by + 1) * BIN_SIZE, fb.ScreenHeight()) - 1);
+
+			const Command* pCommands = list.Commands();
+			const Vec2D* pVerts = list.Vertices();
+			uint64_t nPixels = 0;
+
+			for (uint32_t nIndex : m_bins[nBin]) {
+				const Command& cmd = pCommands[nIndex];
+				typename BasicFramebuffer<FORMAT>::Brush brush = fb.MakeBrush(cmd.p, cmd.nType == Command::CLEAR ? BlendMode::NONE : cmd.blend);
+
+				switch (cmd.nType) {
+				case Command::CLEAR:
+					fb.FillRect(clip.x0, clip.y0, clip.x1, clip.y1, brush, clip);
+					break;
+
+				case Command::PIXEL:
+					fb.RasterPixel(cmd.a[0], cmd.a[1], brush, clip);
+					break;
+
+				case Command::LINE:
+					fb.RasterLine(cmd.a[0], cmd.a[1], cmd.a[2], cmd.a[3], brush, clip);
+					break;
+
+				case Command::RECT:
+					fb.FillRect(cmd.a[0], cmd.a[1], cmd.a[2], cmd.a[3], brush, clip);
+					break;
+
+				case Command::TRIANGLE: {
+					const Vec2D* v = pVerts + cmd.a[0];
+					fb.RasterTriangle(v[0], v[1], v[2], brush, clip);
+					break;
+				}
+
+				case Command::QUAD: {
+					const Vec2D* v = pVerts + cmd.a[0];
+					fb.RasterQuad(v[0], v[1], v[2], v[3], brush, clip);
+					break;
+				}
+				}
+
+				nPixels += brush.nPixels;
+			}
+
+			return nPixels;
+		}
+
+
+
+	public:
+		// nThreads counts the calling thread, 0 picks the hardware thread count
+		explicit TiledRasterizer(unsigned nThreads = 0) {
+			m_nThreads = nThreads;
+		}
+
+
+
+		// Takes effect on the next Execute
+		void SetThreadCount(unsigned nThreads) {
+			if (nThreads != m_nThreads) {
+				m_nThreads = nThreads;
+				m_pPool.reset();
+			}
+		}
+
+
+
+		unsigned ThreadCount() const {
+			return m_pPool ? m_pPool->ThreadCount() : m_nThreads;
+		}
+
+
+
+		// Created on first use, other parallel passes of the frame share it
+		ThreadPool& Pool() {
+			if (!m_pPool)
+				m_pPool.reset(new ThreadPool(m_nThreads));
+			return *m_pPool;
+		}
+
+
+
+		template<typename FORMAT>
+		void Execute(const CommandList& list, BasicFramebuffer<FORMAT>& fb) {
+			if (list.Empty() || fb.ScreenWidth() <= 0 || fb.ScreenHeight() <= 0)
+				return;
+
+			ThreadPool& pool = Pool();
+
+			Bin(list, fb);
+
+			if (m_binPixels.size() < m_activeBins.size())
+				m_binPixels.resize(m_activeBins.size());
+
+			pool.ParallelFor(m_activeBins.size(), [&](size_t i) {
+				m_binPixels[i] = RasterBin(list, fb, m_activeBins[i]);
+			});
+
+			fb.m_stats.nPrimitives += list.Size();
+			for (size_t i = 0; i < m_activeBins.size(); i++)
+				fb.m_stats.nPixels += m_binPixels[i];
+		}
+	};
+
+}
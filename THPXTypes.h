@@ -0,0 +1,159 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <new>
+#include <algorithm>
+
+
+namespace THPX {
+
+	struct Pixel {
+		uint8_t r, g, b, a;
+
+		Pixel() {};
+
+		Pixel(uint8_t red, uint8_t green, uint8_t blue, uint8_t alpha = 255) {
+			r = red;
+			g = green;
+			b = blue;
+			a = alpha;
+		}
+	};
+
+
+	struct Vec2D {
+		int x, y;
+
+		Vec2D() {};
+
+		Vec2D(int posX, int posY) {
+			x = posX;
+			y = posY;
+		};
+
+		Vec2D operator+(const Vec2D &v) const
+		{
+			return Vec2D(x + v.x, y + v.y);
+		}
+	};
+
+	struct Line {
+		Vec2D p0, p1;
+		Pixel p;
+
+		Line() {};
+
+		Line(Vec2D start, Vec2D end, Pixel color) {
+			p0 = start;
+			p1 = end;
+			p = color;
+		}
+	};
+
+	// Inclusive pixel rectangle
+	struct Rect {
+		int x0, y0, x1, y1;
+
+		Rect() {};
+
+		Rect(int left, int top, int right, int bottom) {
+			x0 = left;
+			y0 = top;
+			x1 = right;
+			y1 = bottom;
+		}
+	};
+
+	// Corner of a texture mapped triangle: screen position, texture coordinates in
+	// texels, the view depth w (clip space w, above 0), equal for flat mapping, and
+	// the z in [0, 1] tested against a depth buffer
+	struct TexVertex {
+		Vec2D pos;
+		float u, v, w, z;
+
+		TexVertex() {}
+
+		TexVertex(Vec2D position, float texU, float texV, float fW = 1.0f, float fZ = 0.0f) {
+			pos = position;
+			u = texU;
+			v = texV;
+			w = fW;
+			z = fZ;
+		}
+	};
+
+	// Convex hull of the four corners of a quad given in any order, in winding order.
+	// Returns the number of hull points, below 3 if the corners are collinear.
+	inline int QuadHull(const Vec2D* pCorners, Vec2D* pHull) {
+		Vec2D v[4] = { pCorners[0], pCorners[1], pCorners[2], pCorners[3] };
+		std::sort(v, v + 4, [](const Vec2D& a, const Vec2D& b) { return a.x < b.x || (a.x == b.x && a.y < b.y); });
+
+		auto cross = [](Vec2D o, Vec2D a, Vec2D b) {
+			return ((int64_t)a.x - o.x) * ((int64_t)b.y - o.y) - ((int64_t)a.y - o.y) * ((int64_t)b.x - o.x);
+		};
+
+		// Monotone chain, collinear points dropped
+		Vec2D chain[8];
+		int n = 0;
+		for (int i = 0; i < 4; i++) {
+			while (n >= 2 && cross(chain[n - 2], chain[n - 1], v[i]) <= 0)
+				n--;
+			chain[n++] = v[i];
+		}
+		for (int i = 2, nLower = n + 1; i >= 0; i--) {
+			while (n >= nLower && cross(chain[n - 2], chain[n - 1], v[i]) <= 0)
+				n--;
+			chain[n++] = v[i];
+		}
+
+		// The last point repeats the first
+		n = std::max(n - 1, 1);
+		std::copy(chain, chain + n, pHull);
+		return n;
+	}
+
+	static const Pixel
+		WHITE(255, 255, 255), BLACK(0, 0, 0),
+		RED(255, 0, 0), GREEN(0, 255, 0),
+		BLUE(0, 0, 255), BLANK(0, 0, 0, 0);
+
+
+
+	//===== ALIGNED ALLOCATOR =====//
+
+	// Allocator for std::vector that hands out ALIGNMENT byte aligned blocks
+	template<typename T, size_t ALIGNMENT>
+	struct AlignedAllocator {
+		using value_type = T;
+
+		template<typename U>
+		struct rebind {
+			using other = AlignedAllocator<U, ALIGNMENT>;
+		};
+
+		AlignedAllocator() {}
+
+		template<typename U>
+		AlignedAllocator(const AlignedAllocator<U, ALIGNMENT>&) {}
+
+		T* allocate(size_t n) {
+			return (T*)::operator new(n * sizeof(T), std::align_val_t(ALIGNMENT));
+		}
+
+		void deallocate(T* p, size_t) {
+			::operator delete((void*)p, std::align_val_t(ALIGNMENT));
+		}
+
+		template<typename U>
+		bool operator==(const AlignedAllocator<U, ALIGNMENT>&) const {
+			return true;
+		}
+
+		template<typename U>
+		bool operator!=(const AlignedAllocator<U, ALIGNMENT>&) const {
+			return false;
+		}
+	};
+
+}